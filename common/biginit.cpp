@@ -20,7 +20,7 @@ int bnstep = 0, bnlength = 0, intlength = 0, rlength = 0, padding = 0, shiftfact
 int bflength = 0, rbflength = 0, bfdecimals = 0;
 
 // used internally by bignum.c routines
-static char s_storage[4096];
+static char s_storage[0x10000];          // the allocator below assumes a 64K segment
 static bn_t bnroot = BIG_NULL;
 static bn_t stack_ptr = BIG_NULL; // memory allocator base after global variables
 bn_t bntmp1 = BIG_NULL, bntmp2 = BIG_NULL, bntmp3 = BIG_NULL, bntmp4 = BIG_NULL, bntmp5 = BIG_NULL, bntmp6 = BIG_NULL; // rlength
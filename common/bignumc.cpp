@@ -6,6 +6,10 @@ Wesley Loewer's Big Numbers.        (C) 1994-95, Wesley B. Loewer
 #include <float.h>
 #include <memory.h>
 
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
 #include "port.h"
 #include "big.h"
 
@@ -24,7 +28,8 @@ Wesley Loewer's Big Numbers.        (C) 1994-95, Wesley B. Loewer
 
  The 16/32 bit compination of integer sizes could be increased to
  32/64 bit to improve efficiency, but since many compilers don't offer
- 64 bit integers, this option was not included.
+ 64 bit integers, this option was not included.  The multiplication
+ routines are the exception; see the note above them.
 
 *********************************************************************/
 
@@ -321,6 +326,266 @@ bn_t half_a_bn(bn_t r)
     return r;
 }
 
+/************************************************************************/
+// Multiplication works on whole machine words ("limbs") rather than 16
+// bit pieces: 64 bit limbs with 128 bit products where the compiler
+// provides them, otherwise 32 bit limbs with 64 bit products.  Numbers
+// are copied into limb arrays, multiplied there and copied back out, so
+// the byte layout of bn_t does not change.
+//
+// Full products of numbers at least karatsuba_length bytes long use
+// Karatsuba's method.  Shorter truncated products skip exactly the
+// partial products the 16 bit loops used to skip, so they give the same
+// bits as before; longer ones are cut from the exact product, which only
+// differs from that in the padding bytes.
+
+#if defined(__SIZEOF_INT128__)
+typedef std::uint64_t bn_limb;
+typedef unsigned __int128 bn_dlimb;
+#else
+typedef std::uint32_t bn_limb;
+typedef std::uint64_t bn_dlimb;
+#endif
+static int const LIMB_BYTES = sizeof(bn_limb);
+static int const LIMB_BITS = 8*sizeof(bn_limb);
+static int const LIMB_WORDS = sizeof(bn_limb)/2;    // 16 bit words per limb
+
+int karatsuba_length = 1024;
+
+static std::vector<bn_limb> s_limbs;    // operands, product and scratch
+
+static void load_limbs(bn_limb *d, BYTE const *s, int bytes, int limbs)
+{
+    for (int i = 0; i < limbs; i++)
+    {
+        bn_limb v = 0;
+        for (int b = LIMB_BYTES-1; b >= 0; b--)
+        {
+            int const k = i*LIMB_BYTES + b;
+            v = (v << 8) | (k < bytes ? s[k] : 0);
+        }
+        d[i] = v;
+    }
+}
+
+// d = bytes [from, from+bytes) of the little endian limb array s
+static void store_limbs(BYTE *d, int bytes, bn_limb const *s, int from)
+{
+    for (int i = 0; i < bytes; i++)
+    {
+        int const k = from + i;
+        d[i] = (BYTE)(s[k/LIMB_BYTES] >> (8*(k % LIMB_BYTES)));
+    }
+}
+
+// r += x over nr limbs, returns the carry out
+static bn_limb add_limbs(bn_limb *r, int nr, bn_limb const *x, int nx)
+{
+    bn_limb carry = 0;
+    for (int i = 0; i < nr && (i < nx || carry != 0); i++)
+    {
+        bn_dlimb const t = (bn_dlimb)r[i] + (i < nx ? x[i] : 0) + carry;
+        r[i] = (bn_limb)t;
+        carry = (bn_limb)(t >> LIMB_BITS);
+    }
+    return carry;
+}
+
+// r -= x over nr limbs, returns the borrow out
+static bn_limb sub_limbs(bn_limb *r, int nr, bn_limb const *x, int nx)
+{
+    bn_limb borrow = 0;
+    for (int i = 0; i < nr && (i < nx || borrow != 0); i++)
+    {
+        bn_limb const y = i < nx ? x[i] : 0;
+        bn_limb const next = (r[i] < y || (r[i] == y && borrow != 0)) ? 1 : 0;
+        r[i] = r[i] - y - borrow;
+        borrow = next;
+    }
+    return borrow;
+}
+
+// d = |x - y| over n limbs, returns true if x < y
+static bool abs_diff_limbs(bn_limb *d, bn_limb const *x, int nx, bn_limb const *y, int ny, int n)
+{
+    for (int i = 0; i < n; i++)
+        d[i] = i < nx ? x[i] : 0;
+    if (sub_limbs(d, n, y, ny) == 0)
+        return false;
+    bn_limb carry = 1;              // two's complement back to |x - y|
+    for (int i = 0; i < n; i++)
+    {
+        d[i] = ~d[i] + carry;
+        carry = (carry != 0 && d[i] == 0) ? 1 : 0;
+    }
+    return true;
+}
+
+// the sum of the 16 bit partial products of x*y in columns first and up
+static bn_dlimb limb_product(bn_limb x, bn_limb y, int first)
+{
+    bn_dlimb p = (bn_dlimb)x*y;
+    for (int a = 0; a < LIMB_WORDS && a < first; a++)
+        for (int b = 0; b < LIMB_WORDS && a + b < first; b++)
+            p -= ((bn_dlimb)((x >> 16*a) & 0xFFFF)*((y >> 16*b) & 0xFFFF)) << 16*(a + b);
+    return p;
+}
+
+// r[0, 2n) = a*b, leaving out 16 bit partial products below column skip
+static void mul_basecase(bn_limb *r, bn_limb const *a, bn_limb const *b, int n, int skip)
+{
+    std::fill(r, r + 2*n, 0);
+    for (int i = 0; i < n; i++)
+    {
+        bn_limb carry = 0;
+        for (int j = 0; j < n; j++)
+        {
+            int const first = skip - LIMB_WORDS*(i + j);
+            if (first > 2*(LIMB_WORDS-1))
+                continue;
+            bn_dlimb const t = (first > 0 ? limb_product(a[i], b[j], first) : (bn_dlimb)a[i]*b[j])
+                               + r[i+j] + carry;
+            r[i+j] = (bn_limb)t;
+            carry = (bn_limb)(t >> LIMB_BITS);
+        }
+        r[i+n] = carry;
+    }
+}
+
+// r[0, 2n) = a^2, same partial products as mul_basecase(r, a, a, n, skip)
+static void sqr_basecase(bn_limb *r, bn_limb const *a, int n, int skip)
+{
+    std::fill(r, r + 2*n, 0);
+    // cross products once, then doubled
+    for (int i = 0; i < n; i++)
+    {
+        bn_limb carry = 0;
+        for (int j = i+1; j < n; j++)
+        {
+            int const first = skip - LIMB_WORDS*(i + j);
+            if (first > 2*(LIMB_WORDS-1))
+                continue;
+            bn_dlimb const t = (first > 0 ? limb_product(a[i], a[j], first) : (bn_dlimb)a[i]*a[j])
+                               + r[i+j] + carry;
+            r[i+j] = (bn_limb)t;
+            carry = (bn_limb)(t >> LIMB_BITS);
+        }
+        r[i+n] = carry;
+    }
+    bn_limb top = 0;
+    for (int k = 0; k < 2*n; k++)
+    {
+        bn_limb const v = r[k];
+        r[k] = (v << 1) | top;
+        top = v >> (LIMB_BITS-1);
+    }
+    // and the squares
+    for (int i = 0; i < n; i++)
+    {
+        int const first = skip - LIMB_WORDS*2*i;
+        if (first > 2*(LIMB_WORDS-1))
+            continue;
+        bn_limb const sq[2] =
+        {
+            (bn_limb)(first > 0 ? limb_product(a[i], a[i], first) : (bn_dlimb)a[i]*a[i]),
+            (bn_limb)((first > 0 ? limb_product(a[i], a[i], first) : (bn_dlimb)a[i]*a[i]) >> LIMB_BITS)
+        };
+        add_limbs(r + 2*i, 2*(n-i), sq, 2);
+    }
+}
+
+// r[0, 2n) = a*b, scratch needs karatsuba_scratch(n) limbs
+static void mul_karatsuba(bn_limb *r, bn_limb const *a, bn_limb const *b, int n, bn_limb *scratch)
+{
+    if (n*LIMB_BYTES < karatsuba_length || n < 4)
+    {
+        mul_basecase(r, a, b, n, 0);
+        return;
+    }
+    // a = a1*B^h + a0, b = b1*B^h + b0
+    // a*b = z2*B^2h + (z0 + z2 + (a0 - a1)*(b1 - b0))*B^h + z0
+    int const h = n/2;
+    int const l = n - h;
+    bn_limb *da = scratch;
+    bn_limb *db = da + l;
+    bn_limb *zm = db + l;
+    bn_limb *mid = zm + 2*l;
+    bn_limb *next = mid + 2*l + 1;
+    bool const nega = abs_diff_limbs(da, a, h, a + h, l, l);
+    bool const negb = abs_diff_limbs(db, b + h, l, b, h, l);
+    mul_karatsuba(r, a, b, h, next);
+    mul_karatsuba(r + 2*h, a + h, b + h, l, next);
+    mul_karatsuba(zm, da, db, l, next);
+    std::copy(r + 2*h, r + 2*n, mid);
+    mid[2*l] = 0;
+    add_limbs(mid, 2*l+1, r, 2*h);
+    if (nega == negb)
+        add_limbs(mid, 2*l+1, zm, 2*l);
+    else
+        sub_limbs(mid, 2*l+1, zm, 2*l);
+    add_limbs(r + h, 2*n - h, mid, 2*l+1);
+}
+
+// r[0, 2n) = a^2
+static void sqr_karatsuba(bn_limb *r, bn_limb const *a, int n, bn_limb *scratch)
+{
+    if (n*LIMB_BYTES < karatsuba_length || n < 4)
+    {
+        sqr_basecase(r, a, n, 0);
+        return;
+    }
+    // a^2 = z2*B^2h + (z0 + z2 - (a0 - a1)^2)*B^h + z0
+    int const h = n/2;
+    int const l = n - h;
+    bn_limb *da = scratch;
+    bn_limb *zm = da + l;
+    bn_limb *mid = zm + 2*l;
+    bn_limb *next = mid + 2*l + 1;
+    abs_diff_limbs(da, a, h, a + h, l, l);
+    sqr_karatsuba(r, a, h, next);
+    sqr_karatsuba(r + 2*h, a + h, l, next);
+    sqr_karatsuba(zm, da, l, next);
+    std::copy(r + 2*h, r + 2*n, mid);
+    mid[2*l] = 0;
+    add_limbs(mid, 2*l+1, r, 2*h);
+    sub_limbs(mid, 2*l+1, zm, 2*l);
+    add_limbs(r + h, 2*n - h, mid, 2*l+1);
+}
+
+/*
+   r = the top rbytes of |n1|*|n2|, both bnlength bytes long, leaving out
+   the 16 bit partial products that fall below the result.  n1 == n2
+   squares.
+*/
+static void bn_product(bn_t r, int rbytes, bn_t n1, bn_t n2)
+{
+    int const n = (bnlength + LIMB_BYTES-1)/LIMB_BYTES;
+    int const skip = (2*bnlength - rbytes)/2;
+    size_t const scratch = 8*n + 64;
+    if (s_limbs.size() < 4*n + scratch)
+        s_limbs.resize(4*n + scratch);
+    bn_limb *a = &s_limbs[0];
+    bn_limb *b = a + n;
+    bn_limb *p = b + n;
+    load_limbs(a, n1, bnlength, n);
+    if (n1 == n2)
+    {
+        if (n*LIMB_BYTES >= karatsuba_length)
+            sqr_karatsuba(p, a, n, p + 2*n);
+        else
+            sqr_basecase(p, a, n, skip);
+    }
+    else
+    {
+        load_limbs(b, n2, bnlength, n);
+        if (n*LIMB_BYTES >= karatsuba_length)
+            mul_karatsuba(p, a, b, n, p + 2*n);
+        else
+            mul_basecase(p, a, b, n, skip);
+    }
+    store_limbs(r, rbytes, p, 2*skip);
+}
+
 /************************************************************************/
 // r = n1 * n2
 // Note: r will be a double wide result, 2*bnlength
@@ -329,18 +594,13 @@ bn_t half_a_bn(bn_t r)
 bn_t unsafe_full_mult_bn(bn_t r, bn_t n1, bn_t n2)
 {
     bool sign2 = false;
-    int samevar;
-    int steps, doublesteps, carry_steps;
-    bn_t n1p, n2p;      // pointers for n1, n2
-    bn_t rp1, rp2, rp3; // pointers for r
-    U32 prod, sum;
 
     bool sign1 = is_bn_neg(n1);
     if (sign1) // =, not ==
     {
         neg_a_bn(n1);
     }
-    samevar = (n1 == n2);
+    int samevar = (n1 == n2);
     if (!samevar) // check to see if they're the same pointer
     {
         sign2 = is_bn_neg(n2);
@@ -350,41 +610,7 @@ bn_t unsafe_full_mult_bn(bn_t r, bn_t n1, bn_t n2)
         }
     }
 
-    n1p = n1;
-    steps = bnlength >> 1; // two bytes at a time
-    carry_steps = doublesteps = (steps << 1) - 2;
-    bnlength <<= 1;
-    clear_bn(r);        // double width
-    bnlength >>= 1;
-    rp1 = rp2 = r;
-    for (int i = 0; i < steps; i++)
-    {
-        n2p = n2;
-        for (int j = 0; j < steps; j++)
-        {
-            prod = (U32)big_access16(n1p) * (U32)big_access16(n2p); // U16*U16=U32
-            sum = (U32)big_access16(rp2) + prod; // add to previous, including overflow
-            big_set16(rp2, (U16)sum); // save the lower 2 bytes
-            sum >>= 16;             // keep just the upper 2 bytes
-            rp3 = rp2 + 2;          // move over 2 bytes
-            sum += big_access16(rp3);     // add what was the upper two bytes
-            big_set16(rp3 , (U16)sum); // save what was the upper two bytes
-            sum >>= 16;             // keep just the overflow
-            for (int k = 0; sum != 0 && k < carry_steps; k++)
-            {
-                rp3 += 2;               // move over 2 bytes
-                sum += big_access16(rp3);     // add to what was the overflow
-                big_set16(rp3, (U16)sum); // save what was the overflow
-                sum >>= 16;             // keep just the new overflow
-            }
-            n2p += 2;       // to next word
-            rp2 += 2;
-            carry_steps--;  // use one less step
-        }
-        n1p += 2;           // to next word
-        rp2 = rp1 += 2;
-        carry_steps = --doublesteps; // decrease doubles steps and reset carry_steps
-    }
+    bn_product(r, bnlength << 1, n1, n2);
 
     // if they were the same or same sign, the product must be positive
     if (!samevar && sign1 != sign2)
@@ -405,75 +631,21 @@ bn_t unsafe_full_mult_bn(bn_t r, bn_t n1, bn_t n2)
 bn_t unsafe_mult_bn(bn_t r, bn_t n1, bn_t n2)
 {
     bool sign2 = false;
-    int samevar;
-    int steps, doublesteps, carry_steps, skips;
-    bn_t n1p, n2p;      // pointers for n1, n2
-    bn_t rp1, rp2, rp3; // pointers for r
-    U32 prod, sum;
     int bnl; // temp bnlength holder
 
     bnl = bnlength;
     bool sign1 = is_bn_neg(n1);
     if (sign1 != 0) // =, not ==
         neg_a_bn(n1);
-    samevar = (n1 == n2);
+    int samevar = (n1 == n2);
     if (!samevar) // check to see if they're the same pointer
     {
         sign2 = is_bn_neg(n2);
         if (sign2) // =, not ==
             neg_a_bn(n2);
     }
-    n1p = n1;
-    n2 += (bnlength << 1) - rlength;  // shift n2 over to where it is needed
-
-    bnlength = rlength;
-    clear_bn(r);        // zero out r, rlength width
-    bnlength = bnl;
 
-    steps = (rlength-bnlength) >> 1;
-    skips = (bnlength >> 1) - steps;
-    carry_steps = doublesteps = (rlength >> 1)-2;
-    rp2 = rp1 = r;
-    for (int i = bnlength >> 1; i > 0; i--)
-    {
-        n2p = n2;
-        for (int j = 0; j < steps; j++)
-        {
-            prod = (U32)big_access16(n1p) * (U32)big_access16(n2p); // U16*U16=U32
-            sum = (U32)big_access16(rp2) + prod; // add to previous, including overflow
-            big_set16(rp2, (U16)sum); // save the lower 2 bytes
-            sum >>= 16;             // keep just the upper 2 bytes
-            rp3 = rp2 + 2;          // move over 2 bytes
-            sum += big_access16(rp3);     // add what was the upper two bytes
-            big_set16(rp3, (U16)sum); // save what was the upper two bytes
-            sum >>= 16;             // keep just the overflow
-            for (int k = 0; sum != 0 && k < carry_steps; k++)
-            {
-                rp3 += 2;               // move over 2 bytes
-                sum += big_access16(rp3);     // add to what was the overflow
-                big_set16(rp3, (U16)sum); // save what was the overflow
-                sum >>= 16;             // keep just the new overflow
-            }
-            n2p += 2;                   // increase by two bytes
-            rp2 += 2;
-            carry_steps--;
-        }
-        n1p += 2;   // increase by two bytes
-
-        if (skips != 0)
-        {
-            n2 -= 2;    // shift n2 back a word
-            steps++;    // one more step this time
-            skips--;    // keep track of how many times we've done this
-        }
-        else
-        {
-            rp1 += 2;           // shift forward a word
-            doublesteps--;      // reduce the carry steps needed next time
-        }
-        rp2 = rp1;
-        carry_steps = doublesteps;
-    }
+    bn_product(r, rlength, n1, n2);
 
     // if they were the same or same sign, the product must be positive
     if (!samevar && sign1 != sign2)
@@ -497,87 +669,10 @@ bn_t unsafe_mult_bn(bn_t r, bn_t n1, bn_t n2)
 // SIDE-EFFECTS: n is changed to its absolute value
 bn_t unsafe_full_square_bn(bn_t r, bn_t n)
 {
-    int steps, doublesteps, carry_steps;
-    bn_t n1p, n2p;
-    bn_t rp1, rp2, rp3;
-    U32 prod, sum;
-
     if (is_bn_neg(n))  // don't need to keep track of sign since the
         neg_a_bn(n);   // answer must be positive.
 
-    bnlength <<= 1;
-    clear_bn(r);        // zero out r, double width
-    bnlength >>= 1;
-
-    steps = (bnlength >> 1)-1;
-    carry_steps = doublesteps = (steps << 1) - 1;
-    rp2 = rp1 = r + 2;  // start with second two-byte word
-    n1p = n;
-    if (steps != 0) // if zero, then skip all the middle term calculations
-    {
-        for (int i = steps; i > 0; i--) // steps gets altered, count backwards
-        {
-            n2p = n1p + 2;  // set n2p pointer to 1 step beyond n1p
-            for (int j = 0; j < steps; j++)
-            {
-                prod = (U32)big_access16(n1p) * (U32)big_access16(n2p); // U16*U16=U32
-                sum = (U32)big_access16(rp2) + prod; // add to previous, including overflow
-                big_set16(rp2, (U16)sum); // save the lower 2 bytes
-                sum >>= 16;             // keep just the upper 2 bytes
-                rp3 = rp2 + 2;          // move over 2 bytes
-                sum += big_access16(rp3);     // add what was the upper two bytes
-                big_set16(rp3, (U16)sum); // save what was the upper two bytes
-                sum >>= 16;             // keep just the overflow
-                for (int k = 0; sum != 0 && k < carry_steps; k++)
-                {
-                    rp3 += 2;               // move over 2 bytes
-                    sum += big_access16(rp3);     // add to what was the overflow
-                    big_set16(rp3, (U16)sum); // save what was the overflow
-                    sum >>= 16;             // keep just the new overflow
-                }
-                n2p += 2;       // increase by two bytes
-                rp2 += 2;
-                carry_steps--;
-            }
-            n1p += 2;           // increase by two bytes
-            rp2 = rp1 += 4;     // increase by 2 * two bytes
-            carry_steps = doublesteps -= 2;   // reduce the carry steps needed
-            steps--;
-        }
-        // All the middle terms have been multiplied.  Now double it.
-        bnlength <<= 1;     // double wide bignumber
-        double_a_bn(r);
-        bnlength >>= 1;
-        // finished with middle terms
-    }
-
-    // Now go back and add in the squared terms.
-    n1p = n;
-    steps = (bnlength >> 1);
-    carry_steps = doublesteps = (steps << 1) - 2;
-    rp1 = r;
-    for (int i = 0; i < steps; i++)
-    {
-        // square it
-        prod = (U32)big_access16(n1p) * (U32)big_access16(n1p); // U16*U16=U32
-        sum = (U32)big_access16(rp1) + prod; // add to previous, including overflow
-        big_set16(rp1, (U16)sum); // save the lower 2 bytes
-        sum >>= 16;             // keep just the upper 2 bytes
-        rp3 = rp1 + 2;          // move over 2 bytes
-        sum += big_access16(rp3);     // add what was the upper two bytes
-        big_set16(rp3, (U16)sum); // save what was the upper two bytes
-        sum >>= 16;             // keep just the overflow
-        for (int k = 0; sum != 0 && k < carry_steps; k++)
-        {
-            rp3 += 2;               // move over 2 bytes
-            sum += big_access16(rp3);     // add to what was the overflow
-            big_set16(rp3, (U16)sum); // save what was the overflow
-            sum >>= 16;             // keep just the new overflow
-        }
-        n1p += 2;       // increase by 2 bytes
-        rp1 += 4;       // increase by 4 bytes
-        carry_steps = doublesteps -= 2;
-    }
+    bn_product(r, bnlength << 1, n, n);
     return r;
 }
 
@@ -596,127 +691,10 @@ bn_t unsafe_full_square_bn(bn_t r, bn_t n)
 // SIDE-EFFECTS: n is changed to its absolute value
 bn_t unsafe_square_bn(bn_t r, bn_t n)
 {
-    int steps, doublesteps, carry_steps;
-    int skips, rodd;
-    bn_t n1p, n2p, n3p;
-    bn_t rp1, rp2, rp3;
-    U32 prod, sum;
-    int bnl;
-
-    // This whole procedure would be a great deal simpler if we could assume that
-    // rlength < 2*bnlength (that is, not =).  Therefore, we will take the
-    // easy way out and call full_square_bn() if it is.
-    if (rlength == (bnlength << 1)) // rlength == 2*bnlength
-        return unsafe_full_square_bn(r, n);    // call full_square_bn() and quit
-
     if (is_bn_neg(n))  // don't need to keep track of sign since the
         neg_a_bn(n);   // answer must be positive.
 
-    bnl = bnlength;
-    bnlength = rlength;
-    clear_bn(r);        // zero out r, of width rlength
-    bnlength = bnl;
-
-    // determine whether r is on an odd or even two-byte word in the number
-    rodd = (U16)(((bnlength << 1)-rlength) >> 1) & 0x0001;
-    int i = (bnlength >> 1)-1;
-    steps = (rlength-bnlength) >> 1;
-    carry_steps = doublesteps = (bnlength >> 1)+steps-2;
-    skips = (i - steps) >> 1;     // how long to skip over pointer shifts
-    rp2 = rp1 = r;
-    n1p = n;
-    n3p = n2p = n1p + (((bnlength >> 1)-steps) << 1);    // n2p = n1p + 2*(bnlength/2 - steps)
-    if (i != 0) // if zero, skip middle term calculations
-    {
-        // i is already set
-        for (; i > 0; i--)
-        {
-            for (int j = 0; j < steps; j++)
-            {
-                prod = (U32)big_access16(n1p) * (U32)big_access16(n2p); // U16*U16=U32
-                sum = (U32)big_access16(rp2) + prod; // add to previous, including overflow
-                big_set16(rp2, (U16)sum); // save the lower 2 bytes
-                sum >>= 16;             // keep just the upper 2 bytes
-                rp3 = rp2 + 2;          // move over 2 bytes
-                sum += big_access16(rp3);     // add what was the upper two bytes
-                big_set16(rp3, (U16)sum); // save what was the upper two bytes
-                sum >>= 16;             // keep just the overflow
-                for (int k = 0; sum != 0 && k < carry_steps; k++)
-                {
-                    rp3 += 2;               // move over 2 bytes
-                    sum += big_access16(rp3);     // add to what was the overflow
-                    big_set16(rp3, (U16)sum); // save what was the overflow
-                    sum >>= 16;             // keep just the new overflow
-                }
-                n2p += 2;       // increase by 2-byte word size
-                rp2 += 2;
-                carry_steps--;
-            }
-            n1p += 2;       // increase by 2-byte word size
-            if (skips > 0)
-            {
-                n2p = n3p -= 2;
-                steps++;
-                skips--;
-            }
-            else if (skips == 0)    // only gets executed once
-            {
-                steps -= rodd;  // rodd is 1 or 0
-                doublesteps -= rodd+1;
-                rp1 += (rodd+1) << 1;
-                n2p = n1p+2;
-                skips--;
-            }
-            else // skips < 0
-            {
-                steps--;
-                doublesteps -= 2;
-                rp1 += 4;           // add two 2-byte words
-                n2p = n1p + 2;
-            }
-            rp2 = rp1;
-            carry_steps = doublesteps;
-        }
-        // All the middle terms have been multiplied.  Now double it.
-        bnlength = rlength;
-        double_a_bn(r);
-        bnlength = bnl;
-    }
-    // Now go back and add in the squared terms.
-
-    // be careful, the next dozen or so lines are confusing!
-    // determine whether r is on an odd or even word in the number
-    // using i as a temporary variable here
-    i = (bnlength << 1)-rlength;
-    rp1 = r + ((U16)i & (U16)0x0002);
-    i = (U16)((i >> 1)+1) & (U16)0xFFFE;
-    n1p = n + i;
-    // i here is no longer a temp var., but will be used as a loop counter
-    i = (bnlength - i) >> 1;
-    carry_steps = doublesteps = (i << 1)-2;
-    // i is already set
-    for (; i > 0; i--)
-    {
-        // square it
-        prod = (U32)big_access16(n1p) * (U32)big_access16(n1p); // U16*U16=U32
-        sum = (U32)big_access16(rp1) + prod; // add to previous, including overflow
-        big_set16(rp1, (U16)sum); // save the lower 2 bytes
-        sum >>= 16;             // keep just the upper 2 bytes
-        rp3 = rp1 + 2;          // move over 2 bytes
-        sum += big_access16(rp3);     // add what was the upper two bytes
-        big_set16(rp3, (U16)sum); // save what was the upper two bytes
-        sum >>= 16;             // keep just the overflow
-        for (int k = 0; sum != 0 && k < carry_steps; k++)
-        {
-            rp3 += 2;               // move over 2 bytes
-            sum += big_access16(rp3);     // add to what was the overflow
-            big_set16(rp3, (U16)sum); // save what was the overflow
-            sum >>= 16;             // keep just the new overflow
-        }
-        n1p += 2;
-        rp1 += 4;
-        carry_steps = doublesteps -= 2;
-    }
+    bn_product(r, rlength, n, n);
     return r;
 }
 
@@ -12,6 +12,7 @@ Additional fractal-specific modules are also invoked from CALCFRAC:
   and more
  -------------------------------------------------------------------- */
 #include <algorithm>
+#include <memory>
 #include <vector>
 
 #include <limits.h>
@@ -25,18 +26,34 @@ Additional fractal-specific modules are also invoked from CALCFRAC:
 #include "fractype.h"
 #include "targa_lc.h"
 #include "drivers.h"
+#include "workpool.h"
 
 // routines in this module
 static void perform_worklist();
 static int  OneOrTwoPass();
 static int  StandardCalc(int);
+static int  StandardCalcTiles(int);
+static bool tile_calc_ok();
+static int  calcmandfp_color(long &, long, double);
+static bool std_interior_ok();
+static orbit_kernel std_orbit_kernel();
 static int  potential(double, long);
 static void decomposition();
+static void init_log_table();
+static bool iter_cache_wanted();
+static void iter_cache_pixel(bool cycle);
+static void iter_cache_mandfp(int col, int row, long rciter, DComplex z, double mag);
 static int  bound_trace_main();
 static void step_col_row();
+static bool pool_engine_ok();
+static int  bound_trace_tiles();
 static int  solidguess();
 static bool guessrow(bool firstpass, int y, int blocksize);
 static void plotblock(int, int, int, int);
+static bool guess_ahead_ok();
+static void guess_ahead_pass(int blocksize, bool firstpass);
+static void guess_ahead_end();
+static int  calcmandfp_guessed();
 static void setsymmetry(symmetry_type sym, bool uselist);
 static bool xsym_split(int xaxis_row, bool xaxis_between);
 static bool ysym_split(int yaxis_col, bool yaxis_between);
@@ -196,6 +213,38 @@ static bool bottom_guess = false;
 BYTE dstack[4096] = { 0 };              // common temp, two put_line calls
 unsigned int tprefix[2][maxyblk][maxxblk] = { 0 }; // common temp
 
+// threaded solid guessing, see guess_ahead_ok()
+#define GUESS_AHEAD 2           // rows of blocks queued per thread
+
+struct guess_dot
+{
+    pixel_context pc;
+    long start;                 // where its periodicity checking started
+};
+
+struct guess_band               // a row of blocks, rows y and y+halfblock
+{
+    std::vector<guess_dot> dots;
+    std::vector<int> index;     // dot at each halfblock position, or -1
+    std::atomic<bool> done;
+    guess_band() : done(false)
+    {
+    }
+};
+
+static std::unique_ptr<work_pool> s_guess_pool;
+static std::vector<guess_band> s_guess_bands;
+static std::vector<int> s_guess_grid;   // colors of the blocksize grid
+static int s_guess_block = 0;           // blocksize of the pass
+static int s_guess_top = 0;             // iystart of the pass
+static int s_guess_cols = 0;            // halfblock positions across
+static int s_guess_grid_cols = 0;
+static int s_guess_queued = 0;          // bands handed to the pool
+static int s_guess_released = 0;        // bands let go of
+static bool s_guess_firstpass = false;
+static bool std_interior = false;       // see std_interior_ok()
+static orbit_kernel std_kernel = nullptr; // see std_orbit_kernel()
+
 bool nxtscreenflag = false;             // for cellular next screen generation
 int attractors = 0;                     // number of finite attractors
 DComplex attr[MAX_NUM_ATTRACTORS] = { 0.0 };        // finite attractor vals (f.p)
@@ -566,73 +615,9 @@ int calctypeshowdot()
     return out;
 }
 
-/******* calcfract - the top level routine for generating an image *******/
-
-int calcfract()
+// set up the logmap= or ranges= table for the coloring
+static void init_log_table()
 {
-    attractors = 0;          // default to no known finite attractors
-    display3d = 0;
-    basin = 0;
-    putcolor = putcolor_a;
-    if (g_is_true_color && truemode)
-    {
-        // Have to force passes = 1
-        stdcalcmode = '1';
-        usr_stdcalcmode = stdcalcmode;
-    }
-    if (truecolor)
-    {
-        check_writefile(light_name, ".tga");
-        if (!startdisk1(light_name, nullptr, false))
-        {
-            // Have to force passes = 1
-            stdcalcmode = '1';
-            usr_stdcalcmode = stdcalcmode;
-            putcolor = puttruecolor_disk;
-        }
-        else
-            truecolor = false;
-    }
-    if (!use_grid)
-    {
-        if (usr_stdcalcmode != 'o')
-        {
-            stdcalcmode = '1';
-            usr_stdcalcmode = stdcalcmode;
-        }
-    }
-
-    init_misc();  // set up some variables in parser.c
-    reset_clock();
-
-    // following delta values useful only for types with rotation disabled
-    // currently used only by bifurcation
-    if (integerfractal)
-        distest = 0;
-    parm.x   = param[0];
-    parm.y   = param[1];
-    parm2.x  = param[2];
-    parm2.y  = param[3];
-
-    if (LogFlag && colors < 16)
-    {
-        stopmsg(STOPMSG_NONE, "Need at least 16 colors to use logmap");
-        LogFlag = 0;
-    }
-
-    if (use_old_period)
-    {
-        nextsavedincr = 1;
-        firstsavedand = 1;
-    }
-    else
-    {
-        nextsavedincr = (int)log10(static_cast<double>(maxit)); // works better than log()
-        if (nextsavedincr < 4)
-            nextsavedincr = 4; // maintains image with low iterations
-        firstsavedand = (long)((nextsavedincr*2) + 1);
-    }
-
     LogTable.clear();
     MaxLTSize = maxit;
     Log_Calc = false;
@@ -721,6 +706,76 @@ int calcfract()
         else
             SetupLogTable();
     }
+}
+
+/******* calcfract - the top level routine for generating an image *******/
+
+int calcfract()
+{
+    attractors = 0;          // default to no known finite attractors
+    display3d = 0;
+    basin = 0;
+    putcolor = putcolor_a;
+    if (g_is_true_color && truemode)
+    {
+        // Have to force passes = 1
+        stdcalcmode = '1';
+        usr_stdcalcmode = stdcalcmode;
+    }
+    if (truecolor)
+    {
+        check_writefile(light_name, ".tga");
+        if (!startdisk1(light_name, nullptr, false))
+        {
+            // Have to force passes = 1
+            stdcalcmode = '1';
+            usr_stdcalcmode = stdcalcmode;
+            putcolor = puttruecolor_disk;
+        }
+        else
+            truecolor = false;
+    }
+    if (!use_grid)
+    {
+        if (usr_stdcalcmode != 'o')
+        {
+            stdcalcmode = '1';
+            usr_stdcalcmode = stdcalcmode;
+        }
+    }
+
+    init_misc();  // set up some variables in parser.c
+    reset_clock();
+
+    // following delta values useful only for types with rotation disabled
+    // currently used only by bifurcation
+    if (integerfractal)
+        distest = 0;
+    parm.x   = param[0];
+    parm.y   = param[1];
+    parm2.x  = param[2];
+    parm2.y  = param[3];
+
+    if (LogFlag && colors < 16)
+    {
+        stopmsg(STOPMSG_NONE, "Need at least 16 colors to use logmap");
+        LogFlag = 0;
+    }
+
+    if (use_old_period)
+    {
+        nextsavedincr = 1;
+        firstsavedand = 1;
+    }
+    else
+    {
+        nextsavedincr = (int)log10(static_cast<double>(maxit)); // works better than log()
+        if (nextsavedincr < 4)
+            nextsavedincr = 4; // maintains image with low iterations
+        firstsavedand = (long)((nextsavedincr*2) + 1);
+    }
+
+    init_log_table();
     lm = 4L << bitshift;                 // CALCMAND magnitude limit
 
     if (save_release > 2002)
@@ -828,6 +883,7 @@ int calcfract()
         ixstop = xxstop;
         calc_status = calc_status_value::IN_PROGRESS; // mark as in-progress
         distest = 0; // only standard escape time engine supports distest
+        iter_cache_clear(); // nor the iteration cache
         // per_image routine is run here
         if (curfractalspecific->per_image())
         {   // not a stand-alone
@@ -847,7 +903,8 @@ int calcfract()
     }
     else // standard escape-time engine
     {
-        if (stdcalcmode == '3')  // convoluted 'g' + '2' hybrid
+        if (stdcalcmode == '3' && g_png_out == png_out_kind::NONE
+            && !iter_cache_wanted())  // convoluted 'g' + '2' hybrid
         {
             int oldcalcmode;
             oldcalcmode = stdcalcmode;
@@ -897,6 +954,8 @@ int calcfract()
         close_snd();
     if (truecolor)
         enddisk();
+    png_stream_end(calc_status == calc_status_value::COMPLETED);
+    iter_cache_end(calc_status == calc_status_value::COMPLETED);
     return (calc_status == calc_status_value::COMPLETED) ? 0 : -1;
 }
 
@@ -907,10 +966,11 @@ int find_alternate_math(fractal_type type, bf_math_type math)
         return -1;
     int i = -1;
     fractal_type curtype;
-    while ((curtype = alternatemath[++i].type) != type && curtype != fractal_type::NOFRACTAL)
+    while ((curtype = alternatemath[++i].type) != fractal_type::NOFRACTAL
+            && (curtype != type || alternatemath[i].math != math))
         ;
     int ret = -1;
-    if (curtype == type && alternatemath[i].math != bf_math_type::NONE)
+    if (curtype == type)
         ret = i;
     return ret;
 }
@@ -923,7 +983,14 @@ static void perform_worklist()
     int (*sv_orbitcalc)() = nullptr;  // function that calculates one orbit
     int (*sv_per_pixel)() = nullptr;  // once-per-pixel init
     bool (*sv_per_image)() = nullptr;  // once-per-image setup
-    int alt = find_alternate_math(fractype, bf_math);
+    bf_math_type const sv_bf_math = bf_math;
+    int alt = -1;
+    if (bf_math != bf_math_type::NONE && perturbation_ok())
+        alt = find_alternate_math(fractype, bf_math_type::PERTURBATION);
+    if (alt < 0 && bf_math != bf_math_type::NONE && ddouble_ok())
+        alt = find_alternate_math(fractype, bf_math_type::DOUBLE_DOUBLE);
+    if (alt < 0)
+        alt = find_alternate_math(fractype, bf_math);
 
     if (alt > -1)
     {
@@ -949,6 +1016,22 @@ static void perform_worklist()
                 stdcalcmode = (char)tmpcalcmode;    // maybe we can carry on???
             }
     }
+    if (g_png_out != png_out_kind::NONE && !resuming)
+    {
+        // pngout= goes beside the GIF, under the same name
+        char name[FILE_MAX_PATH];
+        strcpy(name, savename);
+        if (char *period = has_ext(name))
+            *period = 0;
+        strcat(name, ".png");
+        check_writefile(name, ".png");
+        if (png_stream_begin(name, g_png_out, xdots, ydots, batch_parms_text()))
+            stdcalcmode = '1'; // rows must arrive in order
+    }
+    if (iter_cache_wanted() && iter_cache_begin(resuming))
+        stdcalcmode = '1'; // every pixel must be calculated
+    else
+        iter_cache_clear();
     if (stdcalcmode == 'b' && (curfractalspecific->flags & NOTRACE))
         stdcalcmode = '1';
     if (stdcalcmode == 'g' && (curfractalspecific->flags & NOGUESS))
@@ -1060,6 +1143,8 @@ static void perform_worklist()
         calc_status = calc_status_value::IN_PROGRESS; // mark as in-progress
 
         curfractalspecific->per_image();
+        std_interior = std_interior_ok();
+        std_kernel = std_orbit_kernel();
         if (showdot >= 0)
         {
             find_special_colors();
@@ -1198,6 +1283,8 @@ static void perform_worklist()
         curfractalspecific->per_pixel = sv_per_pixel;
         curfractalspecific->per_image = sv_per_image;
     }
+    if (bf_math == bf_math_type::PERTURBATION || bf_math == bf_math_type::DOUBLE_DOUBLE)
+        bf_math = sv_bf_math;
 }
 
 static int diffusion_scan()
@@ -1712,6 +1799,8 @@ static int OneOrTwoPass()
 
 static int StandardCalc(int passnum)
 {
+    if (tile_calc_ok())
+        return StandardCalcTiles(passnum);
     got_status = 0;
     curpass = passnum;
     row = yybegin;
@@ -1737,6 +1826,7 @@ static int StandardCalc(int passnum)
             {
                 if ((*calctype)() == -1) // StandardFractal(), calcmand() or calcmandfp()
                     return -1;          // interrupted
+                png_stream_pixel(col, row, color, realcoloriter);
                 resuming = false;       // reset so quick_calc works
                 reset_periodicity = false;
                 if (passnum == 1)       // first pass, copy pixel and bump col
@@ -1761,6 +1851,188 @@ static int StandardCalc(int passnum)
     return 0;
 }
 
+/*
+   Threaded StandardCalc() for the fractals calcmandfp() handles.  The rows
+   to visit are cut into bands of TILE_ROWS full-width rows, which the work
+   pool calculates into a color buffer while this thread plots the finished
+   bands strictly in order.  Whole rows keep the periodicity checking, which
+   carries from pixel to pixel along a row, the same as the serial scan, and
+   plotting in order keeps the symmetry and the resume point unchanged.
+   calcmandfp_rows() runs the rows of a band side by side in SIMD lanes, so
+   this is worth using even with a single thread.  The same goes for the
+   lyapunov type when lyapunov_batch_ok(), whose pixels lyapunov_pixels()
+   runs in batches.
+*/
+#define TILE_ROWS 8
+
+static bool tile_calc_ok()
+{
+    return (calctype == calcmandfp || (calctype == lyapunov && lyapunov_batch_ok()))
+        && !invert
+        && !(potflag && pot16bit)
+        && !truecolor
+        && !show_orbit
+        && !(quick_calc && !resuming)
+        && (work_pool_threads() > 1 || calctype == lyapunov || calcmandfp_lanes() > 1);
+}
+
+// color the pixels of a band of the lyapunov type
+static void tile_calc_lyapunov(std::vector<pixel_context> const &band, std::vector<int> const &start,
+                               int first, int last, BYTE *pixels, long *iters, int width)
+{
+    std::vector<double> a(band.size());
+    std::vector<double> b(band.size());
+    std::vector<int> colors(band.size());
+    std::vector<long> cycles(band.size());
+    for (size_t j = 0; j < band.size(); ++j)
+    {
+        a[j] = band[j].init.y;
+        b[j] = band[j].init.x;
+    }
+    lyapunov_pixels(&a[0], &b[0], &colors[0], &cycles[0], static_cast<int>(band.size()));
+    for (int i = first; i < last; ++i)
+    {
+        for (int j = start[i - first]; j < start[i - first + 1]; ++j)
+        {
+            pixels[(long)i*width + band[j].col] = (BYTE) colors[j];
+            if (iters != nullptr)
+                iters[(long)i*width + band[j].col] = cycles[j];
+        }
+    }
+}
+
+// calculate visited rows [first, last) of the image into pixels, and
+// into iters, if not null, their iteration counts for pngout=
+static void tile_calc_rows(int passnum, std::vector<int> const &rows, int first, int last,
+                           BYTE *pixels, long *iters, int width, bool lyapunov_band)
+{
+    std::vector<pixel_context> band;
+    std::vector<int> start;
+    for (int i = first; i < last; ++i)
+    {
+        int const r = rows[i];
+        start.push_back(static_cast<int>(band.size()));
+        for (int c = (i == 0) ? xxbegin : ixstart; c <= ixstop; ++c)
+        {
+            if (passnum == 1 || stdcalcmode == '1' || (r&1) != 0 || (c&1) != 0)
+            {
+                pixel_context pc;
+                pc.row = r;
+                pc.col = c;
+                pc.init.x = dxpixel_rc(r, c);
+                pc.init.y = dypixel_rc(r, c);
+                pc.oldcoloriter = 0;
+                pc.reset_periodicity = static_cast<int>(band.size()) == start.back();
+                pc.show_orbit = false;
+                band.push_back(pc);
+                if (passnum == 1 && (c&1) == 0 && c < ixstop)
+                    ++c;
+            }
+        }
+    }
+    start.push_back(static_cast<int>(band.size()));
+    if (band.empty())
+        return;
+    if (lyapunov_band)
+    {
+        tile_calc_lyapunov(band, start, first, last, pixels, iters, width);
+        return;
+    }
+
+    calcmandfp_rows(&band[0], &start[0], last - first);
+    for (int i = first; i < last; ++i)
+    {
+        for (int j = start[i - first]; j < start[i - first + 1]; ++j)
+        {
+            pixel_context &pc = band[j];
+            pixels[(long)i*width + pc.col] =
+                (BYTE) calcmandfp_color(pc.coloriter, pc.realcoloriter, pc.magnitude);
+            if (iter_cache_filling())
+                iter_cache_mandfp(pc.col, pc.row, pc.realcoloriter, pc.z, pc.magnitude);
+            if (iters != nullptr)
+                iters[(long)i*width + pc.col] = pc.realcoloriter;
+        }
+    }
+}
+
+static int StandardCalcTiles(int passnum)
+{
+    std::vector<int> rows;              // the rows StandardCalc() visits
+    for (int r = yybegin; r <= iystop; ++r)
+    {
+        rows.push_back(r);
+        if (passnum == 1 && (r&1) == 0)
+            ++r;
+    }
+    int const num_rows = static_cast<int>(rows.size());
+    int const num_bands = (num_rows + TILE_ROWS - 1)/TILE_ROWS;
+    int const width = ixstop + 1;
+    std::vector<BYTE> pixels((long)num_rows*width);
+    std::vector<long> iters(png_streaming() ? (long)num_rows*width : 0);
+    std::vector<std::atomic<bool>> done(num_bands);
+    bool const lyapunov_band = calctype == lyapunov;
+
+    work_pool pool(work_pool_threads());
+    for (int band = 0; band < num_bands; ++band)
+    {
+        pool.push([&, band](int)
+        {
+            tile_calc_rows(passnum, rows, band*TILE_ROWS,
+                           std::min((band + 1)*TILE_ROWS, num_rows), &pixels[0],
+                           iters.empty() ? nullptr : &iters[0], width, lyapunov_band);
+            done[band] = true;
+        });
+    }
+
+    got_status = 0;
+    curpass = passnum;
+    for (int band = 0; band < num_bands; ++band)
+    {
+        while (!done[band])
+        {
+            if (check_key())
+            {
+                pool.cancel();
+                row = rows[band*TILE_ROWS];
+                col = (band == 0) ? xxbegin : ixstart;
+                return -1;              // interrupted
+            }
+            pool.wait(10);
+        }
+        int const last = std::min((band + 1)*TILE_ROWS, num_rows);
+        for (int i = band*TILE_ROWS; i < last; ++i)
+        {
+            row = rows[i];
+            currow = row;
+            for (col = (i == 0) ? xxbegin : ixstart; col <= ixstop; ++col)
+            {
+                if (passnum == 1 || stdcalcmode == '1' || (row&1) != 0 || (col&1) != 0)
+                {
+                    color = pixels[(long)i*width + col];
+                    (*plot)(col, row, color);
+                    if (!iters.empty())
+                        png_stream_pixel(col, row, color, iters[(long)i*width + col]);
+                    if (passnum == 1)   // first pass, copy pixel and bump col
+                    {
+                        if ((row&1) == 0 && row < iystop)
+                        {
+                            (*plot)(col, row+1, color);
+                            if ((col&1) == 0 && col < ixstop)
+                                (*plot)(col+1, row+1, color);
+                        }
+                        if ((col&1) == 0 && col < ixstop)
+                            (*plot)(++col, row, color);
+                    }
+                }
+            }
+        }
+        resuming = false;
+    }
+    col = ixstart;
+    row = iystop + 1;
+    return 0;
+}
+
 
 int calcmand()              // fast per pixel 1/2/b/g, called with row & col set
 {
@@ -1816,59 +2088,119 @@ int calcmandfp()
     }
     if (calcmandfpasm() >= 0)
     {
-        if (potflag)
-            coloriter = potential(magnitude, realcoloriter);
-        if ((!LogTable.empty() || Log_Calc) // map color, but not if maxit & adjusted for inside,etc
-                && (realcoloriter < maxit || (inside < COLOR_BLACK && coloriter == maxit)))
-            coloriter = logtablecalc(coloriter);
-        color = abs((int)coloriter);
-        if (coloriter >= colors)
-        { // don't use color 0 unless from inside/outside
-            if (save_release <= 1950)
-            {
-                if (colors < 16)
-                    color &= g_and_color;
-                else
-                    color = ((color - 1) % g_and_color) + 1;  // skip color zero
-            }
-            else
-            {
-                if (colors < 16)
-                    color = (int)(coloriter & g_and_color);
-                else
-                    color = (int)(((coloriter - 1) % g_and_color) + 1);
-            }
-        }
-        if (debugflag != debug_flags::force_boundary_trace_error)
-            if (color == 0 && stdcalcmode == 'b')
-                color = 1;
+        if (iter_cache_filling())
+            iter_cache_mandfp(col, row, realcoloriter, g_new, magnitude);
+        color = calcmandfp_color(coloriter, realcoloriter, magnitude);
         (*plot)(col, row, color);
     }
     else
         color = (int)coloriter;
     return color;
 }
-#define STARTRAILMAX FLT_MAX   // just a convenient large number
-#define green 2
-#define yellow 6
-int StandardFractal()       // per pixel 1/2/b/g, called with row & col set
+
+// map the result of calcmandfpasm() to a color, safe to call from the
+// threaded engines unless pot16bit is on
+static int calcmandfp_color(long &citer, long rciter, double mag)
 {
-#ifdef NUMSAVED
-    DComplex savedz[NUMSAVED] = { 0.0 };
-    long caught[NUMSAVED] = { 0 };
-    long changed[NUMSAVED] = { 0 };
-    int zctr = 0;
-#endif
-    long savemaxit = 0;
-    double tantable[16] = { 0.0 };
-    int hooper = 0;
-    long lcloseprox = 0;
-    double memvalue = 0.0;
-    double min_orbit = 100000.0;        // orbit value closest to origin
-    long   min_index = 0;               // iteration of min_orbit
-    long cyclelen = -1;
-    long savedcoloriter = 0;
+    int result;
+    if (potflag)
+        citer = potential(mag, rciter);
+    if ((!LogTable.empty() || Log_Calc) // map color, but not if maxit & adjusted for inside,etc
+            && (rciter < maxit || (inside < COLOR_BLACK && citer == maxit)))
+        citer = logtablecalc(citer);
+    result = abs((int)citer);
+    if (citer >= colors)
+    { // don't use color 0 unless from inside/outside
+        if (save_release <= 1950)
+        {
+            if (colors < 16)
+                result &= g_and_color;
+            else
+                result = ((result - 1) % g_and_color) + 1;  // skip color zero
+        }
+        else
+        {
+            if (colors < 16)
+                result = (int)(citer & g_and_color);
+            else
+                result = (int)(((citer - 1) % g_and_color) + 1);
+        }
+    }
+    if (debugflag != debug_flags::force_boundary_trace_error)
+        if (result == 0 && stdcalcmode == 'b')
+            result = 1;
+    return result;
+}
+
+// calculate the pixel at x, y for the threaded engines, carrying the
+// periodicity in pc on from the pixel before; returns its color
+static int calcmandfp_at(pixel_context &pc, int x, int y)
+{
+    pc.row = y;
+    pc.col = x;
+    pc.init.x = dxpixel_rc(y, x);
+    pc.init.y = dypixel_rc(y, x);
+    calcmandfp_pixel(pc);
+    pc.reset_periodicity = false;
+    if (iter_cache_filling())
+        iter_cache_mandfp(x, y, pc.realcoloriter, pc.z, pc.magnitude);
+    return calcmandfp_color(pc.coloriter, pc.realcoloriter, pc.magnitude);
+}
+
+/* Can StandardFractal() color the pixels that mandel_interior() finds
+   inside without iterating them?  Their orbits stay within |z|^2 < 3, so
+   they must run to maxit with a constant inside color. */
+static bool std_interior_ok()
+{
+    double const least = (bailoutest == bailouts::Manh || bailoutest == bailouts::Manr) ? 6.0 : 3.0;
+    return fractype == fractal_type::MANDELFP
+        && bf_math == bf_math_type::NONE
+        && (inside >= COLOR_BLACK || inside == ITER)
+        && periodicitycheck >= 0
+        && useinitorbit == 0
+        && parm.x == 0.0 && parm.y == 0.0
+        && (orbitsave & 2) == 0
+        && attractors == 0
+        && rqlim > least;
+}
+
+/* Can StandardFractal() run the orbits in an orbit kernel?  Only if it
+   has nothing to do between iterations but check periodicity. */
+static orbit_kernel std_orbit_kernel()
+{
+#ifdef NUMSAVED
+    return nullptr;
+#else
+    if (integerfractal || bf_math != bf_math_type::NONE || distest || attractors > 0
+        || outside == TDIS || outside == FMOD
+        || (inside < ITER && inside != ZMAG && inside != PERIOD && inside != ATANI))
+        return nullptr;
+    return find_orbit_kernel();
+#endif
+}
+
+#define STARTRAILMAX FLT_MAX   // just a convenient large number
+#define green 2
+#define yellow 6
+int StandardFractal()       // per pixel 1/2/b/g, called with row & col set
+{
+#ifdef NUMSAVED
+    DComplex savedz[NUMSAVED] = { 0.0 };
+    long caught[NUMSAVED] = { 0 };
+    long changed[NUMSAVED] = { 0 };
+    int zctr = 0;
+#endif
+    long savemaxit = 0;
+    double tantable[16] = { 0.0 };
+    int hooper = 0;
+    long lcloseprox = 0;
+    double memvalue = 0.0;
+    double min_orbit = 100000.0;        // orbit value closest to origin
+    long   min_index = 0;               // iteration of min_orbit
+    long cyclelen = -1;
+    long savedcoloriter = 0;
     bool caught_a_cycle = false;
+    bool interior = false;
     long savedand = 0;
     int savedincr = 0;                  // for periodicity checking
     LComplex lsaved = { 0 };
@@ -2019,9 +2351,37 @@ int StandardFractal()       // per pixel 1/2/b/g, called with row & col set
     else
         check_freq = 2048;
 
+    if (std_interior && !show_orbit && mandel_interior(init.x, init.y))
+    {
+        interior = true;
+        coloriter = maxit - 1;     // skip the orbit, it is inside
+    }
     if (show_orbit)
         snd_time_write();
-    while (++coloriter < maxit)
+    bool orbit_done = false;
+    if (std_kernel != nullptr && !show_orbit)
+    {
+        orbit_loop loop;
+        loop.coloriter = coloriter;
+        loop.oldcoloriter = oldcoloriter;
+        loop.savedand = savedand;
+        loop.savedincr = savedincr;
+        loop.savedcoloriter = savedcoloriter;
+        loop.cyclelen = cyclelen;
+        loop.check_freq = check_freq;
+        loop.caught_a_cycle = caught_a_cycle;
+        int const status = std_kernel(loop);
+        if (status < 0)
+            return -1;
+        coloriter = loop.coloriter;
+        savedand = loop.savedand;
+        savedincr = loop.savedincr;
+        savedcoloriter = loop.savedcoloriter;
+        cyclelen = loop.cyclelen;
+        caught_a_cycle = loop.caught_a_cycle;
+        orbit_done = status == 0;       // else the orbit display came on
+    }
+    while (!orbit_done && ++coloriter < maxit)
     {
         // calculation of one orbit goes here
         // input in "old" -- output in "new"
@@ -2291,6 +2651,8 @@ int StandardFractal()       // per pixel 1/2/b/g, called with row & col set
                     copy_bf(bfsaved.x, bfnew.x);
                     copy_bf(bfsaved.y, bfnew.y);
                 }
+                else if (bf_math == bf_math_type::DOUBLE_DOUBLE)
+                    ddouble_save_orbit();
                 else
                 {
                     saved = g_new;  // floating pt fractals
@@ -2328,6 +2690,11 @@ int StandardFractal()       // per pixel 1/2/b/g, called with row & col set
                         if (cmp_bf(abs_a_bf(sub_bf(bftmp, bfsaved.y, bfnew.y)), bfclosenuff) < 0)
                             caught_a_cycle = true;
                 }
+                else if (bf_math == bf_math_type::DOUBLE_DOUBLE)
+                {
+                    if (ddouble_orbit_cycled())
+                        caught_a_cycle = true;
+                }
                 else
                 {
                     if (fabs(saved.x - g_new.x) < closenuff)
@@ -2380,6 +2747,8 @@ int StandardFractal()       // per pixel 1/2/b/g, called with row & col set
         if (coloriter == 0)
             coloriter = 1;         // needed to make same as calcmand
     }
+    if (iter_cache_filling())
+        iter_cache_pixel(caught_a_cycle || interior);
 
     if (potflag)
     {
@@ -2981,13 +3350,186 @@ static int potential(double mag, long iterations)
     return i_pot;
 }
 
+/**************** iteration cache for itercache= ***********************/
+
+// can the iteration cache keep this image?  only for pixels that
+// StandardFractal() or calcmandfp() iterate right through
+static bool iter_cache_wanted()
+{
+    return g_iter_cache
+        && (curfractalspecific->calctype == StandardFractal
+            || curfractalspecific->calctype == calcmandfp)
+        && !integerfractal
+        && !distest
+        && !finattract
+        && inside != STARTRAIL      // changes maxit and the orbit
+        && inside != EPSCROSS       // stops the orbit early
+        && !(potflag && pot16bit)
+        && !evolving;
+}
+
+// keep the result of StandardFractal() in the iteration cache
+static void iter_cache_pixel(bool cycle)
+{
+    DComplex z = g_new;
+    if (bf_math == bf_math_type::BIGNUM)
+        z = cmplxbntofloat(&bnnew);
+    else if (bf_math == bf_math_type::BIGFLT)
+        z = cmplxbftofloat(&bfnew);
+    long const pot = potflag ? potential(sqr(z.x) + sqr(z.y), coloriter) : 0;
+    if (cycle)
+        z.x = z.y = NAN;            // not the final z of an inside point
+    iter_cache_store(col, row, realcoloriter, z, pot);
+}
+
+// keep the result of calcmandfp(), which has no final z for inside points
+static void iter_cache_mandfp(int col, int row, long rciter, DComplex z, double mag)
+{
+    long const pot = potflag ? potential(mag, rciter) : 0;
+    if (rciter >= maxit)
+        z.x = z.y = NAN;
+    iter_cache_store(col, row, rciter, z, pot);
+}
+
+/*
+   The color StandardFractal() would give a pixel with these iterations
+   and final z, the way it colors after the orbit is done, or the color
+   calcmandfp() would give when mandfp is set.  Only for the colorings
+   recolor_image() accepts.
+*/
+static int cached_color(long iterations, DComplex const &z, long pot, bool mandfp)
+{
+    coloriter = iterations;
+    g_new = z;
+    if (coloriter < maxit && coloriter == 0)
+        coloriter = 1;
+    if (potflag)
+    {
+        // the potential of inside points depends on inside=
+        coloriter = (iterations >= maxit) ? potential(0.0, iterations) : pot;
+        if ((!LogTable.empty() || Log_Calc)
+            && (!mandfp || iterations < maxit || (inside < COLOR_BLACK && coloriter == maxit)))
+            coloriter = logtablecalc(coloriter);
+    }
+    else if (coloriter >= maxit)
+    {
+        if (inside >= COLOR_BLACK)
+            coloriter = inside;
+        else
+        {
+            if (inside == ATANI)
+                coloriter = (long)fabs(atan2(g_new.y, g_new.x)*atan_colors/PI);
+            else if (inside == ZMAG)
+                coloriter = (long)((sqr(g_new.x) + sqr(g_new.y)) * (maxit >> 1) + 1);
+            else
+                coloriter = maxit;
+            if (!LogTable.empty() || Log_Calc)
+                coloriter = logtablecalc(coloriter);
+        }
+    }
+    else
+    {
+        if (outside < ITER)
+        {
+            if (outside == REAL)
+                coloriter += (long)g_new.x + 7;
+            else if (outside == IMAG)
+                coloriter += (long)g_new.y + 7;
+            else if (outside == MULT  && g_new.y)
+                coloriter = (long)((double)coloriter * (g_new.x/g_new.y));
+            else if (outside == SUM)
+                coloriter += (long)(g_new.x + g_new.y);
+            else if (outside == ATAN)
+                coloriter = (long)fabs(atan2(g_new.y, g_new.x)*atan_colors/PI);
+            if (coloriter <= 0 || coloriter > maxit)
+                coloriter = (save_release < 1961) ? 0 : 1;
+        }
+        if (decomp[0] > 0)
+            decomposition();
+        else if (biomorph != -1)
+        {
+            if (fabs(g_new.x) < rqlim2 || fabs(g_new.y) < rqlim2)
+                coloriter = biomorph;
+        }
+        if (outside >= COLOR_BLACK)
+            coloriter = outside;
+        if ((!LogTable.empty() || Log_Calc) && (outside < COLOR_BLACK || mandfp))
+            coloriter = logtablecalc(coloriter);
+    }
+
+    int result = abs((int)coloriter);
+    if (coloriter >= colors)
+    { // don't use color 0 unless from inside/outside
+        if (save_release <= 1950)
+        {
+            if (colors < 16)
+                result &= g_and_color;
+            else
+                result = ((result - 1) % g_and_color) + 1;  // skip color zero
+        }
+        else
+        {
+            if (colors < 16)
+                result = (int)(coloriter & g_and_color);
+            else
+                result = (int)(((coloriter - 1) % g_and_color) + 1);
+        }
+    }
+    return result;
+}
+
+/*
+   Redraws the completed image from the iteration cache after the
+   coloring options changed, instead of calculating it again.  Returns
+   false, with nothing drawn, if there is no cache for the image or the
+   coloring needs more than the iterations and the final z.
+*/
+bool recolor_image()
+{
+    if (!iter_cache_ready() || truecolor || evolving || periodicitycheck < 0)
+        return false;
+    if (inside < COLOR_BLACK && inside != ITER && inside != ZMAG && inside != ATANI)
+        return false;                   // needs the orbit
+    if (outside < ATAN)
+        return false;                   // fmod, tdis need the orbit
+    if (labs(LogFlag) == 2 || (LogFlag && Log_Auto_Calc))
+        return false;                   // autologmap() calculates
+    if (LogFlag && colors < 16)
+        return false;
+    if ((inside == ZMAG || inside == ATANI) && !potflag && !iter_cache_inside_z())
+        return false;
+    if ((usr_biomorph != -1) != (biomorph != -1) && bailout == 0
+        && !(potflag && potparam[2] != 0.0))
+        return false;                   // biomorph changes the default bailout
+
+    biomorph = usr_biomorph;
+    // decomp= and biomorph= decide which engine a new calculation would
+    // use, and the two color a few cases differently
+    if (fractype == fractal_type::MANDELFP || fractype == fractal_type::JULIAFP)
+        curfractalspecific->per_image();
+    bool const mandfp = calctype == calcmandfp;
+    init_log_table();
+    for (int r = 0; r < ydots; ++r)
+    {
+        for (int c = 0; c < xdots; ++c)
+        {
+            long iterations;
+            long pot;
+            DComplex z;
+            iter_cache_fetch(c, r, iterations, z, pot);
+            putcolor(c, r, cached_color(iterations, z, pot, mandfp));
+        }
+    }
+    return true;
+}
+
 
 /******************* boundary trace method ***************************/
 #define bkcolor 0
 
 inline direction advance(direction dir, int increment)
 {
-    return static_cast<direction>((static_cast<int>(dir) + increment) % 4);
+    return static_cast<direction>((static_cast<int>(dir) + increment) & 3);
 }
 
 inline void advance_match(direction &coming_from)
@@ -3019,6 +3561,8 @@ int  bound_trace_main()
         stopmsg(STOPMSG_NONE, "Boundary tracing cannot be used with < 16 colors");
         return -1;
     }
+    if (pool_engine_ok())
+        return bound_trace_tiles();
 
     got_status = 2;
     max_putline_length = 0; // reset max_putline_length
@@ -3138,7 +3682,7 @@ int  bound_trace_main()
                             while (--right >= ixstart)
                             {
                                 color = getcolor(right, row);
-                                if (color == trail_color)
+                                if (color != trail_color)
                                 {
                                     break;
                                 }
@@ -3216,6 +3760,377 @@ static void step_col_row()
     }
 }
 
+/*
+   Threaded boundary tracing, for the fractals calcmandfp() handles.  The
+   window is cut into tiles of TRACE_TILE pixels square.  The rows and
+   columns where the tiles meet are calculated first, a line per task;
+   then each tile is traced and filled on its own, the way
+   bound_trace_main() does a window, with the lines around it as edges it
+   only reads.  A region crossing a tile edge is traced in every tile it
+   reaches, so those lines are where the tiles are stitched together.
+   The work goes into a copy of the window and this thread plots each tile
+   when it is done.
+
+   As the shared lines are calculated where the serial trace may fill over
+   them, the image can differ from it by a few pixels.
+*/
+#define TRACE_TILE 64
+
+struct trace_tile
+{
+    int left, top, right, bottom;   // including the lines shared with neighbors
+    std::atomic<bool> done;
+    trace_tile() : left(0), top(0), right(0), bottom(0), done(false)
+    {
+    }
+};
+
+// the walk of bound_trace_main() within one tile of the window copy
+class tile_tracer
+{
+public:
+    tile_tracer(std::vector<BYTE> &pixels, work_pool const &pool)
+        : m_pixels(pixels), m_pool(pool), m_width(ixstop - ixstart + 1),
+          m_xorg(ixstart), m_yorg(iystart)
+    {
+        m_pc.oldcoloriter = 0;
+        m_pc.reset_periodicity = true;
+        m_pc.show_orbit = false;
+    }
+    void seam_row(int y);
+    void seam_col(int x);
+    void trace(trace_tile const &tile);
+
+private:
+    BYTE &pixel(int x, int y)
+    {
+        return m_pixels[(long)(y - m_yorg)*m_width + x - m_xorg];
+    }
+    bool in_tile(int x, int y, int currow) const
+    {
+        return y >= currow && x >= m_left && x <= m_right && y <= m_bottom;
+    }
+    int calc(int x, int y);
+    void step();
+    void advance_match(direction &coming_from)
+    {
+        m_going_to = advance(m_going_to, -1);
+        coming_from = advance(m_going_to, -1);
+    }
+
+    std::vector<BYTE> &m_pixels;
+    work_pool const &m_pool;
+    int m_width, m_xorg, m_yorg;
+    int m_left = 0, m_right = 0, m_bottom = 0;
+    pixel_context m_pc;
+    int m_row = 0, m_col = 0;
+    int m_trail_row = 0, m_trail_col = 0;
+    direction m_going_to = direction::East;
+};
+
+// is offset from the start of the window a line shared by two tiles?
+static bool trace_seam(int offset, int extent)
+{
+    return offset > 0 && offset < extent - 1 && offset % TRACE_TILE == 0;
+}
+
+int tile_tracer::calc(int x, int y)
+{
+    int const result = calcmandfp_at(m_pc, x, y);
+    pixel(x, y) = (BYTE) result;
+    return result;
+}
+
+void tile_tracer::step()
+{
+    switch (m_going_to)
+    {
+    case direction::North:
+        m_col = m_trail_col;
+        m_row = m_trail_row - 1;
+        break;
+    case direction::East:
+        m_col = m_trail_col + 1;
+        m_row = m_trail_row;
+        break;
+    case direction::South:
+        m_col = m_trail_col;
+        m_row = m_trail_row + 1;
+        break;
+    case direction::West:
+        m_col = m_trail_col - 1;
+        m_row = m_trail_row;
+        break;
+    }
+}
+
+// the pixels of row y not known yet, across the whole window
+void tile_tracer::seam_row(int y)
+{
+    m_pc.reset_periodicity = true;
+    for (int x = m_xorg; x < m_xorg + m_width && !m_pool.cancelled(); ++x)
+    {
+        if (pixel(x, y) == bkcolor)
+            calc(x, y);
+        else
+            m_pc.reset_periodicity = true;
+    }
+}
+
+// the pixels of column x not known yet, less those on the shared rows,
+// which belong to seam_row() and are not even read here
+void tile_tracer::seam_col(int x)
+{
+    int const height = (int) (m_pixels.size()/m_width);
+    m_pc.reset_periodicity = true;
+    for (int y = m_yorg; y < m_yorg + height && !m_pool.cancelled(); ++y)
+    {
+        if (!trace_seam(y - m_yorg, height) && pixel(x, y) == bkcolor)
+            calc(x, y);
+        else
+            m_pc.reset_periodicity = true;
+    }
+}
+
+void tile_tracer::trace(trace_tile const &tile)
+{
+    m_left = tile.left;
+    m_right = tile.right;
+    m_bottom = tile.bottom;
+    // the pixels of this tile alone, the shared lines are only read
+    int const top = tile.top + (tile.top > m_yorg ? 1 : 0);
+    int const bottom = tile.bottom - (tile.bottom < iystop ? 1 : 0);
+    int const left = tile.left + (tile.left > m_xorg ? 1 : 0);
+    int const right = tile.right - (tile.right < ixstop ? 1 : 0);
+    for (int currow = top; currow <= bottom && !m_pool.cancelled(); currow++)
+    {
+        m_pc.reset_periodicity = true;
+        int color = bkcolor;
+        for (int curcol = left; curcol <= right; curcol++)
+        {
+            if (pixel(curcol, currow) != bkcolor)
+                continue;
+            int trail_color = color;
+            color = calc(curcol, currow);
+            if (color != trail_color)
+                continue;
+
+            // sweep clockwise to trace outline
+            m_trail_row = currow;
+            m_trail_col = curcol;
+            int const fillcolor_used = fillcolor > 0 ? fillcolor : trail_color;
+            direction coming_from = direction::West;
+            m_going_to = direction::East;
+            unsigned int matches_found = 0;
+            bool continue_loop = true;
+            do
+            {
+                step();
+                if (in_tile(m_col, m_row, currow))
+                {
+                    color = pixel(m_col, m_row);
+                    if (color == bkcolor && m_row >= top && m_row <= bottom
+                        && m_col >= left && m_col <= right)
+                        color = calc(m_col, m_row);
+                }
+                if (in_tile(m_col, m_row, currow) && color == trail_color)
+                {
+                    if (matches_found < 4) // to keep it from overflowing
+                        matches_found++;
+                    m_trail_row = m_row;
+                    m_trail_col = m_col;
+                    advance_match(coming_from);
+                }
+                else
+                {
+                    m_going_to = advance(m_going_to, 1);
+                    continue_loop = (m_going_to != coming_from) || (matches_found > 0);
+                }
+            }
+            while (continue_loop && (m_col != curcol || m_row != currow));
+
+            if (matches_found <= 3)
+            {   // no hole
+                color = bkcolor;
+                m_pc.reset_periodicity = true;
+                continue;
+            }
+
+            // fill in region by looping around again
+            m_trail_row = currow;
+            m_trail_col = curcol;
+            coming_from = direction::West;
+            m_going_to = direction::East;
+            do
+            {
+                bool match_found = false;
+                do
+                {
+                    step();
+                    if (in_tile(m_col, m_row, currow) && pixel(m_col, m_row) == trail_color)
+                    {
+                        if ((m_going_to == direction::South
+                                || (m_going_to == direction::West && coming_from != direction::East))
+                            && m_row >= top && m_row <= bottom)
+                        {   // fill a row, but only once
+                            int fill_right = m_col;
+                            int last = trail_color;
+                            while (--fill_right >= m_left)
+                            {
+                                last = pixel(fill_right, m_row);
+                                if (last != trail_color)
+                                    break;
+                            }
+                            if (last == bkcolor && fill_right >= left)
+                            {
+                                int fill_left = fill_right;
+                                while (fill_left > left && pixel(fill_left - 1, m_row) == bkcolor)
+                                    --fill_left;
+                                for (int x = fill_left; x <= fill_right; ++x)
+                                    pixel(x, m_row) = (BYTE) fillcolor_used;
+                            }
+                        }
+                        m_trail_row = m_row;
+                        m_trail_col = m_col;
+                        advance_match(coming_from);
+                        match_found = true;
+                    }
+                    else
+                        m_going_to = advance(m_going_to, 1);
+                }
+                while (!match_found && m_going_to != coming_from);
+
+                if (!match_found)
+                {   // next one has to be a match
+                    step();
+                    m_trail_row = m_row;
+                    m_trail_col = m_col;
+                    advance_match(coming_from);
+                }
+            }
+            while (m_trail_col != curcol || m_trail_row != currow);
+            m_pc.reset_periodicity = true; // reset after a trace/fill
+            color = bkcolor;
+        }
+    }
+}
+
+// can the threaded boundary trace and tesseral engines run?
+static bool pool_engine_ok()
+{
+    return calctype == calcmandfp
+        && !invert
+        && !(potflag && pot16bit)
+        && !truecolor
+        && !show_orbit
+        && work_pool_threads() > 1;
+}
+
+static int bound_trace_tiles()
+{
+    int const width = ixstop - ixstart + 1;
+    int const height = iystop - iystart + 1;
+    int const across = std::max(1, (width + TRACE_TILE - 2)/TRACE_TILE);
+    int const down = std::max(1, (height + TRACE_TILE - 2)/TRACE_TILE);
+    std::vector<BYTE> pixels((long)width*height);
+    for (int y = iystart; y <= iystop; ++y)
+        for (int x = ixstart; x <= ixstop; ++x)
+            pixels[(long)(y - iystart)*width + x - ixstart] = (BYTE) getcolor(x, y);
+    std::vector<BYTE> shown(pixels);    // what is on the screen
+
+    std::vector<trace_tile> tiles(across*down);
+    for (int j = 0; j < down; ++j)
+    {
+        for (int i = 0; i < across; ++i)
+        {
+            trace_tile &tile = tiles[j*across + i];
+            tile.left = ixstart + i*TRACE_TILE;
+            tile.top = iystart + j*TRACE_TILE;
+            tile.right = (i == across - 1) ? ixstop : tile.left + TRACE_TILE;
+            tile.bottom = (j == down - 1) ? iystop : tile.top + TRACE_TILE;
+        }
+    }
+
+    auto plot_changed = [&](int left, int top, int right, int bottom)
+    {
+        for (int y = top; y <= bottom; ++y)
+        {
+            for (int x = left; x <= right; ++x)
+            {
+                long const i = (long)(y - iystart)*width + x - ixstart;
+                if (pixels[i] != shown[i])
+                {
+                    shown[i] = pixels[i];
+                    (*plot)(x, y, pixels[i]);
+                }
+            }
+        }
+    };
+
+    got_status = 2;
+    work_pool pool(work_pool_threads());
+    for (int j = 1; j < down; ++j)
+        pool.push([&, j](int)
+        {
+            tile_tracer(pixels, pool).seam_row(iystart + j*TRACE_TILE);
+        });
+    for (int i = 1; i < across; ++i)
+        pool.push([&, i](int)
+        {
+            tile_tracer(pixels, pool).seam_col(ixstart + i*TRACE_TILE);
+        });
+    bool interrupted = false;
+    while (!pool.wait(10))
+    {
+        if (check_key())
+        {
+            interrupted = true;
+            break;
+        }
+    }
+
+    if (!interrupted)
+    {
+        plot_changed(ixstart, iystart, ixstop, iystop);
+        for (trace_tile &tile : tiles)
+            pool.push([&](int)
+            {
+                tile_tracer(pixels, pool).trace(tile);
+                tile.done = true;
+            });
+        std::vector<bool> plotted(tiles.size(), false);
+        bool all_done = false;
+        while (!all_done)
+        {
+            all_done = pool.wait(10);
+            for (size_t t = 0; t < tiles.size(); ++t)
+            {
+                if (!plotted[t] && tiles[t].done)
+                {
+                    plotted[t] = true;
+                    currow = tiles[t].top;
+                    plot_changed(tiles[t].left, tiles[t].top, tiles[t].right, tiles[t].bottom);
+                }
+            }
+            if (!all_done && check_key())
+            {
+                interrupted = true;
+                break;
+            }
+        }
+    }
+    if (!interrupted)
+        return 0;
+
+    pool.cancel();
+    while (!pool.wait(10))
+    {
+    }
+    plot_changed(ixstart, iystart, ixstop, iystop);
+    add_worklist(xxstart, xxstop, xxstart, yystart, yystop, yystart, 0, worksym);
+    return -1;
+}
+
 /******************* end of boundary trace method *******************/
 
 
@@ -3268,10 +4183,17 @@ static int solidguess()
 
     got_status = 1;
 
+    if (guess_ahead_ok())
+    {
+        s_guess_pool.reset(new work_pool(work_pool_threads()));
+        calctype = calcmandfp_guessed;
+    }
+
     if (workpass == 0) // otherwise first pass already done
     {
         // first pass, calc every blocksize**2 pixel, quarter result & paint it
         curpass = 1;
+        guess_ahead_pass(blocksize, true);
         if (iystart <= yystart) // first time for this window, init it
         {
             currow = 0;
@@ -3369,6 +4291,7 @@ static int solidguess()
             if (workpass >= stoppass)
                 goto exit_solidguess;
         curpass = workpass + 1;
+        guess_ahead_pass(blocksize, false);
         for (int y = iystart; y <= iystop; y += blocksize)
         {
             currow = y;
@@ -3391,6 +4314,7 @@ static int solidguess()
     }
 
 exit_solidguess:
+    guess_ahead_end();
     return 0;
 }
 
@@ -3706,6 +4630,295 @@ static void plotblock(int buildrow, int x, int y, int color)
             (*plot)(i, y, color);
 }
 
+/*
+   Threaded solid guessing for the fractals calcmandfp() handles.  Which
+   pixels a pass calculates depends on the colors found so far, and the
+   periodicity checking carries from one calculated pixel to the next, so
+   solidguess() and guessrow() still run on this thread in the serial
+   order.  Ahead of them the work pool calculates, a row of blocks at a
+   time, the pixels the pass will most likely ask for: the whole grid of
+   the first pass, and the new pixels of each block whose corners, or the
+   corners of the block above or to the left, differ.  The skip flags of
+   the first pass leave out the same blocks guessrow() skips.
+   calcmandfp_guessed() hands guessrow() such a pixel when
+   calcmandfp_same_result() says the serial calculation gives the same,
+   and calculates it itself otherwise, so the image is identical to the
+   serial one.
+*/
+static bool guess_ahead_ok()
+{
+    return calctype == calcmandfp
+        && !invert
+        && !(potflag && pot16bit)
+        && !truecolor
+        && !show_orbit
+        && work_pool_threads() > 1;
+}
+
+// band and index of (x, y) if it is on the halfblock grid of the pass
+static bool guess_position(int x, int y, int &band, int &pos)
+{
+    int const half = s_guess_block >> 1;
+    int const dy = y - s_guess_top;
+    if (dy < 0 || y > iystop || x < ixstart || x > ixstop
+        || (x - ixstart) % half != 0 || dy % half != 0)
+        return false;
+    band = dy/s_guess_block;
+    pos = ((dy % s_guess_block) ? s_guess_cols : 0) + (x - ixstart)/half;
+    return band < static_cast<int>(s_guess_bands.size());
+}
+
+static void guess_add(guess_band &band, int x, int y)
+{
+    int b;
+    int pos;
+    if (!guess_position(x, y, b, pos) || band.index[pos] >= 0)
+        return;
+    band.index[pos] = static_cast<int>(band.dots.size());
+    guess_dot dot;
+    dot.pc.row = y;
+    dot.pc.col = x;
+    dot.pc.init.x = dxpixel_rc(y, x);
+    dot.pc.init.y = dypixel_rc(y, x);
+    dot.pc.oldcoloriter = 0;
+    dot.pc.reset_periodicity = false;
+    dot.pc.show_orbit = false;
+    dot.start = 0;
+    band.dots.push_back(dot);
+}
+
+// calculate dots [first, end) in order, the periodicity carrying from one
+// to the next the way it does for calcmandfp(); seed starts the first
+static void guess_calc_dots(work_pool const &pool, guess_band &band, int first,
+                            pixel_context seed)
+{
+    for (int i = first; i < static_cast<int>(band.dots.size()); ++i)
+    {
+        if (pool.cancelled())
+            break;
+        pixel_context &pc = band.dots[i].pc;
+        pc.oldcoloriter = (i == first) ? seed.oldcoloriter : band.dots[i-1].pc.oldcoloriter;
+        pc.reset_periodicity = i == first && seed.reset_periodicity;
+        band.dots[i].start = calcmandfp_check_start(pc);
+        calcmandfp_pixel(pc);
+    }
+    band.done = true;
+}
+
+static void guess_queue(guess_band &band, int first, pixel_context const &seed)
+{
+    if (first == static_cast<int>(band.dots.size()))
+    {
+        band.done = true;
+        return;
+    }
+    band.done = false;
+    work_pool *pool = s_guess_pool.get();
+    pool->push([pool, &band, first, seed](int)
+    {
+        guess_calc_dots(*pool, band, first, seed);
+    });
+}
+
+// grid color at (x, y) as guessrow() sees it, -1 past the edges
+static int guess_grid_color(int x, int y)
+{
+    if (x > ixstop || y > iystop)
+        return -1;
+    return s_guess_grid[((y - s_guess_top)/s_guess_block)*s_guess_grid_cols
+                        + (x - ixstart)/s_guess_block];
+}
+
+static bool guess_block_differs(int x, int y)
+{
+    if (x < ixstart || y < s_guess_top)
+        return false;
+    int const c = guess_grid_color(x, y);
+    return c != guess_grid_color(x + s_guess_block, y)
+        || c != guess_grid_color(x, y + s_guess_block)
+        || c != guess_grid_color(x + s_guess_block, y + s_guess_block);
+}
+
+// pick the pixels of band k that guessrow() will likely calculate, in the
+// order it calculates them, and queue them
+static void guess_queue_band(int k)
+{
+    guess_band &band = s_guess_bands[k];
+    int const first = static_cast<int>(band.dots.size());
+    int const block = s_guess_block;
+    int const half = block >> 1;
+    int const y = s_guess_top + k*block;
+    for (int x = ixstart; x <= ixstop; x += block)
+    {
+        if (!s_guess_firstpass)
+        {
+            int const i = y/maxblock;
+            if ((tprefix[0][(i >> 4) + 1][x/maxblock + 1] & (1 << (i & 15))) == 0)
+                continue;               // guessrow() skips it
+        }
+        bool const differs = guess_block_differs(x, y);
+        if (differs)
+            guess_add(band, x + half, y + half);
+        if (differs || guess_block_differs(x, y - block))
+            guess_add(band, x + half, y);
+        if (differs || guess_block_differs(x - block, y))
+            guess_add(band, x, y + half);
+    }
+
+    // in the first pass the grid row below is calculated right before
+    pixel_context seed;
+    seed.oldcoloriter = 0;
+    seed.reset_periodicity = true;
+    if (s_guess_firstpass && k + 1 < static_cast<int>(s_guess_bands.size()))
+    {
+        guess_band const &below = s_guess_bands[k + 1];
+        int const i = below.index[(s_guess_grid_cols - 1)*2];
+        if (i >= 0)
+        {
+            seed.oldcoloriter = below.dots[i].pc.oldcoloriter;
+            seed.reset_periodicity = false;
+        }
+    }
+    guess_queue(band, first, seed);
+}
+
+// guessrow() is at band k: keep the pool busy ahead of it and let go of
+// the bands it is done with; it still fixes pixels in the band above
+static void guess_queue_ahead(int k)
+{
+    int const num = static_cast<int>(s_guess_bands.size());
+    int const ahead = k + GUESS_AHEAD*s_guess_pool->size();
+    while (s_guess_queued <= ahead && s_guess_queued < num)
+        guess_queue_band(s_guess_queued++);
+    while (s_guess_released < k - 2 && s_guess_bands[s_guess_released].done)
+    {
+        guess_band &band = s_guess_bands[s_guess_released++];
+        std::vector<guess_dot>().swap(band.dots);
+        std::vector<int>().swap(band.index);
+    }
+}
+
+static void guess_ahead_end()
+{
+    if (!s_guess_pool)
+        return;
+    s_guess_pool.reset();               // waits for the running tasks
+    std::vector<guess_band>().swap(s_guess_bands);
+    std::vector<int>().swap(s_guess_grid);
+    calctype = calcmandfp;
+}
+
+// start calculating ahead for a pass of solidguess()
+static void guess_ahead_pass(int blocksize, bool firstpass)
+{
+    if (!s_guess_pool)
+        return;
+    int const threads = s_guess_pool->size();
+    s_guess_pool.reset();               // drop what is left of the pass before
+    s_guess_pool.reset(new work_pool(threads));
+    s_guess_block = blocksize;
+    s_guess_top = iystart;
+    s_guess_firstpass = firstpass;
+    s_guess_cols = (ixstop - ixstart)/(blocksize >> 1) + 1;
+    s_guess_grid_cols = (ixstop - ixstart)/blocksize + 1;
+    s_guess_queued = 0;
+    s_guess_released = 0;
+    int const num = (iystart <= iystop) ? (iystop - iystart)/blocksize + 1 : 0;
+    std::vector<guess_band>(num).swap(s_guess_bands);
+    for (guess_band &band : s_guess_bands)
+        band.index.assign(2*s_guess_cols, -1);
+    s_guess_grid.assign((size_t) num*s_guess_grid_cols, 0);
+
+    if (firstpass)
+    {
+        // the grid rows, each calculated left to right from a periodicity
+        // reset, as solidguess() does; the top one only for a new window
+        pixel_context seed;
+        seed.oldcoloriter = 0;
+        seed.reset_periodicity = true;
+        for (int k = (iystart <= yystart) ? 0 : 1; k < num; ++k)
+        {
+            for (int x = ixstart; x <= ixstop; x += blocksize)
+                guess_add(s_guess_bands[k], x, iystart + k*blocksize);
+            guess_queue(s_guess_bands[k], 0, seed);
+        }
+        while (!s_guess_pool->wait(10))
+            if (check_key())
+            {
+                guess_ahead_end();      // calcmandfp() sees the key too
+                return;
+            }
+    }
+    for (int k = 0; k < num; ++k)
+    {
+        int const y = iystart + k*blocksize;
+        for (int j = 0; j < s_guess_grid_cols; ++j)
+        {
+            int const x = ixstart + j*blocksize;
+            int color;
+            int const i = s_guess_bands[k].index[2*j];
+            if (firstpass && i >= 0)
+            {
+                pixel_context pc = s_guess_bands[k].dots[i].pc;
+                color = calcmandfp_color(pc.coloriter, pc.realcoloriter, pc.magnitude);
+            }
+            else
+                color = getcolor(x, y);
+            s_guess_grid[(size_t) k*s_guess_grid_cols + j] = color;
+        }
+    }
+    guess_queue_ahead(0);
+}
+
+// calctype while guessing ahead, calcmandfp() using the pixels calculated
+static int calcmandfp_guessed()
+{
+    int band;
+    int pos;
+    if (show_orbit || !guess_position(col, row, band, pos))
+        return calcmandfp();
+    guess_queue_ahead(band);
+    guess_band &b = s_guess_bands[band];
+    int const i = b.index.empty() ? -1 : b.index[pos];
+    if (i < 0)
+        return calcmandfp();
+    while (!b.done)
+    {
+        if (check_key())
+        {
+            coloriter = -1;
+            return -1;
+        }
+        s_guess_pool->wait(10);
+    }
+    pixel_context const &pc = b.dots[i].pc;
+    pixel_context serial;
+    serial.oldcoloriter = oldcoloriter;
+    serial.reset_periodicity = reset_periodicity;
+    if (!calcmandfp_same_result(pc, b.dots[i].start, calcmandfp_check_start(serial)))
+        return calcmandfp();
+    kbdcount -= pc.iterations;
+    if (kbdcount < 0)
+    {
+        kbdcount = 1000;
+        if (check_key())
+        {
+            coloriter = -1;
+            return -1;
+        }
+    }
+    init = pc.init;
+    oldcoloriter = pc.oldcoloriter;
+    realcoloriter = pc.realcoloriter;
+    coloriter = pc.coloriter;
+    magnitude = pc.magnitude;
+    if (realcoloriter < maxit && outside <= REAL)
+        g_new = pc.z;
+    color = calcmandfp_color(coloriter, realcoloriter, magnitude);
+    (*plot)(col, row, color);
+    return color;
+}
+
 
 /************************* symmetry plot setup ************************/
 
@@ -3806,13 +5019,14 @@ static void setsymmetry(symmetry_type sym, bool uselist) // set up proper symmet
         plot = noplot;
         return;
     }
-    // NOTE: 16-bit potential disables symmetry
+    // NOTE: 16-bit potential, pngout= and itercache= disable symmetry
     // also any decomp= option and any inversion not about the origin
     // also any rotation other than 180deg and any off-axis stretch
     if (bf_math != bf_math_type::NONE)
         if (cmp_bf(bfxmin, bfx3rd) || cmp_bf(bfymin, bfy3rd))
             return;
     if ((potflag && pot16bit) || (invert && inversion[2] != 0.0)
+            || g_png_out != png_out_kind::NONE || iter_cache_filling()
             || decomp[0] != 0
             || xxmin != xx3rd || yymin != yy3rd)
         return;
@@ -4049,6 +5263,9 @@ struct tess             // one of these per box to be done gets stacked
     int top, bot, lft, rgt;  // edge colors, -1 mixed, -2 unknown
 };
 
+static int tesseral_pool(tess const *stack, int boxes);
+static void tess_add_worklist(tess const &box);
+
 static int tesseral()
 {
     tess *tp;
@@ -4122,6 +5339,9 @@ static int tesseral()
 
     got_status = 4; // for tab_display
 
+    if (pool_engine_ok())
+        return tesseral_pool((tess *)&dstack[0], (int)(tp - (tess *)&dstack[0]) + 1);
+
     while (tp >= (tess *)&dstack[0])
     { // do next box
         curcol = tp->x1; // for tab_display
@@ -4272,29 +5492,35 @@ tess_split:
 tess_end:
     if (tp >= (tess *)&dstack[0])
     { // didn't complete
-        int i, xsize, ysize;
-        ysize = 1;
-        xsize = ysize;
-        i = 2;
-        while (tp->x2 - tp->x1 - 2 >= i)
-        {
-            i <<= 1;
-            ++xsize;
-        }
-        i = 2;
-        while (tp->y2 - tp->y1 - 2 >= i)
-        {
-            i <<= 1;
-            ++ysize;
-        }
-        add_worklist(xxstart, xxstop, xxstart, yystart, yystop,
-                     (ysize << 12)+tp->y1, (xsize << 12)+tp->x1, worksym);
+        tess_add_worklist(*tp);
         return -1;
     }
     return 0;
 
 } // tesseral
 
+// save box as the place to resume, the boxes after it are redone
+static void tess_add_worklist(tess const &box)
+{
+    int i, xsize, ysize;
+    ysize = 1;
+    xsize = ysize;
+    i = 2;
+    while (box.x2 - box.x1 - 2 >= i)
+    {
+        i <<= 1;
+        ++xsize;
+    }
+    i = 2;
+    while (box.y2 - box.y1 - 2 >= i)
+    {
+        i <<= 1;
+        ++ysize;
+    }
+    add_worklist(xxstart, xxstop, xxstart, yystart, yystop,
+                 (ysize << 12)+box.y1, (xsize << 12)+box.x1, worksym);
+}
+
 static int tesschkcol(int x, int y1, int y2)
 {
     int i;
@@ -4356,6 +5582,352 @@ static int tessrow(int x1, int x2, int y)
     return rowcolor;
 }
 
+/*
+   Threaded tesseral, for the fractals calcmandfp() handles.  Each box is a
+   task which checks its edges and calculates its middle line into a copy
+   of the window, then fills the box or pushes its two halves for any
+   thread to take; boxes under TESS_INLINE pixels do their halves in the
+   same task.  A box writes only inside itself and its halves only read
+   the line between them, so the image is the one tesseral() makes.  The
+   tasks pass their finished lines and fills to this thread to plot.
+
+   On an interrupt the first unfinished box, in the order tesseral() takes
+   them, goes on the worklist, and resuming redoes the boxes after it.  A
+   box whose halves are all done is freed at once, so only the boxes still
+   being worked on are kept, which is all tess_unfinished() needs.
+*/
+#define TESS_INLINE 1024
+
+struct tess_node
+{
+    tess box;
+    tess_node *parent;
+    std::atomic<bool> done;
+    std::atomic<int> pending;               // its own turn and unfinished halves
+    std::unique_ptr<tess_node> first;       // left or top half, null once finished
+    std::unique_ptr<tess_node> second;
+    tess_node(tess const &b, tess_node *p) : box(b), parent(p), done(false), pending(1)
+    {
+    }
+};
+
+struct tess_plot                // a finished line or fill
+{
+    int x1, y1, x2, y2;
+    int color;                  // -1 for the calculated pixels
+};
+
+struct tess_state
+{
+    std::vector<BYTE> pixels;   // copy of the window
+    int width;
+    int xorg, yorg;
+    work_pool *pool;
+    std::mutex lock;
+    std::vector<tess_plot> plots;   // waiting for this thread
+};
+
+static BYTE &tess_pixel(tess_state &ts, int x, int y)
+{
+    return ts.pixels[(long)(y - ts.yorg)*ts.width + x - ts.xorg];
+}
+
+static void tess_post(tess_state &ts, int x1, int y1, int x2, int y2, int color)
+{
+    tess_plot const p = { x1, y1, x2, y2, color };
+    std::lock_guard<std::mutex> guard(ts.lock);
+    ts.plots.push_back(p);
+}
+
+// tesscol() or tessrow() into the copy, from x, y to last
+static int tess_line(tess_state &ts, int x, int y, int last, bool column)
+{
+    pixel_context pc;
+    pc.oldcoloriter = 0;
+    pc.reset_periodicity = true;
+    pc.show_orbit = false;
+    int const x1 = x;
+    int const y1 = y;
+    int linecolor = -2;
+    do
+    {
+        int const i = calcmandfp_at(pc, x, y);
+        tess_pixel(ts, x, y) = (BYTE) i;
+        if (linecolor == -2)
+            linecolor = i;
+        else if (i != linecolor)
+            linecolor = -1;
+        if (column)
+            ++y;
+        else
+            ++x;
+    }
+    while ((column ? y : x) <= last);
+    tess_post(ts, x1, y1, column ? x1 : last, column ? last : y1, -1);
+    return linecolor;
+}
+
+// tesschkcol() on the copy
+static int tess_check_col(tess_state &ts, int x, int y1, int y2)
+{
+    int const i = tess_pixel(ts, x, ++y1);
+    while (--y2 > y1)
+        if (tess_pixel(ts, x, y2) != i)
+            return -1;
+    return i;
+}
+
+// tesschkrow() on the copy
+static int tess_check_row(tess_state &ts, int x1, int x2, int y)
+{
+    int const i = tess_pixel(ts, x1, y);
+    while (x2 > x1)
+    {
+        if (tess_pixel(ts, x2, y) != i)
+            return -1;
+        --x2;
+    }
+    return i;
+}
+
+/* Called when node's turn or one of its halves is finished.  Once all
+   of them are, node goes from its parent, which may then be finished. */
+static void tess_finished(tess_node &node)
+{
+    if (--node.pending != 0)
+        return;
+    tess_node *const parent = node.parent;
+    if (parent == nullptr)
+        return;                 // the roots stay until the end
+    if (parent->first.get() == &node)
+        parent->first.reset();
+    else
+        parent->second.reset();
+    tess_finished(*parent);
+}
+
+// one turn of the tesseral() loop for node's box
+static void tess_box(tess_state &ts, tess_node &node)
+{
+    if (ts.pool->cancelled())
+        return;
+    tess &tp = node.box;
+    bool const down = tp.x2 - tp.x1 > tp.y2 - tp.y1;   // divide down the middle
+    int const mid = down ? (tp.x1 + tp.x2) >> 1 : (tp.y1 + tp.y2) >> 1;
+    int midcolor = -2;
+    auto middle = [&]()
+    {
+        midcolor = down ? tess_line(ts, mid, tp.y1+1, tp.y2-1, true)
+                        : tess_line(ts, tp.x1+1, mid, tp.x2-1, false);
+    };
+    auto solid = [&]()
+    {
+        if (tp.top == -1 || tp.bot == -1 || tp.lft == -1 || tp.rgt == -1)
+            return false;
+        // for any edge whose color is unknown, set it
+        if (tp.top == -2)
+            tp.top = tess_check_row(ts, tp.x1, tp.x2, tp.y1);
+        if (tp.top == -1)
+            return false;
+        if (tp.bot == -2)
+            tp.bot = tess_check_row(ts, tp.x1, tp.x2, tp.y2);
+        if (tp.bot != tp.top)
+            return false;
+        if (tp.lft == -2)
+            tp.lft = tess_check_col(ts, tp.x1, tp.y1, tp.y2);
+        if (tp.lft != tp.top)
+            return false;
+        if (tp.rgt == -2)
+            tp.rgt = tess_check_col(ts, tp.x2, tp.y1, tp.y2);
+        if (tp.rgt != tp.top)
+            return false;
+        middle();
+        return midcolor == tp.top;
+    };
+
+    if (solid())
+    {   // all 4 edges are the same color, fill in
+        if (fillcolor != 0)
+            tess_post(ts, tp.x1+1, tp.y1+1, tp.x2-1, tp.y2-1,
+                      fillcolor > 0 ? fillcolor % colors : tp.top);
+        node.done = true;
+        tess_finished(node);
+        return;
+    }
+
+    // box not surrounded by same color, sub-divide
+    if (midcolor == -2)
+        middle();
+    if (down && tp.x2 - mid > 1)
+    {   // right part >= 1 column
+        if (tp.top == -1)
+            tp.top = -2;
+        if (tp.bot == -1)
+            tp.bot = -2;
+        if (mid - tp.x1 > 1)
+        {
+            node.first.reset(new tess_node(tp, &node));
+            node.first->box.x2 = mid;
+            node.first->box.rgt = midcolor;
+        }
+        node.second.reset(new tess_node(tp, &node));
+        node.second->box.x1 = mid;
+        node.second->box.lft = midcolor;
+    }
+    else if (!down && tp.y2 - mid > 1)
+    {   // bottom part >= 1 row
+        if (tp.lft == -1)
+            tp.lft = -2;
+        if (tp.rgt == -1)
+            tp.rgt = -2;
+        if (mid - tp.y1 > 1)
+        {
+            node.first.reset(new tess_node(tp, &node));
+            node.first->box.y2 = mid;
+            node.first->box.bot = midcolor;
+        }
+        node.second.reset(new tess_node(tp, &node));
+        node.second->box.y1 = mid;
+        node.second->box.top = midcolor;
+    }
+    tess_node *const first = node.first.get();
+    tess_node *const second = node.second.get();
+    node.pending += (first != nullptr) + (second != nullptr);
+    node.done = true;
+
+    if ((long)(tp.x2 - tp.x1)*(tp.y2 - tp.y1) < TESS_INLINE)
+    {
+        if (first != nullptr)
+            tess_box(ts, *first);
+        if (second != nullptr)
+            tess_box(ts, *second);
+    }
+    else
+    {
+        // the first half is pushed last, so this thread takes it next
+        for (tess_node *half : { second, first })
+        {
+            if (half != nullptr)
+            {
+                tess_state *state = &ts;
+                ts.pool->push([state, half](int)
+                {
+                    tess_box(*state, *half);
+                });
+            }
+        }
+    }
+    tess_finished(node);
+}
+
+// plot a line or fill the way tesseral() does
+static void tess_show(tess_state &ts, tess_plot const &p)
+{
+    curcol = p.x1; // for tab_display
+    currow = p.y1;
+    if (p.color < 0)
+    {
+        for (int y = p.y1; y <= p.y2; y++)
+            for (int x = p.x1; x <= p.x2; x++)
+                (*plot)(x, y, tess_pixel(ts, x, y));
+        return;
+    }
+    int const j = p.x2 - p.x1 + 1;
+    if (guessplot || j < 2)
+    { // paint dots
+        for (int x = p.x1; x <= p.x2; x++)
+            for (int y = p.y1; y <= p.y2; y++)
+                (*plot)(x, y, p.color);
+        return;
+    }
+    // use put_line for speed
+    memset(&dstack[OLDMAXPIXELS], p.color, j);
+    for (int y = p.y1; y <= p.y2; y++)
+    {
+        put_line(y, p.x1, p.x2, &dstack[OLDMAXPIXELS]);
+        if (plot != putcolor) // symmetry
+        {
+            int const sym = yystop-(y-yystart);
+            if (sym > iystop && sym < ydots)
+                put_line(sym, p.x1, p.x2, &dstack[OLDMAXPIXELS]);
+        }
+    }
+}
+
+// the first box, in the order tesseral() takes them, not yet done
+static tess_node const *tess_unfinished(tess_node const &node)
+{
+    if (!node.done)
+        return &node;
+    for (tess_node const *half : { node.first.get(), node.second.get() })
+        if (half != nullptr)
+            if (tess_node const *box = tess_unfinished(*half))
+                return box;
+    return nullptr;
+}
+
+// run the boxes of tesseral()'s stack, the last one first, on the pool
+static int tesseral_pool(tess const *stack, int boxes)
+{
+    tess_state ts;
+    ts.width = ixstop - ixstart + 1;
+    ts.xorg = ixstart;
+    ts.yorg = iystart;
+    ts.pixels.resize((long)ts.width*(iystop - iystart + 1));
+    for (int y = iystart; y <= iystop; ++y)
+        for (int x = ixstart; x <= ixstop; ++x)
+            tess_pixel(ts, x, y) = (BYTE) getcolor(x, y);
+
+    std::vector<std::unique_ptr<tess_node>> roots;
+    for (int i = boxes - 1; i >= 0; --i)
+        roots.emplace_back(new tess_node(stack[i], nullptr));
+
+    work_pool pool(work_pool_threads());
+    ts.pool = &pool;
+    for (auto &root : roots)
+    {
+        tess_node *node = root.get();
+        pool.push([&ts, node](int)
+        {
+            tess_box(ts, *node);
+        });
+    }
+
+    std::vector<tess_plot> plots;
+    bool interrupted = false;
+    bool all_done;
+    do
+    {
+        all_done = pool.wait(10);
+        {
+            std::lock_guard<std::mutex> guard(ts.lock);
+            plots.swap(ts.plots);
+        }
+        for (tess_plot const &p : plots)
+            tess_show(ts, p);
+        plots.clear();
+        if (!all_done && !interrupted && check_key())
+        {
+            interrupted = true;
+            pool.cancel();
+        }
+    }
+    while (!all_done);
+
+    if (interrupted)
+    {
+        for (auto const &root : roots)
+        {
+            if (tess_node const *box = tess_unfinished(*root))
+            {
+                tess_add_worklist(box->box);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
 // added for testing autologmap()
 // insert at end of CALCFRAC.C
 
@@ -4,7 +4,18 @@
  * This file Copyright 1992 Ken Shirriff.  It may be used according to the
  * fractint license conditions, blah blah blah.
  */
+#include <algorithm>
+
 #include <float.h>
+#include <math.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
 #include "port.h"
 #include "prototyp.h"
 #include "fractype.h"
@@ -16,56 +27,165 @@ extern int nextsavedincr;
 
 static int inside_color, periodicity_color;
 
+/* Interior detection.  A Mandelbrot pixel in the main cardioid or the
+   period 2 bulb is inside, which a closed-form test tells before any
+   iterating.  A Julia set of a parameter in those components has an
+   attracting fixed point or 2-cycle, and the derivative there gives a
+   ball around each cycle point that the map (or its second iterate)
+   shrinks into itself; an orbit that comes into a ball is inside.
+   Either way the pixel gets the color it would get at maxit. */
+static bool cardioid_test;
+static cycle_balls julia_cycle;
+
 void calcmandfpasmstart()
 {
     inside_color = (inside < COLOR_BLACK) ? maxit : inside;
     periodicity_color = (periodicitycheck < 0) ? 7 : inside_color;
     oldcoloriter = 0;
+    cardioid_test = false;
+    julia_cycle.num = 0;
+    if (periodicitycheck < 0)
+    {
+        return;                 // showing what periodicity checking catches
+    }
+    if (fractype != fractal_type::JULIAFP && fractype != fractal_type::JULIA)
+    {
+        // a pixel in either stays within |z|^2 < 3 so must not bail out there
+        cardioid_test = parm.x == 0.0 && parm.y == 0.0 && rqlim > 3.0;
+    }
+    else
+    {
+        julia_cycle_balls(parm, julia_cycle);
+    }
 }
 
-#define ABS(x) ((x) < 0?-(x):(x))
+/* Is c = x + iy in the main cardioid or the period 2 bulb of the
+   Mandelbrot set? */
+bool mandel_interior(double x, double y)
+{
+    double const y2 = y*y;
+    double const q = (x - 0.25)*(x - 0.25) + y2;
+    if (q*(q + (x - 0.25)) < 0.25*y2)
+    {
+        return true;
+    }
+    return (x + 1.0)*(x + 1.0) + y2 < 0.0625;
+}
 
-/* If USE_NEW is 1, the magnitude is used for periodicity checking instead
-   of the x and y values.  This is experimental. */
-#define USE_NEW 0
+static void add_ball(cycle_balls &balls, double x, double y, double r, double reach)
+{
+    // the orbit must not bail out anywhere it can go from the ball
+    if (reach*reach < rqlim)
+    {
+        balls.x[balls.num] = x;
+        balls.y[balls.num] = y;
+        balls.r2[balls.num] = r*r;
+        balls.num++;
+    }
+}
 
-long calcmandfpasm()
+/* The radius d of a ball around a, a point of an attracting 2-cycle a, b,
+   in which z^2 + c moves z to within d*(d + 2|a|) of b and then back to
+   within shrink*d of a. */
+static double cycle2_radius(double mod_a, double mod_b, double shrink)
 {
-    long cx;
-    long savedand;
-    int savedincr;
-    long tmpfsd;
-#if USE_NEW
-    double x, y, x2, y2, xy, Cx, Cy, savedmag;
-#else
-    double x, y, x2, y2, xy, Cx, Cy, savedx, savedy;
-#endif
+    double lo = 0.0;
+    double hi = 1.0;
+    for (int i = 0; i < 50; i++)
+    {
+        double const d = (lo + hi)/2;
+        if ((d + 2*mod_a)*(d*(d + 2*mod_a) + 2*mod_b) <= shrink)
+        {
+            lo = d;
+        }
+        else
+        {
+            hi = d;
+        }
+    }
+    return lo;
+}
 
-    if (periodicitycheck == 0)
+/* The balls around the attracting cycle of z^2 + c, if it has one, for
+   an orbit that bails out when |z|^2 reaches rqlim. */
+void julia_cycle_balls(DComplex const &c, cycle_balls &balls)
+{
+    balls.num = 0;
+
+    // fixed points (1 +- sqrt(1 - 4c))/2 with multiplier 2z
+    DComplex const s = ComplexSqrtFloat(1.0 - 4.0*c.x, -4.0*c.y);
+    for (int sign = -1; sign <= 1; sign += 2)
     {
-        oldcoloriter = 0;      // don't check periodicity
+        double const x = (1.0 + sign*s.x)/2;
+        double const y = sign*s.y/2;
+        double const mod = sqrt(x*x + y*y);
+        if (2*mod < 1.0)
+        {
+            // |z^2 + c - z*| = |z - z*||z + z*| <= (1 + 2|z*|)/2 |z - z*|
+            double const r = (1.0 - 2*mod)/2;
+            add_ball(balls, x, y, r, mod + r);
+        }
     }
-    else if (reset_periodicity)
+
+    // 2-cycle (-1 +- sqrt(-3 - 4c))/2 with multiplier 4(c + 1)
+    double const lambda = 4*sqrt((c.x + 1.0)*(c.x + 1.0) + c.y*c.y);
+    if (lambda < 1.0)
     {
-        oldcoloriter = maxit - 255;
+        DComplex const t = ComplexSqrtFloat(-3.0 - 4.0*c.x, -4.0*c.y);
+        double const ax = (-1.0 + t.x)/2;
+        double const ay = t.y/2;
+        double const bx = (-1.0 - t.x)/2;
+        double const by = -t.y/2;
+        double const mod_a = sqrt(ax*ax + ay*ay);
+        double const mod_b = sqrt(bx*bx + by*by);
+        double const shrink = (1.0 + lambda)/2;
+        double const ra = cycle2_radius(mod_a, mod_b, shrink);
+        double const rb = cycle2_radius(mod_b, mod_a, shrink);
+        double const reach_a = std::max(mod_a + ra, mod_b + ra*(ra + 2*mod_a));
+        double const reach_b = std::max(mod_b + rb, mod_a + rb*(rb + 2*mod_b));
+        add_ball(balls, ax, ay, ra, reach_a);
+        add_ball(balls, bx, by, rb, reach_b);
     }
+}
 
-    tmpfsd = maxit - firstsavedand;
-    if (oldcoloriter > tmpfsd) // this defeats checking periodicity immediately
+bool in_cycle_balls(cycle_balls const &balls, double x, double y)
+{
+    for (int i = 0; i < balls.num; i++)
     {
-        oldcoloriter = tmpfsd; // but matches the code in StandardFractal()
+        double const dx = x - balls.x[i];
+        double const dy = y - balls.y[i];
+        if (dx*dx + dy*dy < balls.r2[i])
+        {
+            return true;
+        }
     }
+    return false;
+}
 
-    // initparms
-#if USE_NEW
-    savedmag = 0;
+#define ABS(x) ((x) < 0?-(x):(x))
+
+/* If USE_NEW is 1, the magnitude is used for periodicity checking instead
+   of the x and y values.  This is experimental. */
+#define USE_NEW 0
+
+/* The SIMD loops must do exactly the same arithmetic as the scalar one,
+   which only holds where scalar doubles use SSE2 as well. */
+#if !USE_NEW && (defined(__x86_64__) || defined(_M_X64))
+#define MANDFP_SIMD 1
+#if defined(__GNUC__)
+#define MANDFP_AVX2 __attribute__((target("avx2")))
 #else
-    savedx = 0;
-    savedy = 0;
+#define MANDFP_AVX2
+#endif
+#else
+#define MANDFP_SIMD 0
 #endif
+
+long calcmandfpasm()
+{
+    pixel_context pc;
+
     orbit_ptr = 0;
-    savedand = firstsavedand;
-    savedincr = 1;             // start checking the very first time
     kbdcount--;                // Only check the keyboard sometimes
     if (kbdcount < 0)
     {
@@ -87,28 +207,245 @@ long calcmandfpasm()
         }
     }
 
-    cx = maxit;
+    pc.row = row;
+    pc.col = col;
+    pc.init = init;
+    pc.oldcoloriter = oldcoloriter;
+    pc.reset_periodicity = reset_periodicity;
+    pc.show_orbit = show_orbit;
+    calcmandfp_pixel(pc);
+
+    oldcoloriter = pc.oldcoloriter;
+    realcoloriter = pc.realcoloriter;
+    coloriter = pc.coloriter;
+    magnitude = pc.magnitude;
+    if (pc.realcoloriter < maxit && (outside <= REAL || iter_cache_filling()))
+        g_new = pc.z;
+    kbdcount -= pc.iterations;
+    if (orbit_ptr)
+    {
+        scrub_orbit();
+    }
+    return coloriter;
+}
+
+/* Where calcmandfp_pixel() starts checking periodicity for pc: the loop
+   counts down from maxit and checks once the count is below this. */
+long calcmandfp_check_start(pixel_context const &pc)
+{
+    long start = pc.oldcoloriter;
+    long tmpfsd;
+
+    if (periodicitycheck == 0)
+    {
+        start = 0;                // don't check periodicity
+    }
+    else if (pc.reset_periodicity)
+    {
+        start = maxit - 255;
+    }
+
+    tmpfsd = maxit - firstsavedand;
+    if (start > tmpfsd)         // this defeats checking periodicity immediately
+    {
+        start = tmpfsd;         // but matches the code in StandardFractal()
+    }
+    return start;
+}
+
+// periodicity setup shared by the scalar and SIMD loops
+static void mandfp_reset_periodicity(pixel_context &pc)
+{
+    pc.oldcoloriter = calcmandfp_check_start(pc);
+}
+
+/* Is pc, calculated with periodicity checking from start, also what
+   calcmandfp_pixel() gives when checking from other_start?  It is when
+   both start at the same count, when the orbit escapes before other_start
+   would check it, and when the orbit ran to maxit without a cycle or was
+   found inside by interior detection, as a cycle found earlier colors it
+   inside as well. */
+bool calcmandfp_same_result(pixel_context const &pc, long start, long other_start)
+{
+    if (start == other_start)
+    {
+        return true;
+    }
+    if (pc.realcoloriter < maxit)
+    {
+        return other_start <= maxit - pc.realcoloriter + 1;
+    }
+    if (pc.interior)
+    {
+        return true;
+    }
+    return pc.iterations == maxit && periodicitycheck > 0;
+}
+
+// the orbit value going into the loop
+static void mandfp_start(pixel_context const &pc, double &x, double &y)
+{
     if (fractype != fractal_type::JULIAFP && fractype != fractal_type::JULIA)
     {
         // Mandelbrot_87
-        Cx = init.x;
-        Cy = init.y;
-        x = parm.x+Cx;
-        y = parm.y+Cy;
+        x = parm.x+pc.init.x;
+        y = parm.y+pc.init.y;
     }
     else
     {
         // dojulia_87
+        double const x2 = pc.init.x*pc.init.x;
+        double const y2 = pc.init.y*pc.init.y;
+        double const xy = pc.init.x*pc.init.y;
+        x = x2-y2+parm.x;
+        y = 2*xy+parm.y;
+    }
+}
+
+// the loop found a cycle
+static void mandfp_periodic(pixel_context &pc, long cx, double mag)
+{
+    //          oldcoloriter = 65535;
+    pc.oldcoloriter = maxit;
+    pc.realcoloriter = maxit;
+    pc.iterations = maxit-cx;
+    pc.coloriter = periodicity_color;
+    pc.magnitude = mag;
+}
+
+// reached maxit
+static void mandfp_inside(pixel_context &pc, double mag)
+{
+    // check periodicity immediately next time, remember we count down from maxit
+    pc.oldcoloriter = maxit;
+    pc.iterations = maxit;
+    pc.realcoloriter = maxit;
+    pc.coloriter = inside_color;
+    pc.magnitude = mag;
+}
+
+// found inside by interior detection after maxit - cx iterations
+static void mandfp_interior(pixel_context &pc, long cx, double mag)
+{
+    pc.oldcoloriter = maxit;
+    pc.iterations = maxit-cx;
+    pc.realcoloriter = maxit;
+    pc.coloriter = inside_color;
+    pc.magnitude = mag;
+    pc.interior = true;
+}
+
+// over_bailout_87
+static void mandfp_bailout(pixel_context &pc, long cx, double x, double y, double mag)
+{
+    pc.z.x = x;
+    pc.z.y = y;
+    pc.magnitude = mag;
+    if (cx-10 > 0)
+    {
+        pc.oldcoloriter = cx-10;
+    }
+    else
+    {
+        pc.oldcoloriter = 0;
+    }
+    pc.realcoloriter = maxit-cx;
+    pc.coloriter = pc.realcoloriter;
+    if (pc.coloriter == 0)
+    {
+        pc.coloriter = 1;
+    }
+    pc.iterations = pc.realcoloriter;
+    if (outside == ITER)
+    {
+    }
+    else if (outside > REAL)
+    {
+        pc.coloriter = outside;
+    }
+    else
+    {
+        // special_outside
+        if (outside == REAL)
+        {
+            pc.coloriter += (long) x + 7;
+        }
+        else if (outside == IMAG)
+        {
+            pc.coloriter += (long) y + 7;
+        }
+        else if (outside == MULT && y != 0.0)
+        {
+            pc.coloriter = (long)((double) pc.coloriter * (x/y));
+        }
+        else if (outside == SUM)
+        {
+            pc.coloriter += (long)(x + y);
+        }
+        else if (outside == ATAN)
+        {
+            pc.coloriter = (long) fabs(atan2(y, x)*atan_colors/PI);
+        }
+        // check_color
+        if ((pc.coloriter <= 0 || pc.coloriter > maxit) && outside != FMOD)
+        {
+            if (save_release < 1961)
+            {
+                pc.coloriter = 0;
+            }
+            else
+            {
+                pc.coloriter = 1;
+            }
+        }
+    }
+}
+
+/* The per pixel loop of calcmandfpasm().  Everything it changes is kept in
+   the pixel_context, so the threaded engines can run it concurrently; the
+   other globals it reads are only set up once per image. */
+long calcmandfp_pixel(pixel_context &pc)
+{
+    long cx;
+    long savedand;
+    int savedincr;
+    double mag = 0.0;
+#if USE_NEW
+    double x, y, x2, y2, xy, Cx, Cy, savedmag;
+#else
+    double x, y, x2, y2, xy, Cx, Cy, savedx, savedy;
+#endif
+
+    mandfp_reset_periodicity(pc);
+    pc.interior = false;
+
+    // initparms
+#if USE_NEW
+    savedmag = 0;
+#else
+    savedx = 0;
+    savedy = 0;
+#endif
+    savedand = firstsavedand;
+    savedincr = 1;             // start checking the very first time
+
+    cx = maxit;
+    if (fractype != fractal_type::JULIAFP && fractype != fractal_type::JULIA)
+    {
+        Cx = pc.init.x;
+        Cy = pc.init.y;
+    }
+    else
+    {
         Cx = parm.x;
         Cy = parm.y;
-        x = init.x;
-        y = init.y;
-        x2 = x*x;
-        y2 = y*y;
-        xy = x*y;
-        x = x2-y2+Cx;
-        y = 2*xy+Cy;
     }
+    if (cardioid_test && !pc.show_orbit && mandel_interior(Cx, Cy))
+    {
+        mandfp_interior(pc, maxit, 0.0);
+        return pc.coloriter;
+    }
+    mandfp_start(pc, x, y);
     x2 = x*x;
     y2 = y*y;
     xy = x*y;
@@ -121,20 +458,26 @@ long calcmandfpasm()
         x2 = x*x;
         y2 = y*y;
         xy = x*y;
-        magnitude = x2+y2;
+        mag = x2+y2;
 
-        if (magnitude >= rqlim)
+        if (mag >= rqlim)
         {
-            goto over_bailout_87;
+            mandfp_bailout(pc, cx, x, y, mag);
+            return pc.coloriter;
+        }
+        if (julia_cycle.num != 0 && in_cycle_balls(julia_cycle, x, y))
+        {
+            mandfp_interior(pc, cx, mag);
+            return pc.coloriter;
         }
 
         // no_save_new_xy_87
-        if (cx < oldcoloriter)  // check periodicity
+        if (cx < pc.oldcoloriter)  // check periodicity
         {
             if (((maxit - cx) & savedand) == 0)
             {
 #if USE_NEW
-                savedmag = magnitude;
+                savedmag = mag;
 #else
                 savedx = x;
                 savedy = y;
@@ -149,107 +492,402 @@ long calcmandfpasm()
             else
             {
 #if USE_NEW
-                if (ABS(magnitude-savedmag) < closenuff)
+                if (ABS(mag-savedmag) < closenuff)
                 {
 #else
                 if (ABS(savedx-x) < closenuff && ABS(savedy-y) < closenuff)
                 {
 #endif
-                    //          oldcoloriter = 65535;
-                    oldcoloriter = maxit;
-                    realcoloriter = maxit;
-                    kbdcount = kbdcount-(maxit-cx);
-                    coloriter = periodicity_color;
-                    goto pop_stack;
+                    mandfp_periodic(pc, cx, mag);
+                    return pc.coloriter;
                 }
             }
         }
         // no_periodicity_check_87
-        if (show_orbit)
+        if (pc.show_orbit)
         {
             plot_orbit(x, y, -1);
         }
         // no_show_orbit_87
     } // while (--cx > 0)
 
-    // reached maxit
-    // check periodicity immediately next time, remember we count down from maxit
-    oldcoloriter = maxit;
-    kbdcount -= maxit;
-    realcoloriter = maxit;
-    coloriter = inside_color;
+    mandfp_inside(pc, mag);
+    return pc.coloriter;
+}
 
-pop_stack:
-    if (orbit_ptr)
+/*
+   SIMD version of the loop above for whole rows of pixels.  Each lane works
+   along its own row, because the periodicity checking carries over from
+   one pixel to the next in a row; when a lane's pixel is done it picks up
+   the next pixel of its row, or the next row.  The lanes do exactly the
+   same double arithmetic as the scalar loop, so the results are identical.
+   The AVX2 loop is picked at run time if the CPU has it, SSE2 otherwise.
+*/
+#if MANDFP_SIMD
+#define MAX_LANES 4
+
+struct mandfp_lanes
+{
+    double x[MAX_LANES], y[MAX_LANES];
+    double x2[MAX_LANES], y2[MAX_LANES], xy[MAX_LANES], mag[MAX_LANES];
+    double Cx[MAX_LANES], Cy[MAX_LANES];
+    double savedx[MAX_LANES], savedy[MAX_LANES];
+    int n[MAX_LANES];                   // iterations done, maxit - cx
+    int last[MAX_LANES];                // maxit - 1
+    int check[MAX_LANES];               // check periodicity once n is past this
+    int savedand[MAX_LANES];
+    int savedincr[MAX_LANES];
+    int running;                        // lanes with a pixel
+    int done;                           // lanes whose pixel has finished
+    int bailout;                        // ... by bailing out
+    int periodic;                       // ... by finding a cycle
+    int inside;                         // ... by coming into a ball
+};
+
+static void mandfp_iterate_sse2(mandfp_lanes &l)
+{
+    __m128d x = _mm_loadu_pd(l.x);
+    __m128d y = _mm_loadu_pd(l.y);
+    __m128d x2 = _mm_loadu_pd(l.x2);
+    __m128d y2 = _mm_loadu_pd(l.y2);
+    __m128d xy = _mm_loadu_pd(l.xy);
+    __m128d mag;
+    __m128d const Cx = _mm_loadu_pd(l.Cx);
+    __m128d const Cy = _mm_loadu_pd(l.Cy);
+    __m128d savedx = _mm_loadu_pd(l.savedx);
+    __m128d savedy = _mm_loadu_pd(l.savedy);
+    __m128d const bailout = _mm_set1_pd(rqlim);
+    __m128d const close = _mm_set1_pd(closenuff);
+    __m128d const sign = _mm_set1_pd(-0.0);
+    __m128i n = _mm_loadu_si128((__m128i const *) l.n);
+    __m128i const last = _mm_loadu_si128((__m128i const *) l.last);
+    __m128i const check = _mm_loadu_si128((__m128i const *) l.check);
+    __m128i savedand = _mm_loadu_si128((__m128i const *) l.savedand);
+    __m128i savedincr = _mm_loadu_si128((__m128i const *) l.savedincr);
+    __m128i const zero = _mm_setzero_si128();
+    __m128i const one = _mm_set1_epi32(1);
+    __m128i const next = _mm_set1_epi32(nextsavedincr);
+    __m128d ball_cx[2], ball_cy[2], ball_rr[2];
+    for (int i = 0; i < julia_cycle.num; i++)
     {
-        scrub_orbit();
+        ball_cx[i] = _mm_set1_pd(julia_cycle.x[i]);
+        ball_cy[i] = _mm_set1_pd(julia_cycle.y[i]);
+        ball_rr[i] = _mm_set1_pd(julia_cycle.r2[i]);
     }
-    return coloriter;
+    int const balls = julia_cycle.num;
+    int const running = l.running;
+    int done;
+    int out;
+    int periodic;
+    int inside = 0;
 
-over_bailout_87:
-    if (outside <= REAL)
+    do
     {
-        g_new.x = x;
-        g_new.y = y;
+        x = _mm_add_pd(_mm_sub_pd(x2, y2), Cx);
+        y = _mm_add_pd(_mm_add_pd(xy, xy), Cy);
+        x2 = _mm_mul_pd(x, x);
+        y2 = _mm_mul_pd(y, y);
+        xy = _mm_mul_pd(x, y);
+        mag = _mm_add_pd(x2, y2);
+        n = _mm_add_epi32(n, one);
+
+        out = _mm_movemask_pd(_mm_cmpge_pd(mag, bailout));
+        __m128i const checking = _mm_cmpgt_epi32(n, check);
+        __m128i const save = _mm_and_si128(checking, _mm_cmpeq_epi32(_mm_and_si128(n, savedand), zero));
+        int const saving = _mm_movemask_ps(_mm_castsi128_ps(save));
+        __m128d const near = _mm_and_pd(
+            _mm_cmplt_pd(_mm_andnot_pd(sign, _mm_sub_pd(savedx, x)), close),
+            _mm_cmplt_pd(_mm_andnot_pd(sign, _mm_sub_pd(savedy, y)), close));
+        periodic = _mm_movemask_ps(_mm_castsi128_ps(checking)) & ~saving & _mm_movemask_pd(near);
+        for (int i = 0; i < balls; i++)
+        {
+            __m128d const dx = _mm_sub_pd(x, ball_cx[i]);
+            __m128d const dy = _mm_sub_pd(y, ball_cy[i]);
+            inside |= _mm_movemask_pd(_mm_cmplt_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)), ball_rr[i]));
+        }
+        done = (out | periodic | inside | _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(n, last))))
+            & running;
+        if (saving)
+        {
+            __m128d const wide = _mm_castsi128_pd(_mm_shuffle_epi32(save, _MM_SHUFFLE(1, 1, 0, 0)));
+            savedx = _mm_or_pd(_mm_andnot_pd(wide, savedx), _mm_and_pd(wide, x));
+            savedy = _mm_or_pd(_mm_andnot_pd(wide, savedy), _mm_and_pd(wide, y));
+            savedincr = _mm_add_epi32(savedincr, save);
+            __m128i const roll = _mm_and_si128(save, _mm_cmpeq_epi32(savedincr, zero));
+            savedand = _mm_or_si128(_mm_andnot_si128(roll, savedand),
+                _mm_and_si128(roll, _mm_add_epi32(_mm_add_epi32(savedand, savedand), one)));
+            savedincr = _mm_or_si128(_mm_andnot_si128(roll, savedincr), _mm_and_si128(roll, next));
+        }
     }
-    if (cx-10 > 0)
+    while (!done);
+
+    _mm_storeu_pd(l.x, x);
+    _mm_storeu_pd(l.y, y);
+    _mm_storeu_pd(l.x2, x2);
+    _mm_storeu_pd(l.y2, y2);
+    _mm_storeu_pd(l.xy, xy);
+    _mm_storeu_pd(l.mag, mag);
+    _mm_storeu_pd(l.savedx, savedx);
+    _mm_storeu_pd(l.savedy, savedy);
+    _mm_storeu_si128((__m128i *) l.n, n);
+    _mm_storeu_si128((__m128i *) l.savedand, savedand);
+    _mm_storeu_si128((__m128i *) l.savedincr, savedincr);
+    l.done = done;
+    l.bailout = out & done;
+    l.inside = inside & ~out & done;
+    l.periodic = periodic & ~inside & ~out & done;
+}
+
+MANDFP_AVX2 static void mandfp_iterate_avx2(mandfp_lanes &l)
+{
+    __m256d x = _mm256_loadu_pd(l.x);
+    __m256d y = _mm256_loadu_pd(l.y);
+    __m256d x2 = _mm256_loadu_pd(l.x2);
+    __m256d y2 = _mm256_loadu_pd(l.y2);
+    __m256d xy = _mm256_loadu_pd(l.xy);
+    __m256d mag;
+    __m256d const Cx = _mm256_loadu_pd(l.Cx);
+    __m256d const Cy = _mm256_loadu_pd(l.Cy);
+    __m256d savedx = _mm256_loadu_pd(l.savedx);
+    __m256d savedy = _mm256_loadu_pd(l.savedy);
+    __m256d const bailout = _mm256_set1_pd(rqlim);
+    __m256d const close = _mm256_set1_pd(closenuff);
+    __m256d const sign = _mm256_set1_pd(-0.0);
+    __m128i n = _mm_loadu_si128((__m128i const *) l.n);
+    __m128i const last = _mm_loadu_si128((__m128i const *) l.last);
+    __m128i const check = _mm_loadu_si128((__m128i const *) l.check);
+    __m128i savedand = _mm_loadu_si128((__m128i const *) l.savedand);
+    __m128i savedincr = _mm_loadu_si128((__m128i const *) l.savedincr);
+    __m128i const zero = _mm_setzero_si128();
+    __m128i const one = _mm_set1_epi32(1);
+    __m128i const next = _mm_set1_epi32(nextsavedincr);
+    __m256d ball_cx[2], ball_cy[2], ball_rr[2];
+    for (int i = 0; i < julia_cycle.num; i++)
     {
-        oldcoloriter = cx-10;
+        ball_cx[i] = _mm256_set1_pd(julia_cycle.x[i]);
+        ball_cy[i] = _mm256_set1_pd(julia_cycle.y[i]);
+        ball_rr[i] = _mm256_set1_pd(julia_cycle.r2[i]);
     }
-    else
+    int const balls = julia_cycle.num;
+    int const running = l.running;
+    int done;
+    int out;
+    int periodic;
+    int inside = 0;
+
+    do
     {
-        oldcoloriter = 0;
+        x = _mm256_add_pd(_mm256_sub_pd(x2, y2), Cx);
+        y = _mm256_add_pd(_mm256_add_pd(xy, xy), Cy);
+        x2 = _mm256_mul_pd(x, x);
+        y2 = _mm256_mul_pd(y, y);
+        xy = _mm256_mul_pd(x, y);
+        mag = _mm256_add_pd(x2, y2);
+        n = _mm_add_epi32(n, one);
+
+        out = _mm256_movemask_pd(_mm256_cmp_pd(mag, bailout, _CMP_GE_OQ));
+        __m128i const checking = _mm_cmpgt_epi32(n, check);
+        __m128i const save = _mm_and_si128(checking, _mm_cmpeq_epi32(_mm_and_si128(n, savedand), zero));
+        int const saving = _mm_movemask_ps(_mm_castsi128_ps(save));
+        __m256d const near = _mm256_and_pd(
+            _mm256_cmp_pd(_mm256_andnot_pd(sign, _mm256_sub_pd(savedx, x)), close, _CMP_LT_OQ),
+            _mm256_cmp_pd(_mm256_andnot_pd(sign, _mm256_sub_pd(savedy, y)), close, _CMP_LT_OQ));
+        periodic = _mm_movemask_ps(_mm_castsi128_ps(checking)) & ~saving & _mm256_movemask_pd(near);
+        for (int i = 0; i < balls; i++)
+        {
+            __m256d const dx = _mm256_sub_pd(x, ball_cx[i]);
+            __m256d const dy = _mm256_sub_pd(y, ball_cy[i]);
+            __m256d const d2 = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+            inside |= _mm256_movemask_pd(_mm256_cmp_pd(d2, ball_rr[i], _CMP_LT_OQ));
+        }
+        done = (out | periodic | inside | _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(n, last))))
+            & running;
+        if (saving)
+        {
+            __m256d const wide = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(save));
+            savedx = _mm256_blendv_pd(savedx, x, wide);
+            savedy = _mm256_blendv_pd(savedy, y, wide);
+            savedincr = _mm_add_epi32(savedincr, save);
+            __m128i const roll = _mm_and_si128(save, _mm_cmpeq_epi32(savedincr, zero));
+            savedand = _mm_blendv_epi8(savedand, _mm_add_epi32(_mm_add_epi32(savedand, savedand), one), roll);
+            savedincr = _mm_blendv_epi8(savedincr, next, roll);
+        }
     }
-    realcoloriter = maxit-cx;
-    coloriter = realcoloriter;
-    if (coloriter == 0)
+    while (!done);
+
+    _mm256_storeu_pd(l.x, x);
+    _mm256_storeu_pd(l.y, y);
+    _mm256_storeu_pd(l.x2, x2);
+    _mm256_storeu_pd(l.y2, y2);
+    _mm256_storeu_pd(l.xy, xy);
+    _mm256_storeu_pd(l.mag, mag);
+    _mm256_storeu_pd(l.savedx, savedx);
+    _mm256_storeu_pd(l.savedy, savedy);
+    _mm_storeu_si128((__m128i *) l.n, n);
+    _mm_storeu_si128((__m128i *) l.savedand, savedand);
+    _mm_storeu_si128((__m128i *) l.savedincr, savedincr);
+    l.done = done;
+    l.bailout = out & done;
+    l.inside = inside & ~out & done;
+    l.periodic = periodic & ~inside & ~out & done;
+}
+
+static bool cpu_has_avx2()
+{
+#if defined(__GNUC__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#else
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    bool const osxsave = (info[2] & (1 << 27)) != 0;
+    bool const avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#endif
+}
+
+/* Put the next pixel of a row into a lane.  Returns false if the pixel was
+   found inside without iterating, and so is finished already. */
+static bool mandfp_lane_start(mandfp_lanes &l, int lane, pixel_context &pc)
+{
+    double x, y;
+
+    mandfp_reset_periodicity(pc);
+    pc.interior = false;
+    if (cardioid_test && mandel_interior(pc.init.x, pc.init.y))
     {
-        coloriter = 1;
+        mandfp_interior(pc, maxit, 0.0);
+        return false;
     }
-    kbdcount -= realcoloriter;
-    if (outside == ITER)
+    mandfp_start(pc, x, y);
+    l.x[lane] = x;
+    l.y[lane] = y;
+    l.x2[lane] = x*x;
+    l.y2[lane] = y*y;
+    l.xy[lane] = x*y;
+    l.mag[lane] = 0.0;
+    if (fractype != fractal_type::JULIAFP && fractype != fractal_type::JULIA)
     {
+        l.Cx[lane] = pc.init.x;
+        l.Cy[lane] = pc.init.y;
     }
-    else if (outside > REAL)
+    else
     {
-        coloriter = outside;
+        l.Cx[lane] = parm.x;
+        l.Cy[lane] = parm.y;
     }
+    l.savedx[lane] = 0;
+    l.savedy[lane] = 0;
+    l.n[lane] = 0;
+    l.last[lane] = (int)(maxit - 1);
+    l.check[lane] = (int)(maxit - pc.oldcoloriter);
+    l.savedand[lane] = (int) firstsavedand;
+    l.savedincr[lane] = 1;
+    l.running |= 1 << lane;
+    return true;
+}
+
+// take the finished pixel out of a lane
+static void mandfp_lane_finish(mandfp_lanes &l, int lane, pixel_context &pc)
+{
+    long const cx = maxit - l.n[lane];
+    if (l.bailout & (1 << lane))
+        mandfp_bailout(pc, cx, l.x[lane], l.y[lane], l.mag[lane]);
+    else if (l.inside & (1 << lane))
+        mandfp_interior(pc, cx, l.mag[lane]);
+    else if (l.periodic & (1 << lane))
+        mandfp_periodic(pc, cx, l.mag[lane]);
     else
+        mandfp_inside(pc, l.mag[lane]);
+    l.running &= ~(1 << lane);
+}
+#endif
+
+/* The number of pixels calcmandfp_rows() works on at once; the threaded
+   engine is worth using for more than one even without extra threads. */
+int calcmandfp_lanes()
+{
+#if MANDFP_SIMD
+    static int const lanes = cpu_has_avx2() ? 4 : 2;
+    // the SIMD loop counts iterations in 32 bits, see the savedand doubling
+    if (maxit > 1 && maxit < (1L << 30) && firstsavedand < (1L << 30))
+        return lanes;
+#endif
+    return 1;
+}
+
+/* Calculate rows of pixels, carrying the periodicity checking from each
+   pixel to the next along a row just as successive calls of calcmandfpasm()
+   do.  Row i is pixels[start[i]] up to pixels[start[i+1]-1]; row, col, init
+   and reset_periodicity must be filled in. */
+void calcmandfp_rows(pixel_context *pixels, int const *start, int num_rows)
+{
+    int const lanes = calcmandfp_lanes();
+    if (lanes == 1)
     {
-        // special_outside
-        if (outside == REAL)
-        {
-            coloriter += (long) g_new.x + 7;
-        }
-        else if (outside == IMAG)
-        {
-            coloriter += (long) g_new.y + 7;
-        }
-        else if (outside == MULT && g_new.y != 0.0)
-        {
-            coloriter = (long)((double) coloriter * (g_new.x/g_new.y));
-        }
-        else if (outside == SUM)
-        {
-            coloriter += (long)(g_new.x + g_new.y);
-        }
-        else if (outside == ATAN)
-        {
-            coloriter = (long) fabs(atan2(g_new.y, g_new.x)*atan_colors/PI);
-        }
-        // check_color
-        if ((coloriter <= 0 || coloriter > maxit) && outside != FMOD)
+        for (int i = 0; i < num_rows; ++i)
+            for (int j = start[i]; j < start[i+1]; ++j)
+            {
+                if (j > start[i])
+                    pixels[j].oldcoloriter = pixels[j-1].oldcoloriter;
+                calcmandfp_pixel(pixels[j]);
+            }
+        return;
+    }
+
+#if MANDFP_SIMD
+    mandfp_lanes l;
+    int pos[MAX_LANES];                 // pixel in each lane
+    int end[MAX_LANES];                 // end of that pixel's row
+    int next_row = 0;
+
+    // put the next pixel of the lane's row, or else of the next row, in the
+    // lane, finishing those found inside without iterating on the way
+    auto const fill_lane = [&](int lane, bool same_row)
+    {
+        while (true)
         {
-            if (save_release < 1961)
+            if (same_row && ++pos[lane] < end[lane])
             {
-                coloriter = 0;
+                pixels[pos[lane]].oldcoloriter = pixels[pos[lane]-1].oldcoloriter;
             }
             else
             {
-                coloriter = 1;
+                while (next_row < num_rows && start[next_row] == start[next_row+1])
+                    ++next_row;
+                if (next_row >= num_rows)
+                    return;
+                pos[lane] = start[next_row];
+                end[lane] = start[++next_row];
             }
+            if (mandfp_lane_start(l, lane, pixels[pos[lane]]))
+                return;
+            same_row = true;
         }
-    }
+    };
 
-    goto pop_stack;
+    memset(&l, 0, sizeof(l));
+    for (int lane = 0; lane < lanes; ++lane)
+        fill_lane(lane, false);
+    while (l.running)
+    {
+        if (lanes == 4)
+            mandfp_iterate_avx2(l);
+        else
+            mandfp_iterate_sse2(l);
+        for (int lane = 0; lane < lanes; ++lane)
+        {
+            if ((l.done & (1 << lane)) == 0)
+                continue;
+            mandfp_lane_finish(l, lane, pixels[pos[lane]]);
+            fill_lane(lane, true);
+        }
+    }
+#endif
 }
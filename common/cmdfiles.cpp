@@ -8,6 +8,7 @@
 #include <float.h>
 #include <math.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <time.h>
 
 #include "port.h"
@@ -33,6 +34,7 @@ static int  next_command(
     int *lineoffset,
     cmd_file mode);
 static bool next_line(FILE *handle, char *linebuf, cmd_file mode);
+static void command_line_arg(char *curarg);
 int cmdarg(char *argument, cmd_file mode);
 static void argerror(const char *);
 static void initvars_run();
@@ -140,12 +142,22 @@ BYTE exitmode = 3;              // video mode on exit
 int     Log_Fly_Calc = 0;       // calculate logmap on-the-fly
 bool    Log_Auto_Calc = false;          // auto calculate logmap
 bool    nobof = false;                  // Flag to make inside=bof options not duplicate bof images
+int     g_num_threads = 0;              // worker threads for the engines, 0 = one per core
+bool    g_perturbation = false;         // deep zooms iterate deltas from a reference orbit
+char    g_server_dir[FILE_MAX_DIR] = {""};  // spool directory for server=, empty if not serving
+png_out_kind g_png_out = png_out_kind::NONE;    // pngout=, stream the image to a PNG file
+bool    g_iter_cache = false;           // keep the iterations of each pixel for recoloring
+long    g_orbit_density = 0;            // orbit types count the hits of this many million points
 
 bool    escape_exit = false;    // set to true to avoid the "are you sure?" screen
 bool first_init = true;                 // first time into cmdfiles?
 static int init_rseed = 0;
 static bool initcorners = false;
 static bool initparams = false;
+// sstools.ini commands and command line arguments, replayed for each server job
+static std::vector<std::string> s_sstools_args;
+static std::vector<std::string> s_cmdline_args;
+static bool s_server_job = false;       // reading a server job file
 fractalspecificstuff *curfractalspecific = nullptr;
 
 char FormFileName[FILE_MAX_PATH] = { 0 };// file to find (type=)formulas in
@@ -226,7 +238,6 @@ int cmdfiles(int argc, char **argv)
 {
     char    curarg[141];
     char    tempstring[101];
-    char    *sptr;
     FILE    *initfile;
 
     if (first_init)
@@ -249,50 +260,9 @@ int cmdfiles(int argc, char **argv)
         strcpy(curarg, argv[i]);
         if (curarg[0] == ';')             // start of comments?
             break;
-        if (curarg[0] != '@')
-        {           // simple command?
-            if (strchr(curarg, '=') == nullptr)
-            { // not xxx=yyy, so check for gif
-                strcpy(tempstring, curarg);
-                if (has_ext(curarg) == nullptr)
-                    strcat(tempstring, ".gif");
-                initfile = fopen(tempstring, "rb");
-                if (initfile != nullptr)
-                {
-                    fread(tempstring, 6, 1, initfile);
-                    if (tempstring[0] == 'G'
-                            && tempstring[1] == 'I'
-                            && tempstring[2] == 'F'
-                            && tempstring[3] >= '8' && tempstring[3] <= '9'
-                            && tempstring[4] >= '0' && tempstring[4] <= '9')
-                    {
-                        strcpy(readname, curarg);
-                        extract_filename(browsename, readname);
-                        curarg[0] = (char)(showfile = 0);
-                    }
-                    fclose(initfile);
-                }
-            }
-            if (curarg[0])
-                cmdarg(curarg, cmd_file::AT_CMD_LINE);           // process simple command
-        }
-        else if ((sptr = strchr(curarg, '/')) != nullptr)
-        { // @filename/setname?
-            *sptr = 0;
-            if (merge_pathnames(CommandFile, &curarg[1], cmd_file::AT_CMD_LINE) < 0)
-                init_msg("", CommandFile, cmd_file::AT_CMD_LINE);
-            strcpy(CommandName, sptr+1);
-            if (find_file_item(CommandFile, CommandName, &initfile, 0) || initfile == nullptr)
-                argerror(curarg);
-            cmdfile(initfile, cmd_file::AT_CMD_LINE_SET_NAME);
-        }
-        else
-        {                            // @filename
-            initfile = fopen(&curarg[1], "r");
-            if (initfile == nullptr)
-                argerror(curarg);
-            cmdfile(initfile, cmd_file::AT_CMD_LINE);
-        }
+        if (first_init)
+            s_cmdline_args.push_back(curarg);
+        command_line_arg(curarg);
     }
 
     if (!first_init)
@@ -319,6 +289,79 @@ int cmdfiles(int argc, char **argv)
     return 0;
 }
 
+// one command line argument: a simple command, a .gif to show,
+// @filename/setname or @filename
+static void command_line_arg(char *curarg)
+{
+    char    tempstring[101];
+    char    *sptr;
+    FILE    *initfile;
+
+    if (curarg[0] != '@')
+    {           // simple command?
+        if (strchr(curarg, '=') == nullptr)
+        { // not xxx=yyy, so check for gif
+            strcpy(tempstring, curarg);
+            if (has_ext(curarg) == nullptr)
+                strcat(tempstring, ".gif");
+            initfile = fopen(tempstring, "rb");
+            if (initfile != nullptr)
+            {
+                fread(tempstring, 6, 1, initfile);
+                if (tempstring[0] == 'G'
+                        && tempstring[1] == 'I'
+                        && tempstring[2] == 'F'
+                        && tempstring[3] >= '8' && tempstring[3] <= '9'
+                        && tempstring[4] >= '0' && tempstring[4] <= '9')
+                {
+                    strcpy(readname, curarg);
+                    extract_filename(browsename, readname);
+                    curarg[0] = (char)(showfile = 0);
+                }
+                fclose(initfile);
+            }
+        }
+        if (curarg[0])
+            cmdarg(curarg, cmd_file::AT_CMD_LINE);           // process simple command
+    }
+    else if ((sptr = strchr(curarg, '/')) != nullptr)
+    { // @filename/setname?
+        // filename may have slashes of its own, split after the first file
+        for (char *next = sptr; next != nullptr; next = strchr(next + 1, '/'))
+        {
+            struct stat info;
+            *next = 0;
+            bool const is_file = stat(&curarg[1], &info) == 0 && (info.st_mode & S_IFMT) == S_IFREG;
+            *next = '/';
+            if (is_file)
+            {
+                sptr = next;
+                break;
+            }
+        }
+        *sptr = 0;
+        if (merge_pathnames(CommandFile, &curarg[1], cmd_file::AT_CMD_LINE) < 0)
+            init_msg("", CommandFile, cmd_file::AT_CMD_LINE);
+        strcpy(CommandName, sptr+1);
+        if (find_file_item(CommandFile, CommandName, &initfile, 0) || initfile == nullptr)
+        {
+            argerror(curarg);
+            return;
+        }
+        cmdfile(initfile, cmd_file::AT_CMD_LINE_SET_NAME);
+    }
+    else
+    {                            // @filename
+        initfile = fopen(&curarg[1], "r");
+        if (initfile == nullptr)
+        {
+            argerror(curarg);
+            return;
+        }
+        cmdfile(initfile, cmd_file::AT_CMD_LINE);
+    }
+}
+
 
 int load_commands(FILE *infile)
 {
@@ -336,6 +379,63 @@ int load_commands(FILE *infile)
     return ret;
 }
 
+/*
+   server_job(jobfile, savefile) sets up the next image for server=.
+   The sstools.ini commands and command line arguments seen at startup
+   are replayed from memory, savename is set to savefile, and then the
+   job file is read; it holds command line arguments, including
+   @filename/setname.  Returns 0, or -1 if the job can't be used.
+*/
+int server_job(const char *jobfile, const char *savefile)
+{
+    char linebuf[513];
+    char cmdbuf[10000];
+    int lineoffset = 0;
+    int changeflag = 0;
+
+    initvars_restart();
+    initvars_fractal();
+    initbatch = 1;                      // until server= is replayed
+    for (std::string const &arg : s_sstools_args)
+    {
+        strcpy(cmdbuf, arg.c_str());
+        int const i = cmdarg(cmdbuf, cmd_file::SSTOOLS_INI);
+        if (i > 0)
+            changeflag |= i;
+    }
+    if (changeflag & CMDARG_FRACTAL_PARAM)
+    {
+        backwards_v18();
+        backwards_v19();
+        backwards_v20();
+    }
+    for (std::string const &arg : s_cmdline_args)
+    {
+        strcpy(cmdbuf, arg.c_str());
+        command_line_arg(cmdbuf);
+    }
+
+    FILE *job = fopen(jobfile, "r");
+    if (job == nullptr)
+        return -1;
+    strcpy(savename, savefile);
+    s_server_job = true;
+    linebuf[0] = 0;
+    while (next_command(cmdbuf, 10000, job, linebuf, &lineoffset, cmd_file::AT_CMD_LINE) > 0)
+        command_line_arg(cmdbuf);
+    s_server_job = false;
+    fclose(job);
+
+    showfile = 1;
+    dontreadcolor = false;
+    calc_status = calc_status_value::PARAMS_CHANGED;
+    strcpy(searchfor.par, CommandFile);
+    strcpy(searchfor.frm, FormFileName);
+    strcpy(searchfor.lsys, LFileName);
+    strcpy(searchfor.ifs, IFSFileName);
+    return initbatch == 1 ? 0 : -1;     // argerror() sets initbatch = 4
+}
+
 
 static void initvars_run()              // once per run init
 {
@@ -411,6 +511,7 @@ static void initvars_restart()          // <ins> key init
     minor_method = Minor::left_first;       // default inverse julia methods
     truecolor = false;                  // truecolor output flag
     truemode = 0;               // set to default color scheme
+    g_png_out = png_out_kind::NONE;     // no PNG stream
 }
 
 static void initvars_fractal()          // init vars affecting calculation
@@ -439,6 +540,10 @@ static void initvars_fractal()          // init vars affecting calculation
     initparams = false;
     bailout = 0;                        // no user-entered bailout
     nobof = false;                      // use normal bof initialization to make bof images
+    g_perturbation = false;             // deep zooms use the bignum engine
+    g_num_threads = 0;                  // one worker per core
+    g_iter_cache = false;               // no iteration cache
+    g_orbit_density = 0;                // orbit types plot their orbits
     useinitorbit = 0;
     for (int i = 0; i < MAXPARAMS; i++)
         param[i] = 0.0;     // initial parameter values
@@ -594,6 +699,8 @@ static int cmdfile(FILE *handle, cmd_file mode)
     {
         if ((mode == cmd_file::AT_AFTER_STARTUP || mode == cmd_file::AT_CMD_LINE_SET_NAME) && strcmp(cmdbuf, "}") == 0)
             break;
+        if (mode == cmd_file::SSTOOLS_INI && first_init)
+            s_sstools_args.push_back(cmdbuf);
         i = cmdarg(cmdbuf, mode);
         if (i < 0)
             break;
@@ -927,6 +1034,20 @@ int cmdarg(char *curarg, cmd_file mode) // process a single argument
             initbatch = yesnoval[0];
             return 3;
         }
+        if (strcmp(variable, "server") == 0)    // server=?
+        {
+            if (valuelen > (FILE_MAX_DIR-1) || !isadirectory(value))
+            {
+                goto badarg;
+            }
+            strcpy(g_server_dir, value);
+            fix_dirname(g_server_dir);
+#ifdef XFRACT
+            g_init_mode = 0;
+#endif
+            initbatch = 1;
+            return 3;
+        }
         if (strcmp(variable, "maxhistory") == 0)       // maxhistory=?
         {
             if (numval == NONNUMERIC)
@@ -1566,6 +1687,46 @@ int cmdarg(char *curarg, cmd_file mode) // process a single argument
         return 1;
     }
 
+    if (strcmp(variable, "threads") == 0)       // threads=?
+    {
+        if (numval == NONNUMERIC || numval < 0)
+        {
+            goto badarg;
+        }
+        g_num_threads = numval;
+        return 0;
+    }
+
+    if (strcmp(variable, "itercache") == 0)     // itercache=?
+    {
+        if (yesnoval[0] < 0)
+        {
+            goto badarg;
+        }
+        g_iter_cache = yesnoval[0] != 0;
+        return 0;
+    }
+
+    if (strcmp(variable, "orbitdensity") == 0)  // orbitdensity=?
+    {
+        if (numval == NONNUMERIC || numval < 0)
+        {
+            goto badarg;
+        }
+        g_orbit_density = numval;
+        return 1;
+    }
+
+    if (strcmp(variable, "perturbation") == 0)  // perturbation=?
+    {
+        if (yesnoval[0] < 0)
+        {
+            goto badarg;
+        }
+        g_perturbation = yesnoval[0] != 0;
+        return 1;
+    }
+
     if (strcmp(variable, "ismand") == 0)        // ismand=?
     {
         if (yesnoval[0] < 0)
@@ -1685,7 +1846,7 @@ int cmdarg(char *curarg, cmd_file mode) // process a single argument
         {
             goto badarg;
         }
-        if (first_init || mode == cmd_file::AT_AFTER_STARTUP)
+        if (first_init || s_server_job || mode == cmd_file::AT_AFTER_STARTUP)
         {
             if (merge_pathnames(savename, value, mode) < 0)
             {
@@ -3036,6 +3197,19 @@ int cmdarg(char *curarg, cmd_file mode) // process a single argument
         return 3;
     }
 
+    if (strcmp(variable, "pngout") == 0)
+    {    // pngout=?
+        if (strcmp(value, "rgb") == 0)
+            g_png_out = png_out_kind::RGB;
+        else if (strcmp(value, "iter") == 0)
+            g_png_out = png_out_kind::ITERATION;
+        else if (yesnoval[0] == 0)
+            g_png_out = png_out_kind::NONE;
+        else
+            goto badarg;
+        return 3;
+    }
+
     if (strcmp(variable, "usegrayscale") == 0)
     {     // usegrayscale?
         if (yesnoval[0] < 0)
@@ -3318,7 +3492,8 @@ static void argerror(const char *badarg)      // oops. couldn't decode this
     if (initbatch)
     {
         initbatch = 4;
-        goodbye();
+        if (!s_server_job)      // the server carries on with the next job
+            goodbye();
     }
 }
 
@@ -2,14 +2,21 @@
    "Disk-Video" (and RAM-Video and Expanded-Memory Video) routines
 
    Reworked with fast caching July '90 by Pieter Branderhorst.
-   (I'm proud of this cache handler, had to get my name on it!)
-   Caution when modifying any code in here:  bugs are possible which
-   slow the cache substantially but don't cause incorrect results.
-   Do timing tests for a variety of situations after any change.
-
+   The block cache is gone now: the whole frame is held in memory (or in
+   a mapped file), so readdisk and writedisk touch the pixel directly.
+   Offsets are size_t, frames may have more than 2^31 pixels.
 */
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
 #include <float.h>
 #include <string.h>
+#ifdef XFRACT
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include "port.h"
 #include "prototyp.h"
@@ -28,48 +35,20 @@ bool disktarga = false;
 bool g_disk_flag = false;
 bool g_good_mode = false;        // if non-zero, OK to read/write pixels
 
-#define BLOCKLEN 2048   // must be a power of 2, must match next
-#define BLOCKSHIFT 11   // must match above
-#define CACHEMIN 4      // minimum cache size in Kbytes
-#define CACHEMAX 64     // maximum cache size in Kbytes
-#define FREEMEM  33     // try to leave this much memory unallocated
-#define HASHSIZE 1024   // power of 2, near CACHEMAX/(BLOCKLEN+8)
-
-struct cache                // structure of each cache entry
-{
-    long offset;            // pixel offset in image
-    BYTE pixel[BLOCKLEN];   // one pixel per byte (this *is* faster)
-    unsigned int hashlink;  // ptr to next cache entry with same hash
-    bool dirty;             // changed since read?
-    bool lru;               // recently used?
-};
-static cache *cache_end = nullptr;
-static cache *cache_lru = nullptr;
-static cache *cur_cache = nullptr;
-static cache *cache_start = nullptr;
-static long high_offset;           // highwater mark of writes
-static long seek_offset;           // what we'll get next if we don't seek
-static long cur_offset;            // offset of last block referenced
+static BYTE *frame = nullptr;           // the whole 'screen', one byte per pixel
+static std::size_t frame_size = 0;      // bytes at frame, header not included
+static BYTE *mapping = nullptr;         // start of the mapped file, if mapped
+static std::size_t mapping_size = 0;
+static bool on_disk = false;            // frame lives in a file
 static int cur_row;
-static long cur_row_base;
-static unsigned int hash_ptr[HASHSIZE] = { 0 };
-static int pixelshift;
+static BYTE *cur_row_base;
 static int headerlength;
 static int rowsize = 0;   // doubles as a disk video not ok flag
 static int colsize;       // sydots, *2 when pot16bit
 
-static BYTE *membuf;
-static U16 dv_handle = 0;
-static long memoffset = 0;
-static long oldmemoffset = 0;
-static BYTE *membufptr;
-
-static void findload_cache(long);
-static cache *find_cache(long);
-static void  write_cache_lru();
-static void mem_putc(BYTE);
-static BYTE  mem_getc();
-static void mem_seek(long);
+static bool alloc_frame(std::size_t size);
+static bool map_file(FILE *file, std::size_t size);
+static void free_frame();
 
 int startdisk()
 {
@@ -113,19 +92,12 @@ int targa_startdisk(FILE *targafp, int overhead)
     fp = targafp;
     disktarga = true;
     i = common_startdisk(xdots*3, ydots, colors);
-    high_offset = 100000000L; // targa not necessarily init'd to zeros
 
     return i;
 }
 
 int common_startdisk(long newrowsize, long newcolsize, int colors)
 {
-    int freemem;
-    long memorysize;
-    unsigned int *fwd_link = nullptr;
-    long longtmp;
-    unsigned int cache_size;
-    BYTE *tempfar = nullptr;
     if (g_disk_flag)
     {
         enddisk();
@@ -157,155 +129,43 @@ int common_startdisk(long newrowsize, long newcolsize, int colors)
         driver_put_string(BOXROW+10, BOXCOL+4, C_DVID_LO, "Status:");
         dvid_status(0, "clearing the 'screen'");
     }
-    high_offset = -1;
-    seek_offset = high_offset;
-    cur_offset = seek_offset;
-    cur_row    = -1;
-    if (disktarga)
-    {
-        pixelshift = 0;
-    }
-    else
-    {
-        pixelshift = 3;
-        int i = 2;
-        while (i < colors)
-        {
-            i *= i;
-            --pixelshift;
-        }
-    }
+    cur_row = -1;
     timetodisplay = bf_math != bf_math_type::NONE ? 10 : 1000;  // time-to-g_driver-status counter
 
-    /* allocate cache: try for the max; leave FREEMEMk free if we can get
-        that much or more; if we can't get that much leave 1/2 of whatever
-        there is free; demand a certain minimum or nogo at all */
-    freemem = FREEMEM;
-
-    for (cache_size = CACHEMAX; cache_size >= CACHEMIN; --cache_size)
+    // sizes are computed in 64 bits, a poster can have more than 2^31 pixels
+    std::uint64_t const size = static_cast<std::uint64_t>(newrowsize) * newcolsize;
+    bool ok = newrowsize > 0 && newcolsize > 0 && size <= SIZE_MAX - headerlength;
+    if (ok)
     {
-        longtmp = ((int)cache_size < freemem) ?
-                  (long)cache_size << 11 : (long)(cache_size+freemem) << 10;
-        tempfar = static_cast<BYTE *>(malloc(longtmp));
-        if (tempfar != nullptr)
+        if (disktarga)
         {
-            free(tempfar);
-            break;
+            // the targa file already holds the header and the background,
+            // work directly on the stream we were handed, which for an
+            // overlay is the copy in targa_temp rather than light_name
+            ok = fp != nullptr && fflush(fp) == 0
+                && map_file(fp, static_cast<std::size_t>(size));
         }
-    }
-    if (debugflag == debug_flags::force_disk_min_cache)
-    {
-        cache_size = CACHEMIN;
-    }
-    longtmp = (long)cache_size << 10;
-    cache_start = (cache *)malloc(longtmp);
-    if (cache_size == 64)
-    {
-        --longtmp; // safety for next line
-    }
-    cache_lru = cache_start;
-    cache_end = cache_lru + longtmp/sizeof(*cache_start);
-    membuf = (BYTE *)malloc((long)BLOCKLEN);
-    if (cache_start == nullptr || membuf == nullptr)
-    {
-        stopmsg(STOPMSG_NONE,
-            "*** insufficient free memory for cache buffers ***");
-        return -1;
-    }
-    if (driver_diskp())
-    {
-        char buf[50];
-        sprintf(buf, "Cache size: %dK", cache_size);
-        driver_put_string(BOXROW+6, BOXCOL+4, C_DVID_LO, buf);
-    }
-
-    // preset cache to all invalid entries so we don't need free list logic
-    for (int i = 0; i < HASHSIZE; ++i)
-    {
-        hash_ptr[i] = 0xffff; // 0xffff marks the end of a hash chain
-    }
-    longtmp = 100000000L;
-    for (cache *ptr1 = cache_start; ptr1 < cache_end; ++ptr1)
-    {
-        ptr1->dirty = false;
-        ptr1->lru = false;
-        longtmp += BLOCKLEN;
-        fwd_link = &hash_ptr[(((unsigned short)longtmp >> BLOCKSHIFT) & (HASHSIZE-1))];
-        ptr1->offset = longtmp;
-        ptr1->hashlink = *fwd_link;
-        *fwd_link = (int)((char *)ptr1 - (char *)cache_start);
-    }
-
-    memorysize = (long)(newcolsize) * newrowsize + headerlength;
-    int i = (short)memorysize & (BLOCKLEN-1);
-    if (i != 0)
-    {
-        memorysize += BLOCKLEN - i;
-    }
-    memorysize >>= pixelshift;
-    memorysize >>= BLOCKSHIFT;
-    g_disk_flag = true;
-    rowsize = (unsigned int) newrowsize;
-    colsize = (unsigned int) newcolsize;
-
-    if (disktarga)
-    {
-        // Retrieve the header information first
-        BYTE *tmpptr;
-        tmpptr = membuf;
-        fseek(fp, 0L, SEEK_SET);
-        for (int i = 0; i < headerlength; i++)
+        else
         {
-            *tmpptr++ = (BYTE)fgetc(fp);
+            ok = alloc_frame(static_cast<std::size_t>(size));
         }
-        fclose(fp);
-        dv_handle = MemoryAlloc((U16)BLOCKLEN, memorysize, DISK);
-    }
-    else
-    {
-        dv_handle = MemoryAlloc((U16)BLOCKLEN, memorysize, MEMORY);
     }
-    if (dv_handle == 0)
+    if (!ok)
     {
+        free_frame();
         stopmsg(STOPMSG_NONE, "*** insufficient free memory/disk space ***");
         g_good_mode = false;
         rowsize = 0;
         return -1;
     }
+    g_disk_flag = true;
+    rowsize = (unsigned int) newrowsize;
+    colsize = (unsigned int) newcolsize;
 
     if (driver_diskp())
     {
         driver_put_string(BOXROW+2, BOXCOL+23, C_DVID_LO,
-                          (MemoryType(dv_handle) == DISK) ? "Using your Disk Drive" : "Using your memory");
-    }
-
-    membufptr = membuf;
-
-    if (disktarga)
-    {
-        // Put header information in the file
-        MoveToMemory(membuf, (U16)headerlength, 1L, 0, dv_handle);
-    }
-    else
-    {
-        for (long offset = 0; offset < memorysize; offset++)
-        {
-            SetMemory(0, (U16)BLOCKLEN, 1L, offset, dv_handle);
-            if (driver_key_pressed())           // user interrupt
-            {
-                // esc to cancel, else continue
-                if (stopmsg(STOPMSG_CANCEL, "Disk Video initialization interrupted:\n"))
-                {
-                    enddisk();
-                    g_good_mode = false;
-                    return -2;            // -1 == failed, -2 == cancel
-                }
-            }
-        }
-    }
-
-    if (driver_diskp())
-    {
+                          on_disk ? "Using your Disk Drive" : "Using your memory");
         dvid_status(0, "");
     }
     return 0;
@@ -313,46 +173,21 @@ int common_startdisk(long newrowsize, long newcolsize, int colors)
 
 void enddisk()
 {
+    free_frame();
     if (fp != nullptr)
     {
-        if (disktarga) // flush the cache
-        {
-            for (cache_lru = cache_start; cache_lru < cache_end; ++cache_lru)
-            {
-                if (cache_lru->dirty)
-                {
-                    write_cache_lru();
-                }
-            }
-        }
         fclose(fp);
         fp = nullptr;
     }
-
-    if (dv_handle != 0)
-    {
-        MemoryRelease(dv_handle);
-        dv_handle = 0;
-    }
-    if (cache_start != nullptr)
-    {
-        free((void *)cache_start);
-        cache_start = nullptr;
-    }
-    if (membuf != nullptr)
-    {
-        free((void *)membuf);
-        membuf = nullptr;
-    }
     g_disk_flag = false;
     rowsize = 0;
+    colsize = 0;
+    cur_row = -1;
     disk16bit = false;
 }
 
 int readdisk(int col, int row)
 {
-    int col_subscr;
-    long offset;
     char buf[41];
     if (--timetodisplay < 0)  // time to g_driver status?
     {
@@ -371,41 +206,29 @@ int readdisk(int col, int row)
             timetodisplay = 1000;  // time-to-g_driver-status counter
         }
     }
-    if (row != cur_row) // try to avoid ghastly code generated for multiply
+    if (row != cur_row) // keep the multiply out of the per pixel path
     {
-        if (row >= colsize) // while we're at it avoid this test if not needed
+        if ((unsigned int) row >= (unsigned int) colsize)
         {
             return 0;
         }
         cur_row = row;
-        cur_row_base = (long) cur_row * rowsize;
+        cur_row_base = frame + (std::size_t) row * rowsize;
     }
-    if (col >= rowsize)
+    if ((unsigned int) col >= (unsigned int) rowsize)
     {
         return 0;
     }
-    offset = cur_row_base + col;
-    col_subscr = (short) offset & (BLOCKLEN-1); // offset within cache entry
-    if (cur_offset != (offset & (0L-BLOCKLEN))) // same entry as last ref?
-    {
-        findload_cache(offset & (0L-BLOCKLEN));
-    }
-    return cur_cache->pixel[col_subscr];
+    return cur_row_base[col];
 }
 
 int FromMemDisk(long offset, int size, void *dest)
 {
-    int col_subscr = (int)(offset & (BLOCKLEN - 1));
-    if (col_subscr + size > BLOCKLEN)            // access violates  a
+    if (offset < 0 || size < 0 || (std::size_t) offset + size > frame_size)
     {
-        return 0;                                 //   cache boundary
-    }
-    if (cur_offset != (offset & (0L-BLOCKLEN))) // same entry as last ref?
-    {
-        findload_cache(offset & (0L-BLOCKLEN));
+        return 0;
     }
-    memcpy(dest, (void *) &cur_cache->pixel[col_subscr], size);
-    cur_cache->dirty = false;
+    memcpy(dest, frame + offset, size);
     return 1;
 }
 
@@ -421,8 +244,6 @@ void targa_readdisk(unsigned int col, unsigned int row,
 
 void writedisk(int col, int row, int color)
 {
-    int col_subscr;
-    long offset;
     char buf[41];
     if (--timetodisplay < 0)  // time to display status?
     {
@@ -434,48 +255,29 @@ void writedisk(int col, int row, int color)
         }
         timetodisplay = 1000;
     }
-    if (row != (unsigned int) cur_row)     // try to avoid ghastly code generated for multiply
+    if (row != cur_row) // keep the multiply out of the per pixel path
     {
-        if (row >= colsize) // while we're at it avoid this test if not needed
+        if ((unsigned int) row >= (unsigned int) colsize)
         {
             return;
         }
         cur_row = row;
-        cur_row_base = (long) cur_row*rowsize;
+        cur_row_base = frame + (std::size_t) row * rowsize;
     }
-    if (col >= rowsize)
+    if ((unsigned int) col >= (unsigned int) rowsize)
     {
         return;
     }
-    offset = cur_row_base + col;
-    col_subscr = (short) offset & (BLOCKLEN-1);
-    if (cur_offset != (offset & (0L-BLOCKLEN))) // same entry as last ref?
-    {
-        findload_cache(offset & (0L-BLOCKLEN));
-    }
-    if (cur_cache->pixel[col_subscr] != (color & 0xff))
-    {
-        cur_cache->pixel[col_subscr] = (BYTE) color;
-        cur_cache->dirty = true;
-    }
+    cur_row_base[col] = (BYTE) color;
 }
 
 bool ToMemDisk(long offset, int size, void *src)
 {
-    int col_subscr = (int)(offset & (BLOCKLEN - 1));
-
-    if (col_subscr + size > BLOCKLEN)           // access violates  a
-    {
-        return false;                           //   cache boundary
-    }
-
-    if (cur_offset != (offset & (0L-BLOCKLEN))) // same entry as last ref?
+    if (offset < 0 || size < 0 || (std::size_t) offset + size > frame_size)
     {
-        findload_cache(offset & (0L-BLOCKLEN));
+        return false;
     }
-
-    memcpy((void *) &cur_cache->pixel[col_subscr], src, size);
-    cur_cache->dirty = true;
+    memcpy(frame + offset, src, size);
     return true;
 }
 
@@ -487,266 +289,101 @@ void targa_writedisk(unsigned int col, unsigned int row,
     writedisk(col+1, row, red);
 }
 
-static void findload_cache(long offset) // used by read/write
+/* The frame is an ordinary zeroed allocation.  If that is refused, or
+   debug=420 asks for disk memory, an unlinked temporary file is mapped
+   instead so the system pages it to disk; a targa file is always mapped
+   in place.  Without mmap the targa is read in and written back by
+   free_frame().
+   */
+static bool alloc_frame(std::size_t size)
 {
-    unsigned int tbloffset;
-    unsigned int *fwd_link;
-    BYTE *pixelptr = nullptr;
-    cur_offset = offset; // note this for next reference
-    // check if required entry is in cache - lookup by hash
-    tbloffset = hash_ptr[((unsigned short)offset >> BLOCKSHIFT) & (HASHSIZE-1) ];
-    while (tbloffset != 0xffff)  // follow the hash chain
-    {
-        cur_cache = (cache *)((char *)cache_start + tbloffset);
-        if (cur_cache->offset == offset)  // great, it is in the cache
-        {
-            cur_cache->lru = true;
-            return;
-        }
-        tbloffset = cur_cache->hashlink;
-    }
-    // must load the cache entry from backing store
-    while (true)  // look around for something not recently used
-    {
-        if (++cache_lru >= cache_end)
-        {
-            cache_lru = cache_start;
-        }
-        if (!cache_lru->lru)
-        {
-            break;
-        }
-        cache_lru->lru = false;
-    }
-    if (cache_lru->dirty) // must write this block before reusing it
+    on_disk = false;
+    if (debugflag != debug_flags::force_memory_from_disk)
     {
-        write_cache_lru();
-    }
-    // remove block at cache_lru from its hash chain
-    fwd_link = &hash_ptr[(((unsigned short)cache_lru->offset >> BLOCKSHIFT) & (HASHSIZE-1))];
-    tbloffset = (int)((char *)cache_lru - (char *)cache_start);
-    while (*fwd_link != tbloffset)
-    {
-        fwd_link = &((cache *)((char *)cache_start+*fwd_link))->hashlink;
-    }
-    *fwd_link = cache_lru->hashlink;
-    // load block
-    cache_lru->dirty  = false;
-    cache_lru->lru    = true;
-    cache_lru->offset = offset;
-    pixelptr = &cache_lru->pixel[0];
-    if (offset > high_offset)  // never been this high before, just clear it
-    {
-        high_offset = offset;
-        memset(pixelptr, 0, BLOCKLEN);
-    }
-    else
-    {
-        if (offset != seek_offset)
-        {
-            mem_seek(offset >> pixelshift);
-        }
-        seek_offset = offset + BLOCKLEN;
-        switch (pixelshift)
+        frame = static_cast<BYTE *>(calloc(size == 0 ? 1 : size, 1));
+        if (frame != nullptr)
         {
-        case 0:
-            for (int i = 0; i < BLOCKLEN; ++i)
-            {
-                *(pixelptr++) = mem_getc();
-            }
-            break;
-
-        case 1:
-            for (int i = 0; i < BLOCKLEN/2; ++i)
-            {
-                BYTE const tmpchar = mem_getc();
-                *(pixelptr++) = (BYTE)(tmpchar >> 4);
-                *(pixelptr++) = (BYTE)(tmpchar & 15);
-            }
-            break;
-        case 2:
-            for (int i = 0; i < BLOCKLEN/4; ++i)
-            {
-                BYTE const tmpchar = mem_getc();
-                for (int j = 6; j >= 0; j -= 2)
-                    *(pixelptr++) = (BYTE)((tmpchar >> j) & 3);
-            }
-            break;
-        case 3:
-            for (int i = 0; i < BLOCKLEN/8; ++i)
-            {
-                BYTE const tmpchar = mem_getc();
-                for (int j = 7; j >= 0; --j)
-                    *(pixelptr++) = (BYTE)((tmpchar >> j) & 1);
-            }
-            break;
+            frame_size = size;
+            return true;
         }
     }
-    // add new block to its hash chain
-    fwd_link = &hash_ptr[(((unsigned short)offset >> BLOCKSHIFT) & (HASHSIZE-1))];
-    cache_lru->hashlink = *fwd_link;
-    *fwd_link = (int)((char *)cache_lru - (char *)cache_start);
-    cur_cache = cache_lru;
-}
-
-// lookup for write_cache_lru
-static cache *find_cache(long offset)
-{
-    unsigned int tbloffset;
-    cache *ptr1;
-    tbloffset = hash_ptr[((unsigned short)offset >> BLOCKSHIFT) & (HASHSIZE-1)];
-    while (tbloffset != 0xffff)
+#ifdef XFRACT
+    char tmpname[] = "diskvid.$$$";
+    if (FILE *tmp = dir_fopen(tempdir, tmpname, "w+b"))
     {
-        ptr1 = (cache *)((char *)cache_start + tbloffset);
-        if (ptr1->offset == offset)
-        {
-            return (ptr1);
-        }
-        tbloffset = ptr1->hashlink;
+        dir_remove(tempdir, tmpname);   // gone once unmapped
+        bool const ok = map_file(tmp, size);
+        fclose(tmp);
+        return ok;
     }
-    return nullptr;
+#endif
+    return false;
 }
 
-static void  write_cache_lru()
+// maps size bytes of frame after headerlength bytes of file
+static bool map_file(FILE *file, std::size_t size)
 {
-    int i;
-    BYTE *pixelptr;
-    long offset;
-    BYTE tmpchar = 0;
-    cache *ptr1, *ptr2;
-#define WRITEGAP 4 // 1 for no gaps
-    // scan back to also write any preceding dirty blocks, skipping small gaps
-    ptr1 = cache_lru;
-    offset = ptr1->offset;
-    i = 0;
-    while (++i <= WRITEGAP)
+    std::size_t const total = size + headerlength;
+#ifdef XFRACT
+    int const fd = fileno(file);
+    struct stat st;
+    if (fstat(fd, &st) != 0)
     {
-        offset -= BLOCKLEN;
-        ptr2 = find_cache(offset);
-        if (ptr2 != nullptr && ptr2->dirty)
-        {
-            ptr1 = ptr2;
-            i = 0;
-        }
-    }
-    // write all consecutive dirty blocks (often whole cache in 1pass modes)
-    // keep going past small gaps
-
-write_seek:
-    mem_seek(ptr1->offset >> pixelshift);
-
-write_stuff:
-    pixelptr = &ptr1->pixel[0];
-    switch (pixelshift)
-    {
-    case 0:
-        for (int i = 0; i < BLOCKLEN; ++i)
-            mem_putc(*(pixelptr++));
-        break;
-    case 1:
-        for (int i = 0; i < BLOCKLEN/2; ++i)
-        {
-            tmpchar = (BYTE)(*(pixelptr++) << 4);
-            tmpchar = (BYTE)(tmpchar + *(pixelptr++));
-            mem_putc(tmpchar);
-        }
-        break;
-    case 2:
-        for (int i = 0; i < BLOCKLEN/4; ++i)
-        {
-            for (int j = 6; j >= 0; j -= 2)
-                tmpchar = (BYTE)((tmpchar << 2) + *(pixelptr++));
-            mem_putc(tmpchar);
-        }
-        break;
-    case 3:
-        for (int i = 0; i < BLOCKLEN/8; ++i)
-        {
-            mem_putc((BYTE)
-                     ((((((((((((((*pixelptr
-                                   << 1)
-                                  | *(pixelptr+1))
-                                 << 1)
-                                | *(pixelptr+2))
-                               << 1)
-                              | *(pixelptr+3))
-                             << 1)
-                            | *(pixelptr+4))
-                           << 1)
-                          | *(pixelptr+5))
-                         << 1)
-                        | *(pixelptr+6))
-                       << 1)
-                      | *(pixelptr+7)));
-            pixelptr += 8;
-        }
-        break;
+        return false;
     }
-    ptr1->dirty = false;
-    offset = ptr1->offset + BLOCKLEN;
-    ptr1 = find_cache(offset);
-    if (ptr1 != nullptr && ptr1->dirty)
+    if ((std::uint64_t) st.st_size < total && ftruncate(fd, (off_t) total) != 0)
     {
-        goto write_stuff;
+        return false;
     }
-    i = 1;
-    while (++i <= WRITEGAP)
+    void *map = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
     {
-        offset += BLOCKLEN;
-        ptr1 = find_cache(offset);
-        if (ptr1 != nullptr && ptr1->dirty)
-        {
-            goto write_seek;
-        }
+        return false;
     }
-    seek_offset = -1; // force a seek before next read
-}
-
-/* Seek, mem_getc, mem_putc routines follow.
-   Note that the calling logic always separates mem_getc and mem_putc
-   sequences with a seek between them.  A mem_getc is never followed by
-   a mem_putc nor v.v. without a seek between them.
-   */
-static void mem_seek(long offset)        // mem seek
-{
-    offset += headerlength;
-    memoffset = offset >> BLOCKSHIFT;
-    if (memoffset != oldmemoffset)
+    mapping = static_cast<BYTE *>(map);
+    mapping_size = total;
+#else
+    mapping = static_cast<BYTE *>(calloc(total, 1));
+    if (mapping == nullptr)
     {
-        MoveToMemory(membuf, (U16)BLOCKLEN, 1L, oldmemoffset, dv_handle);
-        MoveFromMemory(membuf, (U16)BLOCKLEN, 1L, memoffset, dv_handle);
+        return false;
     }
-    oldmemoffset = memoffset;
-    membufptr = membuf + (offset & (BLOCKLEN - 1));
+    fseek(file, 0L, SEEK_SET);
+    fread(mapping, 1, total, file);   // a short file leaves zeros
+    mapping_size = total;
+#endif
+    frame = mapping + headerlength;
+    frame_size = size;
+    on_disk = true;
+    return true;
 }
 
-static BYTE  mem_getc()                     // memory get_char
+static void free_frame()
 {
-    if (membufptr - membuf >= BLOCKLEN)
+    if (mapping != nullptr)
     {
-        MoveToMemory(membuf, (U16)BLOCKLEN, 1L, memoffset, dv_handle);
-        memoffset++;
-        MoveFromMemory(membuf, (U16)BLOCKLEN, 1L, memoffset, dv_handle);
-        membufptr = membuf;
-        oldmemoffset = memoffset;
+#ifdef XFRACT
+        munmap(mapping, mapping_size);
+#else
+        if (fp != nullptr)
+        {
+            fseek(fp, 0L, SEEK_SET);
+            fwrite(mapping, 1, mapping_size, fp);
+        }
+        free(mapping);
+#endif
+        mapping = nullptr;
+        mapping_size = 0;
     }
-    return (*(membufptr++));
-}
-
-static void mem_putc(BYTE c)     // memory get_char
-{
-    if (membufptr - membuf >= BLOCKLEN)
+    else
     {
-        MoveToMemory(membuf, (U16)BLOCKLEN, 1L, memoffset, dv_handle);
-        memoffset++;
-        MoveFromMemory(membuf, (U16)BLOCKLEN, 1L, memoffset, dv_handle);
-        membufptr = membuf;
-        oldmemoffset = memoffset;
+        free(frame);
     }
-    *(membufptr++) = c;
+    frame = nullptr;
+    frame_size = 0;
+    on_disk = false;
 }
 
-
 void dvid_status(int line, const char *msg)
 {
     char buf[41];
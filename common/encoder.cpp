@@ -2,6 +2,8 @@
         encoder.c - GIF Encoder and associated routines
 */
 #include <algorithm>
+#include <atomic>
+#include <vector>
 
 #include <limits.h>
 #include <string.h>
@@ -15,6 +17,7 @@
 #include "prototyp.h"
 #include "fractype.h"
 #include "drivers.h"
+#include "workpool.h"
 
 static bool compress(int rowlimit);
 static int shftwrite(BYTE * color, int numcolors);
@@ -37,13 +40,11 @@ all the changes we have made to integrate their sources into Fractint.
 
 MEMORY ALLOCATION
 
-There are two large arrays:
+Each band of rows compressed in parallel has its own hash tables:
 
-   long htab[HSIZE]              (5003*4 = 20012 bytes)
+   long htab[HSIZE]              (5003*8 = 40024 bytes)
    unsigned short codetab[HSIZE] (5003*2 = 10006 bytes)
 
-At the moment these arrays reuse extraseg and strlocn, respectively.
-
 */
 
 static int numsaves = 0;        // For adjusting 'save-to-disk' filenames
@@ -593,6 +594,42 @@ static int shftwrite(BYTE * color, int numcolors)
     return (1);
 }
 
+// the palette the GIF gets, shifted to 8 bits, for all 256 color indices
+void gif_palette(BYTE palette[256][3])
+{
+    BYTE const *source = (BYTE const *) g_dac_box;
+    int count = 256;
+#ifdef XFRACT
+    bool const dac = g_got_real_dac || fake_lut;
+#else
+    bool const dac = g_got_real_dac;
+#endif
+    if (colors == 2)
+    {
+        source = paletteBW;
+        count = 2;
+    }
+#ifndef XFRACT
+    else if (colors == 4)
+    {
+        source = paletteCGA;
+        count = 4;
+    }
+#endif
+    else if (!dac)
+    {
+        source = paletteEGA;
+        count = 16;
+    }
+    for (int i = 0; i < 256; i++)
+        for (int j = 0; j < 3; j++)
+        {
+            BYTE thiscolor = source[3 * (i % count) + j];
+            thiscolor = (BYTE)(thiscolor << 2);
+            palette[i][j] = (BYTE)(thiscolor + (BYTE)(thiscolor >> 6));
+        }
+}
+
 static int extend_blk_len(int datalen)
 {
     return (datalen + (datalen + 254) / 255 + 15);
@@ -837,44 +874,17 @@ static void setup_save_info(FRACTAL_INFO *save_info)
 
 // prototypes
 
-static void output(int code);
+static void put_codes(std::vector<BYTE> const &codes, long bits);
 static void char_out(int c);
 static void flush_char();
-static void cl_block();
 
-static int n_bits;                        // number of bits/code
 static int maxbits = BITSF;                // user settable max # bits/code
-static int maxcode;                  // maximum code, given n_bits
 static int maxmaxcode = (int)1 << BITSF; // should NEVER generate this code
 # define MAXCODE(n_bits)        (((int) 1 << (n_bits)) - 1)
 
 unsigned int strlocn[10240] = { 0 };
 BYTE block[4096] = { 0 };
 
-static long htab[HSIZE];
-static unsigned short *codetab = (unsigned short *)strlocn;
-
-/*
- * To save much memory, we overlay the table used by compress() with those
- * used by decompress().  The tab_prefix table is the same size and type
- * as the codetab.  The tab_suffix table needs 2**BITSF characters.  We
- * get this from the beginning of htab.  The output stack uses the rest
- * of htab, and contains characters.  There is plenty of room for any
- * possible stack (stack used to be 8000 characters).
- */
-
-#define tab_prefixof(i)   codetab[i]
-#define tab_suffixof(i)   ((char_type *)(htab))[i]
-#define de_stack          ((char_type *)&tab_suffixof((int)1 << BITSF))
-
-static int free_ent;                  // first unused entry
-
-/*
- * block compression parameters -- after all codes are used up,
- * and compression rate changes, start over.
- */
-static bool clear_flg = false;
-
 /*
  * compress stdin to stdout
  *
@@ -893,6 +903,7 @@ static bool clear_flg = false;
 
 static int ClearCode;
 static int EOFCode;
+static int hshift;                  // set hash code range bound
 static int a_count; // Number of characters so far in this 'packet'
 static unsigned long cur_accum = 0;
 static int  cur_bits = 0;
@@ -902,15 +913,216 @@ static int  cur_bits = 0;
  */
 static char accum[256];
 
+/*
+ * The image is cut into bands of whole rows, which the work pool
+ * compresses independently.  A band starts with an empty code table, as
+ * after a clear code, and every band but the last ends with a clear code,
+ * so the bands' code streams simply follow each other bit for bit.  With a
+ * single band the output is that of the serial compressor.
+ */
+#define BAND_PIXELS 1048576L    // pixels per band, rounded to whole rows
+
+class lzw_coder
+{
+public:
+    lzw_coder(bool first, std::vector<BYTE> &out);
+    void compress(BYTE const *pixels, long count);
+    long finish(bool last);             // returns the number of bits written
+
+private:
+    void output(int code);
+
+    std::vector<BYTE> &m_out;
+    std::vector<long> m_htab;
+    std::vector<unsigned short> m_codetab;
+    int m_n_bits;                       // number of bits/code
+    int m_maxcode;                      // maximum code, given n_bits
+    int m_free_ent;                     // first unused entry
+    bool m_clear_flg;
+    int m_ent;
+    long m_in_count;
+    unsigned long m_accum;
+    int m_bits;
+};
+
+lzw_coder::lzw_coder(bool first, std::vector<BYTE> &out) :
+    m_out(out),
+    m_htab(HSIZE, -1L),
+    m_codetab(HSIZE),
+    m_n_bits(startbits),
+    m_maxcode(MAXCODE(startbits)),
+    m_free_ent(ClearCode + 2),
+    m_clear_flg(false),
+    m_ent(0),
+    m_in_count(0),
+    m_accum(0),
+    m_bits(0)
+{
+    if (first)
+        output(ClearCode);
+}
+
+void lzw_coder::compress(BYTE const *pixels, long count)
+{
+    int const hsize_reg = HSIZE;
+    int ent = m_ent;
+    for (long n = 0; n < count; ++n)
+    {
+        int const color = pixels[n];
+        if (m_in_count == 0)
+        {
+            m_in_count = 1;
+            ent = color;
+            continue;
+        }
+        long fcode = (long)(((long) color << maxbits) + ent);
+        int i = ((color << hshift) ^ ent);    // xor hashing
+
+        if (m_htab[i] == fcode)
+        {
+            ent = m_codetab[i];
+            continue;
+        }
+        else if (m_htab[i] >= 0)        // occupied slot
+        {
+            int disp = hsize_reg - i;   // secondary hash (after G. Knott)
+            if (i == 0)
+                disp = 1;
+            bool found = false;
+            do
+            {
+                if ((i -= disp) < 0)
+                    i += hsize_reg;
+                if (m_htab[i] == fcode)
+                {
+                    ent = m_codetab[i];
+                    found = true;
+                    break;
+                }
+            }
+            while (m_htab[i] > 0);
+            if (found)
+                continue;
+        }
+        output(ent);
+        ent = color;
+        if (m_free_ent < maxmaxcode)
+        {
+            // code -> hashtable
+            m_codetab[i] = (unsigned short)m_free_ent++;
+            m_htab[i] = fcode;
+        }
+        else
+        {
+            // table clear for block compress
+            std::fill(m_htab.begin(), m_htab.end(), -1L);
+            m_free_ent = ClearCode + 2;
+            m_clear_flg = true;
+            output(ClearCode);
+        }
+    }
+    m_ent = ent;
+}
+
+long lzw_coder::finish(bool last)
+{
+    // Put out the final code.
+    if (m_in_count != 0)
+        output(m_ent);
+    if (last)
+        output(EOFCode);
+    else
+    {
+        m_clear_flg = true;
+        output(ClearCode);
+    }
+    long const bits = (long) m_out.size()*8 + m_bits;
+    if (m_bits > 0)
+        m_out.push_back((BYTE)(m_accum & 0xff));
+    return bits;
+}
+
+/*****************************************************************
+ * TAG(output)
+ *
+ * Output the given code.
+ * Inputs:
+ *      code:   A n_bits-bit integer.
+ * Outputs:
+ *      Appends code to the band's code stream.
+ * Assumptions:
+ *      Chars are 8 bits long.
+ */
+void lzw_coder::output(int code)
+{
+    m_accum |= (unsigned long) code << m_bits;
+    m_bits += m_n_bits;
+    while (m_bits >= 8)
+    {
+        m_out.push_back((BYTE)(m_accum & 0xff));
+        m_accum >>= 8;
+        m_bits -= 8;
+    }
+
+    /*
+     * If the next entry is going to be too big for the code size,
+     * then increase it, if possible.
+     */
+    if (m_free_ent > m_maxcode || m_clear_flg)
+    {
+        if (m_clear_flg)
+        {
+            m_n_bits = startbits;
+            m_maxcode = MAXCODE(m_n_bits);
+            m_clear_flg = false;
+        }
+        else
+        {
+            m_n_bits++;
+            if (m_n_bits == maxbits)
+                m_maxcode = maxmaxcode;
+            else
+                m_maxcode = MAXCODE(m_n_bits);
+        }
+    }
+}
+
+struct gif_band
+{
+    std::vector<BYTE> pixels;
+    std::vector<BYTE> codes;
+    long bits = 0;
+    std::atomic<bool> done{false};
+};
+
+// read image row rownum, that is rows rownum, rownum + ydots, ... below
+// rowlimit side by side, into pixels
+static void get_gif_row(int rownum, int rowlimit, BYTE *pixels)
+{
+    for (int ydot = rownum; ydot < rowlimit; ydot += ydots)
+    {
+        if (save16bit && ydot >= ydots)
+        {
+            for (int xdot = 0; xdot < xdots; xdot++)
+                *pixels++ = (BYTE) readdisk(xdot + sxoffs, ydot + syoffs);
+        }
+        else if (sxoffs >= 0 && syoffs >= 0
+            && xdots + sxoffs <= sxdots && ydot + syoffs < sydots)
+        {
+            get_line(ydot, 0, xdots - 1, pixels);
+            pixels += xdots;
+        }
+        else
+        {
+            for (int xdot = 0; xdot < xdots; xdot++)
+                *pixels++ = (BYTE) getcolor(xdot, ydot);
+        }
+    }
+}
+
 static bool compress(int rowlimit)
 {
     int outcolor1, outcolor2;
-    int ent;
-    int disp;
-    int hsize_reg;
-    int hshift;
-    int color;
-    int in_count = 0;
     bool interrupted = false;
     int tempkey;
 
@@ -934,14 +1146,9 @@ static bool compress(int rowlimit)
     // Set up the necessary values
     cur_accum = 0;
     cur_bits = 0;
-    clear_flg = false;
-    ent = 0;
-    n_bits = startbits;
-    maxcode = MAXCODE(n_bits);
 
     ClearCode = (1 << (startbits - 1));
     EOFCode = ClearCode + 1;
-    free_ent = ClearCode + 2;
 
     a_count = 0;
     hshift = 0;
@@ -949,63 +1156,26 @@ static bool compress(int rowlimit)
         hshift++;
     hshift = 8 - hshift;                // set hash code range bound
 
-    memset(htab, 0xff, (unsigned)HSIZE*sizeof(long));
-    hsize_reg = HSIZE;
-
-    output((int)ClearCode);
+    long const width = (long) xdots*(rowlimit/ydots);
+    work_pool pool(work_pool_threads());
+    int band_rows = ydots;
+    if (pool.size() > 1)
+        band_rows = (int) std::max(1L, std::min((long) ydots, BAND_PIXELS/width));
+    int const num_bands = (ydots + band_rows - 1)/band_rows;
+    std::vector<gif_band> bands(num_bands);
+    int pushed = 0;
+    int written = 0;
 
     for (int rownum = 0; rownum < ydots; rownum++)
     {   // scan through the dots
+        gif_band &band = bands[rownum/band_rows];
+        long const start = (long)(rownum % band_rows)*width;
+        if (start == 0)
+            band.pixels.reserve((long) band_rows*width);
+        band.pixels.resize(start + width);
+        get_gif_row(rownum, rowlimit, &band.pixels[start]);
         for (int ydot = rownum; ydot < rowlimit; ydot += ydots)
         {
-            for (int xdot = 0; xdot < xdots; xdot++)
-            {
-                if (save16bit == 0 || ydot < ydots)
-                    color = getcolor(xdot, ydot);
-                else
-                    color = readdisk(xdot + sxoffs, ydot + syoffs);
-                if (in_count == 0)
-                {
-                    in_count = 1;
-                    ent = color;
-                    continue;
-                }
-                long fcode = (long)(((long) color << maxbits) + ent);
-                int i = (((int)color << hshift) ^ ent);    // xor hashing
-
-                if (htab[i] == fcode)
-                {
-                    ent = codetab[i];
-                    continue;
-                }
-                else if ((long)htab[i] < 0)      // empty slot
-                    goto nomatch;
-                disp = hsize_reg - i;           // secondary hash (after G. Knott)
-                if (i == 0)
-                    disp = 1;
-probe:
-                if ((i -= disp) < 0)
-                    i += hsize_reg;
-
-                if (htab[i] == fcode)
-                {
-                    ent = codetab[i];
-                    continue;
-                }
-                if ((long)htab[i] > 0)
-                    goto probe;
-nomatch:
-                output((int) ent);
-                ent = color;
-                if (free_ent < maxmaxcode)
-                {
-                    // code -> hashtable
-                    codetab[i] = (unsigned short)free_ent++;
-                    htab[i] = fcode;
-                }
-                else
-                    cl_block();
-            } // end for xdot
             if (! driver_diskp()       // supress this on disk-video
                     && ydot == rownum)
             {
@@ -1029,112 +1199,77 @@ nomatch:
             if (tempkey && (tempkey != 's'))  // keyboard hit - bail out
             {
                 interrupted = true;
-                rownum = ydots;
                 break;
             }
             if (tempkey == 's')
                 driver_get_key();   // eat the keystroke
         } // end for ydot
+        if (interrupted || rownum == ydots - 1 || (rownum + 1) % band_rows == 0)
+        {
+            // band complete, hand it to the pool
+            int const b = pushed++;
+            bool const last = interrupted || rownum == ydots - 1;
+            pool.push([&bands, b, last](int)
+            {
+                gif_band &band = bands[b];
+                lzw_coder coder(b == 0, band.codes);
+                coder.compress(band.pixels.data(), (long) band.pixels.size());
+                band.bits = coder.finish(last);
+                std::vector<BYTE>().swap(band.pixels);
+                band.done = true;
+            });
+        }
+        while (written < pushed && bands[written].done)
+        {
+            put_codes(bands[written].codes, bands[written].bits);
+            std::vector<BYTE>().swap(bands[written++].codes);
+        }
+        if (interrupted)
+            break;
     } // end for rownum
 
-    // Put out the final code.
-    output((int)ent);
-    output((int) EOFCode);
-    return interrupted;
-}
-
-/*****************************************************************
- * TAG(output)
- *
- * Output the given code.
- * Inputs:
- *      code:   A n_bits-bit integer.  If == -1, then EOF.  This assumes
- *              that n_bits =< (long)wordsize - 1.
- * Outputs:
- *      Outputs code to the file.
- * Assumptions:
- *      Chars are 8 bits long.
- * Algorithm:
- *      Maintain a BITSF character long buffer (so that 8 codes will
- * fit in it exactly).  Use the VAX insv instruction to insert each
- * code in turn.  When the buffer fills up empty it and start over.
- */
-
-
-static void output(int code)
-{
-    static unsigned long masks[] =
-    {   0x0000, 0x0001, 0x0003, 0x0007, 0x000F,
-        0x001F, 0x003F, 0x007F, 0x00FF,
-        0x01FF, 0x03FF, 0x07FF, 0x0FFF,
-        0x1FFF, 0x3FFF, 0x7FFF, 0xFFFF
-    };
-
-    cur_accum &= masks[ cur_bits ];
-
-    if (cur_bits > 0)
-        cur_accum |= ((long)code << cur_bits);
-    else
-        cur_accum = code;
-
-    cur_bits += n_bits;
+    while (written < pushed)
+    {
+        pool.wait(10);
+        while (written < pushed && bands[written].done)
+        {
+            put_codes(bands[written].codes, bands[written].bits);
+            std::vector<BYTE>().swap(bands[written++].codes);
+        }
+    }
 
-    while (cur_bits >= 8)
+    // At EOF, write the rest of the buffer.
+    while (cur_bits > 0)
     {
         char_out((unsigned int)(cur_accum & 0xff));
         cur_accum >>= 8;
         cur_bits -= 8;
     }
+    flush_char();
+    fflush(g_outfile);
+    return interrupted;
+}
 
-    /*
-     * If the next entry is going to be too big for the code size,
-     * then increase it, if possible.
-     */
-    if (free_ent > maxcode || clear_flg)
-    {
-        if (clear_flg)
-        {
-            n_bits = startbits;
-            maxcode = MAXCODE(n_bits);
-            clear_flg = false;
-        }
-        else
-        {
-            n_bits++;
-            if (n_bits == maxbits)
-                maxcode = maxmaxcode;
-            else
-                maxcode = MAXCODE(n_bits);
-        }
-    }
-
-    if (code == EOFCode)
+/*
+ * Append the first bits bits of a band's code stream to the packets,
+ * which need not start on a byte boundary.
+ */
+static void put_codes(std::vector<BYTE> const &codes, long bits)
+{
+    for (long i = 0; bits > 0; ++i, bits -= 8)
     {
-        // At EOF, write the rest of the buffer.
-        while (cur_bits > 0)
+        int const n = bits < 8 ? (int) bits : 8;
+        cur_accum |= (unsigned long)(codes[i] & ((1 << n) - 1)) << cur_bits;
+        cur_bits += n;
+        while (cur_bits >= 8)
         {
             char_out((unsigned int)(cur_accum & 0xff));
             cur_accum >>= 8;
             cur_bits -= 8;
         }
-
-        flush_char();
-
-        fflush(g_outfile);
     }
 }
 
-/*
- * Clear out the hash table
- */
-static void cl_block()             // table clear for block compress
-{
-    memset(htab, 0xff, (unsigned)HSIZE*sizeof(long));
-    free_ent = ClearCode + 2;
-    clear_flg = true;
-    output((int)ClearCode);
-}
-
 /*
  * Add a character to the end of the current packet, and if it is 254
  * characters, flush the packet to disk.
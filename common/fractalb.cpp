@@ -7,6 +7,10 @@ fractal routines.
 #include <float.h>
 #include <limits.h>
 #include <string.h>
+
+#include <algorithm>
+#include <vector>
+
 #if !defined(_WIN32)
 #include <malloc.h>
 #endif
@@ -14,6 +18,7 @@ fractal routines.
 #include "prototyp.h"
 #include "helpdefs.h"
 #include "fractype.h"
+#include "ddouble.h"
 
 
 bf_math_type bf_math = bf_math_type::NONE;
@@ -812,6 +817,323 @@ JuliabfFractal()
     return bigfltbailout();
 }
 
+/*
+   Perturbation for the deep zoomed Mandelbrot set.  One reference orbit,
+   from the pixel in the middle of the screen, is iterated in bigflt and
+   kept as doubles.  Every other pixel only iterates its difference from
+   the reference,
+
+       dz' = 2*Z*dz + dz*dz + dc
+
+   which stays small enough for doubles however deep the zoom is.  When z
+   gets closer to zero than dz the difference no longer carries the pixel's
+   detail (a glitch), so the pixel is rebased onto the start of the
+   reference orbit with dz = z; the same happens when the reference orbit
+   escapes before the pixel does.
+*/
+static std::vector<DComplex> s_ref_orbit;
+static int s_ref_col = 0;
+static int s_ref_row = 0;
+static double s_ref_delx = 0.0;         // pixel steps as doubles
+static double s_ref_dely = 0.0;
+static double s_ref_delx2 = 0.0;
+static double s_ref_dely2 = 0.0;
+static DComplex s_ref_dc;               // this pixel minus the reference
+static DComplex s_ref_dz;
+static int s_ref_iter = 0;              // index of the reference point in use
+
+// perturbation needs z to start at zero, no distance estimator and pixel
+// steps that fit a double
+bool perturbation_ok()
+{
+    if (!g_perturbation || invert || distest || useinitorbit
+            || param[0] != 0.0 || param[1] != 0.0
+            || ((inside == BOF60 || inside == BOF61) && !nobof))
+        return false;
+    int saved = save_stack();
+    bf_t width = alloc_stack(rbflength+2);
+    bf_t height = alloc_stack(rbflength+2);
+    sub_bf(width, bfxmax, bfxmin);
+    sub_bf(height, bfymax, bfymin);
+    LDBL const step = std::min(fabsl(bftofloat(width))/xdots, fabsl(bftofloat(height))/ydots);
+    restore_stack(saved);
+    // keep 52 bits of headroom above the smallest normal double
+    return step > DBL_MIN/DBL_EPSILON;
+}
+
+bool MandelperturbSetup()
+{
+    int saved = save_stack();
+    bf_t step = alloc_stack(rbflength+2);
+    bf_t tmp = alloc_stack(rbflength+2);
+    BFComplex c, z, sq;
+    c.x = alloc_stack(rbflength+2);
+    c.y = alloc_stack(rbflength+2);
+    z.x = alloc_stack(rbflength+2);
+    z.y = alloc_stack(rbflength+2);
+    sq.x = alloc_stack(rbflength+2);
+    sq.y = alloc_stack(rbflength+2);
+
+    s_ref_col = xdots/2;
+    s_ref_row = ydots/2;
+
+    // c.x = xxmin + col*delx + row*delx2
+    sub_bf(step, bfxmax, bfx3rd);
+    div_a_bf_int(step, (U16)(xdots - 1));
+    s_ref_delx = (double)bftofloat(step);
+    mult_bf_int(c.x, step, (U16)s_ref_col);
+    sub_bf(step, bfx3rd, bfxmin);
+    div_a_bf_int(step, (U16)(ydots - 1));
+    s_ref_delx2 = (double)bftofloat(step);
+    mult_bf_int(tmp, step, (U16)s_ref_row);
+    add_a_bf(c.x, tmp);
+    add_a_bf(c.x, bfxmin);
+
+    // c.y = yymax - row*dely - col*dely2
+    sub_bf(step, bfymax, bfy3rd);
+    div_a_bf_int(step, (U16)(ydots - 1));
+    s_ref_dely = (double)bftofloat(step);
+    mult_bf_int(z.y, step, (U16)s_ref_row);
+    sub_bf(step, bfy3rd, bfymin);
+    div_a_bf_int(step, (U16)(xdots - 1));
+    s_ref_dely2 = (double)bftofloat(step);
+    mult_bf_int(tmp, step, (U16)s_ref_col);
+    add_a_bf(z.y, tmp);
+    sub_bf(c.y, bfymax, z.y);
+
+    // periodicity close enough, as the double precision setup does it
+    ddelmin = std::min(std::max(fabs(s_ref_delx), fabs(s_ref_delx2)),
+                       std::max(fabs(s_ref_dely), fabs(s_ref_dely2)));
+
+    // Z[0] = 0, Z[1] = c, and so on until the reference escapes
+    s_ref_orbit.clear();
+    s_ref_orbit.push_back(DComplex{0.0, 0.0});
+    copy_bf(z.x, c.x);
+    copy_bf(z.y, c.y);
+    while (true)
+    {
+        s_ref_orbit.push_back(cmplxbftofloat(&z));
+        if (static_cast<long>(s_ref_orbit.size()) > maxit)
+            break;
+        square_bf(sq.x, z.x);
+        square_bf(sq.y, z.y);
+        add_bf(tmp, sq.x, sq.y);
+        if (bftofloat(tmp) >= rqlim)
+            break;
+        // z = (z.x^2 - z.y^2 + c.x) + i(2*z.x*z.y + c.y)
+        mult_bf(tmp, z.x, z.y);
+        double_a_bf(tmp);
+        add_bf(z.y, tmp, c.y);
+        sub_a_bf(sq.x, sq.y);
+        add_bf(z.x, sq.x, c.x);
+    }
+
+    restore_stack(saved);
+    bf_math = bf_math_type::PERTURBATION;
+    return true;
+}
+
+int mandelperturb_per_pixel()
+{
+    double const dcol = col - s_ref_col;
+    double const drow = row - s_ref_row;
+    s_ref_dc.x = dcol*s_ref_delx + drow*s_ref_delx2;
+    s_ref_dc.y = -drow*s_ref_dely - dcol*s_ref_dely2;
+    s_ref_dz = s_ref_dc;
+    s_ref_iter = 1;
+    old.x = s_ref_orbit[1].x + s_ref_dz.x;
+    old.y = s_ref_orbit[1].y + s_ref_dz.y;
+    tempsqrx = sqr(old.x);
+    tempsqry = sqr(old.y);
+    return 1;                  // 1st iteration has been done
+}
+
+int MandelperturbFractal()
+{
+    DComplex const &ref = s_ref_orbit[s_ref_iter];
+
+    // dz = (2*Z + dz)*dz + dc
+    double const ax = 2*ref.x + s_ref_dz.x;
+    double const ay = 2*ref.y + s_ref_dz.y;
+    double const dx = ax*s_ref_dz.x - ay*s_ref_dz.y + s_ref_dc.x;
+    s_ref_dz.y = ax*s_ref_dz.y + ay*s_ref_dz.x + s_ref_dc.y;
+    s_ref_dz.x = dx;
+
+    ++s_ref_iter;
+    g_new.x = s_ref_orbit[s_ref_iter].x + s_ref_dz.x;
+    g_new.y = s_ref_orbit[s_ref_iter].y + s_ref_dz.y;
+    if (sqr(g_new.x) + sqr(g_new.y) < sqr(s_ref_dz.x) + sqr(s_ref_dz.y)
+            || s_ref_iter == static_cast<int>(s_ref_orbit.size()) - 1)
+    {
+        s_ref_dz = g_new;
+        s_ref_iter = 0;
+    }
+    return floatbailout();
+}
+
+/*
+   Double-double for zooms that need up to DD_DIG digits, a little past
+   double precision but far short of what arbitrary precision is built
+   for.  The corners stay in bigflt; the setup turns them and the pixel
+   steps into double-doubles (see ddouble.h), and every pixel iterates in
+   double-double, several times faster than bignum at these lengths.
+   While the image is drawn bf_math is DOUBLE_DOUBLE, so StandardFractal
+   works on old and new rounded to double, except for the periodicity
+   check: orbits near a tiny minibrot shadow its cycle closer than double
+   can tell apart, so that compares the double-doubles.
+*/
+static ddouble s_dd_xmin;
+static ddouble s_dd_ymax;
+static ddouble s_dd_delx;               // pixel steps
+static ddouble s_dd_dely;
+static ddouble s_dd_delx2;
+static ddouble s_dd_dely2;
+static DDComplex s_dd_parm;
+static DDComplex s_dd_z;                // the orbit, new after each step
+static DDComplex s_dd_saved;            // for periodicity checking
+static double s_dd_closenuff = 0.0;
+
+// sum the mantissa bytes, each exact as a double, from the top down
+static ddouble bftodd(bf_t n)
+{
+    int saved = save_stack();
+    bf_t a = alloc_stack(rbflength+2);
+    copy_bf(a, n);
+    bool const negative = is_bf_neg(a) != 0;
+    if (negative)
+        neg_a_bf(a);
+    // the top two bytes are the integer part, the exponent is base 256
+    int const power = (S16) big_access16(a + bflength);
+    ddouble result = {0.0, 0.0};
+    for (int i = bflength - 1; i >= 0; i--)
+        if (a[i] != 0)
+            result = result + ddouble{ldexp((double) a[i], 8*(i - (bflength - 2) + power)), 0.0};
+    restore_stack(saved);
+    return negative ? -result : result;
+}
+
+// are the corners close enough together to need no more than double-double?
+bool ddouble_ok()
+{
+    if (debugflag == debug_flags::force_arbitrary_precision_math)
+        return false;
+    int const prec = getprecbf(CURRENTREZ);
+    return prec > 0 && prec <= DD_DIG+1;
+}
+
+bool MandelddSetup()
+{
+    int saved = save_stack();
+    bf_t step = alloc_stack(rbflength+2);
+
+    // delx = (xmax - x3rd)/(xdots-1)
+    sub_bf(step, bfxmax, bfx3rd);
+    div_a_bf_int(step, (U16)(xdots - 1));
+    s_dd_delx = bftodd(step);
+
+    // dely = (ymax - y3rd)/(ydots-1)
+    sub_bf(step, bfymax, bfy3rd);
+    div_a_bf_int(step, (U16)(ydots - 1));
+    s_dd_dely = bftodd(step);
+
+    // delx2 = (x3rd - xmin)/(ydots-1)
+    sub_bf(step, bfx3rd, bfxmin);
+    div_a_bf_int(step, (U16)(ydots - 1));
+    s_dd_delx2 = bftodd(step);
+
+    // dely2 = (y3rd - ymin)/(xdots-1)
+    sub_bf(step, bfy3rd, bfymin);
+    div_a_bf_int(step, (U16)(xdots - 1));
+    s_dd_dely2 = bftodd(step);
+
+    s_dd_xmin = bftodd(bfxmin);
+    s_dd_ymax = bftodd(bfymax);
+    if (fractype == fractal_type::JULIAFP)
+    {
+        s_dd_parm.x = bftodd(bfparms[0]);
+        s_dd_parm.y = bftodd(bfparms[1]);
+    }
+    restore_stack(saved);
+
+    // the largest step, halved periodicitycheck times, as MandelbfSetup() does it
+    s_dd_closenuff = std::max(std::max(fabs(s_dd_delx.hi), fabs(s_dd_delx2.hi)),
+                              std::max(fabs(s_dd_dely.hi), fabs(s_dd_dely2.hi)));
+    s_dd_closenuff = ldexp(s_dd_closenuff, -abs(periodicitycheck));
+
+    bf_math = bf_math_type::DOUBLE_DOUBLE;
+    return true;
+}
+
+// the pixel at col, row
+static DDComplex dd_pixel()
+{
+    // x = xxmin + col*delx + row*delx2, y = yymax - row*dely - col*dely2
+    DDComplex pixel;
+    pixel.x = s_dd_xmin + s_dd_delx*(double) col + s_dd_delx2*(double) row;
+    pixel.y = s_dd_ymax - (s_dd_dely*(double) row + s_dd_dely2*(double) col);
+    return pixel;
+}
+
+static int dd_start()
+{
+    old.x = s_dd_z.x.hi;
+    old.y = s_dd_z.y.hi;
+    tempsqrx = sqr(old.x);
+    tempsqry = sqr(old.y);
+    return 1;                  // 1st iteration has been done
+}
+
+int mandeldd_per_pixel()
+{
+    s_dd_parm = dd_pixel();
+    init.x = s_dd_parm.x.hi;
+    init.y = s_dd_parm.y.hi;
+    if ((inside == BOF60 || inside == BOF61) && !nobof)
+    {
+        /* kludge to match "Beauty of Fractals" picture since we start
+           Mandelbrot iteration with init rather than 0 */
+        s_dd_z.x = ddouble{param[0], 0.0};
+        s_dd_z.y = ddouble{param[1], 0.0};
+        coloriter = -1;
+    }
+    else
+    {
+        s_dd_z.x = s_dd_parm.x + ddouble{param[0], 0.0};
+        s_dd_z.y = s_dd_parm.y + ddouble{param[1], 0.0};
+    }
+    return dd_start();
+}
+
+int juliadd_per_pixel()
+{
+    s_dd_z = dd_pixel();
+    init.x = s_dd_z.x.hi;
+    init.y = s_dd_z.y.hi;
+    return dd_start();
+}
+
+int JuliaddFractal()
+{
+    ddouble const x2 = s_dd_z.x*s_dd_z.x;
+    ddouble const y2 = s_dd_z.y*s_dd_z.y;
+    s_dd_z.y = dd_twice(s_dd_z.x*s_dd_z.y) + s_dd_parm.y;
+    s_dd_z.x = x2 - y2 + s_dd_parm.x;
+    g_new.x = s_dd_z.x.hi;
+    g_new.y = s_dd_z.y.hi;
+    return floatbailout();
+}
+
+void ddouble_save_orbit()
+{
+    s_dd_saved = s_dd_z;
+}
+
+bool ddouble_orbit_cycled()
+{
+    return dd_abs(s_dd_saved.x - s_dd_z.x) < s_dd_closenuff
+        && dd_abs(s_dd_saved.y - s_dd_z.y) < s_dd_closenuff;
+}
+
 int
 JuliaZpowerbnFractal()
 {
@@ -142,6 +142,9 @@ AlternateMath alternatemath[] =
     */
     {fractal_type::FPJULIAZPOWER, bf_math_type::BIGFLT, JuliaZpowerbfFractal, juliabf_per_pixel, MandelbfSetup  },
     {fractal_type::FPMANDELZPOWER, bf_math_type::BIGFLT , JuliaZpowerbfFractal, mandelbf_per_pixel, MandelbfSetup},
+    {fractal_type::MANDELFP, bf_math_type::PERTURBATION, MandelperturbFractal, mandelperturb_per_pixel, MandelperturbSetup},
+    {fractal_type::JULIAFP, bf_math_type::DOUBLE_DOUBLE, JuliaddFractal, juliadd_per_pixel, MandelddSetup},
+    {fractal_type::MANDELFP, bf_math_type::DOUBLE_DOUBLE, JuliaddFractal, mandeldd_per_pixel, MandelddSetup},
     {fractal_type::NOFRACTAL, bf_math_type::NONE, nullptr,                nullptr,               nullptr         }
 };
 
@@ -311,7 +314,7 @@ fractalspecificstuff fractalspecific[] =
     {
         "plasma",
         {   "Graininess Factor (0 or 0.125 to 100, default is 2)",
-            "+Algorithm (0 = original, 1 = new)",
+            "+Algorithm (0 = original, 1 = new, 2 = by levels)",
             "+Random Seed Value (0 = Random, 1 = Reuse Last)",
             "+Save as Pot File? (0 = No,     1 = Yes)"
         },
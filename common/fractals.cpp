@@ -3366,6 +3366,582 @@ MandelbrotMix4fpFractal() // from formula by Jim Muth
 #undef K
 #undef L
 
+/*
+   Orbit kernels.  When nothing but periodicity checking happens between
+   iterations, StandardFractal() hands the whole orbit to a kernel: the
+   orbit step of the type and the bailout test compiled into one loop,
+   which keeps the orbit in registers instead of passing it through old,
+   g_new and tempsqrx/tempsqry on two indirect calls per iteration.
+   Each step repeats the arithmetic of its XxxxFractal() and each test
+   that of its xxxbailout(), so the images come out the same.
+*/
+namespace
+{
+
+struct orbit_regs
+{
+    DComplex z;                 // old
+    DComplex n;                 // g_new
+    double sqrx, sqry;          // tempsqrx, tempsqry
+    double magnitude;
+    double lim, lim2;           // rqlim, rqlim2
+};
+
+// the floatbailout() routines, sqrx and sqry set from n
+struct fp_mod_test
+{
+    static bool const sets_magnitude = true;
+    static bool escaped(orbit_regs &r)
+    {
+        r.magnitude = r.sqrx + r.sqry;
+        return r.magnitude >= r.lim;
+    }
+};
+
+struct fp_real_test
+{
+    static bool const sets_magnitude = true;
+    static bool escaped(orbit_regs &r)
+    {
+        r.magnitude = r.sqrx + r.sqry;
+        return r.sqrx >= r.lim;
+    }
+};
+
+struct fp_imag_test
+{
+    static bool const sets_magnitude = true;
+    static bool escaped(orbit_regs &r)
+    {
+        r.magnitude = r.sqrx + r.sqry;
+        return r.sqry >= r.lim;
+    }
+};
+
+struct fp_or_test
+{
+    static bool const sets_magnitude = true;
+    static bool escaped(orbit_regs &r)
+    {
+        r.magnitude = r.sqrx + r.sqry;
+        return r.sqrx >= r.lim || r.sqry >= r.lim;
+    }
+};
+
+struct fp_and_test
+{
+    static bool const sets_magnitude = true;
+    static bool escaped(orbit_regs &r)
+    {
+        r.magnitude = r.sqrx + r.sqry;
+        return r.sqrx >= r.lim && r.sqry >= r.lim;
+    }
+};
+
+struct fp_manh_test
+{
+    static bool const sets_magnitude = true;
+    static bool escaped(orbit_regs &r)
+    {
+        r.magnitude = r.sqrx + r.sqry;
+        double const manhmag = fabs(r.n.x) + fabs(r.n.y);
+        return (manhmag * manhmag) >= r.lim;
+    }
+};
+
+struct fp_manr_test
+{
+    static bool const sets_magnitude = true;
+    static bool escaped(orbit_regs &r)
+    {
+        r.magnitude = r.sqrx + r.sqry;
+        double const manrmag = r.n.x + r.n.y;
+        return (manrmag * manrmag) >= r.lim;
+    }
+};
+
+struct asm_mod_test
+{
+    static bool const sets_magnitude = true;
+    static bool escaped(orbit_regs &r)
+    {
+        r.magnitude = r.sqrx + r.sqry;
+        return r.magnitude > r.lim || r.magnitude < 0.0 || fabs(r.n.x) > r.lim2
+            || fabs(r.n.y) > r.lim2;
+    }
+};
+
+struct asm_real_test
+{
+    static bool const sets_magnitude = false;
+    static bool escaped(orbit_regs &r)
+    {
+        return r.sqrx >= r.lim;
+    }
+};
+
+struct asm_imag_test
+{
+    static bool const sets_magnitude = false;
+    static bool escaped(orbit_regs &r)
+    {
+        return r.sqry >= r.lim;
+    }
+};
+
+struct asm_or_test
+{
+    static bool const sets_magnitude = false;
+    static bool escaped(orbit_regs &r)
+    {
+        return r.sqrx >= r.lim || r.sqry >= r.lim;
+    }
+};
+
+struct asm_and_test
+{
+    static bool const sets_magnitude = false;
+    static bool escaped(orbit_regs &r)
+    {
+        return r.sqrx >= r.lim && r.sqry >= r.lim;
+    }
+};
+
+struct asm_manh_test
+{
+    static bool const sets_magnitude = true;
+    static bool escaped(orbit_regs &r)
+    {
+        r.magnitude = fabs(r.n.x) + fabs(r.n.y);
+        return r.magnitude*r.magnitude >= r.lim;
+    }
+};
+
+struct asm_manr_test
+{
+    static bool const sets_magnitude = true;
+    static bool escaped(orbit_regs &r)
+    {
+        r.magnitude = fabs(r.n.x + r.n.y);
+        return r.magnitude*r.magnitude >= r.lim;
+    }
+};
+
+// floatbailout() on the registers: z = n unless n escaped
+template <class Test>
+inline bool bailed_out(orbit_regs &r)
+{
+    r.sqrx = sqr(r.n.x);
+    r.sqry = sqr(r.n.y);
+    if (Test::escaped(r))
+        return true;
+    r.z = r.n;
+    return false;
+}
+
+/* The orbit steps.  The constructor picks up what the per_pixel routine
+   left in the globals, finish() puts back what the type carries from
+   one orbit to the next. */
+struct julia_step               // JuliafpFractal
+{
+    DComplex c;
+    julia_step() : c(*floatparm) { }
+    template <class Test>
+    bool next(orbit_regs &r)
+    {
+        r.n.x = r.sqrx - r.sqry + c.x;
+        r.n.y = 2.0 * r.z.x * r.z.y + c.y;
+        return bailed_out<Test>(r);
+    }
+    void finish() { }
+};
+
+struct lambda_step              // LambdaFPFractal
+{
+    DComplex c;
+    lambda_step() : c(*floatparm) { }
+    template <class Test>
+    bool next(orbit_regs &r)
+    {
+        double const tx = r.z.x - r.sqrx + r.sqry;
+        double ty = -(r.z.y * r.z.x);
+        ty += ty + r.z.y;
+        r.n.x = c.x * tx - c.y * ty;
+        r.n.y = c.x * ty + c.y * tx;
+        return bailed_out<Test>(r);
+    }
+    void finish() { }
+};
+
+struct markslambda_step         // MarksLambdafpFractal
+{
+    DComplex c, k;
+    markslambda_step() : c(*floatparm), k(coefficient) { }
+    template <class Test>
+    bool next(orbit_regs &r)
+    {
+        double const tx = r.sqrx - r.sqry;
+        double const ty = r.z.x * r.z.y *2;
+        r.n.x = k.x * tx - k.y * ty + c.x;
+        r.n.y = k.x * ty + k.y * tx + c.y;
+        return bailed_out<Test>(r);
+    }
+    void finish() { }
+};
+
+struct mandel4_step             // Mandel4fpFractal
+{
+    DComplex c;
+    mandel4_step() : c(*floatparm) { }
+    template <class Test>
+    bool next(orbit_regs &r)
+    {
+        r.n.x  = r.sqrx - r.sqry;
+        r.n.y = r.z.x*r.z.y*2;
+        if (bailed_out<Test>(r))
+            return true;
+        r.n.x  = r.sqrx - r.sqry + c.x;
+        r.n.y =  r.z.x*r.z.y*2 + c.y;
+        return bailed_out<Test>(r);
+    }
+    void finish() { }
+};
+
+struct zpower_step              // floatZpowerFractal
+{
+    DComplex c;
+    int exp;
+    zpower_step() : c(*floatparm), exp(c_exp) { }
+    template <class Test>
+    bool next(orbit_regs &r)
+    {
+        cpower(&r.z, exp, &r.n);
+        r.n.x += c.x;
+        r.n.y += c.y;
+        return bailed_out<Test>(r);
+    }
+    void finish() { }
+};
+
+struct phoenix_step             // PhoenixFractal
+{
+    DComplex c, y;
+    phoenix_step() : c(*floatparm), y(tmp2) { }
+    template <class Test>
+    bool next(orbit_regs &r)
+    {
+        double const t = r.z.x * r.z.y;
+        r.n.x = r.sqrx - r.sqry + c.x + (c.y * y.x);
+        r.n.y = (t + t) + (c.y * y.y);
+        y = r.z;
+        return bailed_out<Test>(r);
+    }
+    void finish() { tmp2 = y; }
+};
+
+struct phoenixcplx_step         // PhoenixFractalcplx
+{
+    DComplex c, p, y;
+    phoenixcplx_step() : c(*floatparm), p(parm2), y(tmp2) { }
+    template <class Test>
+    bool next(orbit_regs &r)
+    {
+        double const t = r.z.x * r.z.y;
+        r.n.x = r.sqrx - r.sqry + c.x + (p.x * y.x) - (p.y * y.y);
+        r.n.y = (t + t) + c.y + (p.x * y.y) + (p.y * y.x);
+        y = r.z;
+        return bailed_out<Test>(r);
+    }
+    void finish() { tmp2 = y; }
+};
+
+struct spider_step              // SpiderfpFractal
+{
+    DComplex c;
+    spider_step() : c(tmp) { }
+    template <class Test>
+    bool next(orbit_regs &r)
+    {
+        r.n.x = r.sqrx - r.sqry + c.x;
+        r.n.y = 2 * r.z.x * r.z.y + c.y;
+        c.x = c.x/2 + r.n.x;
+        c.y = c.y/2 + r.n.y;
+        return bailed_out<Test>(r);
+    }
+    void finish() { tmp = c; }
+};
+
+struct manowar_step             // ManOWarfpFractal
+{
+    DComplex c, t;
+    manowar_step() : c(*floatparm), t(tmp) { }
+    template <class Test>
+    bool next(orbit_regs &r)
+    {
+        r.n.x = r.sqrx - r.sqry + t.x + c.x;
+        r.n.y = 2.0 * r.z.x * r.z.y + t.y + c.y;
+        t = r.z;
+        return bailed_out<Test>(r);
+    }
+    void finish() { tmp = t; }
+};
+
+struct barnsley1_step           // Barnsley1FPFractal
+{
+    DComplex c;
+    barnsley1_step() : c(*floatparm) { }
+    template <class Test>
+    bool next(orbit_regs &r)
+    {
+        double const xcx = r.z.x * c.x;
+        double const ycy = r.z.y * c.y;
+        double const xcy = r.z.x * c.y;
+        double const ycx = r.z.y * c.x;
+        if (r.z.x >= 0)
+        {
+            r.n.x = (xcx - c.x - ycy);
+            r.n.y = (ycx - c.y + xcy);
+        }
+        else
+        {
+            r.n.x = (xcx + c.x - ycy);
+            r.n.y = (ycx + c.y + xcy);
+        }
+        return bailed_out<Test>(r);
+    }
+    void finish() { }
+};
+
+/* The iteration loop of StandardFractal() with the periodicity check.
+   Returns -1 if a key interrupted it, 1 if the 'o' key turned on the
+   orbit display, which StandardFractal() has to do itself, else 0. */
+template <class Step, class Test>
+int orbit_kernel_loop(orbit_loop &loop)
+{
+    long const maxiter = maxit;
+    if (loop.coloriter + 1 >= maxiter)
+    {
+        ++loop.coloriter;               // nothing to iterate
+        return 0;
+    }
+    Step step;
+    orbit_regs r;
+    r.z = old;
+    r.n = g_new;
+    r.sqrx = tempsqrx;
+    r.sqry = tempsqry;
+    r.magnitude = magnitude;
+    r.lim = rqlim;
+    r.lim2 = rqlim2;
+    double const close = closenuff;
+    DComplex keep = saved;
+    long coloriter = loop.coloriter;
+    long const oldcoloriter = loop.oldcoloriter;
+    long savedand = loop.savedand;
+    int savedincr = loop.savedincr;
+    int result = 0;
+    while (++coloriter < maxiter)
+    {
+        if (coloriter % loop.check_freq == 0)
+        {
+            if (check_key())
+            {
+                result = -1;
+                break;
+            }
+            if (show_orbit)
+            {
+                --coloriter;            // StandardFractal() takes it from here
+                result = 1;
+                break;
+            }
+        }
+        if (step.template next<Test>(r))
+            break;
+        if (coloriter > oldcoloriter) // check periodicity
+        {
+            if ((coloriter & savedand) == 0)            // time to save a new value
+            {
+                loop.savedcoloriter = coloriter;
+                keep = r.n;
+                if (--savedincr == 0)    // time to lengthen the periodicity?
+                {
+                    savedand = (savedand << 1) + 1;
+                    savedincr = nextsavedincr;
+                }
+            }
+            else if (fabs(keep.x - r.n.x) < close && fabs(keep.y - r.n.y) < close)
+            {
+                loop.caught_a_cycle = true;
+                loop.cyclelen = coloriter - loop.savedcoloriter;
+                coloriter = maxiter - 1;
+            }
+        }
+    }
+    step.finish();
+    old = r.z;
+    g_new = r.n;
+    tempsqrx = r.sqrx;
+    tempsqry = r.sqry;
+    if (Test::sets_magnitude)
+        magnitude = r.magnitude;
+    saved = keep;
+    loop.coloriter = coloriter;
+    loop.savedand = savedand;
+    loop.savedincr = savedincr;
+    return result;
+}
+
+/* Julibrot's orbit from z with parameter c, without the periodicity
+   check.  Returns the iterations before it bailed out, counted as
+   zlinefp() counts them, or maxit if it didn't or came into one of the
+   balls.  It touches no globals, so the rays can be cast in parallel. */
+template <class Step, class Test>
+long julibrot_orbit_loop(DComplex const &z, DComplex const &c, cycle_balls const *balls)
+{
+    long const maxiter = maxit;
+    Step step;
+    step.c = c;
+    orbit_regs r;
+    r.z = z;
+    r.n = z;
+    r.sqrx = sqr(z.x);
+    r.sqry = sqr(z.y);
+    r.magnitude = 0.0;
+    r.lim = rqlim;
+    r.lim2 = rqlim2;
+    for (long n = 0; n < maxiter; n++)
+    {
+        if (step.template next<Test>(r))
+            return n;
+        if (balls != nullptr && in_cycle_balls(*balls, r.z.x, r.z.y))
+            break;
+    }
+    return maxiter;
+}
+
+// which loop to instantiate for each bailout test
+template <class Step>
+struct orbit_kernels
+{
+    typedef orbit_kernel kernel;
+    template <class Test>
+    static kernel loop()
+    {
+        return orbit_kernel_loop<Step, Test>;
+    }
+};
+
+template <class Step>
+struct julibrot_kernels
+{
+    typedef julibrot_kernel kernel;
+    template <class Test>
+    static kernel loop()
+    {
+        return julibrot_orbit_loop<Step, Test>;
+    }
+};
+
+// the kernel for the routine floatbailout() points to
+template <class Kernels>
+typename Kernels::kernel bailout_kernel()
+{
+    int (*const test)() = floatbailout;
+    if (test == fpMODbailout)
+        return Kernels::template loop<fp_mod_test>();
+    if (test == fpREALbailout)
+        return Kernels::template loop<fp_real_test>();
+    if (test == fpIMAGbailout)
+        return Kernels::template loop<fp_imag_test>();
+    if (test == fpORbailout)
+        return Kernels::template loop<fp_or_test>();
+    if (test == fpANDbailout)
+        return Kernels::template loop<fp_and_test>();
+    if (test == fpMANHbailout)
+        return Kernels::template loop<fp_manh_test>();
+    if (test == fpMANRbailout)
+        return Kernels::template loop<fp_manr_test>();
+    if (test == asmfpMODbailout)
+        return Kernels::template loop<asm_mod_test>();
+    if (test == asmfpREALbailout)
+        return Kernels::template loop<asm_real_test>();
+    if (test == asmfpIMAGbailout)
+        return Kernels::template loop<asm_imag_test>();
+    if (test == asmfpORbailout)
+        return Kernels::template loop<asm_or_test>();
+    if (test == asmfpANDbailout)
+        return Kernels::template loop<asm_and_test>();
+    if (test == asmfpMANHbailout)
+        return Kernels::template loop<asm_manh_test>();
+    if (test == asmfpMANRbailout)
+        return Kernels::template loop<asm_manr_test>();
+    return nullptr;
+}
+
+// the kernel of the step for the routine floatbailout() points to
+template <class Step>
+orbit_kernel step_kernel()
+{
+    return bailout_kernel<orbit_kernels<Step>>();
+}
+
+} // namespace
+
+/*
+   The kernel for the orbitcalc and floatbailout() routines set up for
+   the current image, or nullptr if the type has none.  Called once per
+   image, after per_image.
+*/
+orbit_kernel find_orbit_kernel()
+{
+    int (*const calc)() = curfractalspecific->orbitcalc;
+    if (calc == JuliafpFractal)
+        return step_kernel<julia_step>();
+    if (calc == LambdaFPFractal)
+        return step_kernel<lambda_step>();
+    if (calc == MarksLambdafpFractal)
+        return step_kernel<markslambda_step>();
+    if (calc == Mandel4fpFractal)
+        return step_kernel<mandel4_step>();
+    if (calc == floatZpowerFractal)
+        return step_kernel<zpower_step>();
+    if (calc == PhoenixFractal)
+        return step_kernel<phoenix_step>();
+    if (calc == PhoenixFractalcplx)
+        return step_kernel<phoenixcplx_step>();
+    if (calc == SpiderfpFractal)
+        return step_kernel<spider_step>();
+    if (calc == ManOWarfpFractal)
+        return step_kernel<manowar_step>();
+    if (calc == Barnsley1FPFractal)
+        return step_kernel<barnsley1_step>();
+    return nullptr;
+}
+
+/*
+   The kernel for the Julibrot orbit type, or nullptr if it has none or
+   carries state from one orbit to the next.  Called once per image,
+   after Std4dfpFractal() has picked the zpower routine.
+*/
+julibrot_kernel find_julibrot_kernel()
+{
+    int (*const calc)() = fractalspecific[static_cast<int>(neworbittype)].orbitcalc;
+    if (calc == JuliafpFractal)
+        return bailout_kernel<julibrot_kernels<julia_step>>();
+    if (calc == LambdaFPFractal)
+        return bailout_kernel<julibrot_kernels<lambda_step>>();
+    if (calc == MarksLambdafpFractal)
+        return bailout_kernel<julibrot_kernels<markslambda_step>>();
+    if (calc == Mandel4fpFractal)
+        return bailout_kernel<julibrot_kernels<mandel4_step>>();
+    if (calc == floatZpowerFractal)
+        return bailout_kernel<julibrot_kernels<zpower_step>>();
+    if (calc == Barnsley1FPFractal)
+        return bailout_kernel<julibrot_kernels<barnsley1_step>>();
+    return nullptr;
+}
+
 /*
  * The following functions calculate the real and imaginary complex
  * coordinates of the point in the complex plane corresponding to
@@ -3439,6 +4015,22 @@ double (*dypixel)() = dypixel_calc;
 long (*lxpixel)() = lxpixel_calc;
 long (*lypixel)() = lypixel_calc;
 
+// Pixel coordinates for an explicit row and column, for the threaded
+// engines that can't share the row/col globals dxpixel()/dypixel() read.
+double dxpixel_rc(int r, int c)
+{
+    if (dxpixel == dxpixel_grid)
+        return dx0[c]+dx1[r];
+    return (double)(xxmin + c*delxx + r*delxx2);
+}
+
+double dypixel_rc(int r, int c)
+{
+    if (dypixel == dypixel_grid)
+        return dy0[r]+dy1[c];
+    return (double)(yymax - r*delyy - c*delyy2);
+}
+
 void set_pixel_calc_functions()
 {
     if (use_grid)
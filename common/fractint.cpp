@@ -246,6 +246,10 @@ restart:   /* insert key re-starts here */
     cmdfiles(argc, argv);         /* process the command-line */
     dopause(0);                  /* pause for error msg if not batch */
     init_msg("", nullptr, cmd_file::AT_CMD_LINE);  /* this causes driver_get_key if init_msg called on runup */
+    if (g_server_dir[0] != 0 && !server_next_job())    /* server=, wait for a job */
+    {
+        goodbye();
+    }
 
     while (maxhistory > 0) /* decrease history if necessary */
     {
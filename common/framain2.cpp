@@ -232,6 +232,7 @@ big_while_loop_result big_while_loop(bool *kbdmore, bool *stacked, bool resumefl
 
         if (showfile == 0)
         {   // loading an image
+            iter_cache_clear();             // not the image it was filled for
             outln_cleanup = nullptr;          // outln routine can set this
             if (display3d)                 // set up 3D decoding
             {
@@ -640,6 +641,10 @@ resumeloop:                             // return here on failed overlays
                     {
                         initbatch = 3; // bailout with error
                     }
+                    if (g_server_dir[0] != 0 && server_next_job())
+                    {
+                        return big_while_loop_result::IMAGE_START;
+                    }
                     goodbye();               // done, exit
                 }
             }
@@ -868,7 +873,12 @@ big_while_loop_result main_menu_switch(int *kbdchar, bool *frommandel, bool *kbd
         driver_unstack_screen();
         if (evolving && truecolor)
             truecolor = false;          // truecolor doesn't play well with the evolver
-        if (maxit > old_maxit && inside >= COLOR_BLACK && calc_status == calc_status_value::COMPLETED &&
+        if (*kbdchar == 'x' && i > 0 && calc_status == calc_status_value::COMPLETED
+                && recolor_image())     // only the coloring changed, itercache=
+        {
+            param_history(0);           // save history
+        }
+        else if (maxit > old_maxit && inside >= COLOR_BLACK && calc_status == calc_status_value::COMPLETED &&
                 curfractalspecific->calctype == StandardFractal && !LogFlag &&
                 !truecolor &&    // recalc not yet implemented with truecolor
                 !(usr_stdcalcmode == 't' && fillcolor > -1) &&
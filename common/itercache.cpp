@@ -0,0 +1,133 @@
+/*
+        itercache.cpp - keeps the iteration results of every pixel, so a
+        change of the coloring options can recolor the image instead of
+        calculating it again
+*/
+#include <cmath>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+#include "port.h"
+#include "prototyp.h"
+
+/*
+   With itercache=yes the escape-time engine stores, for every pixel, the
+   iteration count, the final z and, if potential is on, the potential
+   color.  z is kept as floats to halve the memory; it is NaN for inside
+   points whose final z wasn't kept, such as those that periodicity
+   checking caught.  The arrays are indexed by row*xdots + col.
+
+   recolor_image() uses the cache once the image is complete.  Anything
+   that puts a different image on the screen clears it.
+*/
+
+static std::vector<std::int32_t> s_iterations;
+static std::vector<float> s_z;                  // x, y pairs
+static std::vector<std::int32_t> s_potential;   // empty if potential is off
+static int s_width = 0;
+static int s_height = 0;
+static long s_maxit = 0;
+static bool s_floatflag = false;
+static bool s_filling = false;                  // engine is storing pixels
+static bool s_complete = false;                 // every pixel stored
+
+void iter_cache_clear()
+{
+    std::vector<std::int32_t>().swap(s_iterations);
+    std::vector<float>().swap(s_z);
+    std::vector<std::int32_t>().swap(s_potential);
+    s_width = 0;
+    s_height = 0;
+    s_filling = false;
+    s_complete = false;
+}
+
+/*
+   Starts filling the cache for the image about to be calculated, or
+   carries on with the one being filled when resuming.  Returns false if
+   the cache can't be used.
+*/
+bool iter_cache_begin(bool resuming)
+{
+    if (resuming && s_filling && s_width == xdots && s_height == ydots
+        && s_maxit == maxit && s_potential.empty() != potflag)
+        return true;
+    iter_cache_clear();
+    size_t const pixels = (size_t) xdots*ydots;
+    try
+    {
+        s_iterations.resize(pixels);
+        s_z.resize(2*pixels);
+        if (potflag)
+            s_potential.resize(pixels);
+    }
+    catch (std::bad_alloc const&)
+    {
+        iter_cache_clear();
+        stopmsg(STOPMSG_NONE, "Insufficient memory for itercache, the image will not be cached");
+        return false;
+    }
+    s_width = xdots;
+    s_height = ydots;
+    s_maxit = maxit;
+    s_floatflag = usr_floatflag;
+    s_filling = true;
+    return true;
+}
+
+bool iter_cache_filling()
+{
+    return s_filling;
+}
+
+// safe to call from the threaded engines, each pixel is stored once
+void iter_cache_store(int col, int row, long iterations, DComplex const &z, long potential)
+{
+    if (col < 0 || col >= s_width || row < 0 || row >= s_height)
+        return;
+    size_t const i = (size_t) row*s_width + col;
+    s_iterations[i] = (std::int32_t) iterations;
+    s_z[2*i] = (float) z.x;
+    s_z[2*i + 1] = (float) z.y;
+    if (!s_potential.empty())
+        s_potential[i] = (std::int32_t) potential;
+}
+
+// an interrupted image keeps what it has for the resume
+void iter_cache_end(bool complete)
+{
+    if (s_filling && complete)
+    {
+        s_filling = false;
+        s_complete = true;
+    }
+}
+
+// is the whole image on the screen in the cache, for the same iterations?
+bool iter_cache_ready()
+{
+    return s_complete && s_width == xdots && s_height == ydots
+        && s_maxit == maxit && s_floatflag == usr_floatflag
+        && s_potential.empty() != potflag;
+}
+
+void iter_cache_fetch(int col, int row, long &iterations, DComplex &z, long &potential)
+{
+    size_t const i = (size_t) row*s_width + col;
+    iterations = s_iterations[i];
+    z.x = s_z[2*i];
+    z.y = s_z[2*i + 1];
+    potential = s_potential.empty() ? 0 : s_potential[i];
+}
+
+// does every inside point have its final z?
+bool iter_cache_inside_z()
+{
+    if (!s_complete)
+        return false;
+    for (size_t i = 0; i < s_iterations.size(); ++i)
+        if (s_iterations[i] >= maxit && std::isnan(s_z[2*i]))
+            return false;
+    return true;
+}
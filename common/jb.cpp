@@ -1,10 +1,15 @@
+#include <algorithm>
+#include <atomic>
+#include <vector>
 #include <float.h>
+#include <time.h>
 
 #include "port.h"
 #include "prototyp.h"
 #include "helpdefs.h"
 #include "fractype.h"
 #include "drivers.h"
+#include "workpool.h"
 
 // these need to be accessed elsewhere for saving data
 double mxminfp = -.83;
@@ -33,6 +38,12 @@ struct Perspectivefp
     double x, y, zx, zy;
 };
 
+struct jbfp_ray // a ray from an eye through a pixel, across the z planes
+{
+    double jx, jy;              // where it crosses the first plane
+    double djx, djy;            // and how far it moves to the next one
+};
+
 Perspective LeftEye, RightEye, *Per;
 Perspectivefp LeftEyefp, RightEyefp, *Perfp;
 
@@ -189,18 +200,54 @@ jb_per_pixel()
     return (1);
 }
 
+// the ray from eye through the point x, y inches from the middle of the screen
+static void jbfp_ray_start(Perspectivefp const &eye, double x, double y, jbfp_ray &ray)
+{
+    ray.jx = ((eye.x - x) * initzfp / distfp - x) * x_per_inchfp;
+    ray.jx += xoffsetfp;
+    ray.djx = (depthfp / distfp) * (eye.x - x) * x_per_inchfp / zdots;
+
+    ray.jy = ((eye.y - y) * initzfp / distfp - y) * y_per_inchfp;
+    ray.jy += yoffsetfp;
+    ray.djy = depthfp / distfp * (eye.y - y) * y_per_inchfp / zdots;
+}
+
 int
 jbfp_per_pixel()
 {
-    jxfp = ((Perfp->x - xpixelfp) * initzfp / distfp - xpixelfp) * x_per_inchfp;
-    jxfp += xoffsetfp;
-    djxfp = (depthfp / distfp) * (Perfp->x - xpixelfp) * x_per_inchfp / zdots;
+    jbfp_ray ray;
+    jbfp_ray_start(*Perfp, xpixelfp, ypixelfp, ray);
+    jxfp = ray.jx;
+    jyfp = ray.jy;
+    djxfp = ray.djx;
+    djyfp = ray.djy;
+    return (1);
+}
 
-    jyfp = ((Perfp->y - ypixelfp) * initzfp / distfp - ypixelfp) * y_per_inchfp;
-    jyfp += yoffsetfp;
-    djyfp = depthfp / distfp * (Perfp->y - ypixelfp) * y_per_inchfp / zdots;
+// does the pixel at row, col show the view of the left eye?
+static bool jb_left_eye(int r, int c)
+{
+    if (juli3Dmode == 3)
+        return ((r + c) & 1) != 0;
+    return juli3Dmode != 2;
+}
 
-    return (1);
+// the color of a ray that first stays inside at plane zpixel
+static int jbfp_color(int zpixel, bool left_eye)
+{
+    if (juli3Dmode == 3)
+    {
+        int c = (int)(128l * zpixel / zdots);
+        if (left_eye)
+            return 127 - c;
+        c = (int)(c * brratiofp);
+        if (c < 1)
+            c = 1;
+        if (c > 127)
+            c = 127;
+        return 127 + bbase - c;
+    }
+    return (int)(254l * zpixel / zdots) + 1;
 }
 
 static int zpixel, plotted;
@@ -213,22 +260,7 @@ zline(long x, long y)
     ypixel = y;
     mx = mxmin;
     my = mymin;
-    switch (juli3Dmode)
-    {
-    case 0:
-    case 1:
-        Per = &LeftEye;
-        break;
-    case 2:
-        Per = &RightEye;
-        break;
-    case 3:
-        if ((row + col) & 1)
-            Per = &LeftEye;
-        else
-            Per = &RightEye;
-        break;
-    }
+    Per = jb_left_eye(row, col) ? &LeftEye : &RightEye;
     jb_per_pixel();
     for (zpixel = 0; zpixel < zdots; zpixel++)
     {
@@ -289,22 +321,7 @@ zlinefp(double x, double y)
     ypixelfp = y;
     mxfp = mxminfp;
     myfp = myminfp;
-    switch (juli3Dmode)
-    {
-    case 0:
-    case 1:
-        Perfp = &LeftEyefp;
-        break;
-    case 2:
-        Perfp = &RightEyefp;
-        break;
-    case 3:
-        if ((row + col) & 1)
-            Perfp = &LeftEyefp;
-        else
-            Perfp = &RightEyefp;
-        break;
-    }
+    Perfp = jb_left_eye(row, col) ? &LeftEyefp : &RightEyefp;
     jbfp_per_pixel();
     for (zpixel = 0; zpixel < zdots; zpixel++)
     {
@@ -351,26 +368,7 @@ zlinefp(double x, double y)
                 break;
         if (n == maxit)
         {
-            if (juli3Dmode == 3)
-            {
-                color = (int)(128l * zpixel / zdots);
-                if ((row + col) & 1)
-                    (*plot)(col, row, 127 - color);
-                else
-                {
-                    color = (int)(color * brratiofp);
-                    if (color < 1)
-                        color = 1;
-                    if (color > 127)
-                        color = 127;
-                    (*plot)(col, row, 127 + bbase - color);
-                }
-            }
-            else
-            {
-                color = (int)(254l * zpixel / zdots);
-                (*plot)(col, row, color + 1);
-            }
+            (*plot)(col, row, jbfp_color(zpixel, jb_left_eye(row, col)));
             plotted = 1;
             break;
         }
@@ -423,6 +421,145 @@ Std4dFractal()
     }
     return (0);
 }
+
+/*
+   Std4dfpFractal() works from the middle of the screen outwards, a row
+   above the middle and its mirror image below at a time, and stops at the
+   first pair of rows where no ray meets the set.  When the orbit type has
+   a kernel, find_julibrot_kernel(), a ray needs none of the globals
+   zlinefp() uses, so bands of row pairs are cast on the work pool and
+   plotted in order by this thread; the image is the same as zlinefp()
+   draws.  The c of each plane is the same for every ray, and for z^2 + c
+   with the modulus bailout the balls around its attracting cycle, if it
+   has one, let a ray stop iterating as soon as its orbit can't escape.
+   In the red/blue glasses mode the left and right eye rays of a row are
+   cast in the same pass.
+*/
+#define JB_PAIRS 2              // pairs of rows in a band
+
+// the plane where the ray from eye through x, y first stays inside, or -1
+static int jbfp_cast(julibrot_kernel kernel, Perspectivefp const &eye, double x, double y,
+                     std::vector<DComplex> const &planes, std::vector<cycle_balls> const &balls)
+{
+    long const maxiter = maxit;
+    jbfp_ray ray;
+    jbfp_ray_start(eye, x, y, ray);
+    for (int z = 0; z < zdots; z++)
+    {
+        DComplex const start = { ray.jx, ray.jy };
+        if (kernel(start, planes[z], balls.empty() ? nullptr : &balls[z]) == maxiter)
+            return z;
+        ray.jx += ray.djx;
+        ray.jy += ray.djy;
+    }
+    return -1;
+}
+
+static int jbfp_rows(julibrot_kernel kernel)
+{
+    int const num_pairs = ydots >> 1;
+    int const num_bands = (num_pairs + JB_PAIRS - 1)/JB_PAIRS;
+
+    // the screen positions in inches, summed up as the serial loop does
+    std::vector<double> xs(xdots);
+    std::vector<double> ys(num_pairs);
+    double x = -widthfp / 2;
+    for (int xdot = 0; xdot < xdots; xdot++, x += inch_per_xdotfp)
+        xs[xdot] = x;
+    double y = 0.0;
+    for (int pair = 0; pair < num_pairs; pair++, y -= inch_per_ydotfp)
+        ys[pair] = y;
+
+    std::vector<DComplex> planes(zdots);
+    std::vector<cycle_balls> balls;
+    int (*const calc)() = fractalspecific[static_cast<int>(neworbittype)].orbitcalc;
+    if (calc == JuliafpFractal && (floatbailout == fpMODbailout || floatbailout == asmfpMODbailout))
+        balls.resize(zdots);
+    double mx = mxminfp;
+    double my = myminfp;
+    for (int z = 0; z < zdots; z++)
+    {
+        planes[z].x = mx;
+        planes[z].y = my;
+        if (!balls.empty())
+            julia_cycle_balls(planes[z], balls[z]);
+        mx += dmxfp;
+        my += dmyfp;
+    }
+
+    // the color of each pixel of each pair of rows, or -1 for none
+    std::vector<int> colors((size_t) num_pairs*2*xdots);
+    std::vector<std::atomic<bool>> done(num_bands);
+    work_pool pool(work_pool_threads());
+    auto push_band = [&](int band)
+    {
+        pool.push([&, band](int)
+        {
+            int const last = std::min((band + 1)*JB_PAIRS, num_pairs);
+            for (int pair = band*JB_PAIRS; pair < last; pair++)
+            {
+                int const r = (ydots >> 1) - 1 - pair;
+                int *const above = &colors[(size_t) pair*2*xdots];
+                int *const below = above + xdots;
+                for (int xdot = 0; xdot < xdots && !pool.cancelled(); xdot++)
+                {
+                    int const c = xdots - xdot - 1;
+                    bool left = jb_left_eye(r, xdot);
+                    int z = jbfp_cast(kernel, left ? LeftEyefp : RightEyefp, xs[xdot], ys[pair],
+                                      planes, balls);
+                    above[xdot] = (z < 0) ? -1 : jbfp_color(z, left);
+                    left = jb_left_eye(ydots - r - 1, c);
+                    z = jbfp_cast(kernel, left ? LeftEyefp : RightEyefp, -xs[xdot], -ys[pair],
+                                  planes, balls);
+                    below[c] = (z < 0) ? -1 : jbfp_color(z, left);
+                }
+            }
+            done[band] = true;
+        });
+    };
+
+    // keep only a few bands ahead, as the rows past the set aren't needed
+    int pushed = std::min(num_bands, 2*pool.size() + 1);
+    for (int band = 0; band < pushed; band++)
+        push_band(band);
+    for (int band = 0; band < num_bands; band++)
+    {
+        while (!done[band])
+        {
+            if (driver_key_pressed())
+                return (-1);
+            pool.wait(10);
+        }
+        if (pushed < num_bands)
+            push_band(pushed++);
+        int const last = std::min((band + 1)*JB_PAIRS, num_pairs);
+        for (int pair = band*JB_PAIRS; pair < last; pair++)
+        {
+            int const r = (ydots >> 1) - 1 - pair;
+            int const *const above = &colors[(size_t) pair*2*xdots];
+            int const *const below = above + xdots;
+            bool any = false;
+            for (int xdot = 0; xdot < xdots; xdot++)
+            {
+                int const c = xdots - xdot - 1;
+                if (above[xdot] >= 0)
+                {
+                    (*plot)(xdot, r, above[xdot]);
+                    any = true;
+                }
+                if (below[c] >= 0)
+                {
+                    (*plot)(c, ydots - r - 1, below[c]);
+                    any = true;
+                }
+            }
+            if (!any && ys[pair] != 0)
+                return (0);
+        }
+    }
+    return (0);
+}
+
 int
 Std4dfpFractal()
 {
@@ -438,6 +575,10 @@ Std4dfpFractal()
         get_julia_attractor(param[0], param[1]);  // another attractor?
     }
 
+    julibrot_kernel const kernel = find_julibrot_kernel();
+    if (kernel != nullptr)
+        return jbfp_rows(kernel);
+
     double y = 0.0;
     for (int ydot = (ydots >> 1) - 1; ydot >= 0; ydot--, y -= inch_per_ydotfp)
     {
@@ -2020,7 +2020,9 @@ static void line3d_cleanup()
     {   // Finish up targa files
         T_header_24 = 18;         // Reset Targa header size
         enddisk();
-        if (debugflag == debug_flags::none && (!T_Safe || error) && Targa_Overlay)
+        // an overlay is drawn on the copy in targa_temp, which replaces
+        // the original once it is complete
+        if (debugflag == debug_flags::none && T_Safe && !error && Targa_Overlay)
         {
             dir_remove(workdir, light_name);
             rename(targa_temp, light_name);
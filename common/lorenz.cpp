@@ -3,16 +3,23 @@
    generators - IFS and LORENZ3D, along with code to generate
    red/blue 3D images.
 */
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <new>
+#include <random>
 #include <vector>
 
 #include <float.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "port.h"
 #include "prototyp.h"
 #include "fractype.h"
 #include "drivers.h"
+#include "workpool.h"
 
 // orbitcalc is declared with no arguments so jump through hoops here
 #define LORBIT(x, y, z) \
@@ -92,7 +99,7 @@ static long l_adt, l_bdt, l_cdt, l_xdt, l_ydt;
 static long initorbitlong[3];
 
 static double dx, dy, dz, dt, a, b, c, d;
-static double adt, bdt, cdt, xdt, ydt, zdt;
+static double adt, bdt, cdt;
 static double initorbitfp[3];
 
 // The following declarations used for Inverse Julia.
@@ -873,18 +880,16 @@ int lorenz3dlongorbit(long *l_x, long *l_y, long *l_z)
 
 int lorenz3d1floatorbit(double *x, double *y, double *z)
 {
-    double norm;
-
-    xdt = (*x)*dt;
-    ydt = (*y)*dt;
-    zdt = (*z)*dt;
+    double const xdt = (*x)*dt;
+    double const ydt = (*y)*dt;
+    double const zdt = (*z)*dt;
 
     // 1-lobe Lorenz
-    norm = sqrt((*x)*(*x)+(*y)*(*y));
-    dx   = (-adt-dt)*(*x) + (adt-bdt)*(*y) + (dt-adt)*norm + ydt*(*z);
-    dy   = (bdt-adt)*(*x) - (adt+dt)*(*y) + (bdt+adt)*norm - xdt*(*z) -
+    double const norm = sqrt((*x)*(*x)+(*y)*(*y));
+    double const dx   = (-adt-dt)*(*x) + (adt-bdt)*(*y) + (dt-adt)*norm + ydt*(*z);
+    double const dy   = (bdt-adt)*(*x) - (adt+dt)*(*y) + (bdt+adt)*norm - xdt*(*z) -
            norm*zdt;
-    dz   = (ydt/2) - cdt*(*z);
+    double const dz   = (ydt/2) - cdt*(*z);
 
     *x += dx;
     *y += dy;
@@ -894,14 +899,13 @@ int lorenz3d1floatorbit(double *x, double *y, double *z)
 
 int lorenz3dfloatorbit(double *x, double *y, double *z)
 {
-    xdt = (*x)*dt;
-    ydt = (*y)*dt;
-    zdt = (*z)*dt;
+    double const xdt = (*x)*dt;
+    double const ydt = (*y)*dt;
 
     // 2-lobe Lorenz (the original)
-    dx  = -adt*(*x) + adt*(*y);
-    dy  =  bdt*(*x) - ydt - (*z)*xdt;
-    dz  = -cdt*(*z) + (*x)*ydt;
+    double const dx  = -adt*(*x) + adt*(*y);
+    double const dy  =  bdt*(*x) - ydt - (*z)*xdt;
+    double const dz  = -cdt*(*z) + (*x)*ydt;
 
     *x += dx;
     *y += dy;
@@ -911,21 +915,19 @@ int lorenz3dfloatorbit(double *x, double *y, double *z)
 
 int lorenz3d3floatorbit(double *x, double *y, double *z)
 {
-    double norm;
-
-    xdt = (*x)*dt;
-    ydt = (*y)*dt;
-    zdt = (*z)*dt;
+    double const xdt = (*x)*dt;
+    double const ydt = (*y)*dt;
+    double const zdt = (*z)*dt;
 
     // 3-lobe Lorenz
-    norm = sqrt((*x)*(*x)+(*y)*(*y));
-    dx   = (-(adt+dt)*(*x) + (adt-bdt+zdt)*(*y)) / 3 +
+    double const norm = sqrt((*x)*(*x)+(*y)*(*y));
+    double const dx   = (-(adt+dt)*(*x) + (adt-bdt+zdt)*(*y)) / 3 +
            ((dt-adt)*((*x)*(*x)-(*y)*(*y)) +
             2*(bdt+adt-zdt)*(*x)*(*y))/(3*norm);
-    dy   = ((bdt-adt-zdt)*(*x) - (adt+dt)*(*y)) / 3 +
+    double const dy   = ((bdt-adt-zdt)*(*x) - (adt+dt)*(*y)) / 3 +
            (2*(adt-dt)*(*x)*(*y) +
             (bdt+adt-zdt)*((*x)*(*x)-(*y)*(*y)))/(3*norm);
-    dz   = (3*xdt*(*x)*(*y)-ydt*(*y)*(*y))/2 - cdt*(*z);
+    double const dz   = (3*xdt*(*x)*(*y)-ydt*(*y)*(*y))/2 - cdt*(*z);
 
     *x += dx;
     *y += dy;
@@ -935,18 +937,18 @@ int lorenz3d3floatorbit(double *x, double *y, double *z)
 
 int lorenz3d4floatorbit(double *x, double *y, double *z)
 {
-    xdt = (*x)*dt;
-    ydt = (*y)*dt;
-    zdt = (*z)*dt;
+    double const xdt = (*x)*dt;
+    double const ydt = (*y)*dt;
+    double const zdt = (*z)*dt;
 
     // 4-lobe Lorenz
-    dx   = (-adt*(*x)*(*x)*(*x) + (2*adt+bdt-zdt)*(*x)*(*x)*(*y) +
+    double const dx   = (-adt*(*x)*(*x)*(*x) + (2*adt+bdt-zdt)*(*x)*(*x)*(*y) +
             (adt-2*dt)*(*x)*(*y)*(*y) + (zdt-bdt)*(*y)*(*y)*(*y)) /
            (2 * ((*x)*(*x)+(*y)*(*y)));
-    dy   = ((bdt-zdt)*(*x)*(*x)*(*x) + (adt-2*dt)*(*x)*(*x)*(*y) +
+    double const dy   = ((bdt-zdt)*(*x)*(*x)*(*x) + (adt-2*dt)*(*x)*(*x)*(*y) +
             (-2*adt-bdt+zdt)*(*x)*(*y)*(*y) - adt*(*y)*(*y)*(*y)) /
            (2 * ((*x)*(*x)+(*y)*(*y)));
-    dz   = (2*xdt*(*x)*(*x)*(*y) - 2*xdt*(*y)*(*y)*(*y) - cdt*(*z));
+    double const dz   = (2*xdt*(*x)*(*x)*(*y) - 2*xdt*(*y)*(*y)*(*y) - cdt*(*z));
 
     *x += dx;
     *y += dy;
@@ -978,12 +980,12 @@ int henonlongorbit(long *l_x, long *l_y, long * /*l_z*/)
 
 int rosslerfloatorbit(double *x, double *y, double *z)
 {
-    xdt = (*x)*dt;
-    ydt = (*y)*dt;
+    double const xdt = (*x)*dt;
+    double const ydt = (*y)*dt;
 
-    dx = -ydt - (*z)*dt;
-    dy = xdt + (*y)*adt;
-    dz = bdt + (*z)*xdt - (*z)*cdt;
+    double const dx = -ydt - (*z)*dt;
+    double const dy = xdt + (*y)*adt;
+    double const dz = bdt + (*z)*xdt - (*z)*cdt;
 
     *x += dx;
     *y += dy;
@@ -1237,6 +1239,242 @@ int latoofloatorbit(double *x, double *y, double * /*z*/)
 #undef PAR_C
 #undef PAR_D
 
+//********************************************************************
+//   Orbit density - orbitdensity=<nnn>
+//********************************************************************
+
+/*
+   Instead of plotting one trajectory, the density mode counts how often
+   the points of many trajectories land on each pixel and colors the
+   pixels by the logarithm of their count.  Each task runs one trajectory
+   of up to DENSITY_POINTS points from a small random offset of the usual
+   starting point, after skipping `waste` points, and counts into the
+   histogram of the worker running it.  The histograms are only added up
+   when the picture is redrawn; the counts are relaxed atomics that only
+   their worker writes, so a redraw while the tasks run sees most of the
+   counts so far.  A trajectory depends only on its task number, so the
+   image is the same for any number of threads.
+
+   Only the float orbit types whose orbit functions keep no state between
+   calls can run this way.
+*/
+#define DENSITY_POINTS  (1L << 24)
+
+struct density_job
+{
+    bool three_d;
+    affine cvt;                         // 2D screen conversion
+    float3dvtinf inf;                   // 3D view, already set up
+    int axis[3];                        // 2D projection, the orbit's x, y, z
+    std::vector<std::vector<std::atomic<std::uint32_t>>> counts;  // one histogram per worker
+    std::atomic<long> finished;
+};
+
+static bool density_ok()
+{
+    if (g_orbit_density <= 0)
+        return false;
+    typedef int (*float_orbit)(double *, double *, double *);
+    float_orbit const orbit = (float_orbit) curfractalspecific->orbitcalc;
+    return orbit == lorenz3dfloatorbit
+        || orbit == lorenz3d1floatorbit
+        || orbit == lorenz3d3floatorbit
+        || orbit == lorenz3d4floatorbit
+        || orbit == rosslerfloatorbit
+        || orbit == henonfloatorbit
+        || orbit == pickoverfloatorbit
+        || orbit == gingerbreadfloatorbit
+        || orbit == hopalong2dfloatorbit
+        || orbit == chip2dfloatorbit
+        || orbit == quadruptwo2dfloatorbit
+        || orbit == threeply2dfloatorbit
+        || orbit == martin2dfloatorbit
+        || orbit == iconfloatorbit;
+}
+
+static void density_task(density_job &job, int worker, long number, long points)
+{
+    std::vector<std::atomic<std::uint32_t>> &count = job.counts[worker];
+    float3dvtinf inf = job.inf;
+    double *const v = inf.orbit;
+    std::mt19937 random((std::mt19937::result_type) number);
+    for (int i = 0; i < 3; i++)
+    {
+        v[i] = initorbitfp[i];
+        if (number != 0)                // the first one starts as usual
+            v[i] += 0.01*(random()/4294967296.0 - 0.5);
+    }
+    for (long n = -waste; n < points; n++)
+    {
+        int col, row;
+        if (job.three_d)
+        {
+            FORBIT(&v[0], &v[1], &v[2]);
+            if (n < 0)
+                continue;
+            // coloriter is past waste, so this only projects the point
+            float3dviewtransf(&inf);
+            if (inf.col == -2)
+                break;
+            if (inf.col < 0)
+                continue;
+            col = inf.col;
+            row = inf.row;
+        }
+        else
+        {
+            double const x = v[0];
+            double const y = v[1];
+            if (FORBIT(&v[job.axis[0]], &v[job.axis[1]], &v[job.axis[2]]))
+                break;
+            if (n < 0)
+                continue;
+            col = (int)(job.cvt.a*x + job.cvt.b*y + job.cvt.e);
+            row = (int)(job.cvt.c*x + job.cvt.d*y + job.cvt.f);
+            if (col < 0 || col >= xdots || row < 0 || row >= ydots)
+            {
+                if ((long) abs(row) + (long) abs(col) > BAD_PIXEL)
+                    break;
+                continue;
+            }
+        }
+        std::atomic<std::uint32_t> &cell = count[(size_t) row*xdots + col];
+        std::uint32_t const c = cell.load(std::memory_order_relaxed);
+        if (c != 0xffffffffU)           // saturate
+            cell.store(c + 1, std::memory_order_relaxed);
+    }
+    ++job.finished;
+}
+
+// the workers' histograms added up
+static void density_total(density_job const &job, std::vector<std::uint32_t> &total)
+{
+    total.assign(job.counts[0].size(), 0);
+    for (auto const &count : job.counts)
+        for (size_t k = 0; k < count.size(); ++k)
+        {
+            std::uint32_t const sum = total[k] + count[k].load(std::memory_order_relaxed);
+            total[k] = sum < total[k] ? 0xffffffffU : sum;   // saturate
+        }
+}
+
+// color each pixel by the log of its count
+static void density_show(std::vector<std::uint32_t> const &total)
+{
+    std::uint32_t most = 0;
+    for (std::uint32_t n : total)
+        if (n > most)
+            most = n;
+    double const scale = most ? (colors-1)/log(1.0 + most) : 0.0;
+    size_t k = 0;
+    for (int row = 0; row < ydots; row++)
+        for (int col = 0; col < xdots; col++, k++)
+        {
+            int color = 0;
+            if (total[k])
+            {
+                color = 1 + (int)(scale*log(1.0 + total[k]));
+                if (color >= colors)
+                    color = colors-1;
+            }
+            (*plot)(col, row, color);
+        }
+}
+
+static int orbit_density(bool three_d)
+{
+    if (resuming)                       // can't resume
+        return -1;
+    density_job job;
+    job.three_d = three_d;
+    job.finished = 0;
+    job.axis[0] = 0;                    // projection 2
+    job.axis[1] = 1;
+    job.axis[2] = 2;
+    if (three_d)
+    {
+        // find the view from the usual trajectory, as orbit3dfloatcalc does
+        setup_convert_to_screen(&job.inf.cvt);
+        for (int i = 0; i < 3; i++)
+            job.inf.orbit[i] = initorbitfp[i];
+        for (coloriter = 1; coloriter <= waste; coloriter++)
+        {
+            FORBIT(&job.inf.orbit[0], &job.inf.orbit[1], &job.inf.orbit[2]);
+            float3dviewtransf(&job.inf);
+        }
+    }
+    else
+    {
+        setup_convert_to_screen(&job.cvt);
+        if (projection == 0)
+        {
+            job.axis[0] = 2;
+            job.axis[1] = 0;
+            job.axis[2] = 1;
+        }
+        else if (projection == 1)
+        {
+            job.axis[1] = 2;
+            job.axis[2] = 1;
+        }
+    }
+
+    work_pool pool(work_pool_threads());
+    size_t const pixels = (size_t) xdots*ydots;
+    try
+    {
+        job.counts.resize(pool.size());
+        for (auto &count : job.counts)
+            std::vector<std::atomic<std::uint32_t>>(pixels).swap(count);
+    }
+    catch (std::bad_alloc const&)
+    {
+        stopmsg(STOPMSG_NONE, "Insufficient memory for orbitdensity");
+        return -1;
+    }
+
+    double const points = g_orbit_density*1000000.0;
+    long const tasks = (long) ceil(points/DENSITY_POINTS);
+    for (long number = 0; number < tasks; number++)
+    {
+        long const length = (long) std::min<double>(DENSITY_POINTS, points - (double) number*DENSITY_POINTS);
+        density_job *const j = &job;
+        pool.push([j, number, length](int worker)
+        {
+            density_task(*j, worker, number, length);
+        });
+    }
+
+    // redraw every few seconds while the tasks finish
+    int ret = 0;
+    long shown = 0;
+    int ticks = 0;
+    bool all_done;
+    std::vector<std::uint32_t> total;
+    do
+    {
+        all_done = pool.wait(100);
+        if (!all_done && ret == 0 && driver_key_pressed())
+        {
+            ret = -1;
+            pool.cancel();
+        }
+        if (all_done || ++ticks >= 30)
+        {
+            ticks = 0;
+            long const finished = job.finished;
+            if (finished != shown || all_done)
+            {
+                shown = finished;
+                density_total(job, total);
+                density_show(total);
+            }
+        }
+    }
+    while (!all_done);
+    return ret;
+}
+
 //********************************************************************
 //   Main fractal engines - put in fractalspecific[fractype].calctype
 //********************************************************************
@@ -1274,6 +1512,9 @@ int orbit2dfloat()
     affine cvt;
     int ret;
 
+    if (density_ok())
+        return orbit_density(false);
+
     p2 = nullptr;
     p1 = p2;
     p0 = p1;
@@ -1718,6 +1959,9 @@ static int orbit3dfloatcalc()
     int ret;
     float3dvtinf inf;
 
+    if (!realtime && density_ok())
+        return orbit_density(true);
+
     // setup affine screen coord conversion
     setup_convert_to_screen(&inf.cvt);
 
@@ -2192,6 +2436,242 @@ done:
     return (status);
 }
 
+/*
+   The chaos game on the work pool.  The points are split into chunks of
+   IFS_CHUNK, each a task that starts again from the origin and plots
+   nothing for its first IFS_SETTLE points, while it moves onto the
+   attractor.  The random number of each point is a hash of the seed and
+   the point's number, so a chunk needs nothing from the one before, and
+   the function is picked from a table of cumulative probabilities.  Each
+   worker counts hits in its own buffers, which are added up at the end,
+   so the image for a seed (rseed=, else 1) is the same for any number of
+   threads.  With color_method the pixel takes the function of the hit
+   with the highest point number, as it would plotting them in order.
+*/
+#define IFS_CHUNK   (1L << 18)
+#define IFS_SETTLE  32
+
+struct ifs_counts
+{
+    std::vector<BYTE> hits;             // saturate at 255, above any color
+    std::vector<std::uint64_t> last;    // point number << 8 | color
+};
+
+struct ifs_job
+{
+    bool three_d;
+    std::uint64_t key;
+    int maps;
+    int params;                         // per map, 6 for 2D, 12 for 3D
+    std::vector<double> map;
+    std::vector<std::uint64_t> cumulative;  // scaled to 2^32
+    int guide[256];                     // first map for each top byte
+    int color_method;
+    affine cvt;
+    float3dvtinf inf;                   // 3D view, already set up
+    std::vector<ifs_counts> counts;     // one per worker
+};
+
+// the n'th number of the splitmix64 sequence starting at key
+static std::uint64_t ifs_random(std::uint64_t key, std::uint64_t n)
+{
+    std::uint64_t z = key + n*0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30))*0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27))*0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static int ifs_pick(ifs_job const &job, std::uint64_t n)
+{
+    std::uint64_t const r = ifs_random(job.key, n) >> 32;
+    int k = job.guide[r >> 24];
+    while (r >= job.cumulative[k])
+        ++k;
+    return k;
+}
+
+// move the point in v by map k
+static void ifs_apply(ifs_job const &job, int k, double v[3])
+{
+    double const *m = &job.map[k*job.params];
+    if (job.three_d)
+    {
+        double const x = m[0]*v[0] + m[1]*v[1] + m[2]*v[2] + m[9];
+        double const y = m[3]*v[0] + m[4]*v[1] + m[5]*v[2] + m[10];
+        double const z = m[6]*v[0] + m[7]*v[1] + m[8]*v[2] + m[11];
+        v[0] = x;
+        v[1] = y;
+        v[2] = z;
+    }
+    else
+    {
+        double const x = m[0]*v[0] + m[1]*v[1] + m[4];
+        double const y = m[2]*v[0] + m[3]*v[1] + m[5];
+        v[0] = x;
+        v[1] = y;
+    }
+}
+
+static void ifs_task(ifs_job &job, int worker, std::uint64_t first, long points)
+{
+    ifs_counts &count = job.counts[worker];
+    float3dvtinf inf = job.inf;
+    double *const v = inf.orbit;
+    v[0] = 0;
+    v[1] = 0;
+    v[2] = 0;
+    for (long i = 0; i < points; i++)
+    {
+        std::uint64_t const n = first + i;
+        int const k = ifs_pick(job, n);
+        ifs_apply(job, k, v);
+        if (i < IFS_SETTLE)
+            continue;
+        int col, row;
+        if (job.three_d)
+        {
+            // coloriter is past waste, so this only projects the point
+            float3dviewtransf(&inf);
+            if (inf.col == -2)
+                break;
+            if (inf.col < 0)
+                continue;
+            col = inf.col;
+            row = inf.row;
+        }
+        else
+        {
+            col = (int)(job.cvt.a*v[0] + job.cvt.b*v[1] + job.cvt.e);
+            row = (int)(job.cvt.c*v[0] + job.cvt.d*v[1] + job.cvt.f);
+            if (col < 0 || col >= xdots || row < 0 || row >= ydots)
+            {
+                if ((long) abs(row) + (long) abs(col) > BAD_PIXEL)
+                    break;
+                continue;
+            }
+        }
+        size_t const pixel = (size_t) row*xdots + col;
+        if (job.color_method)
+        {
+            int const color = (k % colors) + 1;
+            std::uint64_t const hit = n << 8 | color;
+            if (color < colors && hit > count.last[pixel])  // chunks run in any order
+                count.last[pixel] = hit;
+        }
+        else if (count.hits[pixel] < 255)
+            ++count.hits[pixel];
+    }
+}
+
+static int ifs_pool(bool three_d)
+{
+    ifs_job job;
+    job.three_d = three_d;
+    job.key = rflag ? (std::uint64_t) rseed : 1;
+    job.maps = numaffine;
+    job.params = three_d ? 12 : 6;
+    job.color_method = (int) param[0];
+    int const stride = three_d ? NUM_IFS_3D_PARAMS : NUM_IFS_PARAMS;
+    work_pool pool(work_pool_threads());
+    try
+    {
+        job.map.resize(job.maps*job.params);
+        job.cumulative.resize(job.maps);
+        size_t const pixels = (size_t) xdots*ydots;
+        job.counts.resize(pool.size());
+        for (ifs_counts &count : job.counts)
+            if (job.color_method)
+                count.last.resize(pixels);
+            else
+                count.hits.resize(pixels);
+    }
+    catch (std::bad_alloc const&)
+    {
+        stopmsg(STOPMSG_NONE, insufficient_ifs_mem);
+        return -1;
+    }
+
+    // as with rand(), a total probability under 1 favors the last map
+    double sum = 0;
+    for (int k = 0; k < job.maps; k++)
+    {
+        for (int j = 0; j < job.params; j++)
+            job.map[k*job.params + j] = ifs_defn[k*stride + j];
+        sum += ifs_defn[k*stride + stride - 1];
+        job.cumulative[k] = sum >= 1.0 || k == job.maps-1 ?
+            1ULL << 32 : (std::uint64_t)(sum*4294967296.0);
+    }
+    for (int b = 0, k = 0; b < 256; b++)
+    {
+        while (job.cumulative[k] <= (std::uint64_t) b << 24)
+            ++k;
+        job.guide[b] = k;
+    }
+
+    std::uint64_t const points = maxit*1024ULL;
+    if (three_d)
+    {
+        // find the view from the start of the first chunk, as ifs3dfloat does
+        setup_convert_to_screen(&job.inf.cvt);
+        for (int i = 0; i < 3; i++)
+            job.inf.orbit[i] = 0;
+        for (coloriter = 1; coloriter <= waste; coloriter++)
+        {
+            ifs_apply(job, ifs_pick(job, coloriter-1), job.inf.orbit);
+            float3dviewtransf(&job.inf);
+        }
+    }
+    else
+        setup_convert_to_screen(&job.cvt);
+
+    for (std::uint64_t first = 0; first < points; first += IFS_CHUNK)
+    {
+        long const length = (long) std::min<std::uint64_t>(IFS_CHUNK, points - first);
+        ifs_job *const j = &job;
+        pool.push([j, first, length](int worker)
+        {
+            ifs_task(*j, worker, first, length);
+        });
+    }
+    int ret = 0;
+    while (!pool.wait(100))
+        if (ret == 0 && driver_key_pressed())
+        {
+            ret = -1;
+            pool.cancel();
+        }
+
+    // add up the workers' counts and plot them
+    size_t pixel = 0;
+    for (int row = 0; row < ydots; row++)
+        for (int col = 0; col < xdots; col++, pixel++)
+        {
+            int color = 0;
+            if (job.color_method)
+            {
+                std::uint64_t last = 0;
+                for (ifs_counts const &count : job.counts)
+                    last = std::max(last, count.last[pixel]);
+                color = (int)(last & 255);
+            }
+            else
+            {
+                for (ifs_counts const &count : job.counts)
+                    color += count.hits[pixel];
+                if (color >= colors)
+                    color = colors-1;
+            }
+            if (color)
+                (*plot)(col, row, color);
+        }
+    return ret;
+}
+
+static int ifs3dpool()
+{
+    return ifs_pool(true);
+}
+
 // double version - mainly for testing
 static int ifs3dfloat()
 {
@@ -2309,7 +2789,9 @@ int ifs()                       // front-end for ifs2d and ifs3d
         return (-1);
     if (driver_diskp())                // this would KILL a disk drive!
         notdiskmsg();
-    return !ifs_type ? ifs2d() : ifs3d();
+    if (!ifs_type)
+        return (orbitsave & 1) ? ifs2d() : ifs_pool(false);
+    return ifs3d();
 }
 
 
@@ -2572,6 +3054,8 @@ static int ifs3d()
         realtime = true;
     else
         realtime = false;
+    if (!realtime && !(orbitsave & 1))
+        return (funny_glasses_call(ifs3dpool)); // chaos game on the work pool
     if (floatflag)
         return (funny_glasses_call(ifs3dfloat)); // double version of ifs3d
     else
@@ -3,18 +3,30 @@
 #if !defined(_WIN32)
 #include <malloc.h>
 #endif
+#include <functional>
+#include <new>
+#include <unordered_map>
+#include <vector>
 
 #include "port.h"
 #include "prototyp.h"
 #include "lsys.h"
 #include "drivers.h"
 
-struct lsys_cmd
-{
-    void (*f)(lsys_turtlestatei *);
-    long n;
-    char ch;
-};
+/* The size pass and the drawing walk the rules with an explicit stack
+ * for the drawing and a loop per rule body for everything else, so the
+ * C stack only grows with the order, never with the length of the
+ * expansion or the nesting of brackets.
+ *
+ * Expanding a symbol moves every point it visits by the same amount
+ * when the turtle starts somewhere else, and in fixed point that is
+ * exact.  So what an expansion does depends only on the rule, the depth
+ * and the turtle's angle, direction and size; lsysi_expand() walks each
+ * such combination once and remembers the box around the points it
+ * visits and where the turtle ends up.  The size pass is then a handful
+ * of lookups per level, and the drawing skips whole expansions that
+ * stay inside one pixel, plotting that pixel once instead.
+ */
 
 static bool readLSystemFile(char *str);
 static void free_rules_mem();
@@ -22,33 +34,25 @@ static int rule_present(char symbol);
 static bool save_rule(char *rule, char **saveptr);
 static bool append_rule(char *rule, int index);
 static void free_lcmds();
-static lsys_cmd *findsize(lsys_cmd *, lsys_turtlestatei *, lsys_cmd **, int);
-static lsys_cmd *drawLSysI(lsys_cmd *command, lsys_turtlestatei *ts, lsys_cmd **rules, int depth);
-static bool lsysi_findscale(lsys_cmd *command, lsys_turtlestatei *ts, lsys_cmd **rules, int depth);
-static lsys_cmd *LSysISizeTransform(char *s, lsys_turtlestatei *ts);
-static lsys_cmd *LSysIDrawTransform(char *s, lsys_turtlestatei *ts);
+static lsys_cmd *LSysTransform(char *s);
+static void link_rules();
+static void count_steps(int order);
+static bool lsysi_findscale(lsys_cmd *axiom, lsys_turtlestatei *ts, int depth);
+static bool drawLSysI(lsys_cmd *axiom, lsys_turtlestatei *ts, int depth);
+static void lsysi_free_extents();
 static void lsysi_dosincos();
 
-static void lsysi_doslash(lsys_turtlestatei *cmd);
-static void lsysi_dobslash(lsys_turtlestatei *cmd);
-static void lsysi_doat(lsys_turtlestatei *cmd);
-static void lsysi_dopipe(lsys_turtlestatei *cmd);
-static void lsysi_dosizedm(lsys_turtlestatei *cmd);
-static void lsysi_dosizegf(lsys_turtlestatei *cmd);
-static void lsysi_dodrawd(lsys_turtlestatei *cmd);
-static void lsysi_dodrawm(lsys_turtlestatei *cmd);
-static void lsysi_dodrawg(lsys_turtlestatei *cmd);
-static void lsysi_dodrawf(lsys_turtlestatei *cmd);
-static void lsysi_dodrawc(lsys_turtlestatei *cmd);
-static void lsysi_dodrawgt(lsys_turtlestatei *cmd);
-static void lsysi_dodrawlt(lsys_turtlestatei *cmd);
-
 #define sins ((long *)(boxy))
 #define coss (((long *)(boxy)+50)) // 50 after the start of sins
 static char *ruleptrs[MAXRULES];
 static lsys_cmd *rules2[MAXRULES];
 char maxangle;
 static bool loaded = false;
+#define LSYS_SHORT 16           // quicker to walk than to look up
+static bool lastdot = false;            // lsys_draw_line() drew this dot last
+static int lastdot_x, lastdot_y, lastdot_color;
+static std::vector<double> rulesteps[MAXRULES];  // by depth
+static std::vector<bool> rulecolors[MAXRULES];   // has c, < or > commands
 
 
 bool ispow2(int n)
@@ -247,7 +251,34 @@ int Lsystem()
     order = (int)param[0];
     if (order <= 0)
         order = 0;
-    if (usr_floatflag)
+
+    sc = rules2;
+    for (char **rulesc = ruleptrs; *rulesc && !stackoflow; rulesc++)
+    {
+        *sc = LSysTransform(*rulesc);
+        if (*sc == nullptr)
+            stackoflow = true;
+        else
+            sc++;
+    }
+    *sc = nullptr;
+    if (!stackoflow)
+    {
+        link_rules();
+        try
+        {
+            count_steps(order);
+        }
+        catch (std::bad_alloc const&)
+        {
+            stackoflow = true;
+        }
+    }
+    lastdot = false;
+
+    if (stackoflow)
+        ;
+    else if (usr_floatflag)
         overflow = true;
     else
     {
@@ -257,29 +288,18 @@ int Lsystem()
         ts.maxangle = maxangle;
         ts.dmaxangle = (char)(maxangle - 1);
 
-        sc = rules2;
-        for (char **rulesc = ruleptrs; *rulesc; rulesc++)
-            *sc++ = LSysISizeTransform(*rulesc, &ts);
-        *sc = nullptr;
-
         lsysi_dosincos();
-        if (lsysi_findscale(rules2[0], &ts, &rules2[1], order))
+        if (lsysi_findscale(rules2[0], &ts, order))
         {
             ts.reverse = 0;
             ts.angle = ts.reverse;
             ts.realangle = ts.angle;
 
-            free_lcmds();
-            sc = rules2;
-            for (char **rulesc = ruleptrs; *rulesc; rulesc++)
-                *sc++ = LSysIDrawTransform(*rulesc, &ts);
-            *sc = nullptr;
-
             // !! HOW ABOUT A BETTER WAY OF PICKING THE DEFAULT DRAWING COLOR
             ts.curcolor = 15;
             if (ts.curcolor > colors)
                 ts.curcolor = (char)(colors-1);
-            drawLSysI(rules2[0], &ts, &rules2[1], order);
+            drawLSysI(rules2[0], &ts, order);
         }
         stackoflow = ts.stackoflow;
     }
@@ -298,34 +318,30 @@ int Lsystem()
         ts.maxangle = maxangle;
         ts.dmaxangle = (char)(maxangle - 1);
 
-        sc = rules2;
-        for (char **rulesc = ruleptrs; *rulesc; rulesc++)
-            *sc++ = LSysFSizeTransform(*rulesc, &ts);
-        *sc = nullptr;
-
         lsysf_dosincos();
-        if (lsysf_findscale(rules2[0], &ts, &rules2[1], order))
+        if (lsysf_findscale(rules2[0], &ts, order))
         {
             ts.reverse = 0;
             ts.angle = ts.reverse;
             ts.realangle = ts.angle;
 
-            free_lcmds();
-            sc = rules2;
-            for (char **rulesc = ruleptrs; *rulesc; rulesc++)
-                *sc++ = LSysFDrawTransform(*rulesc, &ts);
-            *sc = nullptr;
-
             // !! HOW ABOUT A BETTER WAY OF PICKING THE DEFAULT DRAWING COLOR
             ts.curcolor = 15;
             if (ts.curcolor > colors)
                 ts.curcolor = (char)(colors-1);
-            lsys_prepfpu(&ts);
-            drawLSysF(rules2[0], &ts, &rules2[1], order);
-            lsys_donefpu(&ts);
+            drawLSysF(rules2[0], &ts, order);
         }
+        if (ts.stackoflow)
+            stopmsg(STOPMSG_NONE, "insufficient memory, try a lower order");
         overflow = false;
     }
+    lsysi_free_extents();
+    lsysf_free_extents();
+    for (int i = 0; i < MAXRULES; i++)
+    {
+        std::vector<double>().swap(rulesteps[i]);
+        std::vector<bool>().swap(rulecolors[i]);
+    }
     free_rules_mem();
     free_lcmds();
     loaded = false;
@@ -407,213 +423,326 @@ static void free_lcmds()
         free(*sc++);
 }
 
-#if defined(XFRACT) || defined(_WIN32)
-#define lsysi_doslash_386 lsysi_doslash
-#define lsysi_dobslash_386 lsysi_dobslash
-#define lsys_doat lsysi_doat
-#define lsys_dosizegf lsysi_dosizegf
-#define lsys_dodrawg lsysi_dodrawg
-void lsys_prepfpu(lsys_turtlestatef *x) { }
-void lsys_donefpu(lsys_turtlestatef *x) { }
-#endif
-
-// integer specific routines
-
-#if defined(XFRACT) || defined(_WIN32)
-static void lsysi_doplus(lsys_turtlestatei *cmd)
+static lsys_cmd *LSysTransform(char *s)
 {
-    if (cmd->reverse)
+    lsys_cmd *ret;
+    lsys_cmd *doub;
+    int maxval = 10;
+    int n = 0;
+    lsys_op op;
+    long num;
+    LDBL numf;
+    LDBL PI180 = PI / 180.0;
+
+    ret = (lsys_cmd *) malloc((long) maxval * sizeof(lsys_cmd));
+    if (ret == nullptr)
+        return nullptr;
+    while (*s)
     {
-        if (++cmd->angle == cmd->maxangle)
-            cmd->angle = 0;
+        op = lsys_op::NONE;
+        num = 0;
+        numf = 0;
+        ret[n].ch = *s;
+        switch (*s)
+        {
+        case '+':
+            op = lsys_op::PLUS;
+            break;
+        case '-':
+            op = lsys_op::MINUS;
+            break;
+        case '/':
+            op = lsys_op::FWDSLASH;
+            numf = getnumber(&s);
+            num = (long)(numf * 11930465L);
+            numf *= PI180;
+            break;
+        case '\\':
+            op = lsys_op::BACKSLASH;
+            numf = getnumber(&s);
+            num = (long)(numf * 11930465L);
+            numf *= PI180;
+            break;
+        case '@':
+            op = lsys_op::AT;
+            numf = getnumber(&s);
+            num = FIXEDPT(numf);
+            break;
+        case '|':
+            op = lsys_op::PIPE;
+            break;
+        case '!':
+            op = lsys_op::BANG;
+            break;
+        case 'd':
+            op = lsys_op::DRAWD;
+            break;
+        case 'm':
+            op = lsys_op::MOVEM;
+            break;
+        case 'g':
+            op = lsys_op::MOVEG;
+            break;
+        case 'f':
+            op = lsys_op::DRAWF;
+            break;
+        case 'c':
+            op = lsys_op::COLOR;
+            num = (long) getnumber(&s);
+            break;
+        case '<':
+            op = lsys_op::LESS;
+            num = (long) getnumber(&s);
+            break;
+        case '>':
+            op = lsys_op::GREATER;
+            num = (long) getnumber(&s);
+            break;
+        case '[':
+            op = lsys_op::PUSH;
+            break;
+        default:
+            break;
+        }
+        ret[n].op = op;
+        ret[n].n = num;
+        ret[n].nf = numf;
+        ret[n].rule = nullptr;
+        ret[n].ruleno = 0;
+        if (++n == maxval)
+        {
+            doub = (lsys_cmd *) malloc((long) maxval*2*sizeof(lsys_cmd));
+            if (doub == nullptr)
+            {
+                free(ret);
+                return nullptr;
+            }
+            memcpy(doub, ret, maxval*sizeof(lsys_cmd));
+            free(ret);
+            ret = doub;
+            maxval <<= 1;
+        }
+        s++;
     }
-    else
+    ret[n].ch = 0;
+    ret[n].op = lsys_op::NONE;
+    ret[n].n = 0;
+    ret[n].nf = 0;
+    ret[n].rule = nullptr;
+    ret[n].ruleno = 0;
+    n++;
+
+    doub = (lsys_cmd *) malloc((long) n*sizeof(lsys_cmd));
+    if (doub == nullptr)
     {
-        if (cmd->angle)
-            cmd->angle--;
-        else
-            cmd->angle = cmd->dmaxangle;
+        free(ret);
+        return nullptr;
     }
+    memcpy(doub, ret, n*sizeof(lsys_cmd));
+    free(ret);
+    return doub;
 }
-#else
-extern void lsysi_doplus(lsys_turtlestatei *cmd);
-#endif
 
-#if defined(XFRACT) || defined(_WIN32)
-// This is the same as lsys_doplus, except maxangle is a power of 2.
-static void lsysi_doplus_pow2(lsys_turtlestatei *cmd)
+// points every command at the rule for its symbol
+static void link_rules()
 {
-    if (cmd->reverse)
-    {
-        cmd->angle++;
-        cmd->angle &= cmd->dmaxangle;
-    }
-    else
-    {
-        cmd->angle--;
-        cmd->angle &= cmd->dmaxangle;
-    }
+    int ruleno[256] = { 0 };
+
+    for (int i = 1; rules2[i]; i++)
+        ruleno[(unsigned char) rules2[i]->ch] = i;
+    for (lsys_cmd **sc = rules2; *sc; sc++)
+        for (lsys_cmd *command = *sc; command->ch; command++)
+        {
+            command->ruleno = ruleno[(unsigned char) command->ch];
+            command->rule = command->ruleno ? rules2[command->ruleno]+1 : nullptr;
+        }
 }
-#else
-extern void lsysi_doplus_pow2(lsys_turtlestatei *cmd);
-#endif
 
-#if defined(XFRACT) || defined(_WIN32)
-static void lsysi_dominus(lsys_turtlestatei *cmd)
+// how many commands walking each rule takes at each depth up to order
+static void count_steps(int order)
 {
-    if (cmd->reverse)
-    {
-        if (cmd->angle)
-            cmd->angle--;
-        else
-            cmd->angle = cmd->dmaxangle;
-    }
-    else
+    for (int i = 1; rules2[i]; i++)
     {
-        if (++cmd->angle == cmd->maxangle)
-            cmd->angle = 0;
+        rulesteps[i].assign(order+1, 0.0);
+        rulecolors[i].assign(order+1, false);
     }
+    for (int depth = 0; depth <= order; depth++)
+        for (int i = 1; rules2[i]; i++)
+        {
+            bool colors = false;
+            for (lsys_cmd *command = rules2[i]+1; command->ch; command++)
+                if (command->op == lsys_op::COLOR || command->op == lsys_op::LESS
+                    || command->op == lsys_op::GREATER
+                    || (depth && command->rule && rulecolors[command->ruleno][depth-1]))
+                    colors = true;
+            rulesteps[i][depth] = lsys_steps(rules2[i]+1, depth);
+            rulecolors[i][depth] = colors;
+        }
 }
-#else
-extern void lsysi_dominus(lsys_turtlestatei *cmd);
-#endif
 
-#if defined(XFRACT) || defined(_WIN32)
-static void lsysi_dominus_pow2(lsys_turtlestatei *cmd)
+// how many commands walking the body starting at command at depth takes
+double lsys_steps(lsys_cmd const *command, int depth)
 {
-    if (cmd->reverse)
+    double steps = 0;
+    for (; command->ch; command++)
     {
-        cmd->angle--;
-        cmd->angle &= cmd->dmaxangle;
-    }
-    else
-    {
-        cmd->angle++;
-        cmd->angle &= cmd->dmaxangle;
+        ++steps;
+        if (depth && command->rule)
+            steps += rulesteps[command->ruleno][depth-1];
     }
+    return steps;
 }
-#else
-extern void lsysi_dominus_pow2(lsys_turtlestatei *cmd);
-#endif
 
-static void lsysi_doslash(lsys_turtlestatei *cmd)
+/* Is walking the rule of command at depth long enough to be worth
+ * looking up its extent, and free of color changes, which keep the
+ * drawing from skipping it?
+ */
+bool lsys_may_skip(lsys_cmd const *command, int depth)
 {
-    if (cmd->reverse)
-        cmd->realangle -= cmd->num;
-    else
-        cmd->realangle += cmd->num;
+    return rulesteps[command->ruleno][depth] >= LSYS_SHORT
+        && !rulecolors[command->ruleno][depth];
 }
 
-#if !defined(XFRACT) && !defined(_WIN32)
-extern void lsysi_doslash_386(lsys_turtlestatei *cmd);
-#endif
-
-static void lsysi_dobslash(lsys_turtlestatei *cmd)
+/* Draws a line for either turtle.  Far into an L-system most lines are
+ * dots, often the same one over and over, and only the first of a run
+ * needs drawing.
+ */
+void lsys_draw_line(int x1, int y1, int x2, int y2, int color)
 {
-    if (cmd->reverse)
-        cmd->realangle += cmd->num;
+    if (x1 == x2 && y1 == y2)
+    {
+        if (lastdot && x1 == lastdot_x && y1 == lastdot_y && color == lastdot_color)
+            return;
+        lastdot = true;
+        lastdot_x = x1;
+        lastdot_y = y1;
+        lastdot_color = color;
+    }
     else
-        cmd->realangle -= cmd->num;
+        lastdot = false;
+    driver_draw_line(x1, y1, x2, y2, color);
 }
 
-#if !defined(XFRACT) && !defined(_WIN32)
-extern void lsysi_dobslash_386(lsys_turtlestatei *cmd);
-#endif
+// integer specific routines
 
-static void lsysi_doat(lsys_turtlestatei *cmd)
+struct lsysi_save           // turtle state kept by [
 {
-    cmd->size = multiply(cmd->size, cmd->num, 19);
-}
+    long size, realangle, xpos, ypos;
+    char angle, reverse, curcolor;
+};
 
-static void lsysi_dopipe(lsys_turtlestatei *cmd)
+// what expanding a rule does, with the turtle starting at the origin
+struct lsysi_extent
 {
-    cmd->angle = (char)(cmd->angle + (char)(cmd->maxangle / 2));
-    cmd->angle %= cmd->maxangle;
-}
+    long xmin, ymin, xmax, ymax;    // around every point visited
+    long xpos, ypos;                // where the turtle ends up
+    long size, realangle;
+    char angle, reverse;
+    bool draws;                     // has d or f commands
+    bool colors;                    // has c, < or > commands
+};
 
-#if defined(XFRACT) || defined(_WIN32)
-static void lsysi_dopipe_pow2(lsys_turtlestatei *cmd)
-{
-    cmd->angle += cmd->maxangle >> 1;
-    cmd->angle &= cmd->dmaxangle;
-}
-#else
-extern void lsysi_dopipe_pow2(lsys_turtlestatei *cmd);
-#endif
+typedef lsys_key<long> lsysi_key;
+typedef lsys_key_hash<long> lsysi_key_hash;
+
+static std::unordered_map<lsysi_key, lsysi_extent, lsysi_key_hash> iextents;
+static long iextent_count = 0;
+static std::vector<lsysi_save> isaves;
+static bool idrawing = false;           // poll the keyboard, not thinking()
 
-#if defined(XFRACT) || defined(_WIN32)
-static void lsysi_dobang(lsys_turtlestatei *cmd)
+static void lsysi_free_extents()
 {
-    cmd->reverse = ! cmd->reverse;
+    std::unordered_map<lsysi_key, lsysi_extent, lsysi_key_hash>().swap(iextents);
+    iextent_count = 0;
+    std::vector<lsysi_save>().swap(isaves);
 }
-#else
-extern void lsysi_dobang(lsys_turtlestatei *cmd);
-#endif
 
-static void lsysi_dosizedm(lsys_turtlestatei *cmd)
+static void lsysi_save_state(lsys_turtlestatei const *ts, lsysi_save &save)
 {
-    double angle = (double) cmd->realangle * ANGLE2DOUBLE;
-    double s, c;
-    long fixedsin, fixedcos;
-
-    FPUsincos(&angle, &s, &c);
-    fixedsin = (long)(s * FIXEDLT1);
-    fixedcos = (long)(c * FIXEDLT1);
-
-    cmd->xpos = cmd->xpos + (multiply(multiply(cmd->size, cmd->aspect, 19), fixedcos, 29));
-    cmd->ypos = cmd->ypos + (multiply(cmd->size, fixedsin, 29));
-
-    // xpos+=size*aspect*cos(realangle*PI/180);
-    // ypos+=size*sin(realangle*PI/180);
-    if (cmd->xpos > cmd->xmax)
-        cmd->xmax = cmd->xpos;
-    if (cmd->ypos > cmd->ymax)
-        cmd->ymax = cmd->ypos;
-    if (cmd->xpos < cmd->xmin)
-        cmd->xmin = cmd->xpos;
-    if (cmd->ypos < cmd->ymin)
-        cmd->ymin = cmd->ypos;
+    save.size = ts->size;
+    save.realangle = ts->realangle;
+    save.xpos = ts->xpos;
+    save.ypos = ts->ypos;
+    save.angle = ts->angle;
+    save.reverse = ts->reverse;
+    save.curcolor = ts->curcolor;
 }
 
-static void lsysi_dosizegf(lsys_turtlestatei *cmd)
+static void lsysi_restore_state(lsys_turtlestatei *ts, lsysi_save const &save)
 {
-    cmd->xpos = cmd->xpos + (multiply(cmd->size, coss[(int)cmd->angle], 29));
-    cmd->ypos = cmd->ypos + (multiply(cmd->size, sins[(int)cmd->angle], 29));
-    // xpos+=size*coss[angle];
-    // ypos+=size*sins[angle];
-    if (cmd->xpos > cmd->xmax)
-        cmd->xmax = cmd->xpos;
-    if (cmd->ypos > cmd->ymax)
-        cmd->ymax = cmd->ypos;
-    if (cmd->xpos < cmd->xmin)
-        cmd->xmin = cmd->xpos;
-    if (cmd->ypos < cmd->ymin)
-        cmd->ymin = cmd->ypos;
+    ts->size = save.size;
+    ts->realangle = save.realangle;
+    ts->xpos = save.xpos;
+    ts->ypos = save.ypos;
+    ts->angle = save.angle;
+    ts->reverse = save.reverse;
+    ts->curcolor = save.curcolor;
 }
 
-static void lsysi_dodrawd(lsys_turtlestatei *cmd)
+// does a command that only changes the turtle's angle, direction or size
+static void lsysi_turn(lsys_turtlestatei *ts, lsys_cmd const *command)
 {
-    double angle = (double) cmd->realangle * ANGLE2DOUBLE;
-    double s, c;
-    long fixedsin, fixedcos;
-    int lastx, lasty;
-
-    FPUsincos(&angle, &s, &c);
-    fixedsin = (long)(s * FIXEDLT1);
-    fixedcos = (long)(c * FIXEDLT1);
-
-    lastx = (int)(cmd->xpos >> 19);
-    lasty = (int)(cmd->ypos >> 19);
-    cmd->xpos = cmd->xpos + (multiply(multiply(cmd->size, cmd->aspect, 19), fixedcos, 29));
-    cmd->ypos = cmd->ypos + (multiply(cmd->size, fixedsin, 29));
-    // xpos+=size*aspect*cos(realangle*PI/180);
-    // ypos+=size*sin(realangle*PI/180);
-    driver_draw_line(lastx, lasty, (int)(cmd->xpos >> 19), (int)(cmd->ypos >> 19), cmd->curcolor);
+    switch (command->op)
+    {
+    case lsys_op::PLUS:
+        if (ts->reverse)
+        {
+            if (++ts->angle == ts->maxangle)
+                ts->angle = 0;
+        }
+        else
+        {
+            if (ts->angle)
+                ts->angle--;
+            else
+                ts->angle = ts->dmaxangle;
+        }
+        break;
+    case lsys_op::MINUS:
+        if (ts->reverse)
+        {
+            if (ts->angle)
+                ts->angle--;
+            else
+                ts->angle = ts->dmaxangle;
+        }
+        else
+        {
+            if (++ts->angle == ts->maxangle)
+                ts->angle = 0;
+        }
+        break;
+    case lsys_op::FWDSLASH:
+        if (ts->reverse)
+            ts->realangle -= command->n;
+        else
+            ts->realangle += command->n;
+        break;
+    case lsys_op::BACKSLASH:
+        if (ts->reverse)
+            ts->realangle += command->n;
+        else
+            ts->realangle -= command->n;
+        break;
+    case lsys_op::AT:
+        ts->size = multiply(ts->size, command->n, 19);
+        break;
+    case lsys_op::PIPE:
+        ts->angle = (char)(ts->angle + (char)(ts->maxangle / 2));
+        ts->angle %= ts->maxangle;
+        break;
+    case lsys_op::BANG:
+        ts->reverse = ! ts->reverse;
+        break;
+    default:
+        break;
+    }
 }
 
-static void lsysi_dodrawm(lsys_turtlestatei *cmd)
+// moves along realangle, for d and m
+static void lsysi_move_dm(lsys_turtlestatei *ts)
 {
-    double angle = (double) cmd->realangle * ANGLE2DOUBLE;
+    double angle = (double) ts->realangle * ANGLE2DOUBLE;
     double s, c;
     long fixedsin, fixedcos;
 
@@ -623,129 +752,179 @@ static void lsysi_dodrawm(lsys_turtlestatei *cmd)
 
     // xpos+=size*aspect*cos(realangle*PI/180);
     // ypos+=size*sin(realangle*PI/180);
-    cmd->xpos = cmd->xpos + (multiply(multiply(cmd->size, cmd->aspect, 19), fixedcos, 29));
-    cmd->ypos = cmd->ypos + (multiply(cmd->size, fixedsin, 29));
+    ts->xpos = ts->xpos + (multiply(multiply(ts->size, ts->aspect, 19), fixedcos, 29));
+    ts->ypos = ts->ypos + (multiply(ts->size, fixedsin, 29));
 }
 
-static void lsysi_dodrawg(lsys_turtlestatei *cmd)
+// moves along angle, for g and f
+static void lsysi_move_gf(lsys_turtlestatei *ts)
 {
-    cmd->xpos = cmd->xpos + (multiply(cmd->size, coss[(int)cmd->angle], 29));
-    cmd->ypos = cmd->ypos + (multiply(cmd->size, sins[(int)cmd->angle], 29));
+    ts->xpos = ts->xpos + (multiply(ts->size, coss[(int)ts->angle], 29));
+    ts->ypos = ts->ypos + (multiply(ts->size, sins[(int)ts->angle], 29));
     // xpos+=size*coss[angle];
     // ypos+=size*sins[angle];
 }
 
-static void lsysi_dodrawf(lsys_turtlestatei *cmd)
+static bool lsysi_interrupted(lsys_turtlestatei *ts)
 {
-    int lastx = (int)(cmd->xpos >> 19);
-    int lasty = (int)(cmd->ypos >> 19);
-    cmd->xpos = cmd->xpos + (multiply(cmd->size, coss[(int)cmd->angle], 29));
-    cmd->ypos = cmd->ypos + (multiply(cmd->size, sins[(int)cmd->angle], 29));
-    // xpos+=size*coss[angle];
-    // ypos+=size*sins[angle];
-    driver_draw_line(lastx, lasty, (int)(cmd->xpos >> 19), (int)(cmd->ypos >> 19), cmd->curcolor);
-}
-
-static void lsysi_dodrawc(lsys_turtlestatei *cmd)
-{
-    cmd->curcolor = (char)(((int) cmd->num) % colors);
-}
-
-static void lsysi_dodrawgt(lsys_turtlestatei *cmd)
-{
-    cmd->curcolor = (char)(cmd->curcolor - (char)cmd->num);
-    cmd->curcolor %= colors;
-    if (cmd->curcolor == 0)
-        cmd->curcolor = (char)(colors-1);
+    if (!(ts->counter++))
+    {
+        // let user know we're not dead
+        if (idrawing ? driver_key_pressed() != 0
+            : thinking(1, "L-System thinking (higher orders take longer)"))
+        {
+            ts->counter--;
+            return true;
+        }
+    }
+    return false;
 }
 
-static void lsysi_dodrawlt(lsys_turtlestatei *cmd)
-{
-    cmd->curcolor = (char)(cmd->curcolor + (char)cmd->num);
-    cmd->curcolor %= colors;
-    if (cmd->curcolor == 0)
-        cmd->curcolor = 1;
-}
+static bool lsysi_expand(lsys_cmd *rule, lsys_turtlestatei *ts, int depth, lsysi_extent &ext);
 
-static lsys_cmd *
-findsize(lsys_cmd *command, lsys_turtlestatei *ts, lsys_cmd **rules, int depth)
+/* Moves the turtle through a rule body without drawing, keeping the box
+ * around where it goes in xmin..ymax.  Returns false if interrupted or
+ * on overflow.
+ */
+static bool lsysi_walk(lsys_cmd *command, lsys_turtlestatei *ts, int depth, lsysi_extent &ext)
 {
-    bool tran;
-
-    if (overflow)     // integer math routines overflowed
-        return nullptr;
-
-    if (stackavail() < 400)
-    { // leave some margin for calling subrtns
-        ts->stackoflow = true;
-        return nullptr;
-    }
+    int open = 0;                       // brackets pushed here
 
-    while (command->ch && command->ch != ']')
+    while (true)
     {
-        if (!(ts->counter++))
+        if (command->ch == ']' && open)
         {
-            // let user know we're not dead
-            if (thinking(1, "L-System thinking (higher orders take longer)"))
-            {
-                ts->counter--;
-                return nullptr;
-            }
+            lsysi_restore_state(ts, isaves.back());
+            isaves.pop_back();
+            --open;
+            command++;
+            continue;
         }
-        tran = false;
-        if (depth)
+        if (!command->ch || command->ch == ']')
+            break;
+        if (lsysi_interrupted(ts))
+            return false;
+        if (depth && command->rule)
         {
-            for (lsys_cmd **rulind = rules; *rulind; rulind++)
-                if ((*rulind)->ch == command->ch)
-                {
-                    tran = true;
-                    if (findsize((*rulind)+1, ts, rules, depth-1) == nullptr)
-                        return (nullptr);
-                }
+            lsysi_extent sub;
+            if (!lsysi_expand(command->rule, ts, depth-1, sub))
+                return false;
+            if (ts->xpos + sub.xmax > ts->xmax)
+                ts->xmax = ts->xpos + sub.xmax;
+            if (ts->ypos + sub.ymax > ts->ymax)
+                ts->ymax = ts->ypos + sub.ymax;
+            if (ts->xpos + sub.xmin < ts->xmin)
+                ts->xmin = ts->xpos + sub.xmin;
+            if (ts->ypos + sub.ymin < ts->ymin)
+                ts->ymin = ts->ypos + sub.ymin;
+            ts->xpos += sub.xpos;
+            ts->ypos += sub.ypos;
+            ts->size = sub.size;
+            ts->realangle = sub.realangle;
+            ts->angle = sub.angle;
+            ts->reverse = sub.reverse;
+            ext.draws |= sub.draws;
+            ext.colors |= sub.colors;
         }
-        if (!depth || !tran)
+        else
         {
-            if (command->f)
+            switch (command->op)
             {
-                ts->num = command->n;
-                (*command->f)(ts);
-            }
-            else if (command->ch == '[')
-            {
-                char saveang, saverev;
-                long savesize, savex, savey;
-                unsigned long saverang;
-
-                saveang = ts->angle;
-                saverev = ts->reverse;
-                savesize = ts->size;
-                saverang = ts->realangle;
-                savex = ts->xpos;
-                savey = ts->ypos;
-                command = findsize(command+1, ts, rules, depth);
-                if (command == nullptr)
-                    return (nullptr);
-                ts->angle = saveang;
-                ts->reverse = saverev;
-                ts->size = savesize;
-                ts->realangle = saverang;
-                ts->xpos = savex;
-                ts->ypos = savey;
+            case lsys_op::DRAWD:
+            case lsys_op::DRAWF:
+                ext.draws = true;
+                // fall through
+            case lsys_op::MOVEM:
+            case lsys_op::MOVEG:
+                if (command->op == lsys_op::DRAWD || command->op == lsys_op::MOVEM)
+                    lsysi_move_dm(ts);
+                else
+                    lsysi_move_gf(ts);
+                if (ts->xpos > ts->xmax)
+                    ts->xmax = ts->xpos;
+                if (ts->ypos > ts->ymax)
+                    ts->ymax = ts->ypos;
+                if (ts->xpos < ts->xmin)
+                    ts->xmin = ts->xpos;
+                if (ts->ypos < ts->ymin)
+                    ts->ymin = ts->ypos;
+                break;
+            case lsys_op::COLOR:
+            case lsys_op::LESS:
+            case lsys_op::GREATER:
+                ext.colors = true;
+                break;
+            case lsys_op::PUSH:
+                isaves.push_back(lsysi_save());
+                lsysi_save_state(ts, isaves.back());
+                ++open;
+                break;
+            default:
+                lsysi_turn(ts, command);
+                break;
             }
         }
         command++;
     }
-    return command;
+    while (open--)
+    {
+        lsysi_restore_state(ts, isaves.back());
+        isaves.pop_back();
+    }
+    return !overflow;
+}
+
+// what walking rule at depth does from the turtle's state, walked once
+static bool lsysi_expand(lsys_cmd *rule, lsys_turtlestatei *ts, int depth, lsysi_extent &ext)
+{
+    lsysi_key const key = { rule, ts->size, ts->realangle, depth, ts->angle, ts->reverse };
+    auto const found = iextents.find(key);
+    if (found != iextents.end())
+    {
+        ext = found->second;
+        return true;
+    }
+
+    lsys_turtlestatei local = *ts;
+    local.xpos = 0;
+    local.ypos = 0;
+    local.xmin = 0;
+    local.ymin = 0;
+    local.xmax = 0;
+    local.ymax = 0;
+    ext.draws = false;
+    ext.colors = false;
+    bool const walked = lsysi_walk(rule, &local, depth, ext);
+    ts->counter = local.counter;
+    if (!walked)
+        return false;
+    ext.xmin = local.xmin;
+    ext.ymin = local.ymin;
+    ext.xmax = local.xmax;
+    ext.ymax = local.ymax;
+    ext.xpos = local.xpos;
+    ext.ypos = local.ypos;
+    ext.size = local.size;
+    ext.realangle = local.realangle;
+    ext.angle = local.angle;
+    ext.reverse = local.reverse;
+    if (iextent_count < LSYS_EXTENTS)
+    {
+        iextents.insert(std::make_pair(key, ext));
+        ++iextent_count;
+    }
+    return true;
 }
 
 static bool
-lsysi_findscale(lsys_cmd *command, lsys_turtlestatei *ts, lsys_cmd **rules, int depth)
+lsysi_findscale(lsys_cmd *axiom, lsys_turtlestatei *ts, int depth)
 {
     float horiz, vert;
     double xmin, xmax, ymin, ymax;
     double locsize;
     double locaspect;
-    lsys_cmd *fsret;
+    bool walked;
+    lsysi_extent ext;
 
     locaspect = screenaspect*xdots/ydots;
     ts->aspect = FIXEDPT(locaspect);
@@ -760,13 +939,24 @@ lsysi_findscale(lsys_cmd *command, lsys_turtlestatei *ts, lsys_cmd **rules, int
     ts->ypos = ts->xmin;
     ts->xpos = ts->ypos;
     ts->size = FIXEDPT(1L);
-    fsret = findsize(command, ts, rules, depth);
+    ext.draws = false;
+    ext.colors = false;
+    idrawing = false;
+    try
+    {
+        walked = lsysi_walk(axiom, ts, depth, ext);
+    }
+    catch (std::bad_alloc const&)
+    {
+        ts->stackoflow = true;
+        walked = false;
+    }
     thinking(0, nullptr); // erase thinking message if any
     xmin = (double) ts->xmin / FIXEDMUL;
     xmax = (double) ts->xmax / FIXEDMUL;
     ymin = (double) ts->ymin / FIXEDMUL;
     ymax = (double) ts->ymax / FIXEDMUL;
-    if (fsret == nullptr)
+    if (!walked)
         return false;
     if (xmax == xmin)
         horiz = (float)1E37;
@@ -793,311 +983,153 @@ lsysi_findscale(lsys_cmd *command, lsys_turtlestatei *ts, lsys_cmd **rules, int
     return true;
 }
 
-static lsys_cmd *
-drawLSysI(lsys_cmd *command, lsys_turtlestatei *ts, lsys_cmd **rules, int depth)
+struct lsysi_frame          // where to go on when a rule body or bracket ends
 {
-    bool tran;
-
-    if (overflow)     // integer math routines overflowed
-        return nullptr;
-
-    if (stackavail() < 400)
-    { // leave some margin for calling subrtns
-        ts->stackoflow = true;
-        return nullptr;
-    }
+    lsys_cmd *command;
+    int depth;
+    bool bracket;           // restore the turtle and go on past the ]
+    lsysi_save save;
+};
 
+static bool lsysi_draw(lsys_cmd *command, lsys_turtlestatei *ts, int depth)
+{
+    std::vector<lsysi_frame> stack(64);
+    int frames = 64;
+    int top = -1;
+    bool extents = true;
 
-    while (command->ch && command->ch != ']')
+    while (true)
     {
-        if (!(ts->counter++))
+        if (!command->ch || command->ch == ']')
         {
-            if (driver_key_pressed())
+            if (top < 0)
+                break;
+            lsysi_frame const &caller = stack[top--];
+            if (caller.bracket)
             {
-                ts->counter--;
-                return nullptr;
+                lsysi_restore_state(ts, caller.save);
+                command = command->ch ? command+1 : command;
             }
+            else
+                command = caller.command;
+            depth = caller.depth;
+            continue;
         }
-        tran = false;
-        if (depth)
+        if (lsysi_interrupted(ts))
+            return false;
+        if (top+1 == frames)
         {
-            for (lsys_cmd **rulind = rules; *rulind; rulind++)
-                if ((*rulind)->ch == command->ch)
-                {
-                    tran = true;
-                    if (drawLSysI((*rulind)+1, ts, rules, depth-1) == nullptr)
-                        return nullptr;
-                }
+            frames *= 2;
+            stack.resize(frames);
         }
-        if (!depth || !tran)
+        if (depth && command->rule)
         {
-            if (command->f)
-            {
-                ts->num = command->n;
-                (*command->f)(ts);
-            }
-            else if (command->ch == '[')
+            int const sub = depth-1;
+            if (extents && iextent_count >= LSYS_EXTENTS)
+                extents = false;        // too many states to remember
+            if (extents && lsys_may_skip(command, sub))
             {
-                char saveang, saverev, savecolor;
-                long savesize, savex, savey;
-                unsigned long saverang;
-
-                saveang = ts->angle;
-                saverev = ts->reverse;
-                savesize = ts->size;
-                saverang = ts->realangle;
-                savex = ts->xpos;
-                savey = ts->ypos;
-                savecolor = ts->curcolor;
-                command = drawLSysI(command+1, ts, rules, depth);
-                if (command == nullptr)
-                    return (nullptr);
-                ts->angle = saveang;
-                ts->reverse = saverev;
-                ts->size = savesize;
-                ts->realangle = saverang;
-                ts->xpos = savex;
-                ts->ypos = savey;
-                ts->curcolor = savecolor;
+                lsysi_extent ext;
+                if (!lsysi_expand(command->rule, ts, sub, ext))
+                    return false;
+                if (!ext.colors && (!ext.draws
+                    || (((ts->xpos + ext.xmin) >> 19) == ((ts->xpos + ext.xmax) >> 19)
+                        && ((ts->ypos + ext.ymin) >> 19) == ((ts->ypos + ext.ymax) >> 19))))
+                {
+                    // it stays in one pixel
+                    if (ext.draws)
+                    {
+                        int const x = (int)(ts->xpos >> 19);
+                        int const y = (int)(ts->ypos >> 19);
+                        lsys_draw_line(x, y, x, y, ts->curcolor);
+                    }
+                    ts->xpos += ext.xpos;
+                    ts->ypos += ext.ypos;
+                    ts->size = ext.size;
+                    ts->realangle = ext.realangle;
+                    ts->angle = ext.angle;
+                    ts->reverse = ext.reverse;
+                    command++;
+                    continue;
+                }
             }
+            stack[++top].command = command+1;
+            stack[top].depth = depth;
+            stack[top].bracket = false;
+            command = command->rule;
+            depth = sub;
+            continue;
         }
-        command++;
-    }
-    return command;
-}
-
-static lsys_cmd *
-LSysISizeTransform(char *s, lsys_turtlestatei *ts)
-{
-    lsys_cmd *ret;
-    lsys_cmd *doub;
-    int maxval = 10;
-    int n = 0;
-    void (*f)(lsys_turtlestatei *);
-    long num;
-
-    void (*plus)(lsys_turtlestatei *) = (ispow2(ts->maxangle)) ? lsysi_doplus_pow2 : lsysi_doplus;
-    void (*minus)(lsys_turtlestatei *) = (ispow2(ts->maxangle)) ? lsysi_dominus_pow2 : lsysi_dominus;
-    void (*pipe)(lsys_turtlestatei *) = (ispow2(ts->maxangle)) ? lsysi_dopipe_pow2 : lsysi_dopipe;
-
-    void (*slash)(lsys_turtlestatei *) = lsysi_doslash_386;
-    void (*bslash)(lsys_turtlestatei *) = lsysi_dobslash_386;
-    void (*at)(lsys_turtlestatei *) = lsysi_doat_386;
-    void (*dogf)(lsys_turtlestatei *) = lsysi_dosizegf_386;
 
-    ret = (lsys_cmd *) malloc((long) maxval * sizeof(lsys_cmd));
-    if (ret == nullptr)
-    {
-        ts->stackoflow = true;
-        return nullptr;
-    }
-    while (*s)
-    {
-        f = nullptr;
-        num = 0;
-        ret[n].ch = *s;
-        switch (*s)
+        int lastx, lasty;
+        switch (command->op)
         {
-        case '+':
-            f = plus;
+        case lsys_op::DRAWD:
+            lastx = (int)(ts->xpos >> 19);
+            lasty = (int)(ts->ypos >> 19);
+            lsysi_move_dm(ts);
+            lsys_draw_line(lastx, lasty, (int)(ts->xpos >> 19), (int)(ts->ypos >> 19), ts->curcolor);
             break;
-        case '-':
-            f = minus;
+        case lsys_op::MOVEM:
+            lsysi_move_dm(ts);
             break;
-        case '/':
-            f = slash;
-            num = (long)(getnumber(&s) * 11930465L);
+        case lsys_op::MOVEG:
+            lsysi_move_gf(ts);
             break;
-        case '\\':
-            f = bslash;
-            num = (long)(getnumber(&s) * 11930465L);
+        case lsys_op::DRAWF:
+            lastx = (int)(ts->xpos >> 19);
+            lasty = (int)(ts->ypos >> 19);
+            lsysi_move_gf(ts);
+            lsys_draw_line(lastx, lasty, (int)(ts->xpos >> 19), (int)(ts->ypos >> 19), ts->curcolor);
             break;
-        case '@':
-            f = at;
-            num = FIXEDPT(getnumber(&s));
+        case lsys_op::COLOR:
+            ts->curcolor = (char)(((int) command->n) % colors);
             break;
-        case '|':
-            f = pipe;
+        case lsys_op::GREATER:
+            ts->curcolor = (char)(ts->curcolor - (char)command->n);
+            ts->curcolor %= colors;
+            if (ts->curcolor == 0)
+                ts->curcolor = (char)(colors-1);
             break;
-        case '!':
-            f = lsysi_dobang;
-            break;
-        case 'd':
-        case 'm':
-            f = lsysi_dosizedm;
-            break;
-        case 'g':
-        case 'f':
-            f = dogf;
-            break;
-        case '[':
-            num = 1;
+        case lsys_op::LESS:
+            ts->curcolor = (char)(ts->curcolor + (char)command->n);
+            ts->curcolor %= colors;
+            if (ts->curcolor == 0)
+                ts->curcolor = 1;
             break;
-        case ']':
-            num = 2;
+        case lsys_op::PUSH:
+            stack[++top].depth = depth;
+            stack[top].bracket = true;
+            lsysi_save_state(ts, stack[top].save);
             break;
         default:
-            num = 3;
+            lsysi_turn(ts, command);
             break;
         }
-        ret[n].f = f;
-        ret[n].n = num;
-        if (++n == maxval)
-        {
-            doub = (lsys_cmd *) malloc((long) maxval*2*sizeof(lsys_cmd));
-            if (doub == nullptr)
-            {
-                free(ret);
-                ts->stackoflow = true;
-                return nullptr;
-            }
-            memcpy(doub, ret, maxval*sizeof(lsys_cmd));
-            free(ret);
-            ret = doub;
-            maxval <<= 1;
-        }
-        s++;
-    }
-    ret[n].ch = 0;
-    ret[n].f = nullptr;
-    ret[n].n = 0;
-    n++;
-
-    doub = (lsys_cmd *) malloc((long) n*sizeof(lsys_cmd));
-    if (doub == nullptr)
-    {
-        free(ret);
-        ts->stackoflow = true;
-        return nullptr;
+        command++;
+        if (overflow)
+            return false;
     }
-    memcpy(doub, ret, n*sizeof(lsys_cmd));
-    free(ret);
-    return doub;
+    return true;
 }
 
-static lsys_cmd *
-LSysIDrawTransform(char *s, lsys_turtlestatei *ts)
+static bool
+drawLSysI(lsys_cmd *axiom, lsys_turtlestatei *ts, int depth)
 {
-    lsys_cmd *ret;
-    lsys_cmd *doub;
-    int maxval = 10;
-    int n = 0;
-    void (*f)(lsys_turtlestatei *);
-    long num;
-
-    void (*plus)(lsys_turtlestatei *) = (ispow2(ts->maxangle)) ? lsysi_doplus_pow2 : lsysi_doplus;
-    void (*minus)(lsys_turtlestatei *) = (ispow2(ts->maxangle)) ? lsysi_dominus_pow2 : lsysi_dominus;
-    void (*pipe)(lsys_turtlestatei *) = (ispow2(ts->maxangle)) ? lsysi_dopipe_pow2 : lsysi_dopipe;
+    bool drawn;
 
-    void (*slash)(lsys_turtlestatei *) = lsysi_doslash_386;
-    void (*bslash)(lsys_turtlestatei *) = lsysi_dobslash_386;
-    void (*at)(lsys_turtlestatei *) = lsysi_doat_386;
-    void (*drawg)(lsys_turtlestatei *) = lsysi_dodrawg_386;
-
-    ret = (lsys_cmd *) malloc((long) maxval * sizeof(lsys_cmd));
-    if (ret == nullptr)
+    idrawing = true;
+    try
     {
-        ts->stackoflow = true;
-        return nullptr;
+        drawn = lsysi_draw(axiom, ts, depth);
     }
-    while (*s)
+    catch (std::bad_alloc const&)
     {
-        f = nullptr;
-        num = 0;
-        ret[n].ch = *s;
-        switch (*s)
-        {
-        case '+':
-            f = plus;
-            break;
-        case '-':
-            f = minus;
-            break;
-        case '/':
-            f = slash;
-            num = (long)(getnumber(&s) * 11930465L);
-            break;
-        case '\\':
-            f = bslash;
-            num = (long)(getnumber(&s) * 11930465L);
-            break;
-        case '@':
-            f = at;
-            num = FIXEDPT(getnumber(&s));
-            break;
-        case '|':
-            f = pipe;
-            break;
-        case '!':
-            f = lsysi_dobang;
-            break;
-        case 'd':
-            f = lsysi_dodrawd;
-            break;
-        case 'm':
-            f = lsysi_dodrawm;
-            break;
-        case 'g':
-            f = drawg;
-            break;
-        case 'f':
-            f = lsysi_dodrawf;
-            break;
-        case 'c':
-            f = lsysi_dodrawc;
-            num = (long) getnumber(&s);
-            break;
-        case '<':
-            f = lsysi_dodrawlt;
-            num = (long) getnumber(&s);
-            break;
-        case '>':
-            f = lsysi_dodrawgt;
-            num = (long) getnumber(&s);
-            break;
-        case '[':
-            num = 1;
-            break;
-        case ']':
-            num = 2;
-            break;
-        default:
-            num = 3;
-            break;
-        }
-        ret[n].f = f;
-        ret[n].n = num;
-        if (++n == maxval)
-        {
-            doub = (lsys_cmd *) malloc((long) maxval*2*sizeof(lsys_cmd));
-            if (doub == nullptr)
-            {
-                free(ret);
-                ts->stackoflow = true;
-                return nullptr;
-            }
-            memcpy(doub, ret, maxval*sizeof(lsys_cmd));
-            free(ret);
-            ret = doub;
-            maxval <<= 1;
-        }
-        s++;
-    }
-    ret[n].ch = 0;
-    ret[n].f = nullptr;
-    ret[n].n = 0;
-    n++;
-
-    doub = (lsys_cmd *) malloc((long) n*sizeof(lsys_cmd));
-    if (doub == nullptr)
-    {
-        free(ret);
         ts->stackoflow = true;
-        return nullptr;
+        drawn = false;
     }
-    memcpy(doub, ret, n*sizeof(lsys_cmd));
-    free(ret);
-    return doub;
+    idrawing = false;
+    return drawn;
 }
 
 static void lsysi_dosincos()
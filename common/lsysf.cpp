@@ -3,6 +3,10 @@
 #if !defined(_WIN32)
 #include <malloc.h>
 #endif
+#include <functional>
+#include <new>
+#include <unordered_map>
+#include <vector>
 
 #include "port.h"
 #include "prototyp.h"
@@ -13,377 +17,326 @@
 #undef max
 #endif
 
-struct lsys_cmd
-{
-    void (*f)(lsys_turtlestatef *);
-    int ptype;
-    union
-    {
-        long n;
-        LDBL nf;
-    } parm;
-    char ch;
-};
+/* The floating point turtle walks the rules the way the integer one in
+ * lsys.cpp does, but adding an expansion's offset to the turtle doesn't
+ * round the same as adding up its steps.  The difference is in the last
+ * bits, yet it can move a line that falls exactly on a pixel edge, so
+ * an L-system that takes fewer than LSYS_STEPS commands is walked step
+ * by step as it always was, and only longer ones use the extents.  The
+ * test for an expansion staying in one pixel leaves a margin for the
+ * rounding.
+ */
 
 #define sins_f ((LDBL *)(boxy))
 #define coss_f (((LDBL *)(boxy)+50))
 
-static lsys_cmd *findsize(lsys_cmd *, lsys_turtlestatef *, lsys_cmd **, int);
-
-#if defined(XFRACT) || defined(_WIN32)
-static void lsysf_doplus(lsys_turtlestatef *cmd)
-{
-    if (cmd->reverse)
-    {
-        if (++cmd->angle == cmd->maxangle)
-            cmd->angle = 0;
-    }
-    else
-    {
-        if (cmd->angle)
-            cmd->angle--;
-        else
-            cmd->angle = cmd->dmaxangle;
-    }
-}
-#else
-extern void lsysf_doplus(lsys_turtlestatef *cmd);
-#endif
-
-#if defined(XFRACT) || defined(_WIN32)
-// This is the same as lsys_doplus, except maxangle is a power of 2.
-static void lsysf_doplus_pow2(lsys_turtlestatef *cmd)
+struct lsysf_save           // turtle state kept by [
 {
-    if (cmd->reverse)
-    {
-        cmd->angle++;
-        cmd->angle &= cmd->dmaxangle;
-    }
-    else
-    {
-        cmd->angle--;
-        cmd->angle &= cmd->dmaxangle;
-    }
-}
-#else
-extern void lsysf_doplus_pow2(lsys_turtlestatef *cmd);
-#endif
+    LDBL size, realangle, xpos, ypos;
+    char angle, reverse, curcolor;
+};
 
-#if defined(XFRACT) || defined(_WIN32)
-static void lsysf_dominus(lsys_turtlestatef *cmd)
+// what expanding a rule does, with the turtle starting at the origin
+struct lsysf_extent
 {
-    if (cmd->reverse)
-    {
-        if (cmd->angle)
-            cmd->angle--;
-        else
-            cmd->angle = cmd->dmaxangle;
-    }
-    else
-    {
-        if (++cmd->angle == cmd->maxangle)
-            cmd->angle = 0;
-    }
-}
-#else
-extern void lsysf_dominus(lsys_turtlestatef *cmd);
-#endif
+    LDBL xmin, ymin, xmax, ymax;    // around every point visited
+    LDBL xpos, ypos;                // where the turtle ends up
+    LDBL size, realangle;
+    char angle, reverse;
+    bool draws;                     // has d or f commands
+    bool colors;                    // has c, < or > commands
+};
 
-#if defined(XFRACT) || defined(_WIN32)
-static void lsysf_dominus_pow2(lsys_turtlestatef *cmd)
-{
-    if (cmd->reverse)
-    {
-        cmd->angle--;
-        cmd->angle &= cmd->dmaxangle;
-    }
-    else
-    {
-        cmd->angle++;
-        cmd->angle &= cmd->dmaxangle;
-    }
-}
-#else
-extern void lsysf_dominus_pow2(lsys_turtlestatef *cmd);
-#endif
+typedef lsys_key<LDBL> lsysf_key;
+typedef lsys_key_hash<LDBL> lsysf_key_hash;
 
-#if defined(XFRACT) || defined(_WIN32)
-static void lsysf_doslash(lsys_turtlestatef *cmd)
-{
-    if (cmd->reverse)
-        cmd->realangle -= cmd->parm.nf;
-    else
-        cmd->realangle += cmd->parm.nf;
-}
-#else
-extern void lsysf_doslash(lsys_turtlestatef *cmd);
-#endif
+#define LSYS_STEPS 0x1000000        // well under a second
+#define LSYS_MARGIN (1.0/1024)      // in pixels, far more than the rounding
+#define LSYS_FAR 1E9                // beyond this (int) isn't safe
 
-#if defined(XFRACT) || defined(_WIN32)
-static void lsysf_dobslash(lsys_turtlestatef *cmd)
-{
-    if (cmd->reverse)
-        cmd->realangle += cmd->parm.nf;
-    else
-        cmd->realangle -= cmd->parm.nf;
-}
-#else
-extern void lsysf_dobslash(lsys_turtlestatef *cmd);
-#endif
+static std::unordered_map<lsysf_key, lsysf_extent, lsysf_key_hash> fextents;
+static long fextent_count = 0;
+static std::vector<lsysf_save> fsaves;
+static bool fdrawing = false;           // poll the keyboard, not thinking()
+static bool fuse_extents = false;       // the L-system is too long to step through
 
-#if defined(XFRACT) || defined(_WIN32)
-static void lsysf_doat(lsys_turtlestatef *cmd)
+void lsysf_free_extents()
 {
-    cmd->size *= cmd->parm.nf;
+    std::unordered_map<lsysf_key, lsysf_extent, lsysf_key_hash>().swap(fextents);
+    fextent_count = 0;
+    std::vector<lsysf_save>().swap(fsaves);
 }
-#else
-extern void lsysf_doat(lsys_turtlestatef *cmd, long n);
-#endif
 
-static void
-lsysf_dopipe(lsys_turtlestatef *cmd)
+static void lsysf_save_state(lsys_turtlestatef const *ts, lsysf_save &save)
 {
-    cmd->angle = (char)(cmd->angle + cmd->maxangle / 2);
-    cmd->angle %= cmd->maxangle;
+    save.size = ts->size;
+    save.realangle = ts->realangle;
+    save.xpos = ts->xpos;
+    save.ypos = ts->ypos;
+    save.angle = ts->angle;
+    save.reverse = ts->reverse;
+    save.curcolor = ts->curcolor;
 }
 
-#if defined(XFRACT) || defined(_WIN32)
-static void lsysf_dopipe_pow2(lsys_turtlestatef *cmd)
+static void lsysf_restore_state(lsys_turtlestatef *ts, lsysf_save const &save)
 {
-    cmd->angle += cmd->maxangle >> 1;
-    cmd->angle &= cmd->dmaxangle;
+    ts->size = save.size;
+    ts->realangle = save.realangle;
+    ts->xpos = save.xpos;
+    ts->ypos = save.ypos;
+    ts->angle = save.angle;
+    ts->reverse = save.reverse;
+    ts->curcolor = save.curcolor;
 }
-#else
-extern void lsysf_dopipe_pow2(lsys_turtlestatef *cmd);
-#endif
 
-#if defined(XFRACT) || defined(_WIN32)
-static void lsysf_dobang(lsys_turtlestatef *cmd)
+// does a command that only changes the turtle's angle, direction or size
+static void lsysf_turn(lsys_turtlestatef *ts, lsys_cmd const *command)
 {
-    cmd->reverse = ! cmd->reverse;
-}
-#else
-extern void lsysf_dobang(lsys_turtlestatef *cmd);
-#endif
-
-#if defined(XFRACT) || defined(_WIN32)
-static void lsysf_dosizedm(lsys_turtlestatef *cmd)
-{
-    double angle = (double) cmd->realangle;
-    double s, c;
-
-    s = sin(angle);
-    c = cos(angle);
-
-    cmd->xpos += cmd->size * cmd->aspect * c;
-    cmd->ypos += cmd->size * s;
-
-    if (cmd->xpos > cmd->xmax)
-        cmd->xmax = cmd->xpos;
-    if (cmd->ypos > cmd->ymax)
-        cmd->ymax = cmd->ypos;
-    if (cmd->xpos < cmd->xmin)
-        cmd->xmin = cmd->xpos;
-    if (cmd->ypos < cmd->ymin)
-        cmd->ymin = cmd->ypos;
-}
-#else
-extern void lsysf_dosizedm(lsys_turtlestatef *cmd, long n);
-#endif
-
-#if defined(XFRACT) || defined(_WIN32)
-static void lsysf_dosizegf(lsys_turtlestatef *cmd)
-{
-    cmd->xpos += cmd->size * coss_f[(int)cmd->angle];
-    cmd->ypos += cmd->size * sins_f[(int)cmd->angle];
-
-    if (cmd->xpos > cmd->xmax)
-        cmd->xmax = cmd->xpos;
-    if (cmd->ypos > cmd->ymax)
-        cmd->ymax = cmd->ypos;
-    if (cmd->xpos < cmd->xmin)
-        cmd->xmin = cmd->xpos;
-    if (cmd->ypos < cmd->ymin)
-        cmd->ymin = cmd->ypos;
-}
-#else
-extern void lsysf_dosizegf(lsys_turtlestatef *cmd);
-#endif
-
-#if defined(XFRACT) || defined(_WIN32)
-static void lsysf_dodrawd(lsys_turtlestatef *cmd)
-{
-    double angle = (double) cmd->realangle;
-    double s, c;
-    int lastx, lasty;
-    s = sin(angle);
-    c = cos(angle);
-
-    lastx = (int) cmd->xpos;
-    lasty = (int) cmd->ypos;
-
-    cmd->xpos += cmd->size * cmd->aspect * c;
-    cmd->ypos += cmd->size * s;
-
-    driver_draw_line(lastx, lasty, (int) cmd->xpos, (int) cmd->ypos, cmd->curcolor);
+    switch (command->op)
+    {
+    case lsys_op::PLUS:
+        if (ts->reverse)
+        {
+            if (++ts->angle == ts->maxangle)
+                ts->angle = 0;
+        }
+        else
+        {
+            if (ts->angle)
+                ts->angle--;
+            else
+                ts->angle = ts->dmaxangle;
+        }
+        break;
+    case lsys_op::MINUS:
+        if (ts->reverse)
+        {
+            if (ts->angle)
+                ts->angle--;
+            else
+                ts->angle = ts->dmaxangle;
+        }
+        else
+        {
+            if (++ts->angle == ts->maxangle)
+                ts->angle = 0;
+        }
+        break;
+    case lsys_op::FWDSLASH:
+        if (ts->reverse)
+            ts->realangle -= command->nf;
+        else
+            ts->realangle += command->nf;
+        break;
+    case lsys_op::BACKSLASH:
+        if (ts->reverse)
+            ts->realangle += command->nf;
+        else
+            ts->realangle -= command->nf;
+        break;
+    case lsys_op::AT:
+        ts->size *= command->nf;
+        break;
+    case lsys_op::PIPE:
+        ts->angle = (char)(ts->angle + ts->maxangle / 2);
+        ts->angle %= ts->maxangle;
+        break;
+    case lsys_op::BANG:
+        ts->reverse = ! ts->reverse;
+        break;
+    default:
+        break;
+    }
 }
-#else
-extern void lsysf_dodrawd(lsys_turtlestatef *cmd);
-#endif
 
-#if defined(XFRACT) || defined(_WIN32)
-static void lsysf_dodrawm(lsys_turtlestatef *cmd)
+// moves along realangle, for d and m
+static void lsysf_move_dm(lsys_turtlestatef *ts)
 {
-    double angle = (double) cmd->realangle;
+    double angle = (double) ts->realangle;
     double s, c;
 
     s = sin(angle);
     c = cos(angle);
 
-    cmd->xpos += cmd->size * cmd->aspect * c;
-    cmd->ypos += cmd->size * s;
+    ts->xpos += ts->size * ts->aspect * c;
+    ts->ypos += ts->size * s;
 }
-#else
-extern void lsysf_dodrawm(lsys_turtlestatef *cmd);
-#endif
 
-#if defined(XFRACT) || defined(_WIN32)
-static void lsysf_dodrawg(lsys_turtlestatef *cmd)
+// moves along angle, for g and f
+static void lsysf_move_gf(lsys_turtlestatef *ts)
 {
-    cmd->xpos += cmd->size * coss_f[(int)cmd->angle];
-    cmd->ypos += cmd->size * sins_f[(int)cmd->angle];
+    ts->xpos += ts->size * coss_f[(int)ts->angle];
+    ts->ypos += ts->size * sins_f[(int)ts->angle];
 }
-#else
-extern void lsysf_dodrawg(lsys_turtlestatef *cmd);
-#endif
 
-#if defined(XFRACT) || defined(_WIN32)
-static void lsysf_dodrawf(lsys_turtlestatef *cmd)
+static bool lsysf_interrupted(lsys_turtlestatef *ts)
 {
-    int lastx = (int) cmd->xpos;
-    int lasty = (int) cmd->ypos;
-    cmd->xpos += cmd->size * coss_f[(int)cmd->angle];
-    cmd->ypos += cmd->size * sins_f[(int)cmd->angle];
-    driver_draw_line(lastx, lasty, (int) cmd->xpos, (int) cmd->ypos, cmd->curcolor);
-}
-#else
-extern void lsysf_dodrawf(lsys_turtlestatef *cmd);
-#endif
-
-static void lsysf_dodrawc(lsys_turtlestatef *cmd)
-{
-    cmd->curcolor = (char)(((int) cmd->parm.n) % colors);
-}
-
-static void lsysf_dodrawgt(lsys_turtlestatef *cmd)
-{
-    cmd->curcolor = (char)(cmd->curcolor - cmd->parm.n);
-    cmd->curcolor %= colors;
-    if (cmd->curcolor == 0)
-        cmd->curcolor = (char)(colors-1);
+    if (!(ts->counter++))
+    {
+        // let user know we're not dead
+        if (fdrawing ? driver_key_pressed() != 0
+            : thinking(1, "L-System thinking (higher orders take longer)"))
+        {
+            ts->counter--;
+            return true;
+        }
+    }
+    return false;
 }
 
-static void lsysf_dodrawlt(lsys_turtlestatef *cmd)
-{
-    cmd->curcolor = (char)(cmd->curcolor + cmd->parm.n);
-    cmd->curcolor %= colors;
-    if (cmd->curcolor == 0)
-        cmd->curcolor = 1;
-}
+static bool lsysf_expand(lsys_cmd *rule, lsys_turtlestatef *ts, int depth, lsysf_extent &ext);
 
-static lsys_cmd *
-findsize(lsys_cmd *command, lsys_turtlestatef *ts, lsys_cmd **rules, int depth)
+/* Moves the turtle through a rule body without drawing, keeping the box
+ * around where it goes in xmin..ymax.  With extents it takes expansions
+ * from lsysf_expand(), otherwise it takes every step.  Returns false if
+ * interrupted.
+ */
+static bool lsysf_walk(lsys_cmd *command, lsys_turtlestatef *ts, int depth, lsysf_extent &ext, bool extents)
 {
-    bool tran;
-
-    if (overflow)     // integer math routines overflowed
-        return nullptr;
+    int open = 0;                       // brackets pushed here
 
-    if (stackavail() < 400)
-    { // leave some margin for calling subrtns
-        ts->stackoflow = true;
-        return nullptr;
-    }
-
-
-    while (command->ch && command->ch != ']')
+    while (true)
     {
-        if (!(ts->counter++))
+        if (command->ch == ']' && open)
         {
-            // let user know we're not dead
-            if (thinking(1, "L-System thinking (higher orders take longer)"))
-            {
-                ts->counter--;
-                return nullptr;
-            }
-        }
-        tran = false;
-        if (depth)
-        {
-            for (lsys_cmd **rulind = rules; *rulind; rulind++)
-                if ((*rulind)->ch == command->ch)
-                {
-                    tran = true;
-                    if (findsize((*rulind)+1, ts, rules, depth-1) == nullptr)
-                        return (nullptr);
-                }
+            lsysf_restore_state(ts, fsaves.back());
+            fsaves.pop_back();
+            --open;
+            command++;
+            continue;
         }
-        if (!depth || !tran)
+        if (!command->ch || command->ch == ']')
+            break;
+        if (lsysf_interrupted(ts))
+            return false;
+        if (depth && command->rule)
         {
-            if (command->f)
+            if (!extents)
             {
-                switch (command->ptype)
-                {
-                case 4:
-                    ts->parm.n = command->parm.n;
-                    break;
-                case 10:
-                    ts->parm.nf = command->parm.nf;
-                    break;
-                default:
-                    break;
-                }
-                (*command->f)(ts);
+                if (!lsysf_walk(command->rule, ts, depth-1, ext, false))
+                    return false;
+                command++;
+                continue;
             }
-            else if (command->ch == '[')
+            lsysf_extent sub;
+            if (!lsysf_expand(command->rule, ts, depth-1, sub))
+                return false;
+            if (ts->xpos + sub.xmax > ts->xmax)
+                ts->xmax = ts->xpos + sub.xmax;
+            if (ts->ypos + sub.ymax > ts->ymax)
+                ts->ymax = ts->ypos + sub.ymax;
+            if (ts->xpos + sub.xmin < ts->xmin)
+                ts->xmin = ts->xpos + sub.xmin;
+            if (ts->ypos + sub.ymin < ts->ymin)
+                ts->ymin = ts->ypos + sub.ymin;
+            ts->xpos += sub.xpos;
+            ts->ypos += sub.ypos;
+            ts->size = sub.size;
+            ts->realangle = sub.realangle;
+            ts->angle = sub.angle;
+            ts->reverse = sub.reverse;
+            ext.draws |= sub.draws;
+            ext.colors |= sub.colors;
+        }
+        else
+        {
+            switch (command->op)
             {
-                char saveang, saverev;
-                LDBL savesize, savex, savey, saverang;
-
-                lsys_donefpu(ts);
-                saveang = ts->angle;
-                saverev = ts->reverse;
-                savesize = ts->size;
-                saverang = ts->realangle;
-                savex = ts->xpos;
-                savey = ts->ypos;
-                lsys_prepfpu(ts);
-                command = findsize(command+1, ts, rules, depth);
-                if (command == nullptr)
-                    return (nullptr);
-                lsys_donefpu(ts);
-                ts->angle = saveang;
-                ts->reverse = saverev;
-                ts->size = savesize;
-                ts->realangle = saverang;
-                ts->xpos = savex;
-                ts->ypos = savey;
-                lsys_prepfpu(ts);
+            case lsys_op::DRAWD:
+            case lsys_op::DRAWF:
+                ext.draws = true;
+                // fall through
+            case lsys_op::MOVEM:
+            case lsys_op::MOVEG:
+                if (command->op == lsys_op::DRAWD || command->op == lsys_op::MOVEM)
+                    lsysf_move_dm(ts);
+                else
+                    lsysf_move_gf(ts);
+                if (ts->xpos > ts->xmax)
+                    ts->xmax = ts->xpos;
+                if (ts->ypos > ts->ymax)
+                    ts->ymax = ts->ypos;
+                if (ts->xpos < ts->xmin)
+                    ts->xmin = ts->xpos;
+                if (ts->ypos < ts->ymin)
+                    ts->ymin = ts->ypos;
+                break;
+            case lsys_op::COLOR:
+            case lsys_op::LESS:
+            case lsys_op::GREATER:
+                ext.colors = true;
+                break;
+            case lsys_op::PUSH:
+                fsaves.push_back(lsysf_save());
+                lsysf_save_state(ts, fsaves.back());
+                ++open;
+                break;
+            default:
+                lsysf_turn(ts, command);
+                break;
             }
         }
         command++;
     }
-    return command;
+    while (open--)
+    {
+        lsysf_restore_state(ts, fsaves.back());
+        fsaves.pop_back();
+    }
+    return true;
+}
+
+// what walking rule at depth does from the turtle's state, walked once
+static bool lsysf_expand(lsys_cmd *rule, lsys_turtlestatef *ts, int depth, lsysf_extent &ext)
+{
+    lsysf_key const key = { rule, ts->size, ts->realangle, depth, ts->angle, ts->reverse };
+    auto const found = fextents.find(key);
+    if (found != fextents.end())
+    {
+        ext = found->second;
+        return true;
+    }
+
+    lsys_turtlestatef local = *ts;
+    local.xpos = 0;
+    local.ypos = 0;
+    local.xmin = 0;
+    local.ymin = 0;
+    local.xmax = 0;
+    local.ymax = 0;
+    ext.draws = false;
+    ext.colors = false;
+    bool const walked = lsysf_walk(rule, &local, depth, ext, true);
+    ts->counter = local.counter;
+    if (!walked)
+        return false;
+    ext.xmin = local.xmin;
+    ext.ymin = local.ymin;
+    ext.xmax = local.xmax;
+    ext.ymax = local.ymax;
+    ext.xpos = local.xpos;
+    ext.ypos = local.ypos;
+    ext.size = local.size;
+    ext.realangle = local.realangle;
+    ext.angle = local.angle;
+    ext.reverse = local.reverse;
+    if (fextent_count < LSYS_EXTENTS)
+    {
+        fextents.insert(std::make_pair(key, ext));
+        ++fextent_count;
+    }
+    return true;
 }
 
 bool
-lsysf_findscale(lsys_cmd *command, lsys_turtlestatef *ts, lsys_cmd **rules, int depth)
+lsysf_findscale(lsys_cmd *axiom, lsys_turtlestatef *ts, int depth)
 {
     float horiz, vert;
     LDBL xmin, xmax, ymin, ymax;
     LDBL locsize;
     LDBL locaspect;
-    lsys_cmd *fsret;
+    bool walked;
+    lsysf_extent ext;
 
     locaspect = screenaspect*xdots/ydots;
     ts->aspect = locaspect;
@@ -398,15 +351,25 @@ lsysf_findscale(lsys_cmd *command, lsys_turtlestatef *ts, lsys_cmd **rules, int
     ts->angle = ts->reverse;
     ts->realangle = 0;
     ts->size = 1;
-    lsys_prepfpu(ts);
-    fsret = findsize(command, ts, rules, depth);
-    lsys_donefpu(ts);
+    ext.draws = false;
+    ext.colors = false;
+    fdrawing = false;
+    try
+    {
+        fuse_extents = lsys_steps(axiom, depth) > LSYS_STEPS;
+        walked = lsysf_walk(axiom, ts, depth, ext, fuse_extents);
+    }
+    catch (std::bad_alloc const&)
+    {
+        ts->stackoflow = true;
+        walked = false;
+    }
     thinking(0, nullptr); // erase thinking message if any
     xmin = ts->xmin;
     xmax = ts->xmax;
     ymin = ts->ymin;
     ymax = ts->ymax;
-    if (fsret == nullptr)
+    if (!walked)
         return false;
     if (xmax == xmin)
         horiz = (float)1E37;
@@ -431,349 +394,157 @@ lsysf_findscale(lsys_cmd *command, lsys_turtlestatef *ts, lsys_cmd **rules, int
     return true;
 }
 
-lsys_cmd *
-drawLSysF(lsys_cmd *command, lsys_turtlestatef *ts, lsys_cmd **rules, int depth)
+static bool lsysf_one_pixel(LDBL lo, LDBL hi)
 {
-    bool tran;
-
-    if (overflow)     // integer math routines overflowed
-        return nullptr;
-
+    return lo > -LSYS_FAR && hi < LSYS_FAR
+        && (int)(lo - LSYS_MARGIN) == (int)(hi + LSYS_MARGIN);
+}
 
-    if (stackavail() < 400)
-    { // leave some margin for calling subroutines
-        ts->stackoflow = true;
-        return nullptr;
-    }
+struct lsysf_frame          // where to go on when a rule body or bracket ends
+{
+    lsys_cmd *command;
+    int depth;
+    bool bracket;           // restore the turtle and go on past the ]
+    lsysf_save save;
+};
 
+static bool lsysf_draw(lsys_cmd *command, lsys_turtlestatef *ts, int depth)
+{
+    std::vector<lsysf_frame> stack(64);
+    int frames = 64;
+    int top = -1;
+    bool extents = fuse_extents;
 
-    while (command->ch && command->ch != ']')
+    while (true)
     {
-        if (!(ts->counter++))
+        if (!command->ch || command->ch == ']')
         {
-            if (driver_key_pressed())
+            if (top < 0)
+                break;
+            lsysf_frame const &caller = stack[top--];
+            if (caller.bracket)
             {
-                ts->counter--;
-                return nullptr;
+                lsysf_restore_state(ts, caller.save);
+                command = command->ch ? command+1 : command;
             }
+            else
+                command = caller.command;
+            depth = caller.depth;
+            continue;
         }
-        tran = false;
-        if (depth)
+        if (lsysf_interrupted(ts))
+            return false;
+        if (top+1 == frames)
         {
-            for (lsys_cmd **rulind = rules; *rulind; rulind++)
-                if ((*rulind)->ch == command->ch)
-                {
-                    tran = true;
-                    if (drawLSysF((*rulind)+1, ts, rules, depth-1) == nullptr)
-                        return nullptr;
-                }
+            frames *= 2;
+            stack.resize(frames);
         }
-        if (!depth || !tran)
+        if (depth && command->rule)
         {
-            if (command->f)
+            int const sub = depth-1;
+            if (extents && fextent_count >= LSYS_EXTENTS)
+                extents = false;        // too many states to remember
+            if (extents && lsys_may_skip(command, sub))
             {
-                switch (command->ptype)
+                lsysf_extent ext;
+                if (!lsysf_expand(command->rule, ts, sub, ext))
+                    return false;
+                if (!ext.colors && (!ext.draws
+                    || (lsysf_one_pixel(ts->xpos + ext.xmin, ts->xpos + ext.xmax)
+                        && lsysf_one_pixel(ts->ypos + ext.ymin, ts->ypos + ext.ymax))))
                 {
-                case 4:
-                    ts->parm.n = command->parm.n;
-                    break;
-                case 10:
-                    ts->parm.nf = command->parm.nf;
-                    break;
-                default:
-                    break;
+                    // it stays in one pixel
+                    if (ext.draws)
+                    {
+                        int const x = (int) ts->xpos;
+                        int const y = (int) ts->ypos;
+                        lsys_draw_line(x, y, x, y, ts->curcolor);
+                    }
+                    ts->xpos += ext.xpos;
+                    ts->ypos += ext.ypos;
+                    ts->size = ext.size;
+                    ts->realangle = ext.realangle;
+                    ts->angle = ext.angle;
+                    ts->reverse = ext.reverse;
+                    command++;
+                    continue;
                 }
-                (*command->f)(ts);
-            }
-            else if (command->ch == '[')
-            {
-                char saveang, saverev, savecolor;
-                LDBL savesize, savex, savey, saverang;
-
-                lsys_donefpu(ts);
-                saveang = ts->angle;
-                saverev = ts->reverse;
-                savesize = ts->size;
-                saverang = ts->realangle;
-                savex = ts->xpos;
-                savey = ts->ypos;
-                savecolor = ts->curcolor;
-                lsys_prepfpu(ts);
-                command = drawLSysF(command+1, ts, rules, depth);
-                if (command == nullptr)
-                    return (nullptr);
-                lsys_donefpu(ts);
-                ts->angle = saveang;
-                ts->reverse = saverev;
-                ts->size = savesize;
-                ts->realangle = saverang;
-                ts->xpos = savex;
-                ts->ypos = savey;
-                ts->curcolor = savecolor;
-                lsys_prepfpu(ts);
             }
+            stack[++top].command = command+1;
+            stack[top].depth = depth;
+            stack[top].bracket = false;
+            command = command->rule;
+            depth = sub;
+            continue;
         }
-        command++;
-    }
-    return command;
-}
 
-lsys_cmd *
-LSysFSizeTransform(char *s, lsys_turtlestatef *ts)
-{
-    lsys_cmd *ret;
-    lsys_cmd *doub;
-    int max = 10;
-    int n = 0;
-    void (*f)(lsys_turtlestatef *);
-    long num;
-    int ptype;
-    double PI180 = PI / 180.0;
-
-    void (*plus)(lsys_turtlestatef *) = (ispow2(ts->maxangle)) ? lsysf_doplus_pow2 : lsysf_doplus;
-    void (*minus)(lsys_turtlestatef *) = (ispow2(ts->maxangle)) ? lsysf_dominus_pow2 : lsysf_dominus;
-    void (*pipe)(lsys_turtlestatef *) = (ispow2(ts->maxangle)) ? lsysf_dopipe_pow2 : lsysf_dopipe;
-
-    void (*slash)(lsys_turtlestatef *) =  lsysf_doslash;
-    void (*bslash)(lsys_turtlestatef *) = lsysf_dobslash;
-    void (*at)(lsys_turtlestatef *) =     lsysf_doat;
-    void (*dogf)(lsys_turtlestatef *) =   lsysf_dosizegf;
-
-    ret = (lsys_cmd *) malloc((long) max * sizeof(lsys_cmd));
-    if (ret == nullptr)
-    {
-        ts->stackoflow = true;
-        return nullptr;
-    }
-    while (*s)
-    {
-        f = nullptr;
-        num = 0;
-        ptype = 4;
-        ret[n].ch = *s;
-        switch (*s)
+        int lastx, lasty;
+        switch (command->op)
         {
-        case '+':
-            f = plus;
-            break;
-        case '-':
-            f = minus;
-            break;
-        case '/':
-            f = slash;
-            ptype = 10;
-            ret[n].parm.nf = getnumber(&s) * PI180;
+        case lsys_op::DRAWD:
+            lastx = (int) ts->xpos;
+            lasty = (int) ts->ypos;
+            lsysf_move_dm(ts);
+            lsys_draw_line(lastx, lasty, (int) ts->xpos, (int) ts->ypos, ts->curcolor);
             break;
-        case '\\':
-            f = bslash;
-            ptype = 10;
-            ret[n].parm.nf = getnumber(&s) * PI180;
+        case lsys_op::MOVEM:
+            lsysf_move_dm(ts);
             break;
-        case '@':
-            f = at;
-            ptype = 10;
-            ret[n].parm.nf = getnumber(&s);
+        case lsys_op::MOVEG:
+            lsysf_move_gf(ts);
             break;
-        case '|':
-            f = pipe;
+        case lsys_op::DRAWF:
+            lastx = (int) ts->xpos;
+            lasty = (int) ts->ypos;
+            lsysf_move_gf(ts);
+            lsys_draw_line(lastx, lasty, (int) ts->xpos, (int) ts->ypos, ts->curcolor);
             break;
-        case '!':
-            f = lsysf_dobang;
+        case lsys_op::COLOR:
+            ts->curcolor = (char)(((int) command->n) % colors);
             break;
-        case 'd':
-        case 'm':
-            f = lsysf_dosizedm;
+        case lsys_op::GREATER:
+            ts->curcolor = (char)(ts->curcolor - command->n);
+            ts->curcolor %= colors;
+            if (ts->curcolor == 0)
+                ts->curcolor = (char)(colors-1);
             break;
-        case 'g':
-        case 'f':
-            f = dogf;
+        case lsys_op::LESS:
+            ts->curcolor = (char)(ts->curcolor + command->n);
+            ts->curcolor %= colors;
+            if (ts->curcolor == 0)
+                ts->curcolor = 1;
             break;
-        case '[':
-            num = 1;
-            break;
-        case ']':
-            num = 2;
+        case lsys_op::PUSH:
+            stack[++top].depth = depth;
+            stack[top].bracket = true;
+            lsysf_save_state(ts, stack[top].save);
             break;
         default:
-            num = 3;
+            lsysf_turn(ts, command);
             break;
         }
-#if defined(XFRACT)
-        ret[n].f = (void (*)(lsys_turtlestatef *))f;
-#else
-        ret[n].f = (void (*)(lsys_turtlestatef *))f;
-#endif
-        if (ptype == 4)
-            ret[n].parm.n = num;
-        ret[n].ptype = ptype;
-        if (++n == max)
-        {
-            doub = (lsys_cmd *) malloc((long) max*2*sizeof(lsys_cmd));
-            if (doub == nullptr)
-            {
-                free(ret);
-                ts->stackoflow = true;
-                return nullptr;
-            }
-            memcpy(doub, ret, max*sizeof(lsys_cmd));
-            free(ret);
-            ret = doub;
-            max <<= 1;
-        }
-        s++;
-    }
-    ret[n].ch = 0;
-    ret[n].f = nullptr;
-    ret[n].parm.n = 0;
-    n++;
-
-    doub = (lsys_cmd *) malloc((long) n*sizeof(lsys_cmd));
-    if (doub == nullptr)
-    {
-        free(ret);
-        ts->stackoflow = true;
-        return nullptr;
+        command++;
     }
-    memcpy(doub, ret, n*sizeof(lsys_cmd));
-    free(ret);
-    return doub;
+    return true;
 }
 
-lsys_cmd *
-LSysFDrawTransform(char *s, lsys_turtlestatef *ts)
+bool
+drawLSysF(lsys_cmd *axiom, lsys_turtlestatef *ts, int depth)
 {
-    lsys_cmd *ret;
-    lsys_cmd *doub;
-    int max = 10;
-    int n = 0;
-    void (*f)(lsys_turtlestatef *);
-    LDBL num;
-    int ptype;
-    LDBL PI180 = PI / 180.0;
-
-    void (*plus)(lsys_turtlestatef *) = (ispow2(ts->maxangle)) ? lsysf_doplus_pow2 : lsysf_doplus;
-    void (*minus)(lsys_turtlestatef *) = (ispow2(ts->maxangle)) ? lsysf_dominus_pow2 : lsysf_dominus;
-    void (*pipe)(lsys_turtlestatef *) = (ispow2(ts->maxangle)) ? lsysf_dopipe_pow2 : lsysf_dopipe;
-
-    void (*slash)(lsys_turtlestatef *) =  lsysf_doslash;
-    void (*bslash)(lsys_turtlestatef *) = lsysf_dobslash;
-    void (*at)(lsys_turtlestatef *) =     lsysf_doat;
-    void (*drawg)(lsys_turtlestatef *) =  lsysf_dodrawg;
-
-    ret = (lsys_cmd *) malloc((long) max * sizeof(lsys_cmd));
-    if (ret == nullptr)
-    {
-        ts->stackoflow = true;
-        return nullptr;
-    }
-    while (*s)
+    bool drawn;
+
+    fdrawing = true;
+    try
     {
-        f = nullptr;
-        num = 0;
-        ptype = 4;
-        ret[n].ch = *s;
-        switch (*s)
-        {
-        case '+':
-            f = plus;
-            break;
-        case '-':
-            f = minus;
-            break;
-        case '/':
-            f = slash;
-            ptype = 10;
-            ret[n].parm.nf = getnumber(&s) * PI180;
-            break;
-        case '\\':
-            f = bslash;
-            ptype = 10;
-            ret[n].parm.nf = getnumber(&s) * PI180;
-            break;
-        case '@':
-            f = at;
-            ptype = 10;
-            ret[n].parm.nf = getnumber(&s);
-            break;
-        case '|':
-            f = pipe;
-            break;
-        case '!':
-            f = lsysf_dobang;
-            break;
-        case 'd':
-            f = lsysf_dodrawd;
-            break;
-        case 'm':
-            f = lsysf_dodrawm;
-            break;
-        case 'g':
-            f = drawg;
-            break;
-        case 'f':
-            f = lsysf_dodrawf;
-            break;
-        case 'c':
-            f = lsysf_dodrawc;
-            num = getnumber(&s);
-            break;
-        case '<':
-            f = lsysf_dodrawlt;
-            num = getnumber(&s);
-            break;
-        case '>':
-            f = lsysf_dodrawgt;
-            num = getnumber(&s);
-            break;
-        case '[':
-            num = 1;
-            break;
-        case ']':
-            num = 2;
-            break;
-        default:
-            num = 3;
-            break;
-        }
-#if defined(XFRACT)
-        ret[n].f = (void (*)(lsys_turtlestatef *))f;
-#else
-        ret[n].f = (void (*)(lsys_turtlestatef *))f;
-#endif
-        if (ptype == 4)
-            ret[n].parm.n = (long)num;
-        ret[n].ptype = ptype;
-        if (++n == max)
-        {
-            doub = (lsys_cmd *) malloc((long) max*2*sizeof(lsys_cmd));
-            if (doub == nullptr)
-            {
-                free(ret);
-                ts->stackoflow = true;
-                return nullptr;
-            }
-            memcpy(doub, ret, max*sizeof(lsys_cmd));
-            free(ret);
-            ret = doub;
-            max <<= 1;
-        }
-        s++;
+        drawn = lsysf_draw(axiom, ts, depth);
     }
-    ret[n].ch = 0;
-    ret[n].f = nullptr;
-    ret[n].parm.n = 0;
-    n++;
-
-    doub = (lsys_cmd *) malloc((long) n*sizeof(lsys_cmd));
-    if (doub == nullptr)
+    catch (std::bad_alloc const&)
     {
-        free(ret);
         ts->stackoflow = true;
-        return nullptr;
+        drawn = false;
     }
-    memcpy(doub, ret, n*sizeof(lsys_cmd));
-    free(ret);
-    return doub;
+    fdrawing = false;
+    return drawn;
 }
 
 void lsysf_dosincos()
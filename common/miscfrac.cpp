@@ -4,11 +4,18 @@ Miscellaneous fractal-specific code (formerly in CALCFRAC.C)
 
 */
 #include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <new>
 #include <vector>
 
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 
 // see Fractint.c for a description of the "include"  hierarchy
 #include "port.h"
@@ -16,6 +23,7 @@ Miscellaneous fractal-specific code (formerly in CALCFRAC.C)
 #include "fractype.h"
 #include "targa_lc.h"
 #include "drivers.h"
+#include "workpool.h"
 
 // routines in this module
 
@@ -322,6 +330,223 @@ static void subDivide(int x1, int y1, int x2, int y2)
     recur_level--;
 }
 
+/*
+   With the second parameter 2 the cloud is worked out in a buffer of 16
+   bit values, 0 where there is nothing yet, a level of the subdivision at
+   a time.  The squares of a level make up a grid, so a level sets the
+   middles of the horizontal edges, then of the vertical edges, then the
+   centers, each step sharing out the rows among the work pool.  The
+   random part of a point is a hash of the seed, the level and the point's
+   place in the grid of the level, so the cloud doesn't depend on the order
+   the points are done in or on the number of threads, and the large
+   features of a seed are the same at any resolution.  The finished rows
+   go to the screen, or the disk video for 16 bit output, at the end.
+   This is not the cloud subDivide() and new_subD() draw from the rand()
+   sequence, so 0 and 1 keep those for existing images.
+*/
+#define PLASMA_ROWS 16          // rows to a task
+
+struct plasma_span
+{
+    int lo, hi;
+};
+
+struct plasma_job
+{
+    std::vector<U16> pixels;    // xdots*ydots
+    std::uint64_t seed;
+    std::uint64_t key;          // of the level
+    S32 recur;                  // 320 >> level
+    bool border;                // outside= colors the border
+};
+
+// the n'th number of the splitmix64 sequence starting at key
+static std::uint64_t plasma_random(std::uint64_t key, std::uint64_t n)
+{
+    std::uint64_t z = key + n*0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30))*0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27))*0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static U16 &plasma_pixel(plasma_job &job, int x, int y)
+{
+    return job.pixels[(size_t) y*xdots + x];
+}
+
+// what putcolorborder() or putpotborder() would leave at (x, y)
+static void plasma_store(plasma_job &job, int x, int y, S32 value)
+{
+    if (job.border && (x == 0 || y == 0 || x == xdots-1 || y == ydots-1))
+        value = outside;
+    if (value < 1)
+        value = 1;
+    plasma_pixel(job, x, y) = (U16) value;
+}
+
+/* (x, y) if not yet set, halfway between (xa, ya) and (xb, yb) give or
+   take; gx and gy number the lines, 2i, and the middles of the spans,
+   2i+1, of the level's grid */
+static void plasma_adjust(plasma_job &job, int xa, int ya, int x, int y, int xb, int yb,
+                          int gx, int gy)
+{
+    if (plasma_pixel(job, x, y) != 0)
+        return;
+    std::uint64_t const n = (std::uint64_t) gx << 32 | (std::uint32_t) gy;
+    S32 const random15 = (S32)(plasma_random(job.key, n) >> 49);
+    S32 pseudorandom;
+    pseudorandom = ((S32)iparmx)*(random15-16383);
+    pseudorandom = pseudorandom * job.recur;
+    pseudorandom = pseudorandom >> shiftvalue;
+    pseudorandom = (((S32)plasma_pixel(job, xa, ya)+(S32)plasma_pixel(job, xb, yb)+1) >> 1)+pseudorandom;
+    if (max_plasma == 0)
+    {
+        if (pseudorandom >= pcolors)
+            pseudorandom = pcolors-1;
+    }
+    else if (pseudorandom >= (S32)max_plasma)
+        pseudorandom = max_plasma;
+    plasma_store(job, x, y, pseudorandom);
+}
+
+// runs step(i) for each i < n on the pool, false if interrupted
+static bool plasma_step(work_pool &pool, int n, std::function<void(int)> const &step)
+{
+    for (int first = 0; first < n; first += PLASMA_ROWS)
+    {
+        int const last = std::min(first + PLASMA_ROWS, n);
+        pool.push([&step, first, last](int)
+        {
+            for (int i = first; i < last; i++)
+                step(i);
+        });
+    }
+    while (!pool.wait(100))
+    {
+        if (driver_key_pressed())
+        {
+            pool.cancel();
+            pool.wait(-1);
+            return false;
+        }
+    }
+    return true;
+}
+
+static std::vector<int> plasma_lines(std::vector<plasma_span> const &spans)
+{
+    std::vector<int> lines(1, spans[0].lo);
+    for (plasma_span const &s : spans)
+        if (s.hi != lines.back())
+            lines.push_back(s.hi);
+    return lines;
+}
+
+// the spans of the next level
+static void plasma_split(std::vector<plasma_span> &spans)
+{
+    std::vector<plasma_span> next;
+    for (plasma_span const &s : spans)
+    {
+        if (s.hi - s.lo >= 2)
+        {
+            int const mid = (s.lo + s.hi) >> 1;
+            next.push_back(plasma_span{s.lo, mid});
+            next.push_back(plasma_span{mid, s.hi});
+        }
+        else
+            next.push_back(s);
+    }
+    spans.swap(next);
+}
+
+// subdivides the squares of the corners down to single pixels
+static bool plasma_levels(plasma_job &job)
+{
+    work_pool pool(work_pool_threads());
+    std::vector<plasma_span> xs(1, plasma_span{0, xdots-1});
+    std::vector<plasma_span> ys(1, plasma_span{0, ydots-1});
+    for (int level = 1; ; level++)
+    {
+        job.key = plasma_random(job.seed, level);
+        job.recur = (S32)(320L >> std::min(level, 31));
+        std::vector<int> wide_x;            // the spans split at this level
+        std::vector<int> wide_y;
+        for (int i = 0; i < static_cast<int>(xs.size()); i++)
+            if (xs[i].hi - xs[i].lo >= 2)
+                wide_x.push_back(i);
+        for (int i = 0; i < static_cast<int>(ys.size()); i++)
+            if (ys[i].hi - ys[i].lo >= 2)
+                wide_y.push_back(i);
+        if (wide_x.empty() && wide_y.empty())
+            return true;
+        std::vector<int> const x_lines = plasma_lines(xs);
+        std::vector<int> const y_lines = plasma_lines(ys);
+
+        // the middles of the horizontal edges, a row at a time
+        if (!plasma_step(pool, static_cast<int>(y_lines.size()), [&](int i)
+            {
+                int const y = y_lines[i];
+                for (int const j : wide_x)
+                {
+                    plasma_span const &s = xs[j];
+                    plasma_adjust(job, s.lo, y, (s.lo + s.hi) >> 1, y, s.hi, y, 2*j + 1, 2*i);
+                }
+            }))
+            return false;
+        // the middles of the vertical edges
+        if (!plasma_step(pool, static_cast<int>(wide_y.size()), [&](int i)
+            {
+                plasma_span const &s = ys[wide_y[i]];
+                int const y = (s.lo + s.hi) >> 1;
+                for (int j = 0; j < static_cast<int>(x_lines.size()); j++)
+                {
+                    int const x = x_lines[j];
+                    plasma_adjust(job, x, s.lo, x, y, x, s.hi, 2*j, 2*wide_y[i] + 1);
+                }
+            }))
+            return false;
+        // the centers
+        if (!plasma_step(pool, static_cast<int>(wide_y.size()), [&](int i)
+            {
+                plasma_span const &t = ys[wide_y[i]];
+                int const y = (t.lo + t.hi) >> 1;
+                for (int const j : wide_x)
+                {
+                    plasma_span const &s = xs[j];
+                    int const x = (s.lo + s.hi) >> 1;
+                    if (plasma_pixel(job, x, y) == 0)
+                        plasma_store(job, x, y, ((S32)plasma_pixel(job, x, t.lo) + plasma_pixel(job, s.hi, y)
+                                                 + plasma_pixel(job, x, t.hi) + plasma_pixel(job, s.lo, y) + 2) >> 2);
+                }
+            }))
+            return false;
+
+        plasma_split(xs);
+        plasma_split(ys);
+    }
+}
+
+// puts the buffer on the screen, or in the disk video for 16 bit output
+static void plasma_show(plasma_job &job)
+{
+    std::vector<BYTE> line(xdots);
+    for (int y = 0; y < ydots; y++)
+    {
+        if (max_plasma == 0)
+        {
+            for (int x = 0; x < xdots; x++)
+                line[x] = (BYTE)(plasma_pixel(job, x, y) & g_and_color);
+            put_line(y, 0, xdots-1, &line[0]);
+        }
+        else
+        {
+            for (int x = 0; x < xdots; x++)
+                if (plasma_pixel(job, x, y) != 0)
+                    putpot(x, y, plasma_pixel(job, x, y));
+        }
+    }
+}
 
 int plasma()
 {
@@ -346,8 +571,8 @@ int plasma()
     param[0] = (double)iparmx / 8.0;  // let user know what was used
     if (param[1] < 0)
         param[1] = 0;  // limit parameter values
-    if (param[1] > 1)
-        param[1] = 1;
+    if (param[1] > 2)
+        param[1] = 2;
     if (param[2] < 0)
         param[2] = 0;  // limit parameter values
     if (param[2] > 1)
@@ -363,6 +588,21 @@ int plasma()
         rseed = (int)param[2];
     max_plasma = (U16)param[3];  // max_plasma is used as a flag for potential
 
+    bool const levels = param[1] == 2;
+    plasma_job job;
+    if (levels)
+    {
+        try
+        {
+            job.pixels.resize((size_t) xdots*ydots);
+        }
+        catch (std::bad_alloc const&)
+        {
+            stopmsg(STOPMSG_NONE, "Insufficient memory for plasma");
+            return -1;
+        }
+    }
+    job.border = outside >= COLOR_BLACK;
     if (max_plasma != 0)
     {
         if (pot_startdisk() >= 0)
@@ -395,6 +635,7 @@ int plasma()
             plot    = putcolor;
         getpix  = (U16(*)(int, int))getcolor;
     }
+    job.seed = (std::uint64_t) rseed;
     srand(rseed);
     if (!rflag)
         ++rseed;
@@ -432,12 +673,27 @@ int plasma()
         for (int n = 0; n < 4; n++)
             rnd[n] = 1;
 
+    int n;
+    if (levels)
+    {
+        plasma_store(job, 0,      0,  rnd[0]);
+        plasma_store(job, xdots-1,      0,  rnd[1]);
+        plasma_store(job, xdots-1, ydots-1,  rnd[2]);
+        plasma_store(job, 0, ydots-1,  rnd[3]);
+
+        if (plasma_levels(job) && !driver_key_pressed())
+            n = 0;
+        else
+            n = 1;
+        plasma_show(job);
+        goto done;
+    }
+
     plot(0,      0,  rnd[0]);
     plot(xdots-1,      0,  rnd[1]);
     plot(xdots-1, ydots-1,  rnd[2]);
     plot(0, ydots-1,  rnd[3]);
 
-    int n;
     recur_level = 0;
     if (param[1] == 0)
         subDivide(0, 0, xdots-1, ydots-1);
@@ -507,6 +763,334 @@ static void set_Plasma_palette()
 
 #define RANDOM(x)  (rand()%(x))
 
+/*
+   Without show_orbit the particles walk on a copy of the screen, in
+   batches on the work pool.  A coarse map holds, for each block of
+   DLA_BLOCK x DLA_BLOCK pixels, the distance in blocks to the nearest
+   block with a piece of the cluster, so a particle far from the cluster
+   jumps to a random point on the largest circle that can't reach it
+   instead of taking every step.  The particles of a batch walk against
+   the cluster as it was when the batch started, remembering where they
+   stepped near it and where they jumped from.  They are added in order
+   afterwards, each at the first of those pixels that touches the cluster
+   as it is by then, so the particles added before it in the batch stop
+   it as they would have on the screen.  One whose jump those particles
+   cut short, or that ends on a pixel just taken, walks on in the next
+   batch from there.  A particle's random numbers come from the seed and its
+   number, so the image is the same for any number of threads.
+*/
+#define DLA_BLOCK   8
+#define DLA_FAR     16              // block distances are kept up to this
+#define DLA_BATCH   256
+
+struct dla_step
+{
+    std::uint32_t pixel;
+    BYTE far;                       // block distance of a jump, 0 for a step
+};
+
+struct dla_walker
+{
+    int x, y;
+    std::uint64_t stream;
+    std::uint64_t draws;
+    std::vector<dla_step> path;     // pixels it stepped or jumped from
+};
+
+struct dla_cluster
+{
+    int mode;
+    int xmin, xmax, ymin, ymax;     // the box of modes 0 and 1
+    int blocks_x, blocks_y;
+    std::vector<BYTE> pixels;       // 0 where there's no particle
+    std::vector<BYTE> far;          // blocks to the cluster, up to DLA_FAR
+};
+
+// the next number of the walker's splitmix64 sequence
+static std::uint64_t dla_random(dla_walker &w)
+{
+    std::uint64_t z = w.stream + ++w.draws*0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30))*0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27))*0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static int dla_below(dla_walker &w, int n)
+{
+    return (int)((dla_random(w) >> 32) % n);
+}
+
+static BYTE dla_far(dla_cluster const &c, int x, int y)
+{
+    return c.far[(size_t)(y/DLA_BLOCK)*c.blocks_x + x/DLA_BLOCK];
+}
+
+static bool dla_taken(dla_cluster const &c, int x, int y)
+{
+    return x >= 0 && x < xdots && y >= 0 && y < ydots
+        && c.pixels[(size_t) y*xdots + x] != 0;
+}
+
+// is the point next to the cluster on any of its eight sides?
+static bool dla_touching(dla_cluster const &c, int x, int y)
+{
+    return dla_taken(c, x+1, y+1) || dla_taken(c, x+1, y) || dla_taken(c, x+1, y-1)
+        || dla_taken(c, x, y+1) || dla_taken(c, x, y-1)
+        || dla_taken(c, x-1, y+1) || dla_taken(c, x-1, y) || dla_taken(c, x-1, y-1);
+}
+
+static void dla_add(dla_cluster &c, int x, int y, int color)
+{
+    if (x < 0 || x >= xdots || y < 0 || y >= ydots)
+        return;
+    c.pixels[(size_t) y*xdots + x] = (BYTE) color;
+    int const bx = x/DLA_BLOCK;
+    int const by = y/DLA_BLOCK;
+    for (int j = std::max(0, by-DLA_FAR+1); j < std::min(c.blocks_y, by+DLA_FAR); j++)
+        for (int i = std::max(0, bx-DLA_FAR+1); i < std::min(c.blocks_x, bx+DLA_FAR); i++)
+        {
+            BYTE const d = (BYTE) std::max(abs(i-bx), abs(j-by));
+            BYTE &far = c.far[(size_t) j*c.blocks_x + i];
+            if (d < far)
+                far = d;
+        }
+}
+
+// walk until the particle touches the cluster, from a pixel that's free
+static void dla_walk(dla_cluster const &c, dla_walker &w)
+{
+    while (dla_taken(c, w.x, w.y) || !dla_touching(c, w.x, w.y))
+    {
+        BYTE const far = dla_far(c, w.x, w.y);
+        if (far >= 3)
+        {
+            /* no pixel within this of the particle touches the cluster as
+               it was when the batch started; the jump is checked against
+               the particles stuck since when the walker is added */
+            w.path.push_back(dla_step{(std::uint32_t)(w.y*xdots + w.x), far});
+            double const jump = (far-1)*DLA_BLOCK - 2;
+            double const angle = (dla_random(w) >> 11)*(2*PI/9007199254740992.0);
+            w.x += (int) floor(jump*cos(angle) + 0.5);
+            w.y += (int) floor(jump*sin(angle) + 0.5);
+            if (c.mode == 0)
+            {
+                w.x = std::min(std::max(w.x, c.xmin), c.xmax);
+                w.y = std::min(std::max(w.y, c.ymin), c.ymax);
+            }
+            else if (c.mode == 1)
+            {
+                w.x = std::min(std::max(w.x, 1), xdots-2);
+                w.y = std::max(w.y, c.ymin);
+            }
+            w.x = std::min(std::max(w.x, 0), xdots-1);
+            w.y = std::min(std::max(w.y, 0), ydots-1);
+            continue;
+        }
+
+        // near the cluster take single steps, as diffusion() does
+        w.path.push_back(dla_step{(std::uint32_t)(w.y*xdots + w.x), 0});
+        if (c.mode == 0)
+        {
+            if (w.x == c.xmax)
+                w.x--;
+            else if (w.x == c.xmin)
+                w.x++;
+            if (w.y == c.ymax)
+                w.y--;
+            else if (w.y == c.ymin)
+                w.y++;
+        }
+        if (c.mode == 1)
+        {
+            if (w.x >= xdots-1)
+                w.x--;
+            else if (w.x <= 1)
+                w.x++;
+            if (w.y < c.ymin)
+                w.y++;
+        }
+        w.x += dla_below(w, 3) - 1;
+        w.y += dla_below(w, 3) - 1;
+    }
+}
+
+static int dla_pool(int mode, int border, int colorshift, std::uint64_t seed,
+    int xmax, int xmin, int ymax, int ymin, float radius)
+{
+    dla_cluster c;
+    c.mode = mode;
+    c.blocks_x = (xdots + DLA_BLOCK-1)/DLA_BLOCK;
+    c.blocks_y = (ydots + DLA_BLOCK-1)/DLA_BLOCK;
+    try
+    {
+        c.pixels.resize((size_t) xdots*ydots);
+        c.far.resize((size_t) c.blocks_x*c.blocks_y, DLA_FAR);
+    }
+    catch (std::bad_alloc const&)
+    {
+        stopmsg(STOPMSG_NONE, "Insufficient memory for diffusion");
+        return -1;
+    }
+
+    // the seed, or when resuming the cluster so far
+    std::uint64_t particle = 0;
+    for (int y = 0; y < ydots; y++)
+        for (int x = 0; x < xdots; x++)
+        {
+            int const color = getcolor(x, y);
+            if (color != 0)
+            {
+                dla_add(c, x, y, color);
+                ++particle;
+            }
+        }
+
+    std::uint64_t released = particle;
+    int colorcount = colorshift;
+    int currentcolor = 1;
+    work_pool pool(work_pool_threads());
+    std::vector<dla_walker> walkers;
+    while (true)
+    {
+        c.xmin = xmin;
+        c.xmax = xmax;
+        c.ymin = ymin;
+        c.ymax = ymax;
+
+        /* release new particles as diffusion() does, after those left
+           over; a small cluster gets small batches, as most would collide */
+        size_t const batch = (size_t) std::min<std::uint64_t>(DLA_BATCH, 1 + particle/64);
+        while (walkers.size() < batch)
+        {
+            dla_walker w;
+            w.stream = seed*0xd1342543de82ef95ULL + released++;
+            w.draws = 0;
+            w.stream = dla_random(w);   // far from the other walkers' numbers
+            w.draws = 0;
+            double angle, sine, cosine;
+            switch (mode)
+            {
+            case 0:
+                angle = (dla_random(w) >> 11)*(2*PI/9007199254740992.0);
+                FPUsincos(&angle, &sine, &cosine);
+                w.x = (int)(cosine*(xmax-xmin) + xdots) >> 1;
+                w.y = (int)(sine  *(ymax-ymin) + ydots) >> 1;
+                break;
+            case 1:
+                w.y = ymin;
+                w.x = dla_below(w, xmax-xmin) + (xdots-xmax+xmin)/2;
+                break;
+            case 2:
+                angle = (dla_random(w) >> 11)*(2*PI/9007199254740992.0);
+                FPUsincos(&angle, &sine, &cosine);
+                w.x = (int)(cosine*radius + xdots) >> 1;
+                w.y = (int)(sine  *radius + ydots) >> 1;
+                break;
+            }
+            walkers.push_back(w);
+        }
+
+        for (dla_walker &w : walkers)
+        {
+            dla_cluster const *const cluster = &c;
+            dla_walker *const walker = &w;
+            pool.push([cluster, walker](int)
+            {
+                dla_walk(*cluster, *walker);
+            });
+        }
+        pool.wait(-1);
+
+        /* add them in order, each where its walk first touched the cluster
+           as it is by now, leaving any that jumped past a particle added
+           since or ended on a pixel just taken */
+        std::vector<dla_walker> left;
+        for (dla_walker &w : walkers)
+        {
+            bool cut_short = false;
+            for (dla_step const &step : w.path)
+            {
+                int const x = (int)(step.pixel % xdots);
+                int const y = (int)(step.pixel / xdots);
+                if (step.far != 0 ? dla_far(c, x, y) < step.far
+                        : !dla_taken(c, x, y) && dla_touching(c, x, y))
+                {
+                    w.x = x;
+                    w.y = y;
+                    cut_short = step.far != 0;
+                    break;
+                }
+            }
+            w.path.clear();
+            if (cut_short || dla_taken(c, w.x, w.y))
+            {
+                left.push_back(w);
+                continue;
+            }
+            int const color = colorshift ? currentcolor : dla_below(w, colors-1)+1;
+            putcolor(w.x, w.y, color);
+            dla_add(c, w.x, w.y, color);
+            ++particle;
+
+            if (colorshift)
+            {
+                if (!--colorcount)
+                {
+                    currentcolor++;
+                    currentcolor %= colors;
+                    if (!currentcolor)
+                        currentcolor++;
+                    colorcount = colorshift;
+                }
+            }
+
+            switch (mode)
+            {
+            case 0:
+                if (((w.x+border) > xmax) || ((w.x-border) < xmin)
+                        || ((w.y-border) < ymin) || ((w.y+border) > ymax))
+                {
+                    ymin--;
+                    ymax++;
+                    xmin--;
+                    xmax++;
+                    if ((ymin == 0) || (xmin == 0))
+                        return 0;
+                }
+                break;
+            case 1:
+                if (w.y-border < ymin)
+                    ymin--;
+                if (ymin == 0)
+                    return 0;
+                break;
+            case 2:
+            {
+                float const r = sqr((float)w.x-xdots/2) + sqr((float)w.y-ydots/2);
+                if (r <= border*border)
+                    return 0;
+                while ((radius-border)*(radius-border) > r)
+                    radius--;
+                break;
+            }
+            }
+        }
+        walkers.swap(left);
+
+        if (check_key())
+        {
+            alloc_resume(20, 1);
+            if (mode != 2)
+                put_resume(sizeof(xmax), &xmax, sizeof(xmin), &xmin,
+                           sizeof(ymax), &ymax, sizeof(ymin), &ymin, 0);
+            else
+                put_resume(sizeof(xmax), &xmax, sizeof(xmin), &xmin,
+                           sizeof(ymax), &ymax, sizeof(radius), &radius, 0);
+            return 1;
+        }
+    }
+}
+
 int diffusion()
 {
     int xmax, ymax, xmin, ymin;     // Current maximum coordinates
@@ -541,6 +1125,7 @@ int diffusion()
     if (border <= 0)
         border = 10;
 
+    std::uint64_t const seed = (std::uint64_t) rseed;
     srand(rseed);
     if (!rflag)
         ++rseed;
@@ -606,6 +1191,9 @@ int diffusion()
         break;
     }
 
+    if (!show_orbit)            // no moving points to show
+        return dla_pool(mode, border, colorshift, seed, xmax, xmin, ymax, ymin, radius);
+
     while (1)
     {
         switch (mode)
@@ -1229,6 +1817,7 @@ int lyapunov_cycles(int, double, double, double);
 #endif
 
 int lyapunov_cycles_in_c(long, double, double);
+static int lyapunov_color(bool overflow, double total, int lnadjust, long i);
 
 int lyapunov()
 {
@@ -1360,7 +1949,7 @@ bool lya_setup()
 
 int lyapunov_cycles_in_c(long filter_cycles, double a, double b)
 {
-    int color, lnadjust;
+    int lnadjust;
     double total;
     double temp;
     // e10=22026.4657948  e-10=0.0000453999297625
@@ -1376,6 +1965,7 @@ int lyapunov_cycles_in_c(long filter_cycles, double a, double b)
             if (curfractalspecific->orbitcalc())
             {
                 overflow = true;
+                i = 0;                  // no cycles of the exponent ran
                 goto jumpout;
             }
         }
@@ -1411,6 +2001,15 @@ int lyapunov_cycles_in_c(long filter_cycles, double a, double b)
     }
 
 jumpout:
+    realcoloriter = i;                  // for pngout=iter
+    return lyapunov_color(overflow, total, lnadjust, i);
+}
+
+// the color of the exponent log(total) + lnadjust over i cycles
+static int lyapunov_color(bool overflow, double total, int lnadjust, long i)
+{
+    double temp;
+    int color;
     if (overflow || total <= 0 || (temp = log(total) + lnadjust) > 0)
         color = 0;
     else
@@ -1425,6 +2024,202 @@ jumpout:
     return color;
 }
 
+/*
+   The row engine of calcfrac.cpp calculates Lyapunov pixels in batches
+   when each pixel depends on its a and b alone, that is when Population
+   starts at param[1] for every pixel instead of at a random value or where
+   the pixel before left it.  lyapunov_pixels() runs LYA_LANES pixels side
+   by side, two to an SSE2 register, with the arithmetic of
+   lyapunov_cycles_in_c() in each lane, so the colors are the same.  A lane
+   that overflows is colored 0 however far it got, so it is only marked and
+   left to run with the others until they all overflow or finish; the
+   cycles it ran before that are kept for pngout=iter.
+*/
+#define LYA_LANES 8
+
+bool lyapunov_batch_ok()
+{
+    return curfractalspecific->orbitcalc == BifurcLambda
+        && param[1] != 0 && param[1] != 1
+        && !invert;
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define LYA_REGS (LYA_LANES/2)
+
+static void lyapunov_lanes(double const *a, double const *b, int *color, long *ran)
+{
+    __m128d const one = _mm_set1_pd(1.0);
+    __m128d const two = _mm_set1_pd(2.0);
+    __m128d const big = _mm_set1_pd(BIG);
+    __m128d const sign = _mm_set1_pd(-0.0);
+    __m128d const zero = _mm_setzero_pd();
+    __m128d const e10 = _mm_set1_pd(22026.4657948);
+    __m128d const em10 = _mm_set1_pd(0.0000453999297625);
+    __m128d const ten = _mm_set1_pd(10.0);
+    __m128d A[LYA_REGS], B[LYA_REGS], P[LYA_REGS];
+    __m128d total[LYA_REGS], adjust[LYA_REGS], out[LYA_REGS];
+    for (int r = 0; r < LYA_REGS; r++)
+    {
+        A[r] = _mm_loadu_pd(a + 2*r);
+        B[r] = _mm_loadu_pd(b + 2*r);
+        P[r] = _mm_set1_pd(param[1]);
+        total[r] = one;
+        adjust[r] = zero;
+        out[r] = zero;
+    }
+    for (int lane = 0; lane < LYA_LANES; lane++)
+        ran[lane] = 0;
+    int const all_out = (1 << LYA_LANES) - 1;
+    auto const overflowed = [&]()
+    {
+        int bits = 0;
+        for (int r = 0; r < LYA_REGS; r++)
+            bits |= _mm_movemask_pd(out[r]) << 2*r;
+        return bits;
+    };
+
+    // as lyapunov_cycles_in_c() takes it, a negative count filters nothing
+    long const filters = (long) filter_cycles;
+    for (long i = 0; i < filters; i++)
+    {
+        for (int count = 0; count < lyaLength; count++)
+        {
+            for (int r = 0; r < LYA_REGS; r++)
+            {
+                __m128d const R = lyaRxy[count] ? A[r] : B[r];
+                P[r] = _mm_mul_pd(_mm_mul_pd(R, P[r]), _mm_sub_pd(one, P[r]));
+                out[r] = _mm_or_pd(out[r], _mm_cmpgt_pd(_mm_andnot_pd(sign, P[r]), big));
+            }
+        }
+        if (overflowed() == all_out)
+            break;
+    }
+    long const cycles = maxit/2;
+    for (long i = 0; i < cycles && overflowed() != all_out; i++)
+    {
+        for (int count = 0; count < lyaLength; count++)
+        {
+            for (int r = 0; r < LYA_REGS; r++)
+            {
+                __m128d const R = lyaRxy[count] ? A[r] : B[r];
+                P[r] = _mm_mul_pd(_mm_mul_pd(R, P[r]), _mm_sub_pd(one, P[r]));
+                out[r] = _mm_or_pd(out[r], _mm_cmpgt_pd(_mm_andnot_pd(sign, P[r]), big));
+                __m128d const temp = _mm_andnot_pd(sign, _mm_sub_pd(R, _mm_mul_pd(_mm_mul_pd(two, R), P[r])));
+                total[r] = _mm_mul_pd(total[r], temp);
+                out[r] = _mm_or_pd(out[r], _mm_cmpeq_pd(total[r], zero));
+            }
+        }
+        for (int r = 0; r < LYA_REGS; r++)
+        {
+            while (true)
+            {
+                __m128d const m = _mm_andnot_pd(out[r], _mm_cmpgt_pd(total[r], e10));
+                if (_mm_movemask_pd(m) == 0)
+                    break;
+                total[r] = _mm_or_pd(_mm_andnot_pd(m, total[r]), _mm_and_pd(m, _mm_mul_pd(total[r], em10)));
+                adjust[r] = _mm_add_pd(adjust[r], _mm_and_pd(m, ten));
+            }
+            while (true)
+            {
+                __m128d const m = _mm_andnot_pd(out[r], _mm_cmplt_pd(total[r], em10));
+                if (_mm_movemask_pd(m) == 0)
+                    break;
+                total[r] = _mm_or_pd(_mm_andnot_pd(m, total[r]), _mm_and_pd(m, _mm_mul_pd(total[r], e10)));
+                adjust[r] = _mm_sub_pd(adjust[r], _mm_and_pd(m, ten));
+            }
+        }
+        int const bits = overflowed();
+        for (int lane = 0; lane < LYA_LANES; lane++)
+            if ((bits & (1 << lane)) == 0)
+                ran[lane] = i + 1;
+    }
+
+    int const lanes_out = overflowed();
+    double t[LYA_LANES], adj[LYA_LANES];
+    for (int r = 0; r < LYA_REGS; r++)
+    {
+        _mm_storeu_pd(t + 2*r, total[r]);
+        _mm_storeu_pd(adj + 2*r, adjust[r]);
+    }
+    for (int lane = 0; lane < LYA_LANES; lane++)
+        color[lane] = lyapunov_color((lanes_out & (1 << lane)) != 0, t[lane], (int) adj[lane], cycles);
+}
+#else
+static void lyapunov_lanes(double const *a, double const *b, int *color, long *ran)
+{
+    for (int lane = 0; lane < LYA_LANES; lane++)
+    {
+        double population = param[1];
+        double total = 1.0;
+        int lnadjust = 0;
+        bool out = false;
+        long i;
+        for (long j = 0; j < (long) filter_cycles && !out; j++)
+            for (int count = 0; count < lyaLength && !out; count++)
+            {
+                double const rate = lyaRxy[count] ? a[lane] : b[lane];
+                population = rate * population * (1 - population);
+                out = fabs(population) > BIG;
+            }
+        for (i = 0; i < maxit/2 && !out; i++)
+        {
+            for (int count = 0; count < lyaLength && !out; count++)
+            {
+                double const rate = lyaRxy[count] ? a[lane] : b[lane];
+                population = rate * population * (1 - population);
+                total *= fabs(rate-2.0*rate*population);
+                out = fabs(population) > BIG || total == 0;
+            }
+            while (!out && total > 22026.4657948)
+            {
+                total *= 0.0000453999297625;
+                lnadjust += 10;
+            }
+            while (!out && total < 0.0000453999297625)
+            {
+                total *= 22026.4657948;
+                lnadjust -= 10;
+            }
+        }
+        color[lane] = lyapunov_color(out, total, lnadjust, i);
+        ran[lane] = out ? std::max(i - 1, 0L) : i;  // i counts the cycle it overflowed in
+    }
+}
+#endif
+
+/*
+   Colors n pixels at a[], b[] the way lyapunov() does, without touching
+   the globals, so the threads of the row engine can call it.  cycles[]
+   gets the cycles of the exponent each ran, as realcoloriter does there.
+*/
+void lyapunov_pixels(double const *a, double const *b, int *color, long *cycles, int n)
+{
+    for (int first = 0; first < n; first += LYA_LANES)
+    {
+        double la[LYA_LANES], lb[LYA_LANES];
+        int lc[LYA_LANES];
+        long lr[LYA_LANES];
+        for (int lane = 0; lane < LYA_LANES; lane++)
+        {
+            int const j = std::min(first + lane, n - 1);     // pad with the last
+            la[lane] = a[j];
+            lb[lane] = b[j];
+        }
+        lyapunov_lanes(la, lb, lc, lr);
+        for (int lane = 0; lane < LYA_LANES && first + lane < n; lane++)
+        {
+            int c = lc[lane];
+            if (inside > COLOR_BLACK && c == 0)
+                c = inside;
+            else if (c >= colors)
+                c = colors-1;
+            color[first + lane] = c;
+            cycles[first + lane] = lr[lane];
+        }
+    }
+}
+
 
 //****************** standalone engine for "cellular" *******************
 
@@ -1439,11 +2234,213 @@ jumpout:
 
 #define CELLULAR_DONE 10
 
-static std::vector<BYTE> cell_array[2];
-
 S16 r, k_1, rule_digits;
 bool lstscreenflag = false;
 
+/*
+   The rows are kept bit sliced: plane p of a row holds bit p of the state
+   of each cell, 64 cells to a word, so each step works out the next state
+   of 64 cells at once.  The states of the 2r+1 neighbors are added up with
+   full adders on whole words, and cell_table[] is applied to the four bits
+   of each sum as a tree of selections.  Only a row that is shown is spread
+   out into bytes for put_line().  The borders take their rand() values in
+   the same order as ever, so the images are the same.
+*/
+#define CELL_PLANES    3        // states 0 to 5
+#define CELL_SUM_BITS  4        // sums up to (2r+1)*k_1 = rule_digits-1 <= 15
+#define CELL_RULE_SUMS (1 << CELL_SUM_BITS)
+#define CELL_VALUES    64       // the most adder and rule values at once
+
+static int cell_planes;         // planes of the k states
+static int cell_sum_bits;       // bits of the largest sum
+static size_t cell_words;       // words in a plane, one spare on the right
+static std::vector<std::uint64_t> cell_bits[2];
+static std::vector<std::uint64_t> cell_scratch; // CELL_VALUES rows of words
+static std::vector<BYTE> cell_line; // a row spread out, cell_words*64 bytes
+static U16 cell_rule[CELL_PLANES];  // bit t of plane p is bit p of cell_table[t]
+
+static void cell_set(std::vector<std::uint64_t> &row, int col, int state)
+{
+    std::uint64_t const bit = std::uint64_t(1) << (col & 63);
+    for (int p = 0; p < cell_planes; p++)
+    {
+        std::uint64_t &word = row[p*cell_words + (col >> 6)];
+        word = ((state >> p) & 1) ? (word | bit) : (word & ~bit);
+    }
+}
+
+// the row in cell_line into planes; returns a state out of range, or -1
+static int cell_pack(std::vector<std::uint64_t> &row)
+{
+    std::fill(row.begin(), row.end(), 0);
+    for (int i = 0; i <= ixstop; i++)
+    {
+        if (cell_line[i] > k_1)
+            return cell_line[i];
+        cell_set(row, i, cell_line[i]);
+    }
+    return -1;
+}
+
+static void cell_unpack(std::vector<std::uint64_t> const &row)
+{
+    // spread[b] has byte j set to bit j of b
+    static std::uint64_t spread[256];
+    if (spread[255] == 0)
+    {
+        for (int b = 0; b < 256; b++)
+        {
+            BYTE bytes[8];
+            for (int j = 0; j < 8; j++)
+                bytes[j] = (BYTE)((b >> j) & 1);
+            memcpy(&spread[b], bytes, 8);
+        }
+    }
+    for (size_t w = 0; w < cell_words; w++)
+    {
+        for (int j = 0; j < 8; j++)
+        {
+            std::uint64_t cells = 0;
+            for (int p = 0; p < cell_planes; p++)
+                cells |= spread[(row[p*cell_words + w] >> 8*j) & 0xff] << p;
+            memcpy(&cell_line[w*64 + j*8], &cells, 8);
+        }
+    }
+}
+
+// a plane of bits worked out for words [w0, w1) of a row
+typedef std::uint64_t *cell_value;
+
+/*
+   One generation, from the filled row to the other.  The adders and the
+   rule are worked on whole rows of words, one operation after another,
+   which the compiler turns into SIMD loops.
+*/
+static void cell_step(S16 filled, bool random_border, int k)
+{
+    std::vector<std::uint64_t> const &from = cell_bits[filled];
+    std::vector<std::uint64_t> &to = cell_bits[1 - filled];
+    for (int i = 0; i <= r; i++)
+    {
+        cell_set(to, i, random_border ? rand()%k : 0);
+        cell_set(to, ixstop-i, random_border ? rand()%k : 0);
+    }
+
+    int const first = r;                // the cells the rule decides
+    int const last = std::max<int>(r, ixstop-r-1);
+    size_t const w0 = first >> 6;
+    size_t const w1 = (last >> 6) + 1;
+    int slots = 0;
+    auto const new_value = [&]()
+    {
+        return &cell_scratch[(slots++)*cell_words];
+    };
+
+    // the bits of weight 2^b of the neighbors' states
+    cell_value column[CELL_SUM_BITS][48];
+    int count[CELL_SUM_BITS] = {0};
+    for (int d = -r; d <= r; d++)
+    {
+        for (int p = 0; p < cell_planes; p++)
+        {
+            std::uint64_t const *plane = &from[p*cell_words];
+            cell_value const x = new_value();
+            if (d > 0)
+                for (size_t w = w0; w < w1; w++)
+                    x[w] = (plane[w] >> d) | (plane[w + 1] << (64 - d));
+            else if (d < 0)
+                for (size_t w = w0; w < w1; w++)
+                    x[w] = (plane[w] << -d) | (w > 0 ? plane[w - 1] >> (64 + d) : 0);
+            else
+                for (size_t w = w0; w < w1; w++)
+                    x[w] = plane[w];
+            column[p][count[p]++] = x;
+        }
+    }
+
+    // added with full and half adders until one of each weight is left;
+    // nothing carries out of the top bit of the largest sum
+    cell_value sum[CELL_SUM_BITS];
+    for (int b = 0; b < cell_sum_bits; b++)
+    {
+        bool const carry = b + 1 < cell_sum_bits;
+        while (count[b] > 1)
+        {
+            cell_value const x = column[b][--count[b]];
+            cell_value const y = column[b][--count[b]];
+            cell_value const c = carry ? new_value() : nullptr;
+            if (count[b] > 0)
+            {
+                cell_value const z = column[b][--count[b]];
+                for (size_t w = w0; w < w1; w++)
+                {
+                    std::uint64_t const xy = x[w] ^ y[w];
+                    if (carry)
+                        c[w] = (x[w] & y[w]) | (z[w] & xy);
+                    x[w] = xy ^ z[w];
+                }
+            }
+            else
+            {
+                for (size_t w = w0; w < w1; w++)
+                {
+                    if (carry)
+                        c[w] = x[w] & y[w];
+                    x[w] ^= y[w];
+                }
+            }
+            column[b][count[b]++] = x;
+            if (carry)
+                column[b + 1][count[b + 1]++] = c;
+        }
+        if (count[b] == 0)
+        {
+            column[b][count[b]++] = new_value();
+            std::fill(column[b][0] + w0, column[b][0] + w1, 0);
+        }
+        sum[b] = column[b][0];
+    }
+
+    // each plane of cell_table[sum], selecting on the bits of the sum
+    for (int p = 0; p < cell_planes; p++)
+    {
+        cell_value v[CELL_RULE_SUMS/2];
+        int n = 1 << (cell_sum_bits - 1);
+        for (int j = 0; j < n; j++)
+        {
+            std::uint64_t const lo = ((cell_rule[p] >> 2*j) & 1) ? ~std::uint64_t(0) : 0;
+            std::uint64_t const hi = ((cell_rule[p] >> (2*j + 1)) & 1) ? ~std::uint64_t(0) : 0;
+            v[j] = new_value();
+            for (size_t w = w0; w < w1; w++)
+                v[j][w] = (lo & ~sum[0][w]) | (hi & sum[0][w]);
+        }
+        for (int b = 1; b < cell_sum_bits; b++)
+        {
+            n /= 2;
+            for (int j = 0; j < n; j++)
+            {
+                cell_value const x = v[2*j];
+                cell_value const y = v[2*j + 1];
+                for (size_t w = w0; w < w1; w++)
+                    x[w] = (x[w] & ~sum[b][w]) | (y[w] & sum[b][w]);
+                v[j] = x;
+            }
+        }
+        slots -= 1 << (cell_sum_bits - 1);
+
+        std::uint64_t *plane = &to[p*cell_words];
+        for (size_t w = w0; w < w1; w++)
+        {
+            std::uint64_t mask = ~std::uint64_t(0);
+            if (w == w0)
+                mask <<= first & 63;
+            if (w == w1 - 1)
+                mask &= ~std::uint64_t(0) >> (63 - (last & 63));
+            plane[w] = (plane[w] & ~mask) | (v[0][w] & mask);
+        }
+    }
+}
+
 void abort_cellular(int err, int t)
 {
     int i;
@@ -1518,7 +2515,6 @@ int cellular()
     U16 init_string[16];
     U16 kr, k;
     U32 lnnmbr;
-    U16 twor;
     S16 t, t2;
     S32 randparam;
     double n;
@@ -1631,12 +2627,26 @@ int cellular()
     }
 
 
+    cell_planes = (k_1 < 2) ? 1 : (k_1 < 4) ? 2 : 3;
+    cell_sum_bits = 1;
+    while ((1 << cell_sum_bits) < rule_digits)
+        cell_sum_bits++;
+    for (int p = 0; p < cell_planes; p++)
+    {
+        cell_rule[p] = 0;
+        for (int i = 0; i < rule_digits; i++)
+            cell_rule[p] |= (U16)(((cell_table[i] >> p) & 1) << i);
+    }
+
     start_row = 0;
     bool resized = false;
     try
     {
-        cell_array[0].resize(ixstop+1);
-        cell_array[1].resize(ixstop+1);
+        cell_words = (ixstop + 64)/64 + 1;
+        cell_bits[0].assign(cell_planes*cell_words, 0);
+        cell_bits[1].assign(cell_planes*cell_words, 0);
+        cell_line.resize(cell_words*64);
+        cell_scratch.resize(CELL_VALUES*cell_words);
         resized = true;
     }
     catch (std::bad_alloc const&)
@@ -1658,13 +2668,13 @@ int cellular()
         start_resume();
         get_resume(sizeof(start_row), &start_row, 0);
         end_resume();
-        get_line(start_row, 0, ixstop, &cell_array[filled][0]);
+        get_line(start_row, 0, ixstop, &cell_line[0]);
     }
     else if (nxtscreenflag && !lstscreenflag)
     {
         start_resume();
         end_resume();
-        get_line(iystop, 0, ixstop, &cell_array[filled][0]);
+        get_line(iystop, 0, ixstop, &cell_line[0]);
         param[3] += iystop + 1;
         start_row = -1; // after 1st iteration its = 0
     }
@@ -1674,7 +2684,7 @@ int cellular()
         {
             for (col = 0; col <= ixstop; col++)
             {
-                cell_array[filled][col] = (BYTE)(rand()%(int)k);
+                cell_line[col] = (BYTE)(rand()%(int)k);
             }
         } // end of if random
 
@@ -1682,19 +2692,25 @@ int cellular()
         {
             for (col = 0; col <= ixstop; col++)
             { // Clear from end to end
-                cell_array[filled][col] = 0;
+                cell_line[col] = 0;
             }
             int i = 0;
             for (col = (ixstop-16)/2; col < (ixstop+16)/2; col++)
             { // insert initial
-                cell_array[filled][col] = (BYTE)init_string[i++];    // string
+                cell_line[col] = (BYTE)init_string[i++];    // string
             }
         } // end of if not random
         if (lnnmbr != 0)
             lstscreenflag = true;
         else
             lstscreenflag = false;
-        put_line(start_row, 0, ixstop, &cell_array[filled][0]);
+        put_line(start_row, 0, ixstop, &cell_line[0]);
+    }
+    t = (S16) cell_pack(cell_bits[filled]);
+    if (t >= 0)
+    {
+        abort_cellular(BAD_T, t);
+        return -1;
     }
     start_row++;
 
@@ -1706,49 +2722,7 @@ int cellular()
         for (U32 big_row = (U32)start_row; big_row < lnnmbr; big_row++)
         {
             thinking(1, "Cellular thinking (higher start row takes longer)");
-            if (rflag || randparam == 0 || randparam == -1)
-            {
-                // Use a random border
-                for (int i = 0; i <= r; i++)
-                {
-                    cell_array[notfilled][i] = (BYTE)(rand()%(int)k);
-                    cell_array[notfilled][ixstop-i] = (BYTE)(rand()%(int)k);
-                }
-            }
-            else
-            {
-                // Use a zero border
-                for (int i = 0; i <= r; i++)
-                {
-                    cell_array[notfilled][i] = 0;
-                    cell_array[notfilled][ixstop-i] = 0;
-                }
-            }
-
-            t = 0; // do first cell
-            twor = (U16)(r+r);
-            for (int i = 0; i <= twor; i++)
-                t = (S16)(t + (S16)cell_array[filled][i]);
-            if (t > rule_digits || t < 0)
-            {
-                thinking(0, nullptr);
-                abort_cellular(BAD_T, t);
-                return (-1);
-            }
-            cell_array[notfilled][r] = (BYTE)cell_table[t];
-
-            // use a rolling sum in t
-            for (col = r+1; col < ixstop-r; col++)
-            { // now do the rest
-                t = (S16)(t + cell_array[filled][col+r] - cell_array[filled][col-r-1]);
-                if (t > rule_digits || t < 0)
-                {
-                    thinking(0, nullptr);
-                    abort_cellular(BAD_T, t);
-                    return (-1);
-                }
-                cell_array[notfilled][col] = (BYTE)cell_table[t];
-            }
+            cell_step(filled, rflag || randparam == 0 || randparam == -1, k);
 
             filled = notfilled;
             notfilled = (S16)(1-filled);
@@ -1768,53 +2742,12 @@ int cellular()
 contloop:
     for (row = start_row; row <= iystop; row++)
     {
-        if (rflag || randparam == 0 || randparam == -1)
-        {
-            // Use a random border
-            for (int i = 0; i <= r; i++)
-            {
-                cell_array[notfilled][i] = (BYTE)(rand()%(int)k);
-                cell_array[notfilled][ixstop-i] = (BYTE)(rand()%(int)k);
-            }
-        }
-        else
-        {
-            // Use a zero border
-            for (int i = 0; i <= r; i++)
-            {
-                cell_array[notfilled][i] = 0;
-                cell_array[notfilled][ixstop-i] = 0;
-            }
-        }
-
-        t = 0; // do first cell
-        twor = (U16)(r+r);
-        for (int i = 0; i <= twor; i++)
-            t = (S16)(t + (S16)cell_array[filled][i]);
-        if (t > rule_digits || t < 0)
-        {
-            thinking(0, nullptr);
-            abort_cellular(BAD_T, t);
-            return (-1);
-        }
-        cell_array[notfilled][r] = (BYTE)cell_table[t];
-
-        // use a rolling sum in t
-        for (col = r+1; col < ixstop-r; col++)
-        { // now do the rest
-            t = (S16)(t + cell_array[filled][col+r] - cell_array[filled][col-r-1]);
-            if (t > rule_digits || t < 0)
-            {
-                thinking(0, nullptr);
-                abort_cellular(BAD_T, t);
-                return (-1);
-            }
-            cell_array[notfilled][col] = (BYTE)cell_table[t];
-        }
+        cell_step(filled, rflag || randparam == 0 || randparam == -1, k);
 
         filled = notfilled;
         notfilled = (S16)(1-filled);
-        put_line(row, 0, ixstop, &cell_array[filled][0]);
+        cell_unpack(cell_bits[filled]);
+        put_line(row, 0, ixstop, &cell_line[0]);
         if (driver_key_pressed())
         {
             abort_cellular(CELLULAR_DONE, 0);
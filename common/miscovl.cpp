@@ -503,6 +503,18 @@ struct write_batch_data // buffer for parms to break lines nicely
     char buf[10000];
 };
 static write_batch_data s_wbdata;
+static std::string *s_parm_text = nullptr;  // put_parm_line() appends here if set
+
+// the parameters of the current image as PAR file lines, without colors
+std::string batch_parms_text()
+{
+    std::string text;
+    char colorinf[] = "n";
+    s_parm_text = &text;
+    write_batch_parms(colorinf, false, colors, 0, 0);
+    s_parm_text = nullptr;
+    return text;
+}
 
 void write_batch_parms(char *colorinf, bool colorsonly, int maxcolor, int ii, int jj)
 {
@@ -1062,6 +1074,9 @@ void write_batch_parms(char *colorinf, bool colorsonly, int maxcolor, int ii, in
         if (start_showorbit)
             put_parm(" %s=%s", "showorbit", "yes");
 
+        if (g_orbit_density > 0 && (curfractalspecific->flags&INFCALC) != 0)
+            put_parm(" %s=%ld", "orbitdensity", g_orbit_density);
+
         if (keep_scrn_coords)
             put_parm(" %s=%s", "screencoords", "yes");
 
@@ -1282,11 +1297,22 @@ static void put_parm_line()
     }
     c = s_wbdata.buf[len];
     s_wbdata.buf[len] = 0;
-    fputs("  ", parmfile);
-    fputs(s_wbdata.buf, parmfile);
-    if (c && c != ' ')
-        fputc('\\', parmfile);
-    fputc('\n', parmfile);
+    if (s_parm_text != nullptr)
+    {
+        *s_parm_text += "  ";
+        *s_parm_text += s_wbdata.buf;
+        if (c && c != ' ')
+            *s_parm_text += '\\';
+        *s_parm_text += '\n';
+    }
+    else
+    {
+        fputs("  ", parmfile);
+        fputs(s_wbdata.buf, parmfile);
+        if (c && c != ' ')
+            fputc('\\', parmfile);
+        fputc('\n', parmfile);
+    }
     s_wbdata.buf[len] = (char)c;
     if (c == ' ')
         ++len;
@@ -6,6 +6,7 @@
 #include <ctype.h>
 #include <stdarg.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <time.h>
 #if defined(XFRACT)
 #include <malloc.h>
@@ -1372,6 +1373,40 @@ int ifsload()                   // read in IFS parameters
     return (ret);
 }
 
+// In server mode the offsets of all the entries in a file are kept, so
+// later jobs seek straight to an entry instead of scanning for it.
+struct entry_index
+{
+    long size;
+    time_t mtime;
+    std::map<std::string, long> offsets;
+};
+static std::map<std::string, entry_index> s_entry_indexes;
+
+// scan_entries(infile, nullptr, itemname) for the file at path
+static int scan_for_item(FILE *infile, const char *path, char *itemname)
+{
+    struct stat info;
+    if (g_server_dir[0] == 0 || stat(path, &info) != 0)
+        return scan_entries(infile, nullptr, itemname);
+
+    entry_index &index = s_entry_indexes[path];
+    if (index.offsets.empty() || index.size != info.st_size || index.mtime != info.st_mtime)
+    {
+        index.size = info.st_size;
+        index.mtime = info.st_mtime;
+        index.offsets.clear();
+        index_entries(infile, index.offsets);
+    }
+    std::string name(itemname);
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    auto const entry = index.offsets.find(name);
+    if (entry == index.offsets.end())
+        return 0;
+    fseek(infile, entry->second, SEEK_SET);
+    return -1;
+}
+
 bool find_file_item(char *filename, char *itemname, FILE **fileptr, int itemtype)
 {
     FILE *infile = nullptr;
@@ -1392,7 +1427,7 @@ bool find_file_item(char *filename, char *itemname, FILE **fileptr, int itemtype
         infile = fopen(filename, "rb");
         if (infile != nullptr)
         {
-            if (scan_entries(infile, nullptr, itemname) == -1)
+            if (scan_for_item(infile, filename, itemname) == -1)
             {
                 found = true;
             }
@@ -1409,7 +1444,7 @@ bool find_file_item(char *filename, char *itemname, FILE **fileptr, int itemtype
             infile = fopen(fullpath, "rb");
             if (infile != nullptr)
             {
-                if (scan_entries(infile, nullptr, itemname) == -1)
+                if (scan_for_item(infile, fullpath, itemname) == -1)
                 {
                     strcpy(filename, fullpath);
                     found = true;
@@ -1459,7 +1494,7 @@ bool find_file_item(char *filename, char *itemname, FILE **fileptr, int itemtype
         infile = fopen(CommandFile, "rb");
         if (infile != nullptr)
         {
-            if (scan_entries(infile, nullptr, parsearchname) == -1)
+            if (scan_for_item(infile, CommandFile, parsearchname) == -1)
             {
                 strcpy(filename, CommandFile);
                 found = true;
@@ -1478,7 +1513,7 @@ bool find_file_item(char *filename, char *itemname, FILE **fileptr, int itemtype
         infile = fopen(fullpath, "rb");
         if (infile != nullptr)
         {
-            if (scan_entries(infile, nullptr, itemname) == -1)
+            if (scan_for_item(infile, fullpath, itemname) == -1)
             {
                 strcpy(filename, fullpath);
                 found = true;
@@ -1511,7 +1546,7 @@ bool find_file_item(char *filename, char *itemname, FILE **fileptr, int itemtype
                 infile = fopen(fullpath, "rb");
                 if (infile != nullptr)
                 {
-                    if (scan_entries(infile, nullptr, itemname) == -1)
+                    if (scan_for_item(infile, fullpath, itemname) == -1)
                     {
                         strcpy(filename, fullpath);
                         found = true;
@@ -1564,7 +1599,7 @@ bool find_file_item(char *filename, char *itemname, FILE **fileptr, int itemtype
         infile = fopen(fullpath, "rb");
         if (infile != nullptr)
         {
-            if (scan_entries(infile, nullptr, itemname) == -1)
+            if (scan_for_item(infile, fullpath, itemname) == -1)
             {
                 strcpy(filename, fullpath);
                 found = true;
@@ -2807,6 +2807,429 @@ static bool ParseStr(char *Str, int pass)
 }
 
 
+/*
+   Compiled form of a D_MATH formula.  Once a formula has parsed,
+   compile_formula() turns f[] into a list of formula_ops, with the Load
+   and Store operands and the jump destinations worked out up front and the
+   most common pairs of ops fused together, and Formula() runs that list in
+   a single switch instead of calling through f[].  The top of the stack
+   lives in a local instead of Arg1, and ops without a case of their own are
+   still called through their function with Arg1 and Arg2 set up.  Each case
+   does exactly the arithmetic of its dStk function, so images don't change.
+*/
+enum class fop
+{
+    CALL,       // anything else, through fn
+    LOD,
+    STO,
+    CLR,
+    STO_CLR,
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    SQR,
+    MOD,
+    NEG,
+    REAL_PART,
+    IMAG_PART,
+    LT,
+    LTE,
+    GT,
+    GTE,
+    EQ,
+    NE,
+    AND,
+    OR,
+    LOD_ADD,    // Lod followed by the op
+    LOD_SUB,
+    LOD_MUL,
+    LOD_SQR,
+    LOD_MOD,
+    LOD_LT,
+    LOD_LTE,
+    LOD_GT,
+    LOD_GTE,
+    JUMP,
+    JUMP_FALSE,
+    JUMP_TRUE,
+    END
+};
+
+struct formula_op
+{
+    fop op;
+    void (*fn)();               // CALL
+    Arg *arg;                   // the Load or Store operand
+    int dest;                   // jumps
+};
+
+static std::vector<formula_op> s_compiled;
+static std::vector<int> s_compiled_index;   // f[] index to s_compiled index
+
+static fop simple_op(void (*fn)())
+{
+    if (fn == StkClr)
+        return fop::CLR;
+    if (fn == dStkAdd)
+        return fop::ADD;
+    if (fn == dStkSub)
+        return fop::SUB;
+    if (fn == dStkMul)
+        return fop::MUL;
+    if (fn == dStkDiv)
+        return fop::DIV;
+    if (fn == dStkSqr)
+        return fop::SQR;
+    if (fn == dStkMod)
+        return fop::MOD;
+    if (fn == dStkNeg)
+        return fop::NEG;
+    if (fn == dStkReal)
+        return fop::REAL_PART;
+    if (fn == dStkImag)
+        return fop::IMAG_PART;
+    if (fn == dStkLT)
+        return fop::LT;
+    if (fn == dStkLTE)
+        return fop::LTE;
+    if (fn == dStkGT)
+        return fop::GT;
+    if (fn == dStkGTE)
+        return fop::GTE;
+    if (fn == dStkEQ)
+        return fop::EQ;
+    if (fn == dStkNE)
+        return fop::NE;
+    if (fn == dStkAND)
+        return fop::AND;
+    if (fn == dStkOR)
+        return fop::OR;
+    return fop::CALL;
+}
+
+static fop fused_lod_op(fop next)
+{
+    switch (next)
+    {
+    case fop::ADD:
+        return fop::LOD_ADD;
+    case fop::SUB:
+        return fop::LOD_SUB;
+    case fop::MUL:
+        return fop::LOD_MUL;
+    case fop::SQR:
+        return fop::LOD_SQR;
+    case fop::MOD:
+        return fop::LOD_MOD;
+    case fop::LT:
+        return fop::LOD_LT;
+    case fop::LTE:
+        return fop::LOD_LTE;
+    case fop::GT:
+        return fop::LOD_GT;
+    case fop::GTE:
+        return fop::LOD_GTE;
+    default:
+        return fop::CALL;
+    }
+}
+
+static bool is_jump_op(void (*fn)())
+{
+    return fn == StkJump || fn == StkJumpOnFalse || fn == StkJumpOnTrue
+        || fn == StkJumpLabel;
+}
+
+static void compile_formula()
+{
+    int const num_ops = (int) LastOp;
+    std::vector<bool> entry(num_ops + 1, false);   // somewhere a jump lands
+    std::vector<int> jump_of(num_ops, -1);          // jump_control index of an op
+
+    s_compiled.clear();
+    s_compiled_index.clear();
+    if (MathType != D_MATH)
+        return;
+
+    int load = 0;
+    int store = 0;
+    int jump = 0;
+    for (int i = 0; i < num_ops; ++i)
+    {
+        if (f[i] == StkLod)
+            ++load;
+        else if (f[i] == StkSto)
+            ++store;
+        else if (is_jump_op(f[i]))
+        {
+            if (jump >= jump_index)
+                return;
+            jump_of[i] = jump;
+            entry[jump_control[jump].ptrs.JumpOpPtr + 1] = true;
+            ++jump;
+        }
+        else if (f[i] == EndInit)
+            entry[i + 1] = true;
+        else if (f[i] == dStkLodDup || f[i] == dStkLodSqr || f[i] == dStkLodSqr2
+                 || f[i] == dStkLodDbl)
+            return;                     // these move LodPtr themselves
+    }
+    if (jump != (uses_jump ? jump_index : 0))
+        return;
+
+    load = 0;
+    store = 0;
+    s_compiled_index.resize(num_ops + 1);
+    for (int i = 0; i < num_ops; ++i)
+    {
+        formula_op op = { fop::CALL, f[i], nullptr, 0 };
+        s_compiled_index[i] = (int) s_compiled.size();
+        if (f[i] == StkLod)
+        {
+            op.op = fop::LOD;
+            op.arg = Load[load++];
+            if (i + 1 < num_ops && !entry[i + 1])
+            {
+                fop const fused = fused_lod_op(simple_op(f[i + 1]));
+                if (fused != fop::CALL)
+                {
+                    op.op = fused;
+                    s_compiled_index[++i] = (int) s_compiled.size();
+                }
+            }
+        }
+        else if (f[i] == StkSto)
+        {
+            op.op = fop::STO;
+            op.arg = Store[store++];
+            if (i + 1 < num_ops && !entry[i + 1] && f[i + 1] == StkClr)
+            {
+                op.op = fop::STO_CLR;
+                s_compiled_index[++i] = (int) s_compiled.size();
+            }
+        }
+        else if (f[i] == StkJumpLabel)
+            continue;
+        else if (f[i] == StkJump || f[i] == StkJumpOnFalse || f[i] == StkJumpOnTrue)
+        {
+            op.op = (f[i] == StkJump) ? fop::JUMP
+                : (f[i] == StkJumpOnFalse) ? fop::JUMP_FALSE : fop::JUMP_TRUE;
+            op.dest = jump_control[jump_of[i]].ptrs.JumpOpPtr + 1;
+        }
+        else
+            op.op = simple_op(f[i]);
+        s_compiled.push_back(op);
+    }
+    s_compiled_index[num_ops] = (int) s_compiled.size();
+    formula_op const end = { fop::END, nullptr, nullptr, 0 };
+    s_compiled.push_back(end);
+    for (formula_op &op : s_compiled)
+        if (op.op == fop::JUMP || op.op == fop::JUMP_FALSE || op.op == fop::JUMP_TRUE)
+            op.dest = s_compiled_index[op.dest];
+}
+
+static void run_compiled_formula(int start)
+{
+    formula_op const *ops = &s_compiled[0];
+    Arg *a = &s[0];                     // Arg1, Arg2 is always a-1
+    double x = s[0].d.x;                // the value at *a
+    double y = s[0].d.y;
+    double tx, ty;
+
+    for (int i = s_compiled_index[start];; ++i)
+    {
+        formula_op const &op = ops[i];
+        switch (op.op)
+        {
+        case fop::CALL:
+            a->d.x = x;
+            a->d.y = y;
+            Arg1 = a;
+            Arg2 = a - 1;
+            op.fn();
+            a = Arg1;
+            x = a->d.x;
+            y = a->d.y;
+            break;
+        case fop::LOD:
+            a->d.x = x;
+            a->d.y = y;
+            ++a;
+            x = op.arg->d.x;
+            y = op.arg->d.y;
+            break;
+        case fop::STO:
+            op.arg->d.x = x;
+            op.arg->d.y = y;
+            break;
+        case fop::CLR:
+            a = &s[0];
+            break;
+        case fop::STO_CLR:
+            op.arg->d.x = x;
+            op.arg->d.y = y;
+            a = &s[0];
+            break;
+        case fop::ADD:
+            --a;
+            x = a->d.x + x;
+            y = a->d.y + y;
+            break;
+        case fop::SUB:
+            --a;
+            x = a->d.x - x;
+            y = a->d.y - y;
+            break;
+        case fop::MUL:
+            --a;
+            tx = a->d.x * x - a->d.y * y;
+            y = a->d.x * y + a->d.y * x;
+            x = tx;
+            break;
+        case fop::DIV:
+            a->d.x = x;
+            a->d.y = y;
+            FPUcplxdiv(&a[-1].d, &a->d, &a[-1].d);
+            --a;
+            x = a->d.x;
+            y = a->d.y;
+            break;
+        case fop::SQR:
+            tx = x * x;
+            ty = y * y;
+            y = x * y * 2.0;
+            x = tx - ty;
+            LastSqr.d.x = tx + ty;
+            LastSqr.d.y = 0;
+            break;
+        case fop::MOD:
+            x = (x * x) + (y * y);
+            y = 0.0;
+            break;
+        case fop::NEG:
+            x = -x;
+            y = -y;
+            break;
+        case fop::REAL_PART:
+            y = 0.0;
+            break;
+        case fop::IMAG_PART:
+            x = y;
+            y = 0.0;
+            break;
+        case fop::LT:
+            --a;
+            x = (double)(a->d.x < x);
+            y = 0.0;
+            break;
+        case fop::LTE:
+            --a;
+            x = (double)(a->d.x <= x);
+            y = 0.0;
+            break;
+        case fop::GT:
+            --a;
+            x = (double)(a->d.x > x);
+            y = 0.0;
+            break;
+        case fop::GTE:
+            --a;
+            x = (double)(a->d.x >= x);
+            y = 0.0;
+            break;
+        case fop::EQ:
+            --a;
+            x = (double)(a->d.x == x);
+            y = 0.0;
+            break;
+        case fop::NE:
+            --a;
+            x = (double)(a->d.x != x);
+            y = 0.0;
+            break;
+        case fop::AND:
+            --a;
+            x = (double)(a->d.x && x);
+            y = 0.0;
+            break;
+        case fop::OR:
+            --a;
+            x = (double)(a->d.x || x);
+            y = 0.0;
+            break;
+        case fop::LOD_ADD:
+            x += op.arg->d.x;
+            y += op.arg->d.y;
+            break;
+        case fop::LOD_SUB:
+            x -= op.arg->d.x;
+            y -= op.arg->d.y;
+            break;
+        case fop::LOD_MUL:
+            tx = x * op.arg->d.x - y * op.arg->d.y;
+            y = x * op.arg->d.y + y * op.arg->d.x;
+            x = tx;
+            break;
+        case fop::LOD_SQR:
+            a->d.x = x;
+            a->d.y = y;
+            ++a;
+            x = op.arg->d.x;
+            y = op.arg->d.y;
+            tx = x * x;
+            ty = y * y;
+            y = x * y * 2.0;
+            x = tx - ty;
+            LastSqr.d.x = tx + ty;
+            LastSqr.d.y = 0;
+            break;
+        case fop::LOD_MOD:
+            a->d.x = x;
+            a->d.y = y;
+            ++a;
+            x = op.arg->d.x;
+            y = op.arg->d.y;
+            x = (x * x) + (y * y);
+            y = 0.0;
+            break;
+        case fop::LOD_LT:
+            x = (double)(x < op.arg->d.x);
+            y = 0.0;
+            break;
+        case fop::LOD_LTE:
+            x = (double)(x <= op.arg->d.x);
+            y = 0.0;
+            break;
+        case fop::LOD_GT:
+            x = (double)(x > op.arg->d.x);
+            y = 0.0;
+            break;
+        case fop::LOD_GTE:
+            x = (double)(x >= op.arg->d.x);
+            y = 0.0;
+            break;
+        case fop::JUMP:
+            i = op.dest - 1;
+            break;
+        case fop::JUMP_FALSE:
+            if (x == 0)
+                i = op.dest - 1;
+            break;
+        case fop::JUMP_TRUE:
+            if (x)
+                i = op.dest - 1;
+            break;
+        case fop::END:
+            a->d.x = x;
+            a->d.y = y;
+            Arg1 = a;
+            Arg2 = a - 1;
+            return;
+        }
+    }
+}
+
 int Formula()
 {
     if (FormName[0] == 0 || overflow)
@@ -2834,6 +3257,14 @@ int Formula()
         }
     }
 
+    if (!s_compiled.empty())
+    {
+        run_compiled_formula(InitOpPtr);
+        g_new = v[3].a.d;
+        old = g_new;
+        return Arg1->d.x == 0.0;
+    }
+
     Arg1 = &s[0];
     Arg2 = Arg1-1;
     while (OpPtr < (int)LastOp)
@@ -4037,6 +4468,7 @@ bool RunForm(char *Name, bool from_prompts1c)
     //  first set the pointers so they point to a fn which always returns 1
     curfractalspecific->per_pixel = BadFormula;
     curfractalspecific->orbitcalc = BadFormula;
+    s_compiled.clear();
 
     if (FormName[0] == 0)
     {
@@ -4065,6 +4497,8 @@ bool RunForm(char *Name, bool from_prompts1c)
                 return true;
             }
 
+            compile_formula();
+
             // all parses succeeded so set the pointers back to good functions
             curfractalspecific->per_pixel = form_per_pixel;
             curfractalspecific->orbitcalc = Formula;
@@ -0,0 +1,308 @@
+/*
+        pngout.cpp - write the image to a PNG file while it is calculated
+*/
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <string.h>
+#if defined(XFRACT)
+#include <unistd.h>
+#endif
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "port.h"
+#include "prototyp.h"
+
+/*
+   With pngout=rgb or pngout=iter the escape-time engine hands every pixel
+   it calculates to png_stream_pixel().  The calculation is forced to one
+   pass without symmetry, as for 16-bit potential, so the pixels arrive row
+   by row.  Each finished row is filtered and deflated into IDAT chunks at
+   once; only the current row and the one above it are kept.
+
+   pngout=rgb writes the colors of the GIF palette as 8-bit RGB,
+   pngout=iter the iteration count of every pixel as 16-bit grayscale,
+   clipped to 65535.
+   The parameters of the image, as make_batch_file() would write them, go
+   in a tEXt chunk with the keyword "fractint", the PNG counterpart of the
+   fractint GIF extension blocks.
+
+   Without zlib the image data is written in stored (uncompressed) deflate
+   blocks, which any PNG reader accepts.
+*/
+
+#define IDAT_SIZE 65536
+
+static FILE *s_file = nullptr;
+static char s_filename[FILE_MAX_PATH];
+static png_out_kind s_kind = png_out_kind::NONE;
+static int s_width;
+static int s_height;
+static int s_row;                       // row being collected
+static int s_pixel_bytes;
+static BYTE s_palette[256][3];          // for pngout=rgb
+static std::vector<BYTE> s_cur;         // s_row, filter byte first
+static std::vector<BYTE> s_prev;        // the row above, unfiltered
+static std::vector<BYTE> s_filtered;
+static std::vector<BYTE> s_idat;        // compressed data not yet written
+#ifdef HAVE_ZLIB
+static z_stream s_zstream;
+#else
+static std::uint32_t s_adler;
+static std::vector<BYTE> s_pending;     // not yet in a stored block
+#endif
+
+static std::uint32_t crc_table[256];
+
+static void make_crc_table()
+{
+    for (std::uint32_t n = 0; n < 256; n++)
+    {
+        std::uint32_t c = n;
+        for (int k = 0; k < 8; k++)
+            c = (c & 1) ? 0xedb88320UL ^ (c >> 1) : c >> 1;
+        crc_table[n] = c;
+    }
+}
+
+static std::uint32_t update_crc(std::uint32_t crc, BYTE const *buf, size_t len)
+{
+    for (size_t n = 0; n < len; n++)
+        crc = crc_table[(crc ^ buf[n]) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+static void put_u32(BYTE *buf, std::uint32_t value)
+{
+    buf[0] = (BYTE)(value >> 24);
+    buf[1] = (BYTE)(value >> 16);
+    buf[2] = (BYTE)(value >> 8);
+    buf[3] = (BYTE) value;
+}
+
+static void write_chunk(char const *type, BYTE const *data, size_t len)
+{
+    BYTE buf[4];
+    put_u32(buf, (std::uint32_t) len);
+    fwrite(buf, 1, 4, s_file);
+    std::uint32_t crc = update_crc(0xffffffffUL, (BYTE const *) type, 4);
+    fwrite(type, 1, 4, s_file);
+    if (len != 0)
+    {
+        crc = update_crc(crc, data, len);
+        fwrite(data, 1, len, s_file);
+    }
+    put_u32(buf, crc ^ 0xffffffffUL);
+    fwrite(buf, 1, 4, s_file);
+}
+
+static void flush_idat(bool all)
+{
+    size_t done = 0;
+    while (s_idat.size() - done >= IDAT_SIZE || (all && done < s_idat.size()))
+    {
+        size_t const len = std::min(s_idat.size() - done, (size_t) IDAT_SIZE);
+        write_chunk("IDAT", &s_idat[done], len);
+        done += len;
+    }
+    s_idat.erase(s_idat.begin(), s_idat.begin() + done);
+}
+
+#ifdef HAVE_ZLIB
+static void deflate_bytes(BYTE const *data, size_t len, bool finish)
+{
+    BYTE out[IDAT_SIZE];
+    s_zstream.next_in = const_cast<BYTE *>(data);
+    s_zstream.avail_in = (uInt) len;
+    int status;
+    do
+    {
+        s_zstream.next_out = out;
+        s_zstream.avail_out = sizeof(out);
+        status = deflate(&s_zstream, finish ? Z_FINISH : Z_NO_FLUSH);
+        s_idat.insert(s_idat.end(), out, out + (sizeof(out) - s_zstream.avail_out));
+    }
+    while (s_zstream.avail_out == 0 || (finish && status != Z_STREAM_END));
+    flush_idat(false);
+}
+#else
+// stored deflate blocks of at most 65535 bytes, 5 byte header each
+static void deflate_bytes(BYTE const *data, size_t len, bool finish)
+{
+    std::uint32_t a = s_adler & 0xffff;
+    std::uint32_t b = s_adler >> 16;
+    for (size_t i = 0; i < len; ++i)
+    {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    s_adler = (b << 16) | a;
+
+    s_pending.insert(s_pending.end(), data, data + len);
+    size_t done = 0;
+    while (s_pending.size() - done >= 65535 || finish)
+    {
+        size_t const block = std::min(s_pending.size() - done, (size_t) 65535);
+        bool const last = finish && done + block == s_pending.size();
+        BYTE header[5];
+        header[0] = (BYTE)(last ? 1 : 0);
+        header[1] = (BYTE) block;
+        header[2] = (BYTE)(block >> 8);
+        header[3] = (BYTE) ~block;
+        header[4] = (BYTE)(~block >> 8);
+        s_idat.insert(s_idat.end(), header, header + 5);
+        s_idat.insert(s_idat.end(), s_pending.begin() + done, s_pending.begin() + done + block);
+        done += block;
+        if (last)
+            break;
+    }
+    s_pending.erase(s_pending.begin(), s_pending.begin() + done);
+    if (finish)
+    {
+        BYTE adler[4];
+        put_u32(adler, s_adler);
+        s_idat.insert(s_idat.end(), adler, adler + 4);
+    }
+    flush_idat(false);
+}
+#endif
+
+// filter (Up) and compress the collected row, then start the next one
+static void end_row()
+{
+    size_t const len = s_cur.size();
+    s_filtered[0] = 2;                  // Up
+    for (size_t i = 1; i < len; ++i)
+        s_filtered[i] = (BYTE)(s_cur[i] - s_prev[i]);
+    deflate_bytes(&s_filtered[0], len, false);
+    s_prev.swap(s_cur);
+    std::fill(s_cur.begin(), s_cur.end(), 0);
+    ++s_row;
+}
+
+/*
+   Starts writing filename.  parms is the text for the "fractint" chunk.
+   Returns false if the file can't be written.
+*/
+bool png_stream_begin(char const *filename, png_out_kind kind, int width, int height,
+                      std::string const &parms)
+{
+    png_stream_end(false);
+    if (kind == png_out_kind::NONE || width <= 0 || height <= 0)
+        return false;
+    s_file = fopen(filename, "wb");
+    if (s_file == nullptr)
+        return false;
+    strcpy(s_filename, filename);
+    if (crc_table[1] == 0)
+        make_crc_table();
+    s_kind = kind;
+    s_width = width;
+    s_height = height;
+    s_row = 0;
+    s_pixel_bytes = kind == png_out_kind::RGB ? 3 : 2;
+    if (kind == png_out_kind::RGB)
+        gif_palette(s_palette);
+    size_t const rowbytes = 1 + (size_t) width*s_pixel_bytes;
+    s_cur.assign(rowbytes, 0);
+    s_prev.assign(rowbytes, 0);
+    s_filtered.assign(rowbytes, 0);
+    s_idat.clear();
+
+    static BYTE const signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+    fwrite(signature, 1, 8, s_file);
+    BYTE ihdr[13];
+    put_u32(ihdr, (std::uint32_t) width);
+    put_u32(ihdr + 4, (std::uint32_t) height);
+    ihdr[8] = (BYTE)(kind == png_out_kind::RGB ? 8 : 16);   // bit depth
+    ihdr[9] = (BYTE)(kind == png_out_kind::RGB ? 2 : 0);    // truecolor, grayscale
+    ihdr[10] = 0;                       // deflate
+    ihdr[11] = 0;                       // adaptive filtering
+    ihdr[12] = 0;                       // not interlaced
+    write_chunk("IHDR", ihdr, sizeof(ihdr));
+
+    std::string text("fractint");
+    text += '\0';
+    text += parms;
+    write_chunk("tEXt", (BYTE const *) text.data(), text.size());
+
+#ifdef HAVE_ZLIB
+    memset(&s_zstream, 0, sizeof(s_zstream));
+    if (deflateInit(&s_zstream, Z_DEFAULT_COMPRESSION) != Z_OK)
+    {
+        png_stream_end(false);
+        return false;
+    }
+#else
+    s_adler = 1;
+    s_pending.clear();
+    static BYTE const zlib_header[2] = { 0x78, 0x01 };
+    s_idat.insert(s_idat.end(), zlib_header, zlib_header + 2);
+#endif
+    return true;
+}
+
+bool png_streaming()
+{
+    return s_file != nullptr;
+}
+
+/*
+   Stores the pixel at col, row.  A pixel of a later row finishes the rows
+   before it; pixels of rows already written are ignored.
+*/
+void png_stream_pixel(int col, int row, int color, long iteration)
+{
+    if (s_file == nullptr || row < s_row || row >= s_height || col < 0 || col >= s_width)
+        return;
+    while (s_row < row)
+        end_row();
+    BYTE *pixel = &s_cur[1 + (size_t) col*s_pixel_bytes];
+    if (s_kind == png_out_kind::RGB)
+    {
+        for (int i = 0; i < 3; ++i)
+            pixel[i] = s_palette[color & 0xff][i];
+    }
+    else
+    {
+        long const value = iteration < 0 ? 0 : (iteration > 65535 ? 65535 : iteration);
+        pixel[0] = (BYTE)(value >> 8);
+        pixel[1] = (BYTE) value;
+    }
+}
+
+/*
+   Finishes the file when the image is complete; otherwise the partial
+   file is removed.  Returns true if a complete file was written.
+*/
+bool png_stream_end(bool complete)
+{
+    if (s_file == nullptr)
+        return false;
+    if (complete)
+    {
+        while (s_row < s_height)
+            end_row();
+        deflate_bytes(nullptr, 0, true);
+        flush_idat(true);
+        write_chunk("IEND", nullptr, 0);
+    }
+#ifdef HAVE_ZLIB
+    deflateEnd(&s_zstream);
+#endif
+    bool const ok = complete && !ferror(s_file);
+    fclose(s_file);
+    s_file = nullptr;
+    if (!ok)
+        remove(s_filename);
+    std::vector<BYTE>().swap(s_cur);
+    std::vector<BYTE>().swap(s_prev);
+    std::vector<BYTE>().swap(s_filtered);
+    std::vector<BYTE>().swap(s_idat);
+    return ok;
+}
@@ -1942,12 +1942,15 @@ int skip_comment(FILE *infile, long *file_offset)
 
 #define MAXENTRIES 2000L
 
-int scan_entries(FILE * infile, entryinfo *choices, char *itemname)
+static int scan_entries(FILE *infile, entryinfo *choices, const char *itemname,
+    std::map<std::string, long> *index)
 {
     /*
     function returns the number of entries found; if a
     specific entry is being looked for, returns -1 if
-    the entry is found, 0 otherwise.
+    the entry is found, 0 otherwise.  With an index, every
+    entry name, prefix included, is put in it with the offset
+    a search for that name would leave the file at.
     */
     char buf[101];
     int exclude_entry;
@@ -2044,6 +2047,11 @@ top:
                     return -1;
                 }
             }
+            else if (index != nullptr)
+            {
+                strlwr(buf);
+                index->insert(std::make_pair(std::string(buf), name_offset + (long) exclude_entry));
+            }
             else // make a whole list of entries
             {
                 if (buf[0] != 0 && stricmp(buf, "comment") != 0 && !exclude_entry)
@@ -2065,6 +2073,16 @@ top:
     return numentries;
 }
 
+int scan_entries(FILE *infile, entryinfo *choices, char *itemname)
+{
+    return scan_entries(infile, choices, itemname, nullptr);
+}
+
+void index_entries(FILE *infile, std::map<std::string, long> &index)
+{
+    scan_entries(infile, nullptr, nullptr, &index);
+}
+
 // subrtn of get_file_entry, separated so that storage gets freed up
 static long gfe_choose_entry(int type, const char *title, char *filename, char *entryname)
 {
@@ -0,0 +1,111 @@
+/*
+        Render server: batch mode that keeps running, taking one image
+        after another from a spool directory.
+*/
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+#include <string.h>
+#ifdef XFRACT
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+#include "port.h"
+#include "prototyp.h"
+
+/*
+   A job is a file NAME.job in the server= directory holding command line
+   arguments, for instance
+
+        @myimages.par/spiral viewwindows=1/0/yes/160/120 savename=spiral
+
+   Jobs are taken in order of name.  A job is claimed by renaming it to
+   NAME.run, so several servers may share one directory, and afterwards
+   it is renamed to NAME.done, or NAME.err when it failed.  The image is
+   saved as NAME.gif in the spool directory unless the job gives its own
+   savename=.  A file named "stop" in the directory makes the server exit
+   once it is idle.
+*/
+
+static std::string s_job;               // name of the job being run, if any
+
+static std::string spool_file(std::string const &name, const char *ext)
+{
+    return std::string(g_server_dir) + name + ext;
+}
+
+// names of the waiting jobs, without the .job extension, in order
+static std::vector<std::string> waiting_jobs()
+{
+    std::vector<std::string> jobs;
+#ifdef XFRACT
+    // fr_findnext() cuts names to 8.3, so read the directory here
+    if (DIR *dir = opendir(g_server_dir))
+    {
+        while (dirent *entry = readdir(dir))
+        {
+            size_t const len = strlen(entry->d_name);
+            if (len > 4 && strcmp(entry->d_name + len - 4, ".job") == 0)
+                jobs.push_back(std::string(entry->d_name, len - 4));
+        }
+        closedir(dir);
+    }
+#else
+    char mask[FILE_MAX_PATH];
+    sprintf(mask, "%s*.job", g_server_dir);
+    for (int out = fr_findfirst(mask); out == 0; out = fr_findnext())
+    {
+        size_t const len = strlen(DTA.filename);
+        if (!(DTA.attribute & SUBDIR) && len > 4)
+            jobs.push_back(std::string(DTA.filename, len - 4));
+    }
+#endif
+    std::sort(jobs.begin(), jobs.end());
+    return jobs;
+}
+
+static void finish_job()
+{
+    if (s_job.empty())
+        return;
+    // initbatch is 2 once the image has been saved
+    std::string const result = spool_file(s_job, initbatch == 2 ? ".done" : ".err");
+    remove(result.c_str());
+    rename(spool_file(s_job, ".run").c_str(), result.c_str());
+    s_job.clear();
+}
+
+/*
+   server_next_job() finishes the current job, if any, and waits for the
+   next one.  Returns true with the next image set up, or false when the
+   server should stop.
+*/
+bool server_next_job()
+{
+    finish_job();
+    while (true)
+    {
+        if (FILE *stop = fopen(spool_file("stop", "").c_str(), "r"))
+        {
+            fclose(stop);
+            return false;
+        }
+        std::vector<std::string> const jobs = waiting_jobs();
+        for (std::string const &job : jobs)
+        {
+            if (rename(spool_file(job, ".job").c_str(), spool_file(job, ".run").c_str()) != 0)
+                continue;                       // another server took it
+            s_job = job;
+            if (server_job(spool_file(job, ".run").c_str(), spool_file(job, ".gif").c_str()) == 0)
+                return true;
+            finish_job();
+        }
+        if (jobs.empty())
+            std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    }
+}
@@ -11,16 +11,24 @@
  * <URL:http://www.cs.tu-berlin.de/~rms/AlmondBread>.
  *
  */
+#include <atomic>
+#include <memory>
+#include <vector>
+
 #include <float.h>
 #include <time.h>
 #include <string.h>
 #if !defined(_WIN32)
 #include <malloc.h>
 #endif
+#if defined(__x86_64__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 #include "port.h"
 #include "prototyp.h"
 #include "drivers.h"
 #include "fractype.h"
+#include "workpool.h"
 
 #define DBLS double
 #define FABS(x)  fabs(x)
@@ -29,6 +37,15 @@
 #define EVERY 15
 #define BASIN_COLOR 0
 
+/* The key values and test points of a rectangle are iterated as a batch,
+   with SSE2 two at a time; that is the same arithmetic as scalar doubles
+   do there. */
+#if defined(__x86_64__) || defined(_M_X64)
+#define SOI_SIMD 1
+#else
+#define SOI_SIMD 0
+#endif
+
 extern int rhombus_stack[10];
 extern int rhombus_depth;
 extern int max_rhombus_depth;
@@ -55,17 +72,159 @@ static long iteration(DBLS cr, DBLS ci,
     return (start);
 }
 
-static void puthline(int x1, int y1, int x2, int color)
+static bool s_asm_bailout = false;      // floatbailout is asmfpMODbailout
+
+/* iteration() for the mandel orbit with the mod bailout, the arithmetic of
+   JuliafpFractal() and floatbailout() without the globals, so the threads
+   can share it. */
+static long mandel_iteration(DBLS cr, DBLS ci,
+                             DBLS re, DBLS im,
+                             long start)
 {
-    int x;
-    for (x = x1; x <= x2; x++)
-        (*plot)(x, y1, color);
+    DBLS sqrx = sqr(re);
+    DBLS sqry = sqr(im);
+    while (true)
+    {
+        DBLS const nx = sqrx - sqry + cr;
+        DBLS const ny = 2.0 * re * im + ci;
+        sqrx = sqr(nx);
+        sqry = sqr(ny);
+        DBLS const mag = sqrx + sqry;
+        if (s_asm_bailout ? mag > rqlim || mag < 0.0 || fabs(nx) > rqlim2 || fabs(ny) > rqlim2
+                : mag >= rqlim)
+            break;
+        re = nx;
+        im = ny;
+        if (start >= maxit)
+            break;
+        start++;
+    }
+    if (start >= maxit)
+        start = BASIN_COLOR;
+    return (start);
 }
 
-static void putbox(int x1, int y1, int x2, int y2, int color)
+/*
+   With more than one thread, a rectangle of SOI_TASK pixels or more hands
+   the four parts it splits into to the work pool as separate tasks; the
+   smaller ones recurse within their task.  A rectangle depends only on its
+   corners and key values, so a part comes out the same either way.  The
+   tasks record what they plot, and this thread plots it in the order of
+   the recursion, since putbox() draws over the edges of its neighbors.
+*/
+#define SOI_TASK 4096
+
+struct soi_rhombus              // the arguments of rhombus()
+{
+    DBLS cre1, cre2, cim1, cim2;
+    int x1, x2, y1, y2;
+    long iter;
+    DBLS zre[9], zim[9];        // key values
+};
+
+struct soi_plot                 // a box, line or point to plot
+{
+    int x1, y1, x2, y2;
+    int color;
+};
+
+struct soi_node                 // a task's rectangle and what came of it
+{
+    soi_rhombus rh;
+    std::vector<soi_plot> plots;
+    std::vector<std::unique_ptr<soi_node>> parts;
+    std::atomic<bool> done;
+    bool shown;
+    explicit soi_node(soi_rhombus const &r) : rh(r), done(false), shown(false)
+    {
+    }
+};
+
+struct soi_job
 {
+    work_pool *pool;            // nullptr for the serial recursion
+    soi_node *node;             // the task's node, which collects the plots
+};
+
+static bool soi_stop(soi_job const &job)
+{
+    return job.pool != nullptr ? job.pool->cancelled() : driver_key_pressed() != 0;
+}
+
+static long soi_iteration(soi_job const &job, DBLS cr, DBLS ci, DBLS re, DBLS im, long start)
+{
+    return job.pool != nullptr ? mandel_iteration(cr, ci, re, im, start)
+           : iteration(cr, ci, re, im, start);
+}
+
+static void putbox(soi_job &job, int x1, int y1, int x2, int y2, int color)
+{
+    if (job.node != nullptr)
+    {
+        soi_plot const p = { x1, y1, x2, y2, color };
+        job.node->plots.push_back(p);
+        return;
+    }
     for (; y1 <= y2; y1++)
-        puthline(x1, y1, x2, color);
+        for (int x = x1; x <= x2; x++)
+            (*plot)(x, y1, color);
+}
+
+static void puthline(soi_job &job, int x1, int y1, int x2, int color)
+{
+    putbox(job, x1, y1, x2, y1, color);
+}
+
+static void putpoint(soi_job &job, int x, int y, int color)
+{
+    putbox(job, x, y, x, y, color);
+}
+
+// nine key values, four test points and a spare to make SSE2 pairs
+#define SOI_ORBITS 14
+
+struct soi_orbits
+{
+    DBLS zr[SOI_ORBITS], zi[SOI_ORBITS];
+    DBLS rq[SOI_ORBITS], iq[SOI_ORBITS];   // zr*zr, zi*zi
+    DBLS cr[SOI_ORBITS], ci[SOI_ORBITS];
+};
+
+// iterate all the orbits once, true if one of them bails out
+static bool soi_step(soi_orbits &o)
+{
+#if SOI_SIMD
+    __m128d const bail = _mm_set1_pd(16.0);
+    __m128d esc = _mm_setzero_pd();
+    for (int k = 0; k < SOI_ORBITS; k += 2)
+    {
+        __m128d zr = _mm_loadu_pd(&o.zr[k]);
+        __m128d zi = _mm_loadu_pd(&o.zi[k]);
+        zi = _mm_add_pd(_mm_mul_pd(_mm_add_pd(zi, zi), zr), _mm_loadu_pd(&o.ci[k]));
+        zr = _mm_add_pd(_mm_sub_pd(_mm_loadu_pd(&o.rq[k]), _mm_loadu_pd(&o.iq[k])),
+                        _mm_loadu_pd(&o.cr[k]));
+        __m128d const rq = _mm_mul_pd(zr, zr);
+        __m128d const iq = _mm_mul_pd(zi, zi);
+        esc = _mm_or_pd(esc, _mm_cmpgt_pd(_mm_add_pd(rq, iq), bail));
+        _mm_storeu_pd(&o.zr[k], zr);
+        _mm_storeu_pd(&o.zi[k], zi);
+        _mm_storeu_pd(&o.rq[k], rq);
+        _mm_storeu_pd(&o.iq[k], iq);
+    }
+    return _mm_movemask_pd(esc) != 0;
+#else
+    bool esc = false;
+    for (int k = 0; k < SOI_ORBITS; k++)
+    {
+        o.zi[k] = (o.zi[k]+o.zi[k])*o.zr[k]+o.ci[k];
+        o.zr[k] = o.rq[k]-o.iq[k]+o.cr[k];
+        o.rq[k] = o.zr[k]*o.zr[k];
+        o.iq[k] = o.zi[k]*o.zi[k];
+        if ((o.rq[k]+o.iq[k]) > 16.0)
+            esc = true;
+    }
+    return esc;
+#endif
 }
 
 /* maximum side length beyond which we start regular scanning instead of
@@ -169,207 +328,205 @@ static DBLS interpolate(DBLS x0, DBLS x1, DBLS x2,
 
       iter       : current number of iterations
       */
-static DBLS zre1, zim1, zre2, zim2, zre3, zim3, zre4, zim4, zre5, zim5,
-       zre6, zim6, zre7, zim7, zre8, zim8, zre9, zim9;
+static int rhombus(soi_job &job, soi_rhombus const &rh);
+
 /*
    The purpose of this macro is to reduce the number of parameters of the
-   function rhombus(), since this is a recursive function, and stack space
-   under DOS is extremely limited.
+   function rhombus(), since this is a recursive function.
 */
 
 #define RHOMBUS(CRE1, CRE2, CIM1, CIM2, X1, X2, Y1, Y2, ZRE1, ZIM1, ZRE2, ZIM2, ZRE3, ZIM3, \
  ZRE4, ZIM4, ZRE5, ZIM5, ZRE6, ZIM6, ZRE7, ZIM7, ZRE8, ZIM8, ZRE9, ZIM9, ITER) \
- zre1 = (ZRE1);zim1 = (ZIM1);\
- zre2 = (ZRE2);zim2 = (ZIM2);\
- zre3 = (ZRE3);zim3 = (ZIM3);\
- zre4 = (ZRE4);zim4 = (ZIM4);\
- zre5 = (ZRE5);zim5 = (ZIM5);\
- zre6 = (ZRE6);zim6 = (ZIM6);\
- zre7 = (ZRE7);zim7 = (ZIM7);\
- zre8 = (ZRE8);zim8 = (ZIM8);\
- zre9 = (ZRE9);zim9 = (ZIM9);\
- status = rhombus((CRE1), (CRE2), (CIM1), (CIM2), (X1), (X2), (Y1), (Y2), (ITER)) != 0
-
-static int rhombus(DBLS cre1, DBLS cre2, DBLS cim1, DBLS cim2,
-                   int x1, int x2, int y1, int y2, long iter)
+ {\
+     soi_rhombus const part = { (CRE1), (CRE2), (CIM1), (CIM2), (X1), (X2), (Y1), (Y2), (ITER),\
+        { (ZRE1), (ZRE2), (ZRE3), (ZRE4), (ZRE5), (ZRE6), (ZRE7), (ZRE8), (ZRE9) },\
+        { (ZIM1), (ZIM2), (ZIM3), (ZIM4), (ZIM5), (ZIM6), (ZIM7), (ZIM8), (ZIM9) } };\
+     status = rhombus_part(job, spawn, part) != 0;\
+ }
+
+// recurse into a part of a split rectangle, or leave it for a task
+static int rhombus_part(soi_job &job, bool spawn, soi_rhombus const &part)
 {
-    // The following variables do not need their values saved
+    if (!spawn)
+        return rhombus(job, part);
+    job.node->parts.emplace_back(new soi_node(part));
+    return 0;
+}
+
+static void soi_task(work_pool &pool, soi_node &node)
+{
+    if (pool.cancelled())
+        return;
+    soi_job job = { &pool, &node };
+    if (rhombus(job, node.rh) != 0)
+        return;                         // cancelled
+    node.done = true;
+    // the first part is pushed last, so this thread takes it next
+    for (auto part = node.parts.rbegin(); part != node.parts.rend(); ++part)
+    {
+        soi_node *next = part->get();
+        pool.push([&pool, next](int)
+        {
+            soi_task(pool, *next);
+        });
+    }
+}
+
+// plot what the finished tasks recorded, as far as the recursion order allows
+static bool soi_show(soi_node &node)
+{
+    if (node.shown)
+        return true;
+    if (!node.done)
+        return false;
+    for (soi_plot const &p : node.plots)
+        for (int y = p.y1; y <= p.y2; y++)
+            for (int x = p.x1; x <= p.x2; x++)
+                (*plot)(x, y, p.color);
+    std::vector<soi_plot>().swap(node.plots);
+    for (auto const &part : node.parts)
+        if (!soi_show(*part))
+            return false;
+    node.shown = true;
+    return true;
+}
+
+static void soi_pool(soi_rhombus const &rh)
+{
+    s_asm_bailout = floatbailout == asmfpMODbailout;
+    soi_node root(rh);
+    work_pool pool(work_pool_threads());
+    soi_node *node = &root;
+    pool.push([&pool, node](int)
+    {
+        soi_task(pool, *node);
+    });
+    bool interrupted = false;
+    bool all_done;
+    do
+    {
+        all_done = pool.wait(10);
+        soi_show(root);
+        if (!all_done && !interrupted && driver_key_pressed())
+        {
+            interrupted = true;
+            pool.cancel();
+        }
+    }
+    while (!all_done);
+}
+
+// can the rectangles be handed to the work pool?
+static bool soi_pool_ok()
+{
+    return work_pool_threads() > 1
+        && bf_math == bf_math_type::NONE
+        && ORBITCALC == JuliafpFractal
+        && (floatbailout == fpMODbailout || floatbailout == asmfpMODbailout);
+}
+
+static int rhombus(soi_job &job, soi_rhombus const &rh)
+{
+    DBLS const cre1 = rh.cre1, cre2 = rh.cre2, cim1 = rh.cim1, cim2 = rh.cim2;
+    int const x1 = rh.x1, x2 = rh.x2, y1 = rh.y1, y2 = rh.y2;
+    long iter = rh.iter;
+
     // used in scanning
-    static long savecolor, color, helpcolor;
-    static int x, y, z, savex;
-
-#define re        mem_static[ 0]
-#define im        mem_static[ 1]
-#define restep    mem_static[ 2]
-#define imstep    mem_static[ 3]
-#define interstep mem_static[ 4]
-#define helpre    mem_static[ 5]
-#define zre       mem_static[ 6]
-#define zim       mem_static[ 7]
-#define br10      mem_static[ 8]
-#define br11      mem_static[ 9]
-#define br12      mem_static[10]
-#define br20      mem_static[11]
-#define br21      mem_static[12]
-#define br22      mem_static[13]
-#define br30      mem_static[14]
-#define br31      mem_static[15]
-#define br32      mem_static[16]
-#define bi10      mem_static[17]
-#define bi11      mem_static[18]
-#define bi12      mem_static[19]
-#define bi20      mem_static[20]
-#define bi21      mem_static[21]
-#define bi22      mem_static[22]
-#define bi30      mem_static[23]
-#define bi31      mem_static[24]
-#define bi32      mem_static[25]
-#define l1        mem_static[26]
-#define l2        mem_static[27]
-#define rq1       mem_static[28]
-#define iq1       mem_static[29]
-#define rq2       mem_static[30]
-#define iq2       mem_static[31]
-#define rq3       mem_static[32]
-#define iq3       mem_static[33]
-#define rq4       mem_static[34]
-#define iq4       mem_static[35]
-#define rq5       mem_static[36]
-#define iq5       mem_static[37]
-#define rq6       mem_static[38]
-#define iq6       mem_static[39]
-#define rq7       mem_static[40]
-#define iq7       mem_static[41]
-#define rq8       mem_static[42]
-#define iq8       mem_static[43]
-#define rq9       mem_static[44]
-#define iq9       mem_static[45]
-#define cr1       mem_static[46]
-#define cr2       mem_static[47]
-#define ci1       mem_static[48]
-#define ci2       mem_static[49]
-#define tzr1      mem_static[50]
-#define tzi1      mem_static[51]
-#define tzr2      mem_static[52]
-#define tzi2      mem_static[53]
-#define tzr3      mem_static[54]
-#define tzi3      mem_static[55]
-#define tzr4      mem_static[56]
-#define tzi4      mem_static[57]
-#define trq1      mem_static[58]
-#define tiq1      mem_static[59]
-#define trq2      mem_static[60]
-#define tiq2      mem_static[61]
-#define trq3      mem_static[62]
-#define tiq3      mem_static[63]
-#define trq4      mem_static[64]
-#define tiq4      mem_static[65]
+    long savecolor, color, helpcolor;
+    int x, y, z, savex;
+    DBLS re, im, restep, imstep, interstep, helpre, zre, zim;
+    DBLS br10, br11, br12, br20, br21, br22, br30, br31, br32;
+    DBLS bi10, bi11, bi12, bi20, bi21, bi22, bi30, bi31, bi32;
+    DBLS l1, l2;
+    // the test points
+    DBLS cr1, cr2, ci1, ci2;
 
     // number of iterations before SOI iteration cycle
-    static long before;
-    static int avail;
-
-    // the variables below need to have local copies for recursive calls
-    int  *mem_int;
-    DBLS *mem;
-    DBLS *mem_static;
+    long before;
+    int avail;
+
+    // the key values and test points, iterated together
+    soi_orbits orb;
+    // the key values before the iteration that failed
+    DBLS sr1, si1, sr2, si2, sr3, si3, sr4, si4, sr5, si5, sr6, si6, sr7, si7,
+         sr8, si8, sr9, si9;
+    // key values of the parts
+    DBLS re10, re11, re12, re13, re14, re15, re16, re17, re18, re19, re20, re21;
+    DBLS im10, im11, im12, im13, im14, im15, im16, im17, im18, im19, im20, im21;
+    DBLS re91, re92, re93, re94, im91, im92, im93, im94;
     // center of rectangle
     DBLS midr = (cre1+cre2)/2, midi = (cim1+cim2)/2;
-
-#define esc1  mem_int[0]
-#define esc2  mem_int[1]
-#define esc3  mem_int[2]
-#define esc4  mem_int[3]
-#define esc5  mem_int[4]
-#define esc6  mem_int[5]
-#define esc7  mem_int[6]
-#define esc8  mem_int[7]
-#define esc9  mem_int[8]
-#define tesc1 mem_int[9]
-#define tesc2 mem_int[10]
-#define tesc3 mem_int[11]
-#define tesc4 mem_int[12]
-
-#define sr1  mem[ 0]
-#define si1  mem[ 1]
-#define sr2  mem[ 2]
-#define si2  mem[ 3]
-#define sr3  mem[ 4]
-#define si3  mem[ 5]
-#define sr4  mem[ 6]
-#define si4  mem[ 7]
-#define sr5  mem[ 8]
-#define si5  mem[ 9]
-#define sr6  mem[10]
-#define si6  mem[11]
-#define sr7  mem[12]
-#define si7  mem[13]
-#define sr8  mem[14]
-#define si8  mem[15]
-#define sr9  mem[16]
-#define si9  mem[17]
-#define re10 mem[18]
-#define re11 mem[19]
-#define re12 mem[20]
-#define re13 mem[21]
-#define re14 mem[22]
-#define re15 mem[23]
-#define re16 mem[24]
-#define re17 mem[25]
-#define re18 mem[26]
-#define re19 mem[27]
-#define re20 mem[28]
-#define re21 mem[29]
-#define im10 mem[30]
-#define im11 mem[31]
-#define im12 mem[32]
-#define im13 mem[33]
-#define im14 mem[34]
-#define im15 mem[35]
-#define im16 mem[36]
-#define im17 mem[37]
-#define im18 mem[38]
-#define im19 mem[39]
-#define im20 mem[40]
-#define im21 mem[41]
-#define re91 mem[42]
-#define re92 mem[43]
-#define re93 mem[44]
-#define re94 mem[45]
-#define im91 mem[46]
-#define im92 mem[47]
-#define im93 mem[48]
-#define im94 mem[49]
+    bool spawn;
+
+#define zre1 orb.zr[0]
+#define zim1 orb.zi[0]
+#define zre2 orb.zr[1]
+#define zim2 orb.zi[1]
+#define zre3 orb.zr[2]
+#define zim3 orb.zi[2]
+#define zre4 orb.zr[3]
+#define zim4 orb.zi[3]
+#define zre5 orb.zr[4]
+#define zim5 orb.zi[4]
+#define zre6 orb.zr[5]
+#define zim6 orb.zi[5]
+#define zre7 orb.zr[6]
+#define zim7 orb.zi[6]
+#define zre8 orb.zr[7]
+#define zim8 orb.zi[7]
+#define zre9 orb.zr[8]
+#define zim9 orb.zi[8]
+#define tzr1 orb.zr[9]
+#define tzi1 orb.zi[9]
+#define tzr2 orb.zr[10]
+#define tzi2 orb.zi[10]
+#define tzr3 orb.zr[11]
+#define tzi3 orb.zi[11]
+#define tzr4 orb.zr[12]
+#define tzi4 orb.zi[12]
+#define trq1 orb.rq[9]
+#define tiq1 orb.iq[9]
+#define trq2 orb.rq[10]
+#define tiq2 orb.iq[10]
+#define trq3 orb.rq[11]
+#define tiq3 orb.iq[11]
+#define trq4 orb.rq[12]
+#define tiq4 orb.iq[12]
 
     bool status = false;
-    rhombus_depth++;
-
-#if 1
-    /* what we go through under DOS to deal with memory! We re-use
-       the sizeofstring array (8k). The first 660 bytes is for
-       static variables, then we make our own "stack" with copies
-       for each recursive call of rhombus() for the rest.
-     */
-    mem_int    = (int *)sizeofstring;
-    mem_static = (DBLS *)(mem_int + 13);
-    mem = mem_static+ 66 + 50*rhombus_depth;
-#endif
-
-    avail = stackavail();
-    if (avail < minstackavail)
-        minstackavail = avail;
-    if (rhombus_depth > max_rhombus_depth)
-        max_rhombus_depth = rhombus_depth;
-    rhombus_stack[rhombus_depth] = avail;
+    if (job.pool == nullptr)
+    {
+        rhombus_depth++;
+        avail = stackavail();
+        if (avail < minstackavail)
+            minstackavail = avail;
+        if (rhombus_depth > max_rhombus_depth)
+            max_rhombus_depth = rhombus_depth;
+        rhombus_stack[rhombus_depth] = avail;
+    }
+    else
+        avail = minstack;               // the stack of a thread is no concern
 
-    if (driver_key_pressed())
+    for (int k = 0; k < 9; k++)
+    {
+        orb.zr[k] = rh.zre[k];
+        orb.zi[k] = rh.zim[k];
+    }
+    orb.zr[13] = 0;                     // the spare stays at 0
+    orb.zi[13] = 0;
+    orb.rq[13] = 0;
+    orb.iq[13] = 0;
+    orb.cr[13] = 0;
+    orb.ci[13] = 0;
+
+    if (soi_stop(job))
     {
         status = true;
         goto rhombus_done;
     }
     if (iter > maxit)
     {
-        putbox(x1, y1, x2, y2, 0);
+        putbox(job, x1, y1, x2, y2, 0);
         status = false;
         goto rhombus_done;
     }
@@ -392,7 +549,7 @@ scan:
 
         for (y = y1, im = cim1; y < y2; y++, im += imstep)
         {
-            if (driver_key_pressed())
+            if (soi_stop(job))
             {
                 status = true;
                 goto rhombus_done;
@@ -400,7 +557,7 @@ scan:
             // cppcheck-suppress duplicateExpression
             zre = GET_SCAN_REAL(cre1, im);
             zim = GET_SCAN_IMAG(cre1, im);
-            savecolor = iteration(cre1, im, zre, zim, iter);
+            savecolor = soi_iteration(job, cre1, im, zre, zim, iter);
             if (savecolor < 0)
             {
                 status = true;
@@ -413,7 +570,7 @@ scan:
                 zre = GET_SCAN_REAL(re, im);
                 zim = GET_SCAN_IMAG(re, im);
 
-                color = iteration(re, im, zre, zim, iter);
+                color = soi_iteration(job, re, im, zre, zim, iter);
                 if (color < 0)
                 {
                     status = true;
@@ -426,7 +583,7 @@ scan:
                 {
                     zre = GET_SCAN_REAL(helpre, im);
                     zim = GET_SCAN_IMAG(helpre, im);
-                    helpcolor = iteration(helpre, im, zre, zim, iter);
+                    helpcolor = soi_iteration(job, helpre, im, zre, zim, iter);
                     if (helpcolor < 0)
                     {
                         status = true;
@@ -434,13 +591,13 @@ scan:
                     }
                     else if (helpcolor == savecolor)
                         break;
-                    (*plot)(z, y, (int)(helpcolor&255));
+                    putpoint(job, z, y, (int)(helpcolor&255));
                 }
 
                 if (savex < z)
-                    puthline(savex, y, z, (int)(savecolor&255));
+                    puthline(job, savex, y, z, (int)(savecolor&255));
                 else
-                    (*plot)(savex, y, (int)(savecolor&255));
+                    putpoint(job, savex, y, (int)(savecolor&255));
 
                 savex = x;
                 savecolor = color;
@@ -450,7 +607,7 @@ scan:
             {
                 zre = GET_SCAN_REAL(helpre, im);
                 zim = GET_SCAN_IMAG(helpre, im);
-                helpcolor = iteration(helpre, im, zre, zim, iter);
+                helpcolor = soi_iteration(job, helpre, im, zre, zim, iter);
                 if (helpcolor < 0)
                 {
                     status = true;
@@ -459,36 +616,23 @@ scan:
                 else if (helpcolor == savecolor)
                     break;
 
-                (*plot)(z, y, (int)(helpcolor&255));
+                putpoint(job, z, y, (int)(helpcolor&255));
             }
 
             if (savex < z)
-                puthline(savex, y, z, (int)(savecolor&255));
+                puthline(job, savex, y, z, (int)(savecolor&255));
             else
-                (*plot)(savex, y, (int)(savecolor&255));
+                putpoint(job, savex, y, (int)(savecolor&255));
         }
         status = false;
         goto rhombus_done;
     }
 
-    rq1 = zre1*zre1;
-    iq1 = zim1*zim1;
-    rq2 = zre2*zre2;
-    iq2 = zim2*zim2;
-    rq3 = zre3*zre3;
-    iq3 = zim3*zim3;
-    rq4 = zre4*zre4;
-    iq4 = zim4*zim4;
-    rq5 = zre5*zre5;
-    iq5 = zim5*zim5;
-    rq6 = zre6*zre6;
-    iq6 = zim6*zim6;
-    rq7 = zre7*zre7;
-    iq7 = zim7*zim7;
-    rq8 = zre8*zre8;
-    iq8 = zim8*zim8;
-    rq9 = zre9*zre9;
-    iq9 = zim9*zim9;
+    for (int k = 0; k < 9; k++)
+    {
+        orb.rq[k] = orb.zr[k]*orb.zr[k];
+        orb.iq[k] = orb.zi[k]*orb.zi[k];
+    }
 
     cr1 = 0.75*cre1+0.25*cre2;
     cr2 = 0.25*cre1+0.75*cre2;
@@ -519,6 +663,34 @@ scan:
     trq4 = tzr4*tzr4;
     tiq4 = tzi4*tzi4;
 
+    // the c of each orbit
+    orb.cr[0] = cre1;
+    orb.ci[0] = cim1;
+    orb.cr[1] = cre2;
+    orb.ci[1] = cim1;
+    orb.cr[2] = cre1;
+    orb.ci[2] = cim2;
+    orb.cr[3] = cre2;
+    orb.ci[3] = cim2;
+    orb.cr[4] = midr;
+    orb.ci[4] = cim1;
+    orb.cr[5] = cre1;
+    orb.ci[5] = midi;
+    orb.cr[6] = cre2;
+    orb.ci[6] = midi;
+    orb.cr[7] = midr;
+    orb.ci[7] = cim2;
+    orb.cr[8] = midr;
+    orb.ci[8] = midi;
+    orb.cr[9] = cr1;
+    orb.ci[9] = ci1;
+    orb.cr[10] = cr2;
+    orb.ci[10] = ci1;
+    orb.cr[11] = cr1;
+    orb.ci[11] = ci2;
+    orb.cr[12] = cr2;
+    orb.ci[12] = ci2;
+
     before = iter;
 
     while (1)
@@ -542,142 +714,12 @@ scan:
         sr9 = zre9;
         si9 = zim9;
 
-
-#define SOI_ORBIT1(zr, rq, zi, iq, cr, ci, esc) \
-        tempsqrx = rq;\
-        tempsqry = iq;\
-        old.x = zr;\
-        old.y = zi;\
-        floatparm->x = cr;\
-        floatparm->y = ci;\
-        esc = ORBITCALC();\
-        rq = tempsqrx;\
-        iq = tempsqry;\
-        zr = new.x;\
-        zi = new.y
-
-#define SOI_ORBIT(zr, rq, zi, iq, cr, ci, esc) \
-      zi = (zi+zi)*zr+ci;\
-      zr = rq-iq+cr;\
-      rq = zr*zr;\
-      iq = zi*zi;\
-      esc = ((rq+iq) > 16.0)?1:0
-
-        // iterate key values
-        SOI_ORBIT(zre1, rq1, zim1, iq1, cre1, cim1, esc1);
-        /*
-              zim1=(zim1+zim1)*zre1+cim1;
-              zre1=rq1-iq1+cre1;
-              rq1=zre1*zre1;
-              iq1=zim1*zim1;
-        */
-        SOI_ORBIT(zre2, rq2, zim2, iq2, cre2, cim1, esc2);
-        /*
-              zim2=(zim2+zim2)*zre2+cim1;
-              zre2=rq2-iq2+cre2;
-              rq2=zre2*zre2;
-              iq2=zim2*zim2;
-        */
-        SOI_ORBIT(zre3, rq3, zim3, iq3, cre1, cim2, esc3);
-        /*
-              zim3=(zim3+zim3)*zre3+cim2;
-              zre3=rq3-iq3+cre1;
-              rq3=zre3*zre3;
-              iq3=zim3*zim3;
-        */
-        SOI_ORBIT(zre4, rq4, zim4, iq4, cre2, cim2, esc4);
-        /*
-              zim4=(zim4+zim4)*zre4+cim2;
-              zre4=rq4-iq4+cre2;
-              rq4=zre4*zre4;
-              iq4=zim4*zim4;
-        */
-        SOI_ORBIT(zre5, rq5, zim5, iq5, midr, cim1, esc5);
-        /*
-              zim5=(zim5+zim5)*zre5+cim1;
-              zre5=rq5-iq5+midr;
-              rq5=zre5*zre5;
-              iq5=zim5*zim5;
-        */
-        SOI_ORBIT(zre6, rq6, zim6, iq6, cre1, midi, esc6);
-        /*
-              zim6=(zim6+zim6)*zre6+midi;
-              zre6=rq6-iq6+cre1;
-              rq6=zre6*zre6;
-              iq6=zim6*zim6;
-        */
-        SOI_ORBIT(zre7, rq7, zim7, iq7, cre2, midi, esc7);
-        /*
-              zim7=(zim7+zim7)*zre7+midi;
-              zre7=rq7-iq7+cre2;
-              rq7=zre7*zre7;
-              iq7=zim7*zim7;
-        */
-        SOI_ORBIT(zre8, rq8, zim8, iq8, midr, cim2, esc8);
-        /*
-              zim8=(zim8+zim8)*zre8+cim2;
-              zre8=rq8-iq8+midr;
-              rq8=zre8*zre8;
-              iq8=zim8*zim8;
-        */
-        SOI_ORBIT(zre9, rq9, zim9, iq9, midr, midi, esc9);
-        /*
-              zim9=(zim9+zim9)*zre9+midi;
-              zre9=rq9-iq9+midr;
-              rq9=zre9*zre9;
-              iq9=zim9*zim9;
-        */
-        // iterate test point
-        SOI_ORBIT(tzr1, trq1, tzi1, tiq1, cr1, ci1, tesc1);
-        /*
-              tzi1=(tzi1+tzi1)*tzr1+ci1;
-              tzr1=trq1-tiq1+cr1;
-              trq1=tzr1*tzr1;
-              tiq1=tzi1*tzi1;
-        */
-
-        SOI_ORBIT(tzr2, trq2, tzi2, tiq2, cr2, ci1, tesc2);
-        /*
-              tzi2=(tzi2+tzi2)*tzr2+ci1;
-              tzr2=trq2-tiq2+cr2;
-              trq2=tzr2*tzr2;
-              tiq2=tzi2*tzi2;
-        */
-        SOI_ORBIT(tzr3, trq3, tzi3, tiq3, cr1, ci2, tesc3);
-        /*
-              tzi3=(tzi3+tzi3)*tzr3+ci2;
-              tzr3=trq3-tiq3+cr1;
-              trq3=tzr3*tzr3;
-              tiq3=tzi3*tzi3;
-        */
-        SOI_ORBIT(tzr4, trq4, tzi4, tiq4, cr2, ci2, tesc4);
-        /*
-              tzi4=(tzi4+tzi4)*tzr4+ci2;
-              tzr4=trq4-tiq4+cr2;
-              trq4=tzr4*tzr4;
-              tiq4=tzi4*tzi4;
-        */
+        // iterate key values and test points
+        bool const escaped = soi_step(orb);
         iter++;
 
         // if one of the iterated values bails out, subdivide
-        /*
-              if ((rq1+iq1)>16.0||
-             (rq2+iq2)>16.0||
-             (rq3+iq3)>16.0||
-             (rq4+iq4)>16.0||
-             (rq5+iq5)>16.0||
-             (rq6+iq6)>16.0||
-             (rq7+iq7)>16.0||
-             (rq8+iq8)>16.0||
-             (rq9+iq9)>16.0||
-             (trq1+tiq1)>16.0||
-             (trq2+tiq2)>16.0||
-             (trq3+tiq3)>16.0||
-             (trq4+tiq4)>16.0)
-            break;
-        */
-        if (esc1||esc2||esc3||esc4||esc5||esc6||esc7||esc8||esc9||
-                tesc1||tesc2||tesc3||tesc4)
+        if (escaped)
             break;
 
         /* if maximum number of iterations is reached, the whole rectangle
@@ -685,7 +727,7 @@ scan:
         of SOI, we seldomly get there */
         if (iter > maxit)
         {
-            putbox(x1, y1, x2, y2, 0);
+            putbox(job, x1, y1, x2, y2, 0);
             status = false;
             goto rhombus_done;
         }
@@ -823,6 +865,8 @@ scan:
     im93 = GET_SAVED_IMAG(cr1, ci2);
     im94 = GET_SAVED_IMAG(cr2, ci2);
 
+    spawn = job.pool != nullptr && (long)(x2-x1)*(y2-y1) >= SOI_TASK;
+
     RHOMBUS(cre1, midr, cim1, midi, x1, ((x1+x2) >> 1), y1, ((y1+y2) >> 1),
             sr1, si1,
             sr5, si5,
@@ -868,14 +912,13 @@ scan:
             re94, im94,
             iter);
 rhombus_done:
-    rhombus_depth--;
+    if (job.pool == nullptr)
+        rhombus_depth--;
     return status ? 1 : 0;
 }
 
 void soi()
 {
-    // cppcheck-suppress unreadVariable
-    bool status;
     DBLS tolerance = 0.1;
     DBLS stepx, stepy;
     DBLS xxminl, xxmaxl, yyminl, yymaxl;
@@ -901,16 +944,25 @@ void soi()
     stepy = (yyminl - yymaxl) / ydots;
     equal = (stepx < stepy ? stepx : stepy);
 
-    RHOMBUS(xxminl, xxmaxl, yymaxl, yyminl,
-            0, xdots, 0, ydots,
-            xxminl, yymaxl,
-            xxmaxl, yymaxl,
-            xxminl, yyminl,
-            xxmaxl, yyminl,
-            (xxmaxl+xxminl)/2, yymaxl,
-            xxminl, (yymaxl+yyminl)/2,
-            xxmaxl, (yymaxl+yyminl)/2,
-            (xxmaxl+xxminl)/2, yyminl,
-            (xxminl+xxmaxl)/2, (yymaxl+yyminl)/2,
-            1);
+    soi_rhombus const whole =
+    {
+        xxminl, xxmaxl, yymaxl, yyminl,
+        0, xdots, 0, ydots,
+        1,
+        {
+            xxminl, xxmaxl, xxminl, xxmaxl, (xxmaxl+xxminl)/2,
+            xxminl, xxmaxl, (xxmaxl+xxminl)/2, (xxminl+xxmaxl)/2
+        },
+        {
+            yymaxl, yymaxl, yyminl, yyminl, yymaxl,
+            (yymaxl+yyminl)/2, (yymaxl+yyminl)/2, yyminl, (yymaxl+yyminl)/2
+        }
+    };
+    if (soi_pool_ok())
+        soi_pool(whole);
+    else
+    {
+        soi_job job = { nullptr, nullptr };
+        rhombus(job, whole);
+    }
 }
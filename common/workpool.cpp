@@ -0,0 +1,127 @@
+/*
+        Worker thread pool for the parallel calculation engines.
+*/
+#include <chrono>
+
+#include "port.h"
+#include "prototyp.h"
+#include "workpool.h"
+
+// the pool and index of the worker running on this thread, if any
+static thread_local work_pool *s_pool = nullptr;
+static thread_local int s_worker = -1;
+
+work_pool::work_pool(int num_threads)
+    : m_queues(num_threads > 0 ? num_threads : 1),
+      m_queued(0),
+      m_pending(0),
+      m_next(0),
+      m_cancel(false),
+      m_stop(false)
+{
+    for (int i = 0; i < static_cast<int>(m_queues.size()); ++i)
+        m_threads.push_back(std::thread(&work_pool::worker, this, i));
+}
+
+work_pool::~work_pool()
+{
+    cancel();
+    wait(-1);
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_stop = true;
+    }
+    m_work_ready.notify_all();
+    for (std::thread &t : m_threads)
+        t.join();
+}
+
+void work_pool::push(task const &t)
+{
+    int const index = (s_pool == this) ? s_worker : static_cast<int>(m_next++ % m_queues.size());
+    ++m_pending;
+    {
+        std::lock_guard<std::mutex> guard(m_queues[index].lock);
+        m_queues[index].tasks.push_back(t);
+        ++m_queued;
+    }
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_work_ready.notify_one();
+}
+
+bool work_pool::wait(int timeout_ms)
+{
+    std::unique_lock<std::mutex> guard(m_lock);
+    if (timeout_ms < 0)
+    {
+        m_idle.wait(guard, [this] { return m_pending == 0; });
+        return true;
+    }
+    return m_idle.wait_for(guard, std::chrono::milliseconds(timeout_ms),
+                           [this] { return m_pending == 0; });
+}
+
+void work_pool::cancel()
+{
+    m_cancel = true;
+}
+
+// own queue newest first, then steal the oldest from the others
+bool work_pool::pop(int index, task &t)
+{
+    int const n = static_cast<int>(m_queues.size());
+    for (int i = 0; i < n; ++i)
+    {
+        task_queue &q = m_queues[(index + i) % n];
+        std::lock_guard<std::mutex> guard(q.lock);
+        if (!q.tasks.empty())
+        {
+            if (i == 0)
+            {
+                t = q.tasks.back();
+                q.tasks.pop_back();
+            }
+            else
+            {
+                t = q.tasks.front();
+                q.tasks.pop_front();
+            }
+            --m_queued;
+            return true;
+        }
+    }
+    return false;
+}
+
+void work_pool::worker(int index)
+{
+    s_pool = this;
+    s_worker = index;
+    while (true)
+    {
+        task t;
+        if (pop(index, t))
+        {
+            if (!m_cancel)
+                t(index);
+            if (--m_pending == 0)
+            {
+                std::lock_guard<std::mutex> guard(m_lock);
+                m_idle.notify_all();
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> guard(m_lock);
+        m_work_ready.wait(guard, [this] { return m_stop || m_queued > 0; });
+        if (m_stop)
+            break;
+    }
+}
+
+int work_pool_threads()
+{
+    if (g_num_threads > 0)
+        return g_num_threads;
+    int const cores = static_cast<int>(std::thread::hardware_concurrency());
+    return cores > 0 ? cores : 1;
+}
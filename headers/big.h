@@ -22,7 +22,9 @@ enum class bf_math_type
 {
     NONE = 0,
     BIGNUM = 1,         // bf_math is being used with bn_t numbers
-    BIGFLT = 2          // bf_math is being used with bf_t numbers
+    BIGFLT = 2,         // bf_math is being used with bf_t numbers
+    PERTURBATION = 3,   // bf_t reference orbit, pixels iterate double deltas
+    DOUBLE_DOUBLE = 4   // bf_t corners, pixels iterate double-doubles
 };
 #ifdef BIG_ANSI_C
 #define USE_BIGNUM_C_CODE
@@ -52,6 +54,7 @@ extern bf_math_type bf_math;
 extern int bnstep, intlength;
 extern int bnlength, rlength,   padding,   decimals,   shiftfactor;
 extern int bflength, rbflength, bfpadding, bfdecimals;
+extern int karatsuba_length;                                 // bytes
 extern bn_t bntmp1, bntmp2, bntmp3, bntmp4, bntmp5, bntmp6;  // rlength
 extern bn_t bntest1, bntest2, bntest3;                       // rlength
 extern bn_t bntmpcpy1, bntmpcpy2;                            // bnlength
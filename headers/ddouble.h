@@ -0,0 +1,93 @@
+// ddouble.h - double-double numbers for zooms just past double precision
+#ifndef DDOUBLE_H
+#define DDOUBLE_H
+
+/*
+   A double-double is the unevaluated sum hi + lo of two doubles with
+   |lo| <= ulp(hi)/2, which carries 106 bits, about 31 decimal digits.
+   The operations are Dekker's and Knuth's exact sum and product of two
+   doubles, so they run at hardware speed; they rely on every double
+   operation being rounded to double, as it is with SSE2.
+*/
+#define DD_DIG 31
+
+struct ddouble
+{
+    double hi, lo;
+};
+
+// a + b exactly, when |a| >= |b|
+inline ddouble dd_quick_two_sum(double a, double b)
+{
+    double const s = a + b;
+    return ddouble{s, b - (s - a)};
+}
+
+// a + b exactly
+inline ddouble dd_two_sum(double a, double b)
+{
+    double const s = a + b;
+    double const bb = s - a;
+    return ddouble{s, (a - (s - bb)) + (b - bb)};
+}
+
+// a*b exactly, splitting each into two 26 bit halves
+inline ddouble dd_two_prod(double a, double b)
+{
+    double const split = 134217729.0;   // 2^27 + 1
+    double const p = a*b;
+    double t = split*a;
+    double const ahi = t - (t - a);
+    double const alo = a - ahi;
+    t = split*b;
+    double const bhi = t - (t - b);
+    double const blo = b - bhi;
+    return ddouble{p, ((ahi*bhi - p) + ahi*blo + alo*bhi) + alo*blo};
+}
+
+inline ddouble operator+(ddouble a, ddouble b)
+{
+    ddouble s = dd_two_sum(a.hi, b.hi);
+    ddouble const t = dd_two_sum(a.lo, b.lo);
+    s = dd_quick_two_sum(s.hi, s.lo + t.hi);
+    return dd_quick_two_sum(s.hi, s.lo + t.lo);
+}
+
+inline ddouble operator-(ddouble a)
+{
+    return ddouble{-a.hi, -a.lo};
+}
+
+inline ddouble operator-(ddouble a, ddouble b)
+{
+    return a + -b;
+}
+
+inline ddouble operator*(ddouble a, ddouble b)
+{
+    ddouble const p = dd_two_prod(a.hi, b.hi);
+    return dd_quick_two_sum(p.hi, p.lo + (a.hi*b.lo + a.lo*b.hi));
+}
+
+inline ddouble operator*(ddouble a, double b)
+{
+    ddouble const p = dd_two_prod(a.hi, b);
+    return dd_quick_two_sum(p.hi, p.lo + a.lo*b);
+}
+
+inline ddouble dd_twice(ddouble a)
+{
+    return ddouble{2*a.hi, 2*a.lo};
+}
+
+inline double dd_abs(ddouble a)
+{
+    return a.hi < 0 ? -a.hi - a.lo : a.hi + a.lo;
+}
+
+struct DDComplex
+{
+    ddouble x, y;
+};
+
+#endif
@@ -322,7 +322,12 @@ extern int                   numaffine;
 extern unsigned              numcolors;
 extern const int             numtrigfn;
 extern int                   num_fractal_types;
+extern int                   g_num_threads;     // threads=, 0 to use every core
 extern int                   num_worklist;
+extern bool                  g_perturbation;    // perturbation= for deep zooms
+extern bool                  g_iter_cache;      // itercache= for recoloring
+extern long                  g_orbit_density;   // orbitdensity=, millions of points
+extern png_out_kind          g_png_out;         // pngout=
 extern bool                  nxtscreenflag;
 extern int                   Offset;
 extern DComplex              old;
@@ -425,6 +430,7 @@ extern int                   rseed;
 extern long                  savebase;
 extern DComplex              SaveC;
 extern int                   savedac;
+extern DComplex              saved;
 extern char                  savename[];
 extern long                  saveticks;
 extern int                   save_orbit[];
@@ -434,6 +440,7 @@ extern int                   scale_map[];
 extern float                 screenaspect;
 extern char                  scrnfile[];
 extern struct SearchPath     searchfor;
+extern char                  g_server_dir[];    // server= spool directory
 extern bool                  set_orbit_corners;
 extern bool                  showbox;
 extern int                   showdot;
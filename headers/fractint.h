@@ -689,6 +689,14 @@ enum class Minor
     right_first
 };
 
+// pngout= streams the image to a PNG file as it is calculated
+enum class png_out_kind
+{
+    NONE,
+    RGB,                                // palette colors, 8-bit RGB
+    ITERATION                           // iteration counts, 16-bit grayscale
+};
+
 // bitmask defines for fractalspecific flags
 #define  NOZOOM         1    // zoombox not allowed at all
 #define  NOGUESS        2    // solid guessing not allowed
@@ -871,6 +879,41 @@ struct WORKLIST     // work list entry for std escape time engines
 };
 
 #define MAXCALCWORK 12
+
+struct pixel_context // per-thread state for the re-entrant pixel routines
+{
+    int row;
+    int col;
+    DComplex init;              // pixel coordinate
+    DComplex z;                 // orbit value at bailout
+    double magnitude;           // |z|^2 at bailout
+    long coloriter;
+    long realcoloriter;
+    long oldcoloriter;          // periodicity carried from the previous pixel
+    long iterations;            // work done, for the keyboard counter
+    bool interior;              // found inside without running to maxit
+    bool reset_periodicity;     // first pixel of a row
+    bool show_orbit;            // only ever set on the main thread
+};
+struct orbit_loop // StandardFractal()'s loop state, for the orbit kernels
+{
+    long coloriter;
+    long oldcoloriter;          // check periodicity past this
+    long savedand;
+    int savedincr;
+    long savedcoloriter;
+    long cyclelen;
+    int check_freq;
+    bool caught_a_cycle;
+};
+typedef int (*orbit_kernel)(orbit_loop &);
+struct cycle_balls // balls around an attracting cycle that orbits don't leave
+{
+    int num;
+    double x[2], y[2], r2[2];
+};
+// a Julibrot orbit from z with parameter c, its iterations or maxit if inside
+typedef long (*julibrot_kernel)(DComplex const &z, DComplex const &c, cycle_balls const *balls);
 struct coords
 {
     int x, y;
@@ -3,10 +3,9 @@
  */
 #ifndef LSYS_H
 #define LSYS_H
+#include <cstddef>
+#include <functional>
 #define size    ssize
-/* Needed for use of asm -- helps decide which pointer to function
- * to put into the struct lsys_cmds.
- */
 /* Macro to take an FP number and turn it into a
  * 16/16-bit fixed-point number.
  */
@@ -23,6 +22,39 @@
 #define ANGLE2DOUBLE    (2.0*PI / 4294967296.0)
 #define MAXRULES 27 // this limits rules to 25
 #define MAX_LSYS_LINE_LEN 255 // this limits line length to 255
+// what a command does to the turtle
+enum class lsys_op
+{
+    NONE,
+    PLUS,               // +
+    MINUS,              // -
+    FWDSLASH,           // /n
+    BACKSLASH,          // \n
+    AT,                 // @n
+    PIPE,               // |
+    BANG,               // !
+    DRAWD,              // d
+    MOVEM,              // m
+    MOVEG,              // g
+    DRAWF,              // f
+    COLOR,              // cn
+    LESS,               // <n
+    GREATER,            // >n
+    PUSH                // [
+};
+/* A rule or the axiom is an array of these ending in ch == 0.  Every
+ * command knows the rule for its symbol, so expanding it needs no
+ * search.
+ */
+struct lsys_cmd
+{
+    char ch;
+    lsys_op op;
+    long n;             // argument in fixed point, or the color
+    LDBL nf;            // argument for the floating point turtle
+    lsys_cmd *rule;     // body of the rule for ch, nullptr if none
+    int ruleno;         // and its index in the rules
+};
 struct lsys_turtlestatei
 {
     char counter, angle, reverse;
@@ -34,7 +66,6 @@ struct lsys_turtlestatei
     long xpos, ypos; // xpos and ypos are long, not fixed point
     long xmin, ymin, xmax, ymax; // as are these
     long aspect; // aspect ratio of each pixel, ysize/xsize
-    long num;
 };
 struct lsys_turtlestatef
 {
@@ -47,31 +78,46 @@ struct lsys_turtlestatef
     LDBL xpos, ypos;
     LDBL xmin, ymin, xmax, ymax;
     LDBL aspect; // aspect ratio of each pixel, ysize/xsize
-    union
+};
+/* The extents of rule expansions are remembered by rule, depth and the
+ * turtle state that changes them, in long for lsys.c and LDBL for lsysf.c.
+ */
+template <typename T>
+struct lsys_key
+{
+    lsys_cmd *rule;
+    T size, realangle;
+    int depth;
+    char angle, reverse;
+
+    bool operator==(lsys_key const &other) const
+    {
+        return rule == other.rule && size == other.size && realangle == other.realangle
+            && depth == other.depth && angle == other.angle && reverse == other.reverse;
+    }
+};
+template <typename T>
+struct lsys_key_hash
+{
+    std::size_t operator()(lsys_key<T> const &key) const
     {
-        long n;
-        LDBL nf;
-    } parm;
+        std::size_t h = std::hash<void *>()(key.rule);
+        h = h*0x9E3779B97F4A7C15ULL ^ std::hash<T>()(key.size);
+        h = h*0x9E3779B97F4A7C15ULL ^ std::hash<T>()(key.realangle);
+        h = h*0x9E3779B97F4A7C15ULL ^ (std::size_t)((key.depth << 16) | ((unsigned char) key.angle << 8) | key.reverse);
+        return h ^ (h >> 29);
+    }
 };
+// enough for any L-system whose turtle only turns by the angle
+#define LSYS_EXTENTS 0x40000
 extern char maxangle;
-// routines in lsysa.asm
-#if defined(XFRACT) || defined(_WIN32)
-#define lsysi_doat_386 lsys_doat
-#define lsysi_dosizegf_386 lsys_dosizegf
-#define lsysi_dodrawg_386 lsys_dodrawg
-#else
-extern void lsysi_doat_386(lsys_turtlestatei *cmd);
-extern void lsysi_dosizegf_386(lsys_turtlestatei *cmd);
-extern void lsysi_dodrawg_386(lsys_turtlestatei *cmd);
-#endif
-// routines in lsysaf.asm
-extern void lsys_prepfpu(lsys_turtlestatef *);
-extern void lsys_donefpu(lsys_turtlestatef *);
+// routines in lsys.c
+extern void lsys_draw_line(int x1, int y1, int x2, int y2, int color);
+extern double lsys_steps(lsys_cmd const *command, int depth);
+extern bool lsys_may_skip(lsys_cmd const *command, int depth);
 // routines in lsysf.c
-struct lsys_cmd;
-extern lsys_cmd *drawLSysF(lsys_cmd *command, lsys_turtlestatef *ts, lsys_cmd **rules, int depth);
-extern bool lsysf_findscale(lsys_cmd *command, lsys_turtlestatef *ts, lsys_cmd **rules, int depth);
-extern lsys_cmd *LSysFSizeTransform(char *s, lsys_turtlestatef *ts);
-extern lsys_cmd *LSysFDrawTransform(char *s, lsys_turtlestatef *ts);
+extern bool drawLSysF(lsys_cmd *axiom, lsys_turtlestatef *ts, int depth);
+extern bool lsysf_findscale(lsys_cmd *axiom, lsys_turtlestatef *ts, int depth);
 extern void lsysf_dosincos();
+extern void lsysf_free_extents();
 #endif
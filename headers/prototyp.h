@@ -1,6 +1,9 @@
 #ifndef PROTOTYP_H
 #define PROTOTYP_H
 // includes needed to define the prototypes
+#include <map>
+#include <string>
+
 #include "mpmath.h"
 #include "big.h"
 #include "fractint.h"
@@ -29,6 +32,14 @@ extern long calcmandasm();
 // calmanfp -- assembler file prototypes
 extern void calcmandfpasmstart();
 extern long calcmandfpasm();
+extern long calcmandfp_pixel(pixel_context &);
+extern long calcmandfp_check_start(pixel_context const &);
+extern bool calcmandfp_same_result(pixel_context const &, long, long);
+extern bool mandel_interior(double, double);
+extern void julia_cycle_balls(DComplex const &, cycle_balls &);
+extern bool in_cycle_balls(cycle_balls const &, double, double);
+extern int calcmandfp_lanes();
+extern void calcmandfp_rows(pixel_context *, int const *, int);
 // fpu087 -- assembler file prototypes
 extern void FPUcplxmul(DComplex *, DComplex *, DComplex *);
 extern void FPUcplxdiv(DComplex *, DComplex *, DComplex *);
@@ -122,6 +133,7 @@ void init_bf_length(int bnl);
 void init_big_pi();
 // calcfrac -- C file prototypes
 extern int calcfract();
+extern bool recolor_image();
 extern int calcmand();
 extern int calcmandfp();
 extern int StandardFractal();
@@ -146,6 +158,8 @@ extern int LongBifurcStewartTrig();
 extern int popcorn();
 extern int lyapunov();
 extern bool lya_setup();
+extern bool lyapunov_batch_ok();
+extern void lyapunov_pixels(double const *, double const *, int *, long *, int);
 extern int cellular();
 extern bool CellularSetup();
 extern int calcfroth();
@@ -157,6 +171,7 @@ extern int find_alternate_math(fractal_type type, bf_math_type math);
 // cmdfiles -- C file prototypes
 extern int cmdfiles(int, char **);
 extern int load_commands(FILE *);
+extern int server_job(const char *, const char *);
 extern void set_3d_defaults();
 extern int get_curarg_len(const char *curarg);
 extern int get_max_curarg_len(const char *floatvalstr[], int totparm);
@@ -202,6 +217,7 @@ extern void displayc(int, int, int, int, int);
 extern int savetodisk(char *);
 extern bool encoder();
 extern int new_to_old(int new_fractype);
+extern void gif_palette(BYTE palette[256][3]);
 // evolve -- C file prototypes
 extern  void initgene();
 extern  void param_history(int);
@@ -431,10 +447,14 @@ extern int long_phoenix_per_pixel();
 extern int phoenix_per_pixel();
 extern int long_mandphoenix_per_pixel();
 extern int mandphoenix_per_pixel();
+extern double dxpixel_rc(int, int);
+extern double dypixel_rc(int, int);
 extern void set_pixel_calc_functions();
 extern int MandelbrotMix4fp_per_pixel();
 extern int MandelbrotMix4fpFractal();
 extern bool MandelbrotMix4Setup();
+extern orbit_kernel find_orbit_kernel();
+extern julibrot_kernel find_julibrot_kernel();
 // fractint -- C file prototypes
 extern int main(int argc, char **argv);
 extern int elapsed_time(int);
@@ -598,6 +618,7 @@ extern void parse_comments(char *value);
 extern void init_comments();
 extern void write_batch_parms(char *colorinf, bool colorsonly, int maxcolor, int i, int j);
 extern void expand_comments(char *, char *);
+extern std::string batch_parms_text();
 // miscres -- C file prototypes
 extern void restore_active_ovly();
 extern void findpath(const char *filename, char *fullpathname);
@@ -868,6 +889,7 @@ extern void load_params(fractal_type fractype);
 extern bool check_orbit_name(char *);
 struct entryinfo;
 extern int scan_entries(FILE *infile, struct entryinfo *ch, char *itemname);
+extern void index_entries(FILE *infile, std::map<std::string, long> &index);
 // prompts2 -- C file prototypes
 extern int get_toggles();
 extern int get_toggles2();
@@ -933,10 +955,27 @@ extern void vidmode_keyname(int, char *);
 extern void freetempmsg();
 extern void load_videotable(int);
 extern void bad_fractint_cfg_msg();
+// itercache -- C file prototypes
+extern void iter_cache_clear();
+extern bool iter_cache_begin(bool resuming);
+extern bool iter_cache_filling();
+extern void iter_cache_store(int col, int row, long iterations, DComplex const &z, long potential);
+extern void iter_cache_end(bool complete);
+extern bool iter_cache_ready();
+extern void iter_cache_fetch(int col, int row, long &iterations, DComplex &z, long &potential);
+extern bool iter_cache_inside_z();
+// pngout -- C file prototypes
+extern bool png_stream_begin(char const *filename, png_out_kind kind, int width, int height,
+                             std::string const &parms);
+extern bool png_streaming();
+extern void png_stream_pixel(int col, int row, int color, long iteration);
+extern bool png_stream_end(bool complete);
 // rotate -- C file prototypes
 extern void rotate(int);
 extern void save_palette();
 extern bool load_palette();
+// server -- C file prototypes
+extern bool server_next_job();
 // slideshw -- C file prototypes
 extern int slideshw();
 extern slides_mode startslideshow();
@@ -989,6 +1028,17 @@ extern int JuliaZpowerbfFractal();
 extern BFComplex *cmplxlog_bf(BFComplex *t, BFComplex *s);
 extern BFComplex *cplxmul_bf(BFComplex *t, BFComplex *x, BFComplex *y);
 extern BFComplex *ComplexPower_bf(BFComplex *t, BFComplex *xx, BFComplex *yy);
+extern bool perturbation_ok();
+extern bool MandelperturbSetup();
+extern int mandelperturb_per_pixel();
+extern int MandelperturbFractal();
+extern bool ddouble_ok();
+extern bool MandelddSetup();
+extern int mandeldd_per_pixel();
+extern int juliadd_per_pixel();
+extern int JuliaddFractal();
+extern void ddouble_save_orbit();
+extern bool ddouble_orbit_cycled();
 // memory -- C file prototypes
 // TODO: Get rid of this and use regular memory routines;
 // see about creating standard disk memory routines for disk video
@@ -0,0 +1,76 @@
+// workpool.h - worker threads for the parallel calculation engines
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+// port.h and fractint.h macros would mangle the <ctime> these pull in
+#pragma push_macro("difftime")
+#pragma push_macro("dysize")
+#undef difftime
+#undef dysize
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#pragma pop_macro("dysize")
+#pragma pop_macro("difftime")
+
+/*
+   A fixed set of worker threads, each with its own task queue.  A worker
+   takes the newest task from its own queue and, when that is empty, steals
+   the oldest task from another worker's queue.  Tasks pushed from inside a
+   task go on the calling worker's own queue, so recursive subdivision stays
+   local until somebody runs out of work.
+
+   Tasks must not touch the driver, the keyboard or any of the per-pixel
+   globals; only the thread that owns the pool does that.  The task argument
+   is the index of the worker running it, 0 .. size()-1, for indexing any
+   per-thread state.
+*/
+class work_pool
+{
+public:
+    typedef std::function<void(int)> task;
+
+    explicit work_pool(int num_threads);
+    ~work_pool();
+
+    int size() const
+    {
+        return static_cast<int>(m_threads.size());
+    }
+    void push(task const &t);
+    bool wait(int timeout_ms);          // true when every task has finished
+    void cancel();                      // skip all tasks not yet started
+    bool cancelled() const
+    {
+        return m_cancel;
+    }
+
+private:
+    struct task_queue
+    {
+        std::mutex lock;
+        std::deque<task> tasks;
+    };
+
+    void worker(int index);
+    bool pop(int index, task &t);
+
+    std::vector<task_queue> m_queues;
+    std::vector<std::thread> m_threads;
+    std::mutex m_lock;
+    std::condition_variable m_work_ready;
+    std::condition_variable m_idle;
+    std::atomic<int> m_queued;          // tasks sitting in queues
+    std::atomic<int> m_pending;         // tasks queued or running
+    std::atomic<unsigned> m_next;       // round robin for outside pushes
+    std::atomic<bool> m_cancel;
+    bool m_stop;
+};
+
+extern int work_pool_threads();         // threads= setting, 0 means all cores
+
+#endif